@@ -0,0 +1,135 @@
+/***************************************************************************
+                          bench_braces.c  -  Throughput of the brace matcher
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Measures how fast the lexer of source_parser.c finds the end of the
+ * first block of a file, against a plain count of the braces of the
+ * same bytes (what find_matching_char() did, without its 5000 chars cap
+ * and its debug() calls, which the braces of the literals and comments
+ * of the input would have misled), and how fast source_parse() indexes
+ * the whole file.  The functions are static, so source_parser.c
+ * is compiled in, see the Makefile; the input is made by gen_source.sh.
+ *
+ * usage: bench_braces <file> [rounds]
+ */
+
+#include "source_parser.c"
+
+static volatile int depth_seen;
+
+/* counts the braces of all the chars from buf to end */
+static size_t count_braces( const char *buf, const char *end )
+{
+    const char *cp;
+    int depth = 0;
+
+    for( cp = buf; cp < end; cp++ ) {
+        if( *cp == '{' ) {
+            depth ++;
+        } else if( *cp == '}' ) {
+            depth --;
+        }
+    }
+    depth_seen = depth;
+    return cp - buf;
+}
+
+static double seconds( void )
+{
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* the best time of rounds calls of match from start, in seconds */
+static double best_of( size_t (*match)( const char *, const char *, int ),
+                       const char *start, const char *end, int rounds, size_t *len )
+{
+    const char *volatile from = start;
+    double best = 0, t;
+    int i;
+
+    for( i = 0; i < rounds; i++ ) {
+        t = seconds();
+        *len = match( from, end, 0 );
+        t = seconds() - t;
+        if( i == 0 || t < best ) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static size_t lexer( const char *buf, const char *end, int php )
+{
+    return block_end( buf, end, php );
+}
+
+static size_t plain( const char *buf, const char *end, int php )
+{
+    return count_braces( buf, end );
+}
+
+int main( int argc, char **argv )
+{
+    sourcecode code;
+    const char *start, *end;
+    double t, best = 0;
+    size_t len;
+    int i, rounds = argc > 2 ? atoi( argv[2] ) : 10;
+
+    if( argc < 2 || rounds < 1 ) {
+        fprintf( stderr, "usage: %s <file> [rounds]\n", argv[0] );
+        return 2;
+    }
+    if( source_open( &code, argv[1] ) != 0 || code.size == 0 ) {
+        fprintf( stderr, "Can't read file %s\n", argv[1] );
+        return 1;
+    }
+    end = code.buffer + code.size;
+    start = memchr( code.buffer, '{', code.size );
+    /* the class itself: the block of the first operation is next */
+    if( start != NULL ) {
+        start = memchr( start + 1, '{', end - start - 1 );
+    }
+    if( start == NULL ) {
+        fprintf( stderr, "No block in %s\n", argv[1] );
+        return 1;
+    }
+    printf( "%s: %.1f MB, best of %d rounds\n", argv[1], code.size / 1e6, rounds );
+
+    t = best_of( lexer, start, end, rounds, &len );
+    if( len == 0 ) {
+        fprintf( stderr, "The first block of %s doesn't end\n", argv[1] );
+        return 1;
+    }
+    printf( "%-24s %10zu bytes %10.1f MB/s\n", "lexer", len, len / t / 1e6 );
+    t = best_of( plain, start, start + len, rounds, &len );
+    printf( "%-24s %10zu bytes %10.1f MB/s\n", "brace count", len, len / t / 1e6 );
+
+    for( i = 0; i < rounds; i++ ) {
+        t = seconds();
+        source_parse( &code );
+        t = seconds() - t;
+        if( i == 0 || t < best ) {
+            best = t;
+        }
+    }
+    printf( "%-24s %10zu blocks %9.1f MB/s\n", "source_parse()", code.count,
+            code.size / best / 1e6 );
+    source_close( &code );
+    return 0;
+}
@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# bench_io.sh
+# Purpose:
+#   Compares the output backends of dia2code: the plain POSIX calls and
+#   --io-uring.  The code of a synthetic diagram (see gen_diagram.sh) is
+#   generated into an empty directory, runs times with each backend, and
+#   the best wall clock, user and system times of each are printed, with
+#   the "file I/O" time that --stats reports.
+#
+# usage: bench_io.sh [dia2code] [classes] [runs] [target]
+
+dia2code=${1:-../../dia2code/dia2code}
+classes=${2:-30000}
+runs=${3:-1}
+target=${4:-java}
+
+case $dia2code in /*) ;; *) dia2code=`pwd`/$dia2code ;; esac
+if [ ! -x "$dia2code" ]; then
+    echo "$dia2code: not found, build dia2code first" >&2
+    exit 1
+fi
+
+work=`mktemp -d ${TMPDIR:-/tmp}/dia2code-bench.XXXXXX` || exit 1
+trap 'rm -rf "$work"' EXIT
+
+echo "Generating a diagram of $classes classes"
+`dirname $0`/gen_diagram.sh $classes > $work/bench.dia || exit 1
+
+# prints "wall user sys io" of one run, in seconds
+run() {
+    local out=$work/out times io
+    rm -rf $out
+    mkdir $out
+    # the java generator writes the classes outside of a package in the
+    # current directory
+    times=$( { TIMEFORMAT='%R %U %S'; time (cd $out && "$dia2code" --stats -t $target \
+               -d . "$@" $work/bench.dia > /dev/null 2> $work/stats); } 2>&1 ) || exit 1
+    io=`awk '/^file I\/O/ { print $3 / 1000 }' $work/stats`
+    echo $times $io
+}
+
+for backend in posix io_uring; do
+    if [ $backend = io_uring ]; then
+        flags=--io-uring
+    else
+        flags=
+    fi
+    best=
+    for i in `seq $runs`; do
+        result=`run $flags` || exit 1
+        # the best run is the one with the least wall clock time
+        if [ -z "$best" ] || awk "BEGIN { exit !(${result%% *} < ${best%% *}) }"; then
+            best=$result
+        fi
+    done
+    set -- $best
+    printf "%-9s wall %8.3fs  user %8.3fs  sys %8.3fs  file I/O %8.3fs\n" \
+           $backend $1 $2 $3 $4
+done
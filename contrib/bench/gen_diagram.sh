@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# gen_diagram.sh
+# Purpose:
+#   Writes a synthetic diagram for the benchmarks on the standard output.
+#   The classes (30000 by default) are all in the top level package, each
+#   with two attributes and two operations and without any relationship,
+#   so that the size of the generated code grows with their number only.
+#
+# usage: gen_diagram.sh [classes] > file.dia
+
+classes=${1:-30000}
+
+awk -v classes="$classes" '
+function str(v) {
+    return "<dia:string>#" v "#</dia:string>"
+}
+function attr(name, inner) {
+    return "<dia:attribute name=\"" name "\">" inner "</dia:attribute>"
+}
+function member(type, name, vtype, comment) {
+    return "<dia:composite type=\"" type "\">" attr("name", str(name)) \
+        attr("type", str(vtype)) attr("value", str("")) \
+        attr("comment", str(comment)) \
+        attr("visibility", "<dia:enum val=\"0\"/>") \
+        attr("abstract", "<dia:boolean val=\"false\"/>") \
+        attr("class_scope", "<dia:boolean val=\"false\"/>")
+}
+BEGIN {
+    print "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    print "<dia:diagram xmlns:dia=\"http://www.lysator.liu.se/~alla/dia/\">"
+    print "<dia:diagramdata/>"
+    print "<dia:layer name=\"Background\" visible=\"true\">"
+    for (i = 0; i < classes; i++) {
+        print "<dia:object type=\"UML - Class\" version=\"0\" id=\"O" i "\">"
+        print attr("obj_pos", "<dia:point val=\"" (i % 100) * 20 "," int(i / 100) * 20 "\"/>")
+        print attr("elem_width", "<dia:real val=\"10\"/>")
+        print attr("elem_height", "<dia:real val=\"10\"/>")
+        print attr("name", str("Class" i))
+        print attr("stereotype", str(""))
+        print attr("comment", str("Class " i " of the benchmark"))
+        print attr("abstract", "<dia:boolean val=\"false\"/>")
+        print attr("attributes", \
+                   member("umlattribute", "count", "int", "a counter") "</dia:composite>" \
+                   member("umlattribute", "name", "String", "a name") "</dia:composite>")
+        print attr("operations", \
+                   member("umloperation", "getCount", "int", "@diaoid " i "_0") \
+                   attr("parameters", "") "</dia:composite>" \
+                   member("umloperation", "setName", "void", "@diaoid " i "_1") \
+                   attr("parameters", "<dia:composite type=\"umlparameter\">" \
+                        attr("name", str("name")) attr("type", str("String")) \
+                        attr("value", str("")) attr("comment", str("")) \
+                        attr("kind", "<dia:enum val=\"0\"/>") "</dia:composite>") \
+                   "</dia:composite>")
+        print "<dia:attribute name=\"templates\"/>"
+        print "</dia:object>"
+    }
+    print "</dia:layer>"
+    print "</dia:diagram>"
+}'
@@ -0,0 +1,40 @@
+#!/bin/bash
+#
+# gen_source.sh
+# Purpose:
+#   Writes on the standard output a java class for the benchmark of the
+#   brace matcher (see bench_braces.c): two operations with a @diaoid
+#   tag, whose bodies of about megabytes MB each (4 by default) are dense
+#   code, with braces in the strings, characters and comments of every
+#   line, as in the worst case of a preserved implementation.
+#
+# usage: gen_source.sh [megabytes] > file.java
+
+megabytes=${1:-4}
+
+awk -v size=$((megabytes * 1024 * 1024)) '
+function body(   n, i) {
+    for (n = i = 0; n < size; i++) {
+        line = "        if (s.indexOf(\"{ \\\" }\") > " i ") { c = (c == '\''{'\'') ? '\''}'\'' : '\''\\\\'\''; } // } " i
+        print line
+        n += length(line) + 1
+        line = "        /* { " i " */ t = \"}\" + t + \"/* \" + '\''\"'\''; { u[" i % 7 "] = t; }"
+        print line
+        n += length(line) + 1
+    }
+}
+BEGIN {
+    print "public class Big"
+    print "{"
+    for (op = 0; op < 2; op++) {
+        print "    /**"
+        print "     * Operation run" op
+        print "     * @diaoid big_" op
+        print "     */"
+        print "    public void run" op " ( )"
+        print "    {"
+        body()
+        print "    }"
+    }
+    print "}"
+}'
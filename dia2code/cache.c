@@ -0,0 +1,795 @@
+/***************************************************************************
+                          cache.c  -  The content-addressed cache of --output-cache
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --output-cache, the files that the task of a class generates are
+ * kept in a cache directory that any number of runs, checkouts and
+ * machines may share.  The key of a class is the hash of the target, of
+ * its options (see d2c_options_hash()) and of the fingerprint of the
+ * class, which covers what the generators read of the diagram.  The
+ * generated files also keep the code found in their previous version
+ * (see source_preserve()), so the entry of a key lists, for each file,
+ * the hash of the file found before it was generated, and is only used
+ * if the files at hand are the same.
+ *
+ * The layout of the directory is:
+ *
+ *   entries/xx/<key>        up to CACHE_VARIANTS variants, the last
+ *                           generated first, each a "-" line followed by
+ *                           one line per file: the hash of the previous
+ *                           file (0 if there was none), the object and
+ *                           the path below the output directory
+ *   objects/xx/<hash-size>  the content of a generated file
+ *   stats                   the hits and misses of all the runs
+ *
+ * Entries and objects are written to a temporary file and renamed, so
+ * that concurrent runs only ever see complete ones.  Using an entry or
+ * an object sets its modification time, and the least recently used
+ * ones are removed once the cache grows beyond --output-cache-size.
+ */
+
+#include "dia2code.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CACHE_HEADER "# dia2code cache entry 1\n"
+#define CACHE_VARIANTS 4   /* of the previous files, kept per entry */
+
+char *output_cache = NULL;        /* Set by switch "--output-cache" */
+long output_cache_size = 1024;    /* Set by switch "--output-cache-size", in megabytes */
+int output_cache_link = 0;        /* Set by switch "--output-cache-link" */
+
+struct d2c_cache {
+    char *dir;
+    int hits, misses;
+    pthread_mutex_t lock;    /* protects the counters, and the directories
+                                of the targets */
+    d2c_cache_target *targets;
+};
+
+struct d2c_cache_target {
+    d2c_cache *cache;
+    uint64_t key;            /* of the target and its options */
+    d2c_fingerprints *fingerprints;
+    const char *outdir;
+    namelist dirs;           /* the output directories restore_file() made */
+    struct d2c_cache_target *next;
+};
+
+/* A file generated by the class being recorded */
+struct cached_file {
+    char *filename;
+    uint64_t previous;       /* see file_hash() */
+    char *buf;               /* NULL until the file is closed */
+    size_t len;
+    struct cached_file *next;
+};
+
+struct recording {
+    d2c_cache_target *target;
+    char *classname;
+    struct cached_file *files;
+};
+
+/* The class whose task the calling thread runs, see d2c_cache_begin() */
+static D2C_TASK_LOCAL struct recording *recording = NULL;
+
+/* The text of an entry being written */
+struct entry_text {
+    char *buf;
+    size_t len, size;
+};
+
+/* A file of an entry */
+struct entry_file {
+    int variant;
+    uint64_t previous;
+    char object[40];
+    char *path;
+};
+
+/* returns the hash of the content of filename, 0 if there is none */
+static uint64_t file_hash(const char *filename)
+{
+    char buf[LARGE_BUFFER];
+    uint64_t h = D2C_HASH_INIT;
+    size_t n;
+    FILE *f = fopen(filename, "rb");
+
+    if (f == NULL) {
+        return 0;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        h = d2c_hash_bytes(h, buf, n);
+    }
+    fclose(f);
+    return h != 0 ? h : 1;
+}
+
+/* returns "<dir>/<kind>/xx/<name>", to be freed by the caller */
+static char *cache_path(d2c_cache *c, const char *kind, const char *name)
+{
+    char *path = my_malloc(strlen(c->dir) + strlen(kind) + strlen(name) + 7);
+
+    sprintf(path, "%s/%s/%.2s/%s", c->dir, kind, name, name);
+    return path;
+}
+
+/* creates the directories of path below the cache */
+static void make_dirs(const char *path)
+{
+    char *dir = strdup(path), *slash;
+
+    if (dir == NULL) {
+        return;
+    }
+    for (slash = strchr(dir + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0777);
+        *slash = '/';
+    }
+    free(dir);
+}
+
+/* writes len bytes of buf to path through a temporary file */
+static int store(const char *path, const char *buf, size_t len)
+{
+    char *tmpname = my_malloc(strlen(path) + 8);
+    int fd, rc = -1;
+
+    sprintf(tmpname, "%s.XXXXXX", path);
+    fd = mkstemp(tmpname);
+    if (fd < 0 && errno == ENOENT) {
+        make_dirs(path);
+        /* mkstemp() changed the template */
+        sprintf(tmpname, "%s.XXXXXX", path);
+        fd = mkstemp(tmpname);
+    }
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        if (write(fd, buf, len) == (ssize_t) len && close(fd) == 0) {
+            rc = rename(tmpname, path);
+        } else {
+            close(fd);
+        }
+        if (rc != 0) {
+            unlink(tmpname);
+        }
+    }
+    free(tmpname);
+    return rc;
+}
+
+/* reads the whole file f into *buf, returns its length or -1 */
+static long read_all(FILE *f, char **buf)
+{
+    size_t size = LARGE_BUFFER, len = 0, n;
+
+    *buf = my_malloc(size);
+    while ((n = fread(*buf + len, 1, size - len, f)) > 0) {
+        len += n;
+        if (len == size) {
+            size *= 2;
+            *buf = realloc(*buf, size);
+            if (*buf == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+    }
+    if (ferror(f)) {
+        free(*buf);
+        return -1;
+    }
+    return (long) len;
+}
+
+/**
+ * Opens the cache directory dir, created if needed, for this run.
+*/
+d2c_cache * d2c_cache_open (const char *dir)
+{
+    d2c_cache *c = NEW (d2c_cache);
+
+    c->dir = my_strdup(dir);
+    c->hits = c->misses = 0;
+    c->targets = NULL;
+    pthread_mutex_init(&c->lock, NULL);
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "warning: can't create the cache directory %s: %s\n",
+                dir, strerror(errno));
+    }
+    return c;
+}
+
+/**
+ * Returns the cache of the classes of target, generated with the
+ * options hash and having the fingerprints into outdir.
+*/
+d2c_cache_target * d2c_cache_use (d2c_cache *c, const char *target, uint64_t options,
+                                  d2c_fingerprints *fingerprints, const char *outdir)
+{
+    d2c_cache_target *t = NEW (d2c_cache_target);
+
+    t->cache = c;
+    t->key = d2c_hash_string(d2c_hash_bytes(D2C_HASH_INIT, &options, sizeof(options)),
+                             target);
+    t->fingerprints = fingerprints;
+    t->outdir = outdir;
+    t->dirs = NULL;
+    t->next = c->targets;
+    c->targets = t;
+    return t;
+}
+
+/* the key of the class classname, as 16 hex digits in name */
+static void class_key(d2c_cache_target *t, const char *classname, char *name)
+{
+    uint64_t fingerprint = d2c_fingerprint(t->fingerprints, classname);
+    uint64_t h = d2c_hash_bytes(t->key, &fingerprint, sizeof(fingerprint));
+
+    h = d2c_hash_string(h, classname);
+    sprintf(name, "%016llx", (unsigned long long) h);
+}
+
+/* returns the path of the output file below t->outdir */
+static char *output_path(d2c_cache_target *t, const char *path)
+{
+    return t->outdir != NULL ? d2c_file_path(t->outdir, path, "")
+                             : d2c_file_path(NULL, path, "");
+}
+
+/* reads the files of the entry of name into *files, and the number of
+   its variants into *variants; returns the number of files or -1 */
+static int read_entry(d2c_cache *c, const char *name, struct entry_file **files,
+                      int *variants)
+{
+    char s[LARGE_BUFFER], *path = cache_path(c, "entries", name), *tab;
+    int count = 0, size = 8;
+    FILE *f = fopen(path, "r");
+
+    free(path);
+    *variants = 0;
+    if (f == NULL) {
+        return -1;
+    }
+    if (fgets(s, sizeof(s), f) == NULL || !eq(s, CACHE_HEADER)) {
+        fclose(f);
+        return -1;
+    }
+    *files = my_malloc(size * sizeof(struct entry_file));
+    while (fgets(s, sizeof(s), f) != NULL) {
+        s[strcspn(s, "\r\n")] = '\0';
+        if (eq(s, "-")) {
+            (*variants)++;
+            continue;
+        }
+        if (count == size) {
+            size *= 2;
+            *files = realloc(*files, size * sizeof(struct entry_file));
+            if (*files == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+        tab = strchr(s, '\t');
+        if (*variants == 0 || tab == NULL || strchr(tab + 1, '\t') == NULL
+                || strchr(tab + 1, '\t') - (tab + 1) >= (int) sizeof((*files)->object)) {
+            continue;
+        }
+        (*files)[count].variant = *variants - 1;
+        (*files)[count].previous = strtoull(s, NULL, 16);
+        *strchr(tab + 1, '\t') = '\0';
+        strcpy((*files)[count].object, tab + 1);
+        (*files)[count].path = strdup(tab + strlen(tab + 1) + 2);
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static void free_entry(struct entry_file *files, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+}
+
+static void count_use(d2c_cache *c, int hit)
+{
+    pthread_mutex_lock(&c->lock);
+    if (hit) {
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * creates the directory of the output file filename of t, as
+ * create_package_dir() does, unless it was already
+ */
+static void make_output_dir(d2c_cache_target *t, const char *filename)
+{
+    char *slash = strrchr(filename, '/'), *name;
+    size_t root_len = 0;
+    namelist dir;
+
+    if (slash == NULL) {
+        return;
+    }
+    name = my_strndup(filename, slash - filename);
+    pthread_mutex_lock(&t->cache->lock);
+    for (dir = t->dirs; dir != NULL && !eq(dir->name, name); dir = dir->next) {
+    }
+    pthread_mutex_unlock(&t->cache->lock);
+    if (dir != NULL) {
+        free(name);
+        return;
+    }
+    if (t->outdir != NULL && strncmp(name, t->outdir, strlen(t->outdir)) == 0) {
+        root_len = strlen(t->outdir);
+    }
+    if (make_package_dir(name, root_len) != 0) {
+        free(name);
+        return;
+    }
+    /* another task may have made it meanwhile, the entries are the same */
+    dir = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+    dir->name = name;
+    pthread_mutex_lock(&t->cache->lock);
+    dir->next = t->dirs;
+    t->dirs = dir;
+    pthread_mutex_unlock(&t->cache->lock);
+}
+
+/* writes the object at path to the output file filename of t */
+static int restore_file(d2c_cache_target *t, const char *path, FILE *object, char *filename)
+{
+    char *buf;
+    long len;
+    FILE *f;
+
+    make_output_dir(t, filename);
+    if (output_cache_link && d2c_outfile_link(path, filename) == 0) {
+        return 0;
+    }
+    len = read_all(object, &buf);
+    if (len < 0) {
+        return -1;
+    }
+    f = d2c_outfile_open(filename, "w");
+    if (f == NULL) {
+        free(buf);
+        return -1;
+    }
+    fwrite(buf, 1, len, f);
+    d2c_outfile_close(f);
+    free(buf);
+    return 0;
+}
+
+/**
+ * Writes the files of the class classname from the cache, if it holds
+ * them for the files at hand.  Returns 1 if it did, 0 if the class is
+ * to be generated.
+*/
+int d2c_cache_restore (d2c_cache_target *t, const char *classname)
+{
+    struct entry_file *files = NULL;
+    char name[17], *filename, **paths;
+    FILE **objects;
+    int count, variants, variant, i, hit = 0;
+
+    class_key(t, classname, name);
+    count = read_entry(t->cache, name, &files, &variants);
+    if (count < 0) {
+        count_use(t->cache, 0);
+        return 0;
+    }
+    /* the variant generated from the files at hand */
+    for (variant = 0; variant < variants && !hit; variant++) {
+        hit = 1;
+        for (i = 0; hit && i < count; i++) {
+            if (files[i].variant == variant) {
+                filename = output_path(t, files[i].path);
+                hit = file_hash(filename) == files[i].previous;
+                free(filename);
+            }
+        }
+    }
+    variant--;
+    objects = my_malloc((count + 1) * sizeof(FILE *));
+    paths = my_malloc((count + 1) * sizeof(char *));
+    /* the objects are opened first, another run may be removing them */
+    for (i = 0; i < count; i++) {
+        paths[i] = cache_path(t->cache, "objects", files[i].object);
+        objects[i] = hit && files[i].variant == variant ? fopen(paths[i], "rb") : NULL;
+        hit = hit && (objects[i] != NULL || files[i].variant != variant);
+    }
+    for (i = 0; hit && i < count; i++) {
+        if (files[i].variant == variant) {
+            filename = output_path(t, files[i].path);
+            hit = restore_file(t, paths[i], objects[i], filename) == 0;
+            free(filename);
+            utimes(paths[i], NULL);
+        }
+    }
+    if (hit) {
+        filename = cache_path(t->cache, "entries", name);
+        utimes(filename, NULL);
+        free(filename);
+    }
+    for (i = 0; i < count; i++) {
+        if (objects[i] != NULL) {
+            fclose(objects[i]);
+        }
+        free(paths[i]);
+    }
+    free(objects);
+    free(paths);
+    free_entry(files, count);
+    count_use(t->cache, hit);
+    return hit;
+}
+
+static void free_recording(struct recording *r)
+{
+    struct cached_file *file, *next;
+
+    for (file = r->files; file != NULL; file = next) {
+        next = file->next;
+        free(file->filename);
+        free(file->buf);
+        free(file);
+    }
+    free(r->classname);
+    free(r);
+}
+
+/**
+ * Records the files that the calling thread generates, until
+ * d2c_cache_end(), as those of the class classname.
+*/
+void d2c_cache_begin (d2c_cache_target *t, const char *classname)
+{
+    /* left by a task that failed */
+    if (recording != NULL) {
+        free_recording(recording);
+    }
+    recording = NEW (struct recording);
+    recording->target = t;
+    recording->classname = strdup(classname);
+    recording->files = NULL;
+}
+
+static struct cached_file *find_file(const char *filename)
+{
+    struct cached_file *file;
+
+    for (file = recording->files; file != NULL; file = file->next) {
+        if (eq(file->filename, filename)) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Called by d2c_outfile_open() for every file.  Returns 1 if the file is
+ * recorded, in which case its content is to be handed to
+ * d2c_cache_content() once it is closed.
+*/
+int d2c_cache_file (const char *filename)
+{
+    struct cached_file *file;
+
+    if (recording == NULL) {
+        return 0;
+    }
+    if (find_file(filename) == NULL) {
+        file = NEW (struct cached_file);
+        file->filename = strdup(filename);
+        file->previous = file_hash(filename);
+        file->buf = NULL;
+        file->len = 0;
+        file->next = recording->files;
+        recording->files = file;
+    }
+    return 1;
+}
+
+void d2c_cache_content (const char *filename, const char *buf, size_t len)
+{
+    struct cached_file *file;
+
+    if (recording == NULL || (file = find_file(filename)) == NULL) {
+        return;
+    }
+    free(file->buf);
+    file->buf = my_malloc(len + 1);
+    memcpy(file->buf, buf, len);
+    file->len = len;
+}
+
+static void add_text(struct entry_text *entry, const char *text)
+{
+    size_t len = strlen(text);
+
+    if (entry->len + len + 1 > entry->size) {
+        entry->size = 2 * entry->size + len;
+        entry->buf = realloc(entry->buf, entry->size);
+        if (entry->buf == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            d2c_exit(1);
+        }
+    }
+    strcpy(entry->buf + entry->len, text);
+    entry->len += len;
+}
+
+static void add_file(struct entry_text *entry, uint64_t previous, const char *object,
+                     const char *path)
+{
+    char s[64];
+
+    sprintf(s, "%016llx\t%s\t", (unsigned long long) previous, object);
+    add_text(entry, s);
+    add_text(entry, path);
+    add_text(entry, "\n");
+}
+
+/* returns 1 if r recorded the file at path, previously with that hash */
+static int recorded(struct recording *r, size_t prefix, uint64_t previous, const char *path)
+{
+    struct cached_file *file;
+
+    for (file = r->files; file != NULL; file = file->next) {
+        if (eq(file->filename + prefix, path)) {
+            return file->previous == previous;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Stores the files recorded since d2c_cache_begin() in the cache, as
+ * the variant of the entry of the class for the files found before.
+*/
+void d2c_cache_end ()
+{
+    struct recording *r = recording;
+    d2c_cache_target *t = r->target;
+    struct cached_file *file;
+    struct entry_file *files = NULL;
+    struct entry_text entry;
+    char name[17], object[40], *path;
+    size_t prefix = t->outdir != NULL ? strlen(t->outdir) + 1 : 0;
+    struct stat st;
+    int stored = 1, count, variants, variant, kept = 1, same, i;
+
+    recording = NULL;
+    entry.size = LARGE_BUFFER;
+    entry.buf = my_malloc(entry.size);
+    entry.len = 0;
+    add_text(&entry, CACHE_HEADER);
+    add_text(&entry, "-\n");
+    for (file = r->files; file != NULL; file = file->next) {
+        /* only the files of the output directory can be used elsewhere */
+        if (file->buf == NULL || strlen(file->filename) <= prefix
+                || (t->outdir != NULL && (strncmp(file->filename, t->outdir, prefix - 1) != 0
+                                          || file->filename[prefix - 1] != '/'))) {
+            stored = 0;
+            break;
+        }
+        sprintf(object, "%016llx-%lx", (unsigned long long)
+                d2c_hash_bytes(D2C_HASH_INIT, file->buf, file->len),
+                (unsigned long) file->len);
+        path = cache_path(t->cache, "objects", object);
+        if (stat(path, &st) != 0) {
+            stored = store(path, file->buf, file->len) == 0;
+        } else {
+            utimes(path, NULL);
+        }
+        free(path);
+        if (!stored) {
+            break;
+        }
+        add_file(&entry, file->previous, object, file->filename + prefix);
+    }
+    if (stored) {
+        class_key(t, r->classname, name);
+        /* the variants of other previous files are kept after this one */
+        count = read_entry(t->cache, name, &files, &variants);
+        for (variant = 0; variant < variants && kept < CACHE_VARIANTS; variant++) {
+            same = 1;
+            for (i = 0; same && i < count; i++) {
+                if (files[i].variant == variant) {
+                    same = recorded(r, prefix, files[i].previous, files[i].path);
+                }
+            }
+            if (same) {
+                continue;
+            }
+            add_text(&entry, "-\n");
+            for (i = 0; i < count; i++) {
+                if (files[i].variant == variant) {
+                    add_file(&entry, files[i].previous, files[i].object, files[i].path);
+                }
+            }
+            kept++;
+        }
+        if (count >= 0) {
+            free_entry(files, count);
+        }
+        path = cache_path(t->cache, "entries", name);
+        store(path, entry.buf, entry.len);
+        free(path);
+    }
+    free(entry.buf);
+    free_recording(r);
+}
+
+/* A file of the cache, for trimming it */
+struct cache_file {
+    char *path;
+    time_t used;
+    off_t size;
+};
+
+/* adds the files of the directories below <dir>/<kind> to *files */
+static void list_files(d2c_cache *c, const char *kind, struct cache_file **files,
+                       int *count, int *size, off_t *total)
+{
+    char *top = d2c_file_path(c->dir, kind, ""), *sub, *path;
+    DIR *d = opendir(top), *s;
+    struct dirent *de, *fe;
+    struct stat st;
+
+    while (d != NULL && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        sub = d2c_file_path(top, de->d_name, "");
+        s = opendir(sub);
+        while (s != NULL && (fe = readdir(s)) != NULL) {
+            path = d2c_file_path(sub, fe->d_name, "");
+            if (fe->d_name[0] == '.' || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+                free(path);
+                continue;
+            }
+            if (*count == *size) {
+                *size = *size == 0 ? 256 : 2 * *size;
+                *files = realloc(*files, *size * sizeof(struct cache_file));
+                if (*files == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    d2c_exit(1);
+                }
+            }
+            (*files)[*count].path = path;
+            (*files)[*count].used = st.st_mtime;
+            (*files)[*count].size = st.st_size;
+            (*count)++;
+            *total += st.st_size;
+        }
+        if (s != NULL) {
+            closedir(s);
+        }
+        free(sub);
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    free(top);
+}
+
+static int by_use(const void *a, const void *b)
+{
+    const struct cache_file *x = a, *y = b;
+
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+/* removes the least recently used files once the cache is too large,
+   returns how many */
+static int trim(d2c_cache *c)
+{
+    struct cache_file *files = NULL;
+    off_t total = 0, max = (off_t) output_cache_size * 1024 * 1024;
+    int count = 0, size = 0, i, removed = 0;
+
+    list_files(c, "entries", &files, &count, &size, &total);
+    list_files(c, "objects", &files, &count, &size, &total);
+    if (total > max) {
+        qsort(files, count, sizeof(struct cache_file), by_use);
+        for (i = 0; i < count && total > max; i++) {
+            if (unlink(files[i].path) == 0) {
+                total -= files[i].size;
+                removed++;
+            }
+        }
+    }
+    for (i = 0; i < count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+    return removed;
+}
+
+/* adds the counts of this run to those of the stats file of the cache */
+static void update_stats(d2c_cache *c, int removed)
+{
+    char *path = d2c_file_path(c->dir, "stats", "");
+    long hits = 0, misses = 0, evicted = 0;
+    char s[LARGE_BUFFER];
+    FILE *f;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    free(path);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+    f = fdopen(fd, "r+");
+    if (f == NULL) {
+        close(fd);
+        return;
+    }
+    while (fgets(s, sizeof(s), f) != NULL) {
+        sscanf(s, "hits %ld", &hits);
+        sscanf(s, "misses %ld", &misses);
+        sscanf(s, "evicted %ld", &evicted);
+    }
+    rewind(f);
+    fprintf(f, "hits %ld\nmisses %ld\nevicted %ld\n", hits + c->hits,
+            misses + c->misses, evicted + removed);
+    fflush(f);
+    ftruncate(fd, ftell(f));
+    fclose(f);
+}
+
+/**
+ * Reports the hits and misses of this run, adds them to the statistics
+ * of the cache, trims it to --output-cache-size and frees c.
+*/
+void d2c_cache_close (d2c_cache *c)
+{
+    d2c_cache_target *t, *next;
+    int removed = trim(c);
+
+    update_stats(c, removed);
+    fprintf(stderr, "cache: %d hits, %d misses", c->hits, c->misses);
+    if (removed > 0) {
+        fprintf(stderr, ", %d files evicted", removed);
+    }
+    fprintf(stderr, "\n");
+    for (t = c->targets; t != NULL; t = next) {
+        next = t->next;
+        free_names(t->dirs);
+        free(t);
+    }
+    pthread_mutex_destroy(&c->lock);
+    free(c->dir);
+    free(c);
+}
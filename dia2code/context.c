@@ -0,0 +1,354 @@
+/***************************************************************************
+                          context.c  -  The library interface, see libdia2code.h
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * A context holds what the command line sets up for a run: the batch
+ * options, the file extensions and the indentation settings, along with
+ * the parsed diagram.  The generators read those from the batch and from
+ * the state of their thread, so d2c_generate() installs the state of the
+ * context on the calling thread for the time of the generation, and
+ * restores the previous one after; the failures it catches with
+ * d2c_catch() become error codes.  The files are collected and only go
+ * to the sink if the generation succeeded.
+ *
+ * The output modes of the command line (--if-changed, --atomic,
+ * --async-write, ...) are settings of the process: they apply to the
+ * files written below the output directory, with a NULL sink.
+ */
+
+#include "dia2code.h"
+#include "code_generators.h"
+#include "parse_diagram.h"
+#include "includes.h"
+#include <pthread.h>
+
+const d2c_generator d2c_generators[] = {
+    {"cpp", generate_code_cpp, 0, 0},
+    {"java", generate_code_java, 1, 1},
+    {"c", generate_code_c, 0, 0},
+    {"sql", generate_code_sql, 0, 0},
+    {"ada", generate_code_ada, 0, 0},
+    {"python", generate_code_python, 0, 1},
+    {"php", generate_code_php, 1, 0},
+    {"shp", generate_code_shp, 0, 0},
+    {"idl", generate_code_idl, 0, 0},
+    {"csharp", generate_code_csharp, 0, 1},
+    {"php5", generate_code_php_five, 0, 1},
+    {"ruby", generate_code_ruby, 0, 1},
+    {"as3", generate_code_as3, 1, 1},
+    {NULL, NULL, 0, 0}
+};
+
+/**
+ * Returns the generator of the language name, as given to "-t", or
+ * NULL if there is none.
+*/
+const d2c_generator *d2c_find_generator (const char *name)
+{
+    const d2c_generator *g;
+
+    for (g = d2c_generators; g->name != NULL; g++) {
+        if (eq(name, g->name)) {
+            return g;
+        }
+    }
+    return NULL;
+}
+
+struct d2c_context {
+    batch b;                 /* the options, and the diagram once parsed */
+    param_list *options;     /* the values set, which b refers to */
+    char *file_ext;
+    char *body_file_ext;
+    int indent_count;
+    int indent_open_brace_on_newline;
+    int invert;              /* "generate.invert", see b.mask */
+    int parsed;
+};
+
+/* libxml2 must be initialized before the threads use it */
+static pthread_once_t library_init = PTHREAD_ONCE_INIT;
+
+d2c_context * d2c_context_new ()
+{
+    d2c_context *ctx;
+
+    pthread_once(&library_init, xmlInitParser);
+    ctx = malloc(sizeof(d2c_context));
+
+    if (ctx == NULL) {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(d2c_context));
+    ctx->b.outdir = ".";
+    ctx->b.clobber = 1;
+    ctx->indent_count = 4;
+    ctx->indent_open_brace_on_newline = 1;
+    return ctx;
+}
+
+void d2c_context_free (d2c_context *ctx)
+{
+    param_list *p, *next;
+
+    if (ctx == NULL) {
+        return;
+    }
+    free_diagram(ctx->b.classlist);
+    free_names(ctx->b.classes);
+    free_names(ctx->b.sqlopts);
+    for (p = ctx->options; p != NULL; p = next) {
+        next = p->next;
+        free(p->name);
+        free(p->value);
+        free(p);
+    }
+    free(ctx);
+}
+
+/* returns 1 for "yes", 0 for "no" and -1 otherwise, as for the
+   initialization file */
+static int yes_no(const char *value)
+{
+    switch (tolower((unsigned char) value[0])) {
+    case 'y':
+        return 1;
+    case 'n':
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+struct option {
+    d2c_context *ctx;
+    const char *name;
+    const char *value;
+    int status;
+};
+
+/* keeps the value of the option, and returns the copy */
+static char *keep_option(d2c_context *ctx, const char *name, const char *value)
+{
+    param_list *p;
+
+    for (p = ctx->options; p != NULL && !eq(p->name, name); p = p->next) {
+    }
+    if (p == NULL) {
+        p = NEW (param_list);
+        p->name = strdup(name);
+        p->next = ctx->options;
+        ctx->options = p;
+    } else {
+        free(p->value);
+    }
+    p->value = strdup(value);
+    if (p->name == NULL || p->value == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    return p->value;
+}
+
+static void set_option(void *arg)
+{
+    struct option *o = arg;
+    d2c_context *ctx = o->ctx;
+    const char *name = o->name;
+    int *flag = NULL, yes;
+
+    if (eq(name, "generate.classes")) {
+        free_names(ctx->b.classes);
+        ctx->b.classes = parse_class_names(o->value);
+    } else if (eq(name, "sql.options")) {
+        free_names(ctx->b.sqlopts);
+        ctx->b.sqlopts = parse_sql_options(o->value);
+    } else if (eq(name, "indent.size")) {
+        if (!isdigit((unsigned char) o->value[0])) {
+            o->status = D2C_ERR_OPTION;
+            return;
+        }
+        ctx->indent_count = atoi(o->value);
+    } else if (eq(name, "indent.brace.newline")) {
+        flag = &ctx->indent_open_brace_on_newline;
+    } else if (eq(name, "generate.invert")) {
+        flag = &ctx->invert;
+    } else if (eq(name, "generate.clobber")) {
+        flag = &ctx->b.clobber;
+    } else if (eq(name, "generate.buildtree")) {
+        flag = &ctx->b.buildtree;
+    } else if (!eq(name, "file.outdir") && !eq(name, "file.license")
+               && !eq(name, "file.ext") && !eq(name, "file.bodyext")) {
+        o->status = D2C_ERR_OPTION;
+        return;
+    }
+    if (flag != NULL) {
+        if ((yes = yes_no(o->value)) < 0) {
+            o->status = D2C_ERR_OPTION;
+            return;
+        }
+        *flag = yes;
+    }
+
+    if (eq(name, "file.outdir")) {
+        ctx->b.outdir = keep_option(ctx, name, o->value);
+    } else if (eq(name, "file.license")) {
+        ctx->b.license = keep_option(ctx, name, o->value);
+    } else if (eq(name, "file.ext")) {
+        ctx->file_ext = keep_option(ctx, name, o->value);
+    } else if (eq(name, "file.bodyext")) {
+        ctx->body_file_ext = keep_option(ctx, name, o->value);
+    } else {
+        keep_option(ctx, name, o->value);
+    }
+    /* as with -cl and -v, which both invert the selection */
+    ctx->b.mask = (ctx->b.classes != NULL) ^ ctx->invert;
+}
+
+int d2c_context_set (d2c_context *ctx, const char *name, const char *value)
+{
+    struct option o;
+    int code;
+
+    if (value == NULL) {
+        return D2C_ERR_OPTION;
+    }
+    o.ctx = ctx;
+    o.name = name;
+    o.value = value;
+    o.status = D2C_OK;
+    code = d2c_catch(set_option, &o);
+    return code != 0 ? code : o.status;
+}
+
+const char * d2c_context_get (d2c_context *ctx, const char *name)
+{
+    param_list *p;
+
+    for (p = ctx->options; p != NULL; p = p->next) {
+        if (eq(p->name, name)) {
+            return p->value;
+        }
+    }
+    return NULL;
+}
+
+struct parse {
+    d2c_context *ctx;
+    const char *path;
+    const char *buf;
+    size_t len;
+};
+
+static void parse(void *arg)
+{
+    struct parse *p = arg;
+    d2c_context *ctx = p->ctx;
+    int keep_blanks;
+
+    free_diagram(ctx->b.classlist);
+    ctx->b.classlist = NULL;
+    ctx->parsed = 0;
+    /* libxml2 keeps this setting per thread, it is restored */
+    keep_blanks = xmlKeepBlanksDefault(0);
+    if (p->path != NULL) {
+        ctx->b.classlist = parse_diagram((char *) p->path);
+    } else {
+        ctx->b.classlist = parse_diagram_buffer(p->buf, (int) p->len);
+    }
+    xmlKeepBlanksDefault(keep_blanks);
+    ctx->parsed = 1;
+}
+
+int d2c_parse_file (d2c_context *ctx, const char *path)
+{
+    struct parse p;
+
+    p.ctx = ctx;
+    p.path = path;
+    p.buf = NULL;
+    p.len = 0;
+    return d2c_catch(parse, &p);
+}
+
+int d2c_parse_buffer (d2c_context *ctx, const char *buf, size_t len)
+{
+    struct parse p;
+
+    p.ctx = ctx;
+    p.path = NULL;
+    p.buf = buf;
+    p.len = len;
+    return d2c_catch(parse, &p);
+}
+
+struct generation {
+    const d2c_generator *generator;
+    batch b;
+};
+
+/* as for a generation task, see run_task() */
+static void run_generator(void *arg)
+{
+    struct generation *g = arg;
+
+    d2c_reset_output_state();
+    includes = NULL;
+    (*g->generator->generator)(&g->b);
+}
+
+int d2c_generate (d2c_context *ctx, const char *target, d2c_sink *sink)
+{
+    struct generation g;
+    d2c_genstate caller, state;
+    void *files = NULL;
+    int code;
+
+    g.generator = d2c_find_generator(target);
+    if (g.generator == NULL) {
+        fprintf(stderr, "Unknown generator %s\n", target);
+        return D2C_ERR_TARGET;
+    }
+    if (!ctx->parsed) {
+        return D2C_ERR_NO_DIAGRAM;
+    }
+    g.b = ctx->b;
+    g.b.buildtree = ctx->b.buildtree && g.generator->buildtree;
+    g.b.pipeline = NULL;
+    /* the package directories of a memory sink are not on the disk */
+    start_package_dirs(&g.b);
+
+    /* what the command line would have set up */
+    d2c_genstate_save(&caller);
+    memset(&state, 0, sizeof(state));
+    state.file_ext = ctx->file_ext;
+    state.body_file_ext = ctx->body_file_ext;
+    state.indent_spaces = 2;
+    state.indent_count = ctx->indent_count;
+    state.indent_open_brace_on_newline = ctx->indent_open_brace_on_newline;
+    state.sink = sink;
+    d2c_genstate_restore(&state);
+
+    d2c_outfile_collect(&files);
+    code = d2c_catch(run_generator, &g);
+    if (code != 0) {
+        d2c_outfile_discard();
+    } else {
+        d2c_outfile_collect(NULL);
+        code = d2c_catch(d2c_outfile_commit, files);
+    }
+    d2c_genstate_restore(&caller);
+    return code;
+}
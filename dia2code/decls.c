@@ -1,9 +1,10 @@
 #include "decls.h"
 
-declaration *decls = NULL;
-static namelist tmp_classes = NULL;
+/* each target builds its own, see d2c_genstate */
+D2C_TASK_LOCAL declaration *decls = NULL;
+D2C_TASK_LOCAL namelist tmp_classes = NULL;
 
-int use_corba = 0;
+D2C_TASK_LOCAL int use_corba = 0;
 
 module *
 create_nested_modules_from_pkglist (umlpackagelist pkglist, module *m)
@@ -11,10 +12,10 @@ create_nested_modules_from_pkglist (umlpackagelist pkglist, module *m)
     /* Expects pkglist and m to be non-NULL and m->contents to be NULL.
        Returns a reference to the innermost module created.  */
     while (pkglist->next != NULL) {
-        declaration *d = NEW (declaration);
+        declaration *d = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
         d->decl_kind = dk_module;
         d->prev = d->next = NULL;
-        d->u.this_module = NEW (module);
+        d->u.this_module = NEW_TAGGED (module, D2C_MEM_DECLARATION);
         m->contents = d;
         pkglist = pkglist->next;
         m = d->u.this_module;
@@ -33,7 +34,7 @@ find_or_add_module (declaration **dptr, umlpackagelist pkglist)
     if (pkglist == NULL)
         return NULL;
     if (d == NULL) {
-        *dptr = NEW (declaration);
+        *dptr = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
         d = *dptr;
     } else {
         declaration *dprev = NULL;
@@ -52,13 +53,13 @@ find_or_add_module (declaration **dptr, umlpackagelist pkglist)
             d = d->next;
         }
         if (dprev != NULL) {
-            dprev->next = NEW (declaration);
+            dprev->next = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
             d = dprev->next;
         }
     }
     d->decl_kind = dk_module;
     d->next = NULL;
-    d->u.this_module = NEW (module);
+    d->u.this_module = NEW_TAGGED (module, D2C_MEM_DECLARATION);
     m = d->u.this_module;
     m->pkg = pkglist->key;
     m->contents = NULL;
@@ -115,14 +116,14 @@ append_decl (declaration *d)
     while (d->next != NULL) {
         d = d->next;
     }
-    d->next = NEW (declaration);
+    d->next = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
     d->next->prev = d;
     d = d->next;
     return d;
 }
 
-void
-push (umlclassnode *node, batch *b)
+static void
+push_class (umlclassnode *node, batch *b)
 {
     umlclasslist used_classes, tmpnode;
     module *m;
@@ -133,7 +134,7 @@ push (umlclassnode *node, batch *b)
         return;
     }
 
-    l_tmp = NEW (namenode);
+    l_tmp = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
     l_tmp->name = strdup (node->key->name);
     l_tmp->next = tmp_classes;
     tmp_classes = l_tmp;
@@ -145,7 +146,7 @@ push (umlclassnode *node, batch *b)
         /* don't push this class !*/
         if (! eq (node->key->name, tmpnode->key->name) &&
             ! (is_present (tmp_classes, tmpnode->key->name) ^ b->mask)) {
-            push (tmpnode, b);
+            push_class (tmpnode, b);
         }
         tmpnode = tmpnode->next;
     }
@@ -154,7 +155,7 @@ push (umlclassnode *node, batch *b)
         umlpackagelist pkglist = make_package_list (node->key->package);
         m = find_or_add_module (&decls, pkglist);
         if (m->contents == NULL) {
-            m->contents = NEW (declaration);
+            m->contents = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
             d = m->contents;
             d->prev = NULL;
         } else {
@@ -164,7 +165,7 @@ push (umlclassnode *node, batch *b)
         }
     } else {
         if (decls == NULL) {
-            decls = NEW (declaration);
+            decls = NEW_TAGGED (declaration, D2C_MEM_DECLARATION);
             d = decls;
             d->prev = NULL;
         } else {
@@ -175,10 +176,20 @@ push (umlclassnode *node, batch *b)
     }
     d->decl_kind = dk_class;
     d->next = NULL;
-    d->u.this_class = NEW (umlclassnode);
+    d->u.this_class = NEW_TAGGED (umlclassnode, D2C_MEM_DECLARATION);
     memcpy (d->u.this_class, node, sizeof(umlclassnode));
     if (strncmp (node->key->stereotype, "CORBA", 5) == 0)
         use_corba = 1;
 }
 
+void
+push (umlclassnode *node, batch *b)
+{
+    d2c_clock clock;
+
+    d2c_stats_start (&clock);
+    push_class (node, b);
+    d2c_stats_stop_at (D2C_PHASE_DECLS, &clock, node->key->name, NULL);
+}
+
 
@@ -41,7 +41,7 @@ struct declaration {
 
 typedef struct declaration declaration;
 
-extern declaration *decls;
+extern D2C_TASK_LOCAL declaration *decls;
 
 /* Utilities for building the global `decls' from umlclassnodes and
    their parents.  (`decls' contains everything in ascending order of
@@ -61,7 +61,13 @@ extern declaration * append_decl (declaration *d);
 
 extern void push (umlclassnode *node, batch *b);
 
-extern int use_corba;  /* Set by push() if CORBA stereotypes in use.  */
+extern D2C_TASK_LOCAL namelist tmp_classes;  /* The classes push() has seen.  */
+
+extern D2C_TASK_LOCAL int use_corba;  /* Set by push() if CORBA stereotypes in use.  */
+
+/* Runs fn(b, d) as a generation task for each top level declaration d
+   of `decls', see d2c_run_tasks().  */
+extern void d2c_generate_decls (batch *b, d2c_task_fn fn);
 
 #endif  /* DECLS_H */
 
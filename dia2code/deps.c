@@ -0,0 +1,230 @@
+/***************************************************************************
+                          deps.c  -  The inputs and outputs of --depfile and --manifest
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --depfile or --manifest, dia2code notes every file it reads (the
+ * diagrams, the initialization files, the licenses and the sources
+ * whose code is preserved) and every file it generates, so that make or
+ * ninja know when the generation must run again.  The depfile has a
+ * single rule, the generated files depending on the files read; a
+ * preserved source that is also generated is left out of it, since a
+ * file can't depend on itself.  The manifest lists the generated files,
+ * one per line, or as JSON, with the files read, if its name ends in
+ * ".json".
+ */
+
+#include "dia2code.h"
+#include <pthread.h>
+
+char *deps_file = NULL;       /* Set by switch "--depfile" */
+char *deps_manifest = NULL;   /* Set by switch "--manifest" */
+
+static namelist inputs = NULL, outputs = NULL;
+static pthread_mutex_t deps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void add(namelist *list, const char *filename)
+{
+    namelist n;
+
+    if (deps_file == NULL && deps_manifest == NULL) {
+        return;
+    }
+    n = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+    n->name = my_strdup(filename);
+    pthread_mutex_lock(&deps_lock);
+    n->next = *list;
+    *list = n;
+    pthread_mutex_unlock(&deps_lock);
+}
+
+/**
+ * Notes that filename was read.
+*/
+void d2c_deps_input (const char *filename)
+{
+    add(&inputs, filename);
+}
+
+/**
+ * Notes that filename was generated.
+*/
+void d2c_deps_output (const char *filename)
+{
+    add(&outputs, filename);
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* returns the names of list, sorted and each once, in an array of
+   *count names that the caller frees */
+static char **sorted(namelist list, int *count)
+{
+    namelist n;
+    char **names;
+    int i, k = 0;
+
+    *count = 0;
+    for (n = list; n != NULL; n = n->next) {
+        (*count)++;
+    }
+    names = my_malloc((*count + 1) * sizeof(char *));
+    for (n = list, i = 0; n != NULL; n = n->next, i++) {
+        names[i] = n->name;
+    }
+    qsort(names, *count, sizeof(char *), by_name);
+    for (i = 0; i < *count; i++) {
+        if (k == 0 || !eq(names[k - 1], names[i])) {
+            names[k++] = names[i];
+        }
+    }
+    *count = k;
+    return names;
+}
+
+static int is_listed(char **names, int count, const char *name)
+{
+    return bsearch(&name, names, count, sizeof(char *), by_name) != NULL;
+}
+
+/* writes name for make, which escapes spaces, '#' and '$' */
+static void put_make(FILE *f, const char *name)
+{
+    for (; *name != '\0'; name++) {
+        if (*name == ' ' || *name == '#') {
+            fputc('\\', f);
+        } else if (*name == '$') {
+            fputc('$', f);
+        }
+        fputc(*name, f);
+    }
+}
+
+static void put_json_list(FILE *f, const char *key, char **names, int count)
+{
+    int i;
+
+    fprintf(f, "  \"%s\": [", key);
+    for (i = 0; i < count; i++) {
+        fprintf(f, i == 0 ? "\n    " : ",\n    ");
+        d2c_put_json(f, names[i]);
+    }
+    fprintf(f, count > 0 ? "\n  ]" : "]");
+}
+
+static int ends_with(const char *s, const char *suffix)
+{
+    size_t len = strlen(s), n = strlen(suffix);
+
+    return len >= n && eq(s + len - n, suffix);
+}
+
+/* closes f, returns -1 with a message if filename could not be written */
+static int finish(FILE *f, const char *filename)
+{
+    if (ferror(f) | (fclose(f) != 0)) {
+        fprintf(stderr, "Can't write file %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_depfile(const char *filename, char **in, int nin, char **out,
+                         int nout, const char *target)
+{
+    FILE *f = fopen(filename, "w");
+    int i;
+
+    if (f == NULL) {
+        fprintf(stderr, "Can't open file %s for writing\n", filename);
+        return -1;
+    }
+    if (target != NULL) {
+        put_make(f, target);
+    }
+    for (i = 0; target == NULL && i < nout; i++) {
+        if (i > 0) {
+            fputs(" \\\n ", f);
+        }
+        put_make(f, out[i]);
+    }
+    if (target == NULL && nout == 0) {
+        put_make(f, filename);
+    }
+    fputc(':', f);
+    for (i = 0; i < nin; i++) {
+        if (!is_listed(out, nout, in[i])) {
+            fputs(" \\\n ", f);
+            put_make(f, in[i]);
+        }
+    }
+    fputc('\n', f);
+    return finish(f, filename);
+}
+
+static int write_manifest(const char *filename, char **in, int nin, char **out, int nout)
+{
+    FILE *f = eq(filename, "-") ? stdout : fopen(filename, "w");
+    int i;
+
+    if (f == NULL) {
+        fprintf(stderr, "Can't open file %s for writing\n", filename);
+        return -1;
+    }
+    if (ends_with(filename, ".json")) {
+        fprintf(f, "{\n");
+        put_json_list(f, "outputs", out, nout);
+        fprintf(f, ",\n");
+        put_json_list(f, "inputs", in, nin);
+        fprintf(f, "\n}\n");
+    } else {
+        for (i = 0; i < nout; i++) {
+            fprintf(f, "%s\n", out[i]);
+        }
+    }
+    if (f == stdout) {
+        return fflush(f) != 0 ? -1 : 0;
+    }
+    return finish(f, filename);
+}
+
+/**
+ * Writes the depfile of --depfile and the manifest of --manifest, once
+ * the generation succeeded; with --tar, target is the archive, which
+ * the depfile has as its only output.  Returns 0, or 3 if they can't
+ * be written.
+*/
+int d2c_deps_write (const char *target)
+{
+    char **in, **out;
+    int nin, nout, status = 0;
+
+    in = sorted(inputs, &nin);
+    out = sorted(outputs, &nout);
+    if (deps_file != NULL && write_depfile(deps_file, in, nin, out, nout, target) != 0) {
+        status = 3;
+    }
+    if (deps_manifest != NULL && write_manifest(deps_manifest, in, nin, out, nout) != 0) {
+        status = 3;
+    }
+    free(in);
+    free(out);
+    free_names(inputs);
+    free_names(outputs);
+    inputs = outputs = NULL;
+    return status;
+}
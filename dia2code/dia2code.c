@@ -16,13 +16,16 @@
  ***************************************************************************/
 
 #include "dia2code.h"
+#include "decls.h"
 #include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
 
 char * d2c_indentstring = "   ";
-int d2c_indentposition = 0;
+D2C_TASK_LOCAL int d2c_indentposition = 0;
 
-int indentlevel = 0;
-static int number_of_spaces_for_one_indentation = 2;
+D2C_TASK_LOCAL int indentlevel = 0;
+static D2C_TASK_LOCAL int number_of_spaces_for_one_indentation = 2;
 static int DBG_LEVEL = 4;
 
 void dia2code_initializations()
@@ -39,7 +42,7 @@ void debug_setlevel( int newlevel )
  */
 void debug( int level, char *fmt, ... )
 {
-    static char debug_buffer[HUGE_BUFFER];
+    static D2C_TASK_LOCAL char debug_buffer[HUGE_BUFFER];
     va_list argptr;
     //printf( "debug call\n" );
     if( level != DBG_LEVEL ) 
@@ -61,7 +64,7 @@ char *strtoupper(char *s) {
     int i, n;
     if (tmp == NULL) {
         fprintf(stderr, "Out of memory\n");
-        exit(1);
+        d2c_exit(1);
     }
     n = strlen(tmp);
     for (i = 0; i < n; i++) {
@@ -79,7 +82,7 @@ char *strtolower(char *s) {
     int i, n;
     if (tmp == NULL) {
         fprintf(stderr, "Out of memory\n");
-        exit(1);
+        d2c_exit(1);
     }
     n = strlen(tmp);
     for (i = 0; i < n; i++) {
@@ -98,7 +101,7 @@ char *strtoupperfirst(char *s) {
     int i, n;
     if (tmp == NULL) {
         fprintf(stderr, "Out of memory\n");
-        exit(1);
+        d2c_exit(1);
     }
     n = strlen(tmp);
     tmp[0] = toupper(tmp[0]);
@@ -110,30 +113,30 @@ char *strtoupperfirst(char *s) {
 
 
 namelist parse_class_names(const char *s) {
-    char *cp, *token;
+    char *cp, *token, *save;
     const char *delim = ",";
     namelist list = NULL;
 
     cp = strdup(s);
     if (cp == NULL) {
         fprintf(stderr, "Out of memory\n");
-        exit(1);
+        d2c_exit(1);
     }
-    token = strtok (cp, delim);
+    token = strtok_r (cp, delim, &save);
     while ( token != NULL ) {
-        namenode *tmp = NEW (namenode);
+        namenode *tmp = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
         if (tmp == NULL) {
             fprintf(stderr, "Out of memory\n");
-            exit(1);
+            d2c_exit(1);
         }
         tmp->name = strdup(token);
         if (tmp->name == NULL) {
             fprintf(stderr, "Out of memory\n");
-            exit(1);
+            d2c_exit(1);
         }
         tmp->next = list;
         list = tmp;
-        token = strtok (NULL, delim);
+        token = strtok_r (NULL, delim, &save);
     }
     free(cp);
     return list;
@@ -144,6 +147,16 @@ namelist parse_sql_options(const char *s) {
   return parse_class_names(s);
 }
 
+void free_names(namelist list) {
+    namelist next;
+
+    for (; list != NULL; list = next) {
+        next = list->next;
+        free(list->name);
+        my_free_tagged(list, D2C_MEM_NAMELIST);
+    }
+}
+
 int is_present(namelist list, const char *name) {
     while (list != NULL) {
         int len;
@@ -168,25 +181,107 @@ int is_present(namelist list, const char *name) {
     return 0;
 }
 
-void * my_malloc( size_t size ) {
+/* where d2c_exit() returns to in this thread, see d2c_catch() */
+static D2C_TASK_LOCAL jmp_buf *exit_point = NULL;
+static D2C_TASK_LOCAL int exit_code = 0;
+
+/**
+ * Ends the run with the exit status code, after the error has been
+ * reported.  Within d2c_catch(), only the caught function is ended.
+*/
+void d2c_exit( int code )
+{
+    if (exit_point != NULL) {
+        exit_code = code;
+        longjmp(*exit_point, 1);
+    }
+    exit(code);
+}
+
+/**
+ * Runs fn(arg).  Returns 0, or the status it passed to d2c_exit().
+ * What the function had allocated is then lost, and the locks it
+ * held are not released.
+*/
+int d2c_catch( void (*fn) (void *), void *arg )
+{
+    jmp_buf here, *outer = exit_point;
+    volatile int code = 0;
+
+    exit_point = &here;
+    if (setjmp(here) == 0) {
+        fn(arg);
+    } else {
+        code = exit_code;
+    }
+    exit_point = outer;
+    return code;
+}
+
+void * my_malloc_tagged( size_t size, int tag ) {
     void * tmp;
     tmp = malloc(size);
     if (tmp == NULL) {
         fprintf(stderr, "Out of memory\n");
-        exit(1);
+        d2c_exit(1);
     }
     /* safer zone */
     memset (tmp, 0, size);
+    if (mem_report) {
+        d2c_mem_alloc(tmp, tag);
+    }
     return tmp;
 }
 
+void * my_malloc( size_t size ) {
+    return my_malloc_tagged(size, D2C_MEM_SCRATCH);
+}
+
+/* strdup() that exits when out of memory, as my_malloc(); NULL gives NULL */
+char * my_strdup( const char *s ) {
+    char *c;
+
+    if (s == NULL) {
+        return NULL;
+    }
+    c = strdup(s);
+    if (c == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    return c;
+}
+
+/* writes s to f as a JSON string, quoted and escaped */
+void d2c_put_json( FILE *f, const char *s ) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if ((unsigned char) *s < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char) *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/* frees ptr, allocated by my_malloc_tagged() with tag */
+void my_free_tagged( void *ptr, int tag ) {
+    if (mem_report) {
+        d2c_mem_free(ptr, tag);
+    }
+    free(ptr);
+}
+
 char * my_strndup(const char *s, size_t n) {
     char *retval;
-    size_t len = strlen(s);
+    size_t len;
     if (s == NULL)
         return NULL;
-    if (len > n)
-        len = n;
+    /* s may be a span of a mapped file, with no '\0' after it */
+    len = strnlen(s, n);
     retval = (char*)malloc(len + 1);
     strncpy(retval, s, len);
     retval[len] = '\0';
@@ -202,7 +297,7 @@ umlpackagelist make_package_list(umlpackage * package) {
     umlpackagelist dummylist, tmplist=NULL;
 
     while (package != NULL) {
-        dummylist = NEW (umlpackagenode);
+        dummylist = NEW_TAGGED (umlpackagenode, D2C_MEM_PACKAGE);
         dummylist->next = tmplist;
         tmplist = dummylist;
         tmplist->key = package;
@@ -217,7 +312,7 @@ umlattrlist copy_attributes(umlattrlist src)
 
     while (src != NULL)
     {
-        umlattrlist tmp = NEW (umlattrnode);
+        umlattrlist tmp = NEW_TAGGED (umlattrnode, D2C_MEM_ATTRIBUTE);
         tmp->key = src->key;
         if (cpy == NULL) {
             cpy = tmp;
@@ -239,39 +334,210 @@ umlattrlist copy_attributes(umlattrlist src)
  * create a directory hierarchy for the package name 
  * batch.outdir is taken as root directory 
  * works with java-like package naming convention 
- * the directory path is stored in pkg->directory
+ * the directory path is cached in pkg->directories
  * eg. org.foo.bar will create directory tree org/foo/bar
  * @param the current batch
  * @param the package pointer
  * @return the full directory path eg. "<outdir>/org/foo/bar"
  * 
  */
+/**
+ * Returns "<dir>/<name><ext>", or "<name><ext>" when dir is NULL, in a
+ * buffer that the caller frees.
+*/
+char *d2c_file_path( const char *dir, const char *name, const char *ext )
+{
+    char *path;
+
+    if (dir == NULL) {
+        path = my_malloc(strlen(name) + strlen(ext) + 1);
+        sprintf(path, "%s%s", name, ext);
+    } else {
+        path = my_malloc(strlen(dir) + strlen(name) + strlen(ext) + 2);
+        sprintf(path, "%s/%s%s", dir, name, ext);
+    }
+    return path;
+}
+
+/* created directories permissions */
+#define PACKAGE_DIR_MODE (S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP)
+
+/*
+ * Finds the directory of pkg below batch->outdir: the output directory
+ * followed by one directory per component of the dotted package name.
+ * Each output directory has its own entry, as the targets of a run have
+ * theirs.  Sets *seen if the run of batch already asked for it; the
+ * directory then exists if the entry is marked created.
+ */
+static umlpackagedir *package_dir( const batch *batch, umlpackage *pkg, int *seen )
+{
+    char *dirname, *component, *p, *save;
+    umlpackagedir *dir;
+    size_t len;
+
+    for (dir = pkg->directories; dir != NULL; dir = dir->next) {
+        if (eq(dir->root, batch->outdir)) {
+            break;
+        }
+    }
+    if (dir == NULL) {
+        len = strlen(batch->outdir);
+        dirname = my_malloc(len + strlen(pkg->name) + 2);
+        strcpy(dirname, batch->outdir);
+        component = strdup(pkg->name);
+        for (p = strtok_r(component, ".", &save); p != NULL;
+             p = strtok_r(NULL, ".", &save)) {
+            dirname[len++] = '/';
+            strcpy(dirname + len, p);
+            len += strlen(p);
+        }
+        free(component);
+        dir = NEW_TAGGED (umlpackagedir, D2C_MEM_PACKAGE);
+        dir->root = strdup(batch->outdir);
+        dir->directory = dirname;
+        dir->next = pkg->directories;
+        pkg->directories = dir;
+    } else if (dir->run == batch->run) {
+        *seen = 1;
+        return dir;
+    }
+    /* the files of an earlier run may have been removed since */
+    dir->run = batch->run;
+    dir->created = 0;
+    *seen = 0;
+    return dir;
+}
+
+/*
+ * Creates dirname and its missing parents below the first root_len
+ * chars, which are the output directory.  The directory itself is tried
+ * first, so that an existing tree costs a single mkdir() call.
+ */
+int make_package_dir( char *dirname, size_t root_len )
+{
+    char *slash;
+    int rc;
+
+    if (d2c_outfile_mkdir(dirname, PACKAGE_DIR_MODE) == 0 || errno == EEXIST) {
+        return 0;
+    }
+    slash = strrchr(dirname, '/');
+    if (errno != ENOENT || slash == NULL || slash - dirname <= root_len) {
+        debug(DBG_GENCODE, "can't create directory %s", dirname);
+        return -1;
+    }
+    *slash = '\0';
+    rc = make_package_dir(dirname, root_len);
+    *slash = '/';
+    if (rc != 0) {
+        return rc;
+    }
+    if (d2c_outfile_mkdir(dirname, PACKAGE_DIR_MODE) == 0 || errno == EEXIST) {
+        return 0;
+    }
+    debug(DBG_GENCODE, "can't create directory %s", dirname);
+    return -1;
+}
+
+/* the generation tasks share the directory cache of the packages */
+static pthread_mutex_t package_dir_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int package_dir_runs = 0;
+
+/*
+ * Starts a generation run of batch.  The package directories the model
+ * knows from the runs before are checked again, once, since the model
+ * outlives its runs with --serve and the library.
+ */
+void start_package_dirs( batch *batch )
+{
+    pthread_mutex_lock(&package_dir_lock);
+    batch->run = ++package_dir_runs;
+    pthread_mutex_unlock(&package_dir_lock);
+}
+
 char *create_package_dir( const batch *batch, umlpackage *pkg )
 {
-    char *fulldirname, *dirname, fulldirnamedup[BIG_BUFFER];
-    /* created directories permissions */
-    mode_t dir_mask = S_IRUSR | S_IWUSR | S_IXUSR |S_IRGRP | S_IXGRP;
+    umlpackagedir *dir;
+    int seen;
+
     if (pkg == NULL) {
         return NULL;
     }
-    if (batch->buildtree == 0 || pkg->name == NULL) {
-        pkg->directory = batch->outdir;
-    } else {
-        fulldirname = (char*)my_malloc(BIG_BUFFER);
-        sprintf(fulldirname, "%s", batch->outdir);
-        dirname = strdup(pkg->name);
-        dirname = strtok( dirname, "." );
-        while (dirname != NULL) {
-            sprintf( fulldirnamedup, "%s/%s", fulldirname, dirname );
-            sprintf( fulldirname, "%s", fulldirnamedup );
-            /* TODO : should create only if not existent */
-            mkdir( fulldirname, dir_mask );
-            dirname = strtok( NULL, "." );
+    if (batch->buildtree == 0) {
+        return batch->outdir;
+    }
+    pthread_mutex_lock(&package_dir_lock);
+    dir = package_dir(batch, pkg, &seen);
+    if (!dir->created) {
+        dir->created = make_package_dir(dir->directory, strlen(batch->outdir)) == 0;
+    }
+    pthread_mutex_unlock(&package_dir_lock);
+    return dir->directory;
+}
+
+static int deeper_dir_first(const void *a, const void *b)
+{
+    const char *dir_a = (*(umlpackagedir **) a)->directory;
+    const char *dir_b = (*(umlpackagedir **) b)->directory;
+    int depth_a = 0, depth_b = 0;
+
+    for (; *dir_a != '\0'; dir_a++) {
+        depth_a += *dir_a == '/';
+    }
+    for (; *dir_b != '\0'; dir_b++) {
+        depth_b += *dir_b == '/';
+    }
+    return depth_b - depth_a;
+}
+
+/**
+ * Creates the directories of all selected classes up front, for the
+ * --buildtree generators.  Each package is handled once and the deepest
+ * directories come first: their parents are then only created when
+ * missing, and the later create_package_dir() calls hit the cache.
+*/
+void create_package_dirs( const batch *batch )
+{
+    umlclasslist tmplist;
+    umlpackage *pkg;
+    umlpackagedir **dirs, *dir;
+    int i, seen, count = 0;
+
+    if (batch->buildtree == 0) {
+        return;
+    }
+    for (tmplist = batch->classlist; tmplist != NULL; tmplist = tmplist->next) {
+        count++;
+    }
+    dirs = my_malloc((count + 1) * sizeof(umlpackagedir *));
+    count = 0;
+    for (tmplist = batch->classlist; tmplist != NULL; tmplist = tmplist->next) {
+        if (is_present(batch->classes, tmplist->key->name) ^ batch->mask) {
+            continue;
+        }
+        /* the generators use the outermost package, see make_package_list() */
+        pkg = tmplist->key->package;
+        while (pkg != NULL && pkg->parent != NULL) {
+            pkg = pkg->parent;
+        }
+        if (pkg == NULL) {
+            continue;
+        }
+        pthread_mutex_lock(&package_dir_lock);
+        dir = package_dir(batch, pkg, &seen);
+        pthread_mutex_unlock(&package_dir_lock);
+        if (!seen) {
+            dirs[count++] = dir;
         }
-        /* set the package directory used later for source file creation */
-        pkg->directory = fulldirname;
     }
-    return pkg->directory;
+    qsort(dirs, count, sizeof(umlpackagedir *), deeper_dir_first);
+    pthread_mutex_lock(&package_dir_lock);
+    for (i = 0; i < count; i++) {
+        dirs[i]->created = make_package_dir(dirs[i]->directory,
+                                            strlen(batch->outdir)) == 0;
+    }
+    pthread_mutex_unlock(&package_dir_lock);
+    free(dirs);
 }
 
 void set_number_of_spaces_for_one_indentation(int n)
@@ -281,18 +547,18 @@ void set_number_of_spaces_for_one_indentation(int n)
 
 char *spc()
 {
-   static char spcbuf[BIG_BUFFER];
+   static D2C_TASK_LOCAL char spcbuf[BIG_BUFFER];
    int n_spaces = number_of_spaces_for_one_indentation * indentlevel;
    if (n_spaces >= sizeof(spcbuf)) {
        fprintf (stderr, "spc(): spaces buffer overflow\n");
-       exit (1);
+       d2c_exit (1);
    }
    memset (spcbuf, ' ', n_spaces);
    spcbuf[n_spaces] = '\0';
    return spcbuf;
 }
 
-FILE *spec = NULL, *body = NULL;
+D2C_TASK_LOCAL FILE *spec = NULL, *body = NULL;
 
 /* Auxiliary define for the emit/print functions  */
 #define var_arg_to_str(first_arg) \
@@ -345,43 +611,36 @@ void pboth (char *msg, ...)
         fprintf (body, "%s%s", spc(), str);
 }
 
-char *file_ext = NULL;
-char *body_file_ext = NULL;
+D2C_TASK_LOCAL char *file_ext = NULL;
+D2C_TASK_LOCAL char *body_file_ext = NULL;
 
-FILE * open_outfile (char *filename, batch *b)
+void d2c_genstate_save (d2c_genstate *state)
 {
-    static char outfilename[BIG_BUFFER];
-    FILE *o;
-    int tmpdirlgth, tmpfilelgth;
-
-    if (b->outdir == NULL) {
-        b->outdir = ".";
-    }
-
-    tmpdirlgth = strlen (b->outdir);
-    tmpfilelgth = strlen (filename);
-
-    /* This prevents buffer overflows */
-    if (tmpfilelgth + tmpdirlgth > sizeof(outfilename) - 2) {
-        fprintf (stderr, "Sorry, name of file too long ...\n"
-                    "Try a smaller dir name\n");
-        exit (1);
-    }
-
-    sprintf (outfilename, "%s/%s", b->outdir, filename);
-    o = fopen (outfilename, "r");
-    if (o != NULL && !b->clobber) {
-        fclose (o);
-        return NULL;
-    }
-    o = fopen (outfilename, "w");
-    if (o == NULL) {
-        fprintf (stderr, "Can't open file %s for writing\n", outfilename);
-        exit (1);
-    }
-    return o;
+    state->file_ext = file_ext;
+    state->body_file_ext = body_file_ext;
+    state->indent_spaces = number_of_spaces_for_one_indentation;
+    state->decls = decls;
+    state->decl_classes = tmp_classes;
+    state->use_corba = use_corba;
+    state->indent_count = indent_count;
+    state->indent_open_brace_on_newline = indent_open_brace_on_newline;
+    state->sink = d2c_outfile_sink();
+    state->stats_generator = d2c_stats_generator();
 }
 
+void d2c_genstate_restore (const d2c_genstate *state)
+{
+    file_ext = state->file_ext;
+    body_file_ext = state->body_file_ext;
+    number_of_spaces_for_one_indentation = state->indent_spaces;
+    decls = state->decls;
+    tmp_classes = state->decl_classes;
+    use_corba = state->use_corba;
+    indent_count = state->indent_count;
+    indent_open_brace_on_newline = state->indent_open_brace_on_newline;
+    d2c_outfile_use_sink(state->sink);
+    d2c_stats_use_generator(state->stats_generator);
+}
 
 int
 is_enum_stereo (char *stereo)
@@ -419,7 +678,8 @@ is_const_stereo (char *stereo)
 
 struct endless_string_buf
 {
-    char *buf;
+    const char *buf;
+    size_t len;
     struct endless_string_buf *next;
 };
 typedef struct endless_string_buf endless_string_buf;
@@ -436,7 +696,7 @@ void dump_endless_string(FILE *f, endless_string *es)
     endless_string_buf *esb = es->start;
     while (esb != NULL)
     {
-        fprintf(f, "%s", esb->buf); /* We do not d2c_fprintf the buffer, cause it's read in indented. */
+        fwrite(esb->buf, 1, esb->len, f); /* We do not d2c_fprintf the buffer, cause it's read in indented. */
         esb = esb->next;
     }
 }
@@ -455,8 +715,6 @@ void destroy_endless_string(endless_string * es)
     endless_string_buf *esb_next;
     while (esb != NULL)
     {
-        if (esb->buf != NULL)
-            free(esb->buf);
         esb_next = esb->next;
         free(esb);
         esb = esb_next;
@@ -464,10 +722,11 @@ void destroy_endless_string(endless_string * es)
     free (es);
 }
 
-void append_endless_string(endless_string * es, char *s)
+void append_endless_string(endless_string * es, const char *s, size_t len)
 {
     endless_string_buf *esb = NEW (endless_string_buf);
-    esb->buf = strdup(s);
+    esb->buf = s;
+    esb->len = len;
     esb->next = NULL;
     if (es->start == NULL)
         es->start = esb;
@@ -477,7 +736,7 @@ void append_endless_string(endless_string * es, char *s)
 }
 
 struct d2c_impl {
-    char name[SMALL_BUFFER];
+    char *name;
     endless_string *impl;
     int impl_len;
     int in_source;
@@ -486,7 +745,12 @@ struct d2c_impl {
 };
 
 typedef struct d2c_impl d2c_impl;
-d2c_impl *d2c_impl_list = NULL;
+D2C_TASK_LOCAL d2c_impl *d2c_impl_list = NULL;
+
+/* The sections of d2c_impl_list, by name: an open addressing hash table
+   of d2c_impl_slots entries, d2c_impl_count of them used. */
+static D2C_TASK_LOCAL d2c_impl **d2c_impl_index = NULL;
+static D2C_TASK_LOCAL size_t d2c_impl_slots = 0, d2c_impl_count = 0;
 
 void d2c_impl_list_destroy()
 {
@@ -494,17 +758,60 @@ void d2c_impl_list_destroy()
     while (p != NULL)
     {
         destroy_endless_string(p->impl);
+        free(p->name);
         d2c_impl_list = p;
         p = p->next;
         free(d2c_impl_list);
     }
     d2c_impl_list = NULL;
+    free(d2c_impl_index);
+    d2c_impl_index = NULL;
+    d2c_impl_slots = d2c_impl_count = 0;
+}
+
+/* Tells if the len chars of word are s. */
+static int word_is(const char *word, size_t len, const char *s)
+{
+    return strlen(s) == len && strncmp(word, s, len) == 0;
 }
 
-d2c_impl * d2c_impl_add(char *name)
+static size_t d2c_impl_slot(const char *name, size_t len)
+{
+    return d2c_hash_bytes(D2C_HASH_INIT, name, len) & (d2c_impl_slots - 1);
+}
+
+static d2c_impl *d2c_impl_find(const char *name, size_t len)
+{
+    size_t i;
+
+    if (d2c_impl_slots == 0)
+        return NULL;
+    for (i = d2c_impl_slot(name, len); d2c_impl_index[i] != NULL;
+         i = (i + 1) & (d2c_impl_slots - 1))
+    {
+        if (word_is(name, len, d2c_impl_index[i]->name))
+            return d2c_impl_index[i];
+    }
+    return NULL;
+}
+
+static void d2c_impl_insert(d2c_impl *d2ci)
+{
+    size_t i, len = strlen(d2ci->name);
+
+    for (i = d2c_impl_slot(d2ci->name, len); d2c_impl_index[i] != NULL;
+         i = (i + 1) & (d2c_impl_slots - 1))
+        ;
+    d2c_impl_index[i] = d2ci;
+    d2c_impl_count++;
+}
+
+static d2c_impl * d2c_impl_add(const char *name, size_t len)
 {
     d2c_impl *d2ci = NEW (d2c_impl);
-    strcpy(d2ci->name, name);
+    d2c_impl *p;
+
+    d2ci->name = my_strndup(name, len);
     d2ci->impl = new_endless_string();
     d2ci->impl_len = 0;
     d2ci->in_source = 0;
@@ -512,26 +819,26 @@ d2c_impl * d2c_impl_add(char *name)
     d2ci->next = d2c_impl_list;
     d2c_impl_list = d2ci;
 
-    return d2ci;
-}
-
-d2c_impl* d2c_impl_find(char *name)
-{
-    d2c_impl *p = d2c_impl_list;
-    while (p != NULL)
+    if (2 * (d2c_impl_count + 1) > d2c_impl_slots)
     {
-        if (strcmp(p->name, name) == 0)
-            return p;
-        p = p->next;
+        free(d2c_impl_index);
+        d2c_impl_slots = d2c_impl_slots == 0 ? 64 : 2 * d2c_impl_slots;
+        d2c_impl_index = my_malloc(d2c_impl_slots * sizeof(d2c_impl *));
+        memset(d2c_impl_index, 0, d2c_impl_slots * sizeof(d2c_impl *));
+        d2c_impl_count = 0;
+        for (p = d2c_impl_list->next; p != NULL; p = p->next)
+            d2c_impl_insert(p);
     }
-    return NULL;
+    d2c_impl_insert(d2ci);
+
+    return d2ci;
 }
 
-d2c_impl *d2c_impl_find_or_add(char *name)
+static d2c_impl *d2c_impl_find_or_add(const char *name, size_t len)
 {
-    d2c_impl *p = d2c_impl_find(name);
+    d2c_impl *p = d2c_impl_find(name, len);
     if (p == NULL)
-        p = d2c_impl_add(name);
+        p = d2c_impl_add(name, len);
 
     return p;
 }
@@ -551,7 +858,7 @@ void d2c_dump_impl(FILE *f, char *section, char *name)
     d2c_impl *d2ci;
 
     sprintf(nm, "%s.%s", section, name);
-    d2ci = d2c_impl_find_or_add(nm);
+    d2ci = d2c_impl_find_or_add(nm, strlen(nm));
 
     d2ci->in_class = 1;
 
@@ -570,6 +877,7 @@ void d2c_deprecate_impl(FILE *f, char *comment_start, char *comment_end)
     d2c_impl *p = d2c_impl_list;
     int cnt = 0;
     endless_string_buf *esb;
+    const char *line, *next, *end;
 
     while (p != NULL)
     {
@@ -583,12 +891,17 @@ void d2c_deprecate_impl(FILE *f, char *comment_start, char *comment_end)
                 d2c_fprintf(f, "%s The following code blocks will be deleted the next time code is generated. %s\n\n", comment_start, comment_end);
             }
             d2c_impl_comment(f, p->name, "start", 0, comment_start, comment_end);
-            esb = p->impl->start;
-            while (esb != NULL)
+            for (esb = p->impl->start; esb != NULL; esb = esb->next)
             {
-                /* We do not d2c_fprintf the buffer, cause it's read in indented. */
-                fprintf(f, "// %s", esb->buf);
-                esb = esb->next;
+                end = esb->buf + esb->len;
+                for (line = esb->buf; line < end; line = next)
+                {
+                    next = memchr(line, '\n', end - line);
+                    next = next != NULL ? next + 1 : end;
+                    /* We do not d2c_fprintf the buffer, cause it's read in indented. */
+                    fputs("// ", f);
+                    fwrite(line, 1, next - line, f);
+                }
             }
 
             d2c_impl_comment(f, p->name, "end", 0, comment_start, comment_end);
@@ -600,103 +913,13 @@ void d2c_deprecate_impl(FILE *f, char *comment_start, char *comment_end)
         fprintf(stderr, "Warning: %d implementation blocks have been deprecated; examime source files.\n", cnt);
 }
 
-static char *sscanfmt(int size)
-{
-    static char buf[10];
-    sprintf (buf, " %%%ds", size - 1);
-    return buf;
-}
-
-void d2c_parse_impl(FILE *f, char *cmt_start, char *cmt_end)
-{
-#define IN_SOURCE 0
-#define START_IMPL 1
-#define IN_IMPL 2
-#define END_IMPL 3
-
-#define STATE_WARNING(s) fprintf(stderr, "Warning: line %ld %s, state=%d, %p, %s\n", line, (s), state, d2ci, ((d2ci != NULL) ? d2ci->name : "<no section>"));
-
-    char s[HUGE_BUFFER];
-    char s_comment[LARGE_BUFFER], s_dbl_hash[SMALL_BUFFER], s_implementation[BIG_BUFFER],
-         s_preserve[SMALL_BUFFER], s_marker[SMALL_BUFFER], s_class[LARGE_BUFFER], s_name[LARGE_BUFFER];
-    int state = IN_SOURCE;
-    int count;
-    d2c_impl *d2ci=NULL;
-    endless_string *es=NULL;
-    long line = 0;
-    int preserve=0;
-    char fmtbuf[SMALL_BUFFER];
-
-    d2c_impl_list_destroy();
-
-    while (fgets(s, HUGE_BUFFER - 1, f) != NULL)
-    {
-        line++;
-        if (state == START_IMPL) state = IN_IMPL;
-        if (state == END_IMPL) state = IN_SOURCE;
-	fmtbuf[0] = '\0';
-	strcat (fmtbuf, sscanfmt (sizeof(s_comment)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_dbl_hash)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_implementation)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_preserve)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_marker)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_class)));
-	strcat (fmtbuf, sscanfmt (sizeof(s_name)));
-        count = sscanf(s, fmtbuf,
-                       s_comment, s_dbl_hash, s_implementation, s_preserve, s_marker, s_class, s_name);
-        if (count == 7 &&
-            (strncmp(s_comment, cmt_start, sizeof(s_comment)) == 0) &&
-            (strncmp(s_dbl_hash, "##", sizeof(s_dbl_hash)) == 0) &&
-            (strncmp(s_implementation, IMPLEMENTATION, sizeof(s_implementation)) == 0))
-        {
-            if (strncmp(s_marker, "start", sizeof(s_marker)) == 0)
-            {
-                if (state != IN_SOURCE)
-                {
-                    STATE_WARNING("found a nested implementation comment")
-                }
-                preserve = strcmp(s_preserve, "preserve") ? 0 : 1;
-                state = START_IMPL;
-                d2ci = d2c_impl_find_or_add(s_name);
-                es = d2ci->impl;
-            }
-            else if (strncmp(s_marker, "end", sizeof(s_marker)) == 0)
-            {
-                if (state != IN_IMPL)
-                {
-                    STATE_WARNING("found an end implemenataion comment without matching start")
-                }
-                if (d2ci && strcmp(d2ci->name, s_name) != 0)
-                {
-                    STATE_WARNING("end implementation comment does not match start implementation comment")
-                }
-                state = END_IMPL;
-                d2ci = NULL;
-                es = NULL;
-            }
-            else
-            {
-                STATE_WARNING("unrecognized state marker")
-            }
-        }
-
-        if (state == IN_IMPL && preserve)
-        {
-            append_endless_string(es, s);
-            d2ci->in_source= 1;
-        }
-    }
-    if (state != IN_SOURCE && state != END_IMPL)
-        STATE_WARNING("found start implementation comment without end comment")
-}
-
 /* This function takes a UML Operation and mangles it for implementation comments.
    Because it uses an internal buffer to store and return, repeated calls to this
    function will overwrite previous values.
 */
 char *d2c_operation_mangle_name(umloperation *ope)
 {
-    static char d2c_mangle_name[LARGE_BUFFER];
+    static D2C_TASK_LOCAL char d2c_mangle_name[LARGE_BUFFER];
     umlattrlist params = ope->parameters;
     char *p;
 
@@ -722,7 +945,7 @@ int d2c_backup(char *filename)
      * tag-on four more characters - not DOS-friendly)
      * But I'll admit to being a bit out-of-the loop here.
      */
-    char *backup_filename = my_malloc(strlen(filename) + 4);
+    char *backup_filename = my_malloc(strlen(filename) + 5);
     strcpy(backup_filename, filename);
     strcat(backup_filename, ".bak");
 
@@ -754,8 +977,8 @@ int d2c_backup(char *filename)
 /* Todo on auto-indentation:
    1. Define meta-characters that are converted to braces
 */
-int indent_count = 4;
-int indent_open_brace_on_newline = 1;
+D2C_TASK_LOCAL int indent_count = 4;
+D2C_TASK_LOCAL int indent_open_brace_on_newline = 1;
 
 
 typedef struct
@@ -764,8 +987,8 @@ typedef struct
     int indentation;
 } D2C_INDENT_STRUCT;
 
-D2C_INDENT_STRUCT d2c_files[32];
-int d2c_num_files = 0;
+D2C_TASK_LOCAL D2C_INDENT_STRUCT d2c_files[32];
+D2C_TASK_LOCAL int d2c_num_files = 0;
 
 int d2c_indent_offset(FILE *f)
 {
@@ -805,7 +1028,21 @@ int d2c_fprint_indent(FILE *f)
     return i;
 }
 
-char d2c_io_lchar = 0;
+D2C_TASK_LOCAL char d2c_io_lchar = 0;
+
+/**
+ * Forgets the output state left by the previous file: the output files,
+ * their indentation and the last character written.  Called before
+ * each generation task.
+*/
+void d2c_reset_output_state()
+{
+    spec = body = NULL;
+    indentlevel = 0;
+    d2c_indentposition = 0;
+    d2c_num_files = 0;
+    d2c_io_lchar = 0;
+}
 
 int _d2c_fputc(int c, FILE *f)
 {
@@ -837,26 +1074,39 @@ int _d2c_fputs(const char *s, FILE *f)
 }
 
 
-char d2c_fprintf_buf[HUGE_BUFFER * 2];
+D2C_TASK_LOCAL char d2c_fprintf_buf[HUGE_BUFFER * 2];
 int _d2c_fprintf(FILE *f, char *fmt, ...)
 {
     va_list argptr;
     int cnt;
     int extern_cnt;
     int i;
+    char *buf = d2c_fprintf_buf;
 
     va_start(argptr, fmt);
-    cnt = vsprintf(d2c_fprintf_buf, fmt, argptr);
+    cnt = vsnprintf(buf, sizeof(d2c_fprintf_buf), fmt, argptr);
     va_end(argptr);
+    /* a preserved implementation can be longer than the buffer */
+    if (cnt >= (int) sizeof(d2c_fprintf_buf))
+    {
+        buf = my_malloc(cnt + 1);
+        va_start(argptr, fmt);
+        vsnprintf(buf, cnt + 1, fmt, argptr);
+        va_end(argptr);
+    }
 
     extern_cnt = cnt;
     if (cnt != EOF)
     {
         for (i = 0; i < cnt; i++)
         {
-            extern_cnt += _d2c_fputc(d2c_fprintf_buf[i], f);
+            extern_cnt += _d2c_fputc(buf[i], f);
         }
     }
+    if (buf != d2c_fprintf_buf)
+    {
+        free(buf);
+    }
     return extern_cnt;
 }
 
@@ -24,6 +24,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
 /* for mkdir and mode_t */
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -33,6 +35,7 @@
 #include <libxml/tree.h>
 
 #include "config.h"
+#include "libdia2code.h"
 
 #if DSO == 1 && defined(CODEGEN_USE_DSO)
 #include <dlfcn.h>
@@ -59,6 +62,14 @@
 #define LARGE_BUFFER  4096
 #define HUGE_BUFFER  16384
 
+/* Storage class of the state that belongs to the file being generated:
+   with --jobs, each worker thread has its own copy.  */
+#ifdef __GNUC__
+#define D2C_TASK_LOCAL __thread
+#else
+#define D2C_TASK_LOCAL _Thread_local
+#endif
+
 struct umlattribute {
     char name[SMALL_BUFFER];
     char value[SMALL_BUFFER];
@@ -123,10 +134,20 @@ struct umlpackage {
     char name[SMALL_BUFFER];
     geometry geom;
     struct umlpackage * parent;
-    char *directory;
+    struct umlpackagedir *directories;  /* see create_package_dir() */
 };
 typedef struct umlpackage umlpackage;
 
+/* The directory of a package below one output directory */
+struct umlpackagedir {
+    char *root;             /* batch->outdir that directory is based on */
+    char *directory;
+    unsigned int run;       /* batch->run that last asked for it */
+    int created;            /* if it was created, or found, in that run */
+    struct umlpackagedir *next;
+};
+typedef struct umlpackagedir umlpackagedir;
+
 struct umlpackagenode {
     umlpackage *key;
     struct umlpackagenode * next;
@@ -190,6 +211,18 @@ struct batch {
     namelist sqlopts;       /* SQL options */
     int mask;               /* Flag that inverts the above selection */
     char *license;          /* License file */
+    struct d2c_pipeline *pipeline; /* Set while the classes are being linked,
+                                      see pipeline.c */
+    int incremental;        /* Only the classes of changed get their files
+                               generated, see d2c_generate_classes() */
+    namelist changed;
+    struct d2c_manifest_target *manifest; /* Records the files of the
+                                             classes, see manifest.c */
+    struct d2c_cache_target *cache; /* Where the files of the classes are
+                                       cached, see cache.c */
+    struct source_prescan *sources; /* The existing files of the classes,
+                                       see source_prescan() */
+    unsigned int run;       /* The generation run, see start_package_dirs() */
 };
 typedef struct batch batch;
 
@@ -198,6 +231,7 @@ char *strtolower(char *s);
 char *strtoupperfirst(char *s);
 namelist parse_class_names(const char *s);
 namelist parse_sql_options(const char *s);
+void free_names(namelist list);
 int is_present(namelist list, const char *name);
 namelist find_classes(umlclasslist current_class, batch *b);
 umlclasslist find_by_name(umlclasslist list, const char * name);
@@ -209,23 +243,60 @@ int is_const_stereo (char * stereo);
 
 umlattrlist copy_attributes(umlattrlist src);
 
+#ifdef __GNUC__
+void d2c_exit( int code ) __attribute__ ((noreturn));
+#else
+void d2c_exit( int code );
+#endif
+int d2c_catch( void (*fn) (void *), void *arg );
+
 void * my_malloc( size_t size );
+char * my_strdup( const char *s );
 char * my_strndup(const char *s, size_t n);
+void d2c_put_json( FILE *f, const char *s );
 
 #define NEW(c) ((c*)my_malloc(sizeof(c)))
 
+/* The allocation tags of --mem-report, see memreport.c.  my_malloc()
+   allocates scratch memory. */
+enum {
+    D2C_MEM_CLASS,
+    D2C_MEM_ATTRIBUTE,
+    D2C_MEM_OPERATION,
+    D2C_MEM_PACKAGE,
+    D2C_MEM_DECLARATION,
+    D2C_MEM_NAMELIST,
+    D2C_MEM_SOURCE,
+    D2C_MEM_SCRATCH,
+    D2C_MEM_TAGS
+};
+
+extern int mem_report;          /* Set by switch "--mem-report" */
+
+void * my_malloc_tagged( size_t size, int tag );
+void my_free_tagged( void *ptr, int tag );
+void d2c_mem_alloc (void *ptr, int tag);
+void d2c_mem_free (void *ptr, int tag);
+void d2c_mem_report ();
+
+#define NEW_TAGGED(c, tag) ((c*)my_malloc_tagged(sizeof(c), (tag)))
+
 umlpackagelist make_package_list( umlpackage * package);
 
 umlclasslist list_classes(umlclasslist current_class, batch *b);
 
+void start_package_dirs(batch *batch);
+int make_package_dir(char *dirname, size_t root_len);
 char *create_package_dir(const batch *batch, umlpackage *pkg);
+void create_package_dirs(const batch *batch);
+char *d2c_file_path(const char *dir, const char *name, const char *ext);
 
-extern char *file_ext;       /* Set by switch "-ext". Language specific
-                                default applies when NULL.  */
-extern char *body_file_ext;  /* Set by switch "-bext". Language specific
-                                default applies when NULL.  */
+extern D2C_TASK_LOCAL char *file_ext;       /* Set by switch "-ext". Language
+                                               specific default applies when NULL.  */
+extern D2C_TASK_LOCAL char *body_file_ext;  /* Set by switch "-bext". Language
+                                               specific default applies when NULL.  */
 
-extern int indentlevel;
+extern D2C_TASK_LOCAL int indentlevel;
 void set_number_of_spaces_for_one_indentation(int n);  /* default: 2 spaces */
 char *spc();
 /* Returns a string consisting of (indentlevel *
@@ -238,9 +309,10 @@ int d2c_directprintf(FILE *f, char *fmt, ...);
  * All backends would use `spec', but not all backends require `body'.
  * Hence not all backends need the {e,p}{body,both} functions below.
 */
-extern FILE *spec, *body;
+extern D2C_TASK_LOCAL FILE *spec, *body;
 
-extern int d2c_indentposition;
+extern D2C_TASK_LOCAL int d2c_indentposition;
+void d2c_reset_output_state();
 
 void dia2code_initializations();
 
@@ -258,6 +330,273 @@ void pboth (char *msg, ...);  /* print with leading indentation to both */
 */
 FILE * open_outfile (char *filename, batch *b);
 
+/**
+ * d2c_outfile_open() opens a generated file given by its full path, with
+ * fopen() modes "w" or "a", and returns NULL if that fails.  Files opened
+ * by it or by open_outfile() must be closed with d2c_outfile_close().
+ * With output_ifchanged set, the content is produced in memory and the
+ * file is only rewritten when it differs, which preserves its mtime.
+ * With output_atomic set, files are written to a temporary file in the
+ * same directory and renamed over the final name when closed.  With
+ * output_async set, closed files are written by a background thread.
+*/
+FILE * d2c_outfile_open (char *filename, char *mode);
+void d2c_outfile_close (FILE *f);
+int d2c_outfile_set_fsync (char *level);
+int d2c_outfile_mkdir (char *dirname, mode_t mode);
+int d2c_outfile_link (const char *source, char *filename);
+void d2c_outfile_finish ();
+/* d2c_outfile_collect(&files) makes the calling thread keep the files it
+   closes in files instead of writing them, until it is called with NULL;
+   d2c_outfile_commit(files) then writes them, or adds them to the files
+   of the calling thread if it collects too.  See d2c_run_tasks().  */
+void d2c_outfile_collect (void **files);
+void d2c_outfile_commit (void *files);
+void d2c_outfile_discard ();
+
+/* The output sinks are declared in libdia2code.h */
+
+extern d2c_sink *output_sink;  /* Set by switch "--tar" */
+/* d2c_outfile_use_sink(sink) makes the calling thread, and the tasks it
+   runs, write to sink instead of output_sink, until called with NULL */
+void d2c_outfile_use_sink (d2c_sink *sink);
+d2c_sink * d2c_outfile_sink ();
+
+/* Durability of atomic writes */
+#define D2C_FSYNC_NONE  0   /* rely on the operating system */
+#define D2C_FSYNC_DIR   1   /* one fsync per output directory and run */
+#define D2C_FSYNC_FILE  2   /* fsync every file, then its directory */
+
+extern int output_ifchanged;  /* Set by switch "--if-changed" */
+extern int output_atomic;     /* Set by switch "--atomic" */
+extern int output_fsync;      /* Set by switch "--fsync" */
+extern int output_async;      /* Set by switch "--async-write" */
+extern int output_uring;      /* Set by switch "--io-uring" */
+
+int d2c_uring_init ();
+int d2c_uring_write (const char *filename, const char *buf, size_t len);
+int d2c_uring_flush ();
+
+/* Comment styles of the license header */
+#define D2C_COMMENT_BLOCK    0   /* C, C++, Java, C#, IDL, PHP, AS3 */
+#define D2C_COMMENT_SLASHES  1   /* C++ style line comments */
+#define D2C_COMMENT_DASHES   2   /* Ada, SQL */
+#define D2C_COMMENT_HASH     3   /* Python, Ruby */
+#define D2C_COMMENT_STYLES   4
+
+/**
+ * Generation tasks, one per generated file (or per group of files that
+ * belong together).  With generate_jobs > 1 they run on that many worker
+ * threads, each file being produced in memory; the files are then
+ * written in task order, so the output does not depend on the number of
+ * jobs.  Tasks open their files in "w" mode only.
+*/
+typedef void (*d2c_task_fn) (batch *b, void *item);
+
+extern int generate_jobs;     /* Set by switch "--jobs" */
+
+void d2c_run_tasks (batch *b, d2c_task_fn fn, void **items, int count);
+void d2c_generate_classes (batch *b, d2c_task_fn fn);
+int d2c_default_jobs ();
+
+/**
+ * What a generator sets up once for all the files of its target.  It is
+ * thread local, so that several targets can be generated at the same
+ * time, and the tasks inherit it from the thread that runs them.
+*/
+struct d2c_genstate {
+    char *file_ext;
+    char *body_file_ext;
+    int indent_spaces;
+    struct declaration *decls;
+    namelist decl_classes;
+    int use_corba;
+    int indent_count;
+    int indent_open_brace_on_newline;
+    d2c_sink *sink;         /* see d2c_outfile_use_sink() */
+    int stats_generator;    /* see d2c_stats_generator() */
+};
+typedef struct d2c_genstate d2c_genstate;
+
+void d2c_genstate_save (d2c_genstate *state);
+void d2c_genstate_restore (const d2c_genstate *state);
+
+/* The languages of "-t", see d2c_find_generator() */
+struct d2c_generator {
+    char *name;
+    void (*generator) (batch *);
+    int buildtree;          /* The generator supports --buildtree */
+    int pipeline;           /* The generator supports --pipeline */
+};
+typedef struct d2c_generator d2c_generator;
+
+extern const d2c_generator d2c_generators[];
+const d2c_generator *d2c_find_generator (const char *name);
+
+/* A language selected with "-t", and the batch it is generated from */
+struct d2c_target {
+    char *name;
+    void (*generator) (batch *);
+    int buildtree;          /* The generator supports --buildtree */
+    int pipeline;           /* The generator supports --pipeline */
+    batch b;
+};
+typedef struct d2c_target d2c_target;
+
+void d2c_generate_targets (d2c_target *targets, int count);
+void d2c_run_jobs (d2c_task_fn fn, void **items, int count, int jobs);
+
+/* Linking the classes while they are generated, see pipeline.c */
+typedef struct d2c_pipeline d2c_pipeline;
+struct umlrelation;           /* see parse_diagram.h */
+
+extern int generate_pipeline; /* Set by switch "--pipeline" */
+
+d2c_pipeline *d2c_pipeline_start (umlclasslist classlist, struct umlrelation *relations);
+void d2c_pipeline_wait (d2c_pipeline *p, int pos);
+void d2c_pipeline_finish (d2c_pipeline *p);
+
+/* The resident server of --serve and its model cache, see server.c */
+typedef struct d2c_model d2c_model;
+typedef int (*d2c_request_fn) (char *request);
+
+extern long serve_cache_size; /* Set by switch "--cache-size" */
+
+int d2c_serve (const char *path, d2c_request_fn handler);
+int d2c_client (const char *path, const char *request);
+d2c_model *d2c_model_get (char *diagram);
+umlclasslist d2c_model_classes (d2c_model *model);
+void d2c_model_release (d2c_model *model);
+
+/* Generating again what changed, see fingerprint.c and watch.c */
+typedef struct d2c_fingerprints d2c_fingerprints;
+struct timespec;
+typedef void (*d2c_watch_fn) (int changed, const struct timespec *saved);
+
+d2c_fingerprints *d2c_fingerprint_classes (umlclasslist classlist);
+void d2c_fingerprints_free (d2c_fingerprints *f);
+uint64_t d2c_fingerprint (d2c_fingerprints *f, const char *name);
+namelist d2c_changed_classes (umlclasslist classlist, d2c_fingerprints *now,
+                              d2c_fingerprints *before, int *count);
+int d2c_watch (char **files, int count, d2c_watch_fn cycle);
+
+#define D2C_HASH_INIT 14695981039346656037ULL
+uint64_t d2c_hash_bytes (uint64_t h, const void *buf, size_t len);
+uint64_t d2c_hash_string (uint64_t h, const char *s);
+
+/* The manifest of --incremental, see manifest.c */
+typedef struct d2c_manifest d2c_manifest;
+typedef struct d2c_manifest_target d2c_manifest_target;
+
+extern int generate_incremental;    /* Set by switch "--incremental" */
+
+d2c_manifest *d2c_manifest_read (const char *outdir);
+d2c_manifest_target *d2c_manifest_use (d2c_manifest *m, const char *target,
+                                       uint64_t options, d2c_fingerprints *fingerprints);
+namelist d2c_manifest_changed (d2c_manifest_target *t, umlclasslist classlist, int *count);
+void d2c_manifest_begin (d2c_manifest_target *t, const char *classname);
+void d2c_manifest_file (const char *filename);
+void d2c_manifest_end ();
+int d2c_manifest_write (d2c_manifest *m);
+uint64_t d2c_options_hash (const batch *b, const char *target);
+
+/* The content-addressed cache of --output-cache, see cache.c */
+typedef struct d2c_cache d2c_cache;
+typedef struct d2c_cache_target d2c_cache_target;
+
+extern char *output_cache;          /* Set by switch "--output-cache" */
+extern long output_cache_size;      /* Set by switch "--output-cache-size" */
+extern int output_cache_link;       /* Set by switch "--output-cache-link" */
+
+d2c_cache *d2c_cache_open (const char *dir);
+d2c_cache_target *d2c_cache_use (d2c_cache *c, const char *target, uint64_t options,
+                                 d2c_fingerprints *fingerprints, const char *outdir);
+int d2c_cache_restore (d2c_cache_target *t, const char *classname);
+void d2c_cache_begin (d2c_cache_target *t, const char *classname);
+int d2c_cache_file (const char *filename);
+void d2c_cache_content (const char *filename, const char *buf, size_t len);
+void d2c_cache_end ();
+void d2c_cache_close (d2c_cache *c);
+
+/* The files read and generated, for --depfile and --manifest, see deps.c */
+extern char *deps_file;             /* Set by switch "--depfile" */
+extern char *deps_manifest;         /* Set by switch "--manifest" */
+
+void d2c_deps_input (const char *filename);
+void d2c_deps_output (const char *filename);
+int d2c_deps_write (const char *target);
+
+/* The preservation index of --preserve-index, see preserve.c */
+extern int preserve_index;          /* Set by switch "--preserve-index" */
+
+void d2c_preserve_index_open (const char *outdir);
+void d2c_preserve_index_close ();
+
+/* The phase timings and counters of --stats, see stats.c */
+#define D2C_STATS_NONE 0
+#define D2C_STATS_TEXT 1
+#define D2C_STATS_JSON 2
+
+extern int generate_stats;          /* Set by switch "--stats" */
+
+enum {
+    D2C_PHASE_XML,
+    D2C_PHASE_CLASSES,
+    D2C_PHASE_RELATIONS,
+    D2C_PHASE_GENERALIZATIONS,
+    D2C_PHASE_PACKAGES,
+    D2C_PHASE_LINK,
+    D2C_PHASE_DECLS,
+    D2C_PHASE_IO,
+    D2C_PHASES
+};
+
+enum {
+    D2C_COUNT_OBJECTS,
+    D2C_COUNT_CLASSES,
+    D2C_COUNT_ATTRIBUTES,
+    D2C_COUNT_OPERATIONS,
+    D2C_COUNT_EDGES,
+    D2C_COUNT_FIND_BY_NAME,
+    D2C_COUNT_FILES,
+    D2C_COUNT_BYTES,
+    D2C_COUNTERS
+};
+
+struct d2c_clock {
+    struct timespec wall;
+    struct timespec cpu;
+};
+typedef struct d2c_clock d2c_clock;
+
+void d2c_stats_start (d2c_clock *start);
+void d2c_stats_stop (int phase, d2c_clock *start);
+void d2c_stats_stop_at (int phase, d2c_clock *start, const char *classname,
+                        const char *path);
+void d2c_stats_add (int counter, long long n);
+int d2c_stats_generator_start (const char *name, d2c_clock *start);
+void d2c_stats_generator_stop (int previous, d2c_clock *start);
+void d2c_stats_task (d2c_clock *start);
+int d2c_stats_generator ();
+void d2c_stats_use_generator (int generator);
+void d2c_stats_report (d2c_clock *start);
+
+#define d2c_count(counter, n) \
+    (generate_stats != D2C_STATS_NONE ? d2c_stats_add((counter), (n)) : (void) 0)
+
+/* The trace events of --trace, see trace.c */
+extern char *trace_file;            /* Set by switch "--trace" */
+
+void d2c_trace_open ();
+void d2c_trace_start (d2c_clock *start);
+void d2c_trace_end (const d2c_clock *start, const char *name, const char *category,
+                    const char *classname, const char *path);
+int d2c_trace_write ();
+
+int d2c_license_load(const char *filename);
+void d2c_license_write(FILE *f, const char *filename, int style);
+void d2c_license_forget(const char *filename);
+
 #define NEW_AUTO_INDENT 1
 #ifdef NEW_AUTO_INDENT
 #define d2c_fprintf _d2c_fprintf
@@ -277,7 +616,6 @@ int _d2c_fprintf(FILE *f, char *fmt, ...);
 /* void d2c_set_braces(char *open, char *close); */
 void d2c_open_brace(FILE *outfile, char *suffix);
 void d2c_close_brace(FILE *outfile, char *suffix);
-void d2c_parse_impl(FILE *f, char *cmt_start, char *cmt_end);
 void d2c_dump_impl(FILE *f, char *section, char *name);
 void d2c_deprecate_impl(FILE *f, char *comment_start, char *comment_end);
 char *d2c_operation_mangle_name(umloperation *op);
@@ -309,8 +647,10 @@ param_list * d2c_parameter_set(char *name, char *value);
 char * d2c_parameter_value(char *name);
 param_list *d2c_parameter_find(char *name);
 
-int indent_count;
-int indent_open_brace_on_newline;
-int generate_backup;
+extern param_list *d2c_parameters;
+
+extern D2C_TASK_LOCAL int indent_count;                  /* Set by "indent.size" */
+extern D2C_TASK_LOCAL int indent_open_brace_on_newline;  /* Set by "indent.brace.newline" */
+extern int generate_backup;                              /* Set by "generate.backup" */
 
 #endif
@@ -0,0 +1,299 @@
+/***************************************************************************
+                          fingerprint.c  -  What changed between two parses
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * The fingerprint of a class is a hash of what the generators read from
+ * it: its name, stereotype, comment and package path, its attributes,
+ * operations and templates, and the names of the classes it inherits
+ * from, depends on and is associated with.  The Dia ids and the
+ * geometry are left out, so moving a class around in the diagram
+ * changes nothing.
+ *
+ * The generators also read the name, stereotype and package of the
+ * classes that a class uses (as found by list_classes()), so the
+ * fingerprint of the class combines its own hash with those of the
+ * classes it uses, Merkle-style; one level is enough, since nothing of
+ * the classes they use in turn is read, and it also holds for classes
+ * that use each other.  A class whose fingerprint is unchanged has the
+ * same files as before, and a class added or removed changes the
+ * fingerprints of those that use it.
+ */
+
+#include "dia2code.h"
+
+struct class_fingerprint {
+    char *name;
+    uint64_t own;            /* see class_hash() */
+    uint64_t hash;           /* combined with those of the classes used */
+    int pos;                 /* in the diagram */
+};
+
+struct d2c_fingerprints {
+    int count;
+    struct class_fingerprint *classes;   /* sorted by name */
+};
+
+/**
+ * Adds the len bytes of buf to the FNV-1a hash h, which starts at
+ * D2C_HASH_INIT.
+*/
+uint64_t d2c_hash_bytes (uint64_t h, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+
+    while (len-- > 0) {
+        h = (h ^ *p++) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Adds the string s to the hash h, its terminating '\0' included so
+ * that "ab","c" differs from "a","bc".
+*/
+uint64_t d2c_hash_string (uint64_t h, const char *s)
+{
+    return d2c_hash_bytes(h, s, strlen(s) + 1);
+}
+
+static uint64_t hash_char(uint64_t h, int c)
+{
+    return (h ^ (unsigned char) c) * 1099511628211ULL;
+}
+
+static uint64_t hash_number(uint64_t h, uint64_t n)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h = hash_char(h, (int) (n >> (8 * i)));
+    }
+    return h;
+}
+
+static uint64_t hash_attribute(uint64_t h, const umlattribute *a)
+{
+    h = d2c_hash_string(h, a->name);
+    h = d2c_hash_string(h, a->value);
+    h = d2c_hash_string(h, a->type);
+    h = d2c_hash_string(h, a->comment);
+    h = hash_char(h, a->visibility);
+    h = hash_char(h, a->isabstract);
+    h = hash_char(h, a->isstatic);
+    h = hash_char(h, a->isconstant);
+    return hash_char(h, a->kind);
+}
+
+/* the hash of the class alone */
+static uint64_t class_hash(umlclasslist node)
+{
+    umlclass *c = node->key;
+    uint64_t h = D2C_HASH_INIT;
+    umlpackage *pkg;
+    umlattrlist a;
+    umloplist op;
+    umltemplatelist t;
+    umlclasslist n;
+    umlassoclist assoc;
+
+    h = d2c_hash_string(h, c->name);
+    h = d2c_hash_string(h, c->stereotype);
+    h = d2c_hash_string(h, c->comment);
+    h = hash_char(h, c->isabstract);
+    for (pkg = c->package; pkg != NULL; pkg = pkg->parent) {
+        h = d2c_hash_string(h, pkg->name);
+    }
+    h = hash_char(h, 'a');
+    for (a = c->attributes; a != NULL; a = a->next) {
+        h = hash_attribute(h, &a->key);
+    }
+    h = hash_char(h, 'o');
+    for (op = c->operations; op != NULL; op = op->next) {
+        h = hash_attribute(h, &op->key.attr);
+        for (a = op->key.parameters; a != NULL; a = a->next) {
+            h = hash_attribute(h, &a->key);
+        }
+        h = hash_char(h, ')');
+    }
+    h = hash_char(h, 't');
+    for (t = c->templates; t != NULL; t = t->next) {
+        h = d2c_hash_string(h, t->key.name);
+        h = d2c_hash_string(h, t->key.type);
+    }
+    h = hash_char(h, 'p');
+    for (n = node->parents; n != NULL; n = n->next) {
+        h = d2c_hash_string(h, n->key->name);
+    }
+    h = hash_char(h, 'd');
+    for (n = node->dependencies; n != NULL; n = n->next) {
+        h = d2c_hash_string(h, n->key->name);
+    }
+    h = hash_char(h, 's');
+    for (assoc = node->associations; assoc != NULL; assoc = assoc->next) {
+        h = d2c_hash_string(h, assoc->key->name);
+        h = d2c_hash_string(h, assoc->name);
+        h = hash_char(h, assoc->composite);
+        h = d2c_hash_string(h, assoc->multiplicity);
+    }
+    return h;
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(((const struct class_fingerprint *) a)->name,
+                  ((const struct class_fingerprint *) b)->name);
+}
+
+static struct class_fingerprint *find_fingerprint(d2c_fingerprints *f, const char *name)
+{
+    struct class_fingerprint key;
+
+    if (f == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    key.name = (char *) name;
+    return bsearch(&key, f->classes, f->count, sizeof(key), by_name);
+}
+
+/* adds to h the own hash of the class of that name, if there is one */
+static uint64_t hash_used(uint64_t h, d2c_fingerprints *f, const char *name)
+{
+    struct class_fingerprint *c = find_fingerprint(f, name);
+
+    if (c == NULL) {
+        return h;
+    }
+    h = d2c_hash_string(h, c->name);
+    return hash_number(h, c->own);
+}
+
+/* combines the own hash of node with those of the classes it uses, in
+   the order of list_classes() */
+static uint64_t combined_hash(umlclasslist node, uint64_t own, d2c_fingerprints *f)
+{
+    uint64_t h = own;
+    umlattrlist a;
+    umloplist op;
+    umlclasslist n;
+    umlassoclist assoc;
+
+    for (a = node->key->attributes; a != NULL; a = a->next) {
+        h = hash_used(h, f, a->key.type);
+    }
+    for (op = node->key->operations; op != NULL; op = op->next) {
+        h = hash_used(h, f, op->key.attr.type);
+        for (a = op->key.parameters; a != NULL; a = a->next) {
+            h = hash_used(h, f, a->key.type);
+        }
+    }
+    for (n = node->parents; n != NULL; n = n->next) {
+        h = hash_used(h, f, n->key->name);
+    }
+    for (n = node->dependencies; n != NULL; n = n->next) {
+        h = hash_used(h, f, n->key->name);
+    }
+    for (assoc = node->associations; assoc != NULL; assoc = assoc->next) {
+        h = hash_used(h, f, assoc->key->name);
+    }
+    return h;
+}
+
+/**
+ * Returns the fingerprints of the classes of classlist, to be freed with
+ * d2c_fingerprints_free().
+*/
+d2c_fingerprints * d2c_fingerprint_classes (umlclasslist classlist)
+{
+    d2c_fingerprints *f = NEW (d2c_fingerprints);
+    struct class_fingerprint **order;
+    umlclasslist node;
+    int i = 0;
+
+    f->count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        f->count++;
+    }
+    f->classes = my_malloc((f->count + 1) * sizeof(struct class_fingerprint));
+    order = my_malloc((f->count + 1) * sizeof(struct class_fingerprint *));
+    for (node = classlist; node != NULL; node = node->next, i++) {
+        f->classes[i].name = node->key->name;
+        f->classes[i].own = class_hash(node);
+        f->classes[i].pos = i;
+    }
+    qsort(f->classes, f->count, sizeof(struct class_fingerprint), by_name);
+    for (i = 0; i < f->count; i++) {
+        order[f->classes[i].pos] = &f->classes[i];
+    }
+    for (node = classlist, i = 0; node != NULL; node = node->next, i++) {
+        order[i]->hash = combined_hash(node, order[i]->own, f);
+    }
+    free(order);
+    /* the names outlive the diagram, which is freed first */
+    for (i = 0; i < f->count; i++) {
+        f->classes[i].name = my_strdup(f->classes[i].name);
+    }
+    return f;
+}
+
+void d2c_fingerprints_free (d2c_fingerprints *f)
+{
+    int i;
+
+    if (f == NULL) {
+        return;
+    }
+    for (i = 0; i < f->count; i++) {
+        free(f->classes[i].name);
+    }
+    free(f->classes);
+    free(f);
+}
+
+/**
+ * Returns the fingerprint of the class of that name, 0 if f has none.
+*/
+uint64_t d2c_fingerprint (d2c_fingerprints *f, const char *name)
+{
+    struct class_fingerprint *c = find_fingerprint(f, name);
+
+    return c != NULL ? c->hash : 0;
+}
+
+/**
+ * Returns the names of the classes of classlist that must be generated
+ * again since the diagram had the fingerprints before, in the order of
+ * the diagram; now holds the fingerprints of classlist.  *count is set
+ * to their number.
+*/
+namelist d2c_changed_classes (umlclasslist classlist, d2c_fingerprints *now,
+                              d2c_fingerprints *before, int *count)
+{
+    umlclasslist node;
+    namelist result = NULL, *last = &result;
+    struct class_fingerprint *old;
+
+    *count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        old = find_fingerprint(before, node->key->name);
+        if (old == NULL || old->hash != d2c_fingerprint(now, node->key->name)) {
+            *last = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+            (*last)->name = strdup(node->key->name);
+            (*last)->next = NULL;
+            last = &(*last)->next;
+            (*count)++;
+        }
+    }
+    return result;
+}
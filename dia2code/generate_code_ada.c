@@ -29,7 +29,7 @@ int use_convention_c = 0;  /* Temporarily here. */
 int strict_corba = 0;      /* Should be turned into command line options.  */
 
 
-static batch *gb;   /* The current batch being processed.  */
+static D2C_TASK_LOCAL batch *gb;   /* The current batch being processed.  */
 
 /* Utilities.  */
 
@@ -94,7 +94,7 @@ has_oo_class (declaration *d)
 static char *
 adaname (char *name)
 {
-    static char buf[SMALL_BUFFER];
+    static D2C_TASK_LOCAL char buf[SMALL_BUFFER];
     if (use_corba &&
         (eq (name, "boolean") ||
          eq (name, "char") ||
@@ -180,7 +180,7 @@ do_operations (char *typename, umloplist umlo, int in_valuetype)
 static char *
 fqname (umlclassnode *node, int use_ref_type)
 {
-    static char buf[BIG_BUFFER];
+    static D2C_TASK_LOCAL char buf[BIG_BUFFER];
 
     buf[0] = '\0';
     if (node == NULL)
@@ -447,7 +447,7 @@ gen_decl (declaration *d)
     } else if (is_const_stereo (stype)) {
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute not set at %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (umla->key.name) > 0)
             fprintf (stderr, "Warning: ignoring attribute name at %s\n", name);
@@ -509,7 +509,7 @@ gen_decl (declaration *d)
         char swname[SMALL_BUFFER];
         if (sw == NULL) {
             fprintf (stderr, "Error: attributes not set at union %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (sw->key.name) == 0)
             sprintf (swname, "Switch");
@@ -548,7 +548,7 @@ gen_decl (declaration *d)
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute (impl type) not set "
                              "at typedef %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (umla->key.name) > 0)  {
             fprintf (stderr, "Warning: typedef %s: ignoring name field "
@@ -590,7 +590,7 @@ gen_decl (declaration *d)
 static char *
 make_filename (char *name, int do_body)
 {
-    static char outfname[BIG_BUFFER];
+    static D2C_TASK_LOCAL char outfname[BIG_BUFFER];
     char *filebase = strtolower (name);
 
     subst (filebase, '.', '-');
@@ -602,12 +602,80 @@ make_filename (char *name, int do_body)
 }
 
 
+/* Generates the files of the outer declaration d, a generation task.  */
+static void
+generate_decl (batch *b, void *item)
+{
+    declaration *d = item;
+    char *name, basename[BIG_BUFFER];
+    int synthesize_package = 0;
+    int need_body = 0;
+
+    gb = b;
+    if (d->decl_kind == dk_module) {
+        name = d->u.this_module->pkg->name;
+        strcpy (basename, name);
+        need_body = has_oo_class (d->u.this_module->contents);
+    } else {         /* dk_class */
+        name = d->u.this_class->key->name;
+        strcpy (basename, name);
+        if (is_oo_class (d->u.this_class->key)) {
+            need_body = 1;
+        } else {
+            strcat (basename, PACKAGE_EXT);
+            synthesize_package = 1;
+        }
+    }
+
+    spec = open_outfile (make_filename (basename, 0), b);
+    if (spec == NULL) {
+        return;
+    }
+
+    /* add license to the header */
+    d2c_license_write (spec, b->license, D2C_COMMENT_DASHES);
+
+    includes = NULL;
+    determine_includes (d, b);
+    if (use_corba)
+        print ("with CORBA.Value;\n\n");
+    if (includes) {
+        namelist incfile = includes;
+        while (incfile != NULL) {
+            if (!eq (incfile->name, name)) {
+                print ("with %s;\n", incfile->name);
+            }
+            incfile = incfile->next;
+        }
+        print ("\n");
+    }
+
+    if (synthesize_package) {
+        emit ("package %s is\n\n", basename);
+        indentlevel++;
+    } else if (need_body) {
+        body = open_outfile (make_filename (basename, 1), b);
+    } else {
+        body = NULL;
+    }
+
+    gen_decl (d);
+
+    if (synthesize_package) {
+        indentlevel--;
+        emit ("end %s;\n\n", basename);
+    } else if (body != NULL) {
+        d2c_outfile_close (body);
+        body = NULL;
+    }
+
+    d2c_outfile_close (spec);
+}
+
 void
 generate_code_ada (batch *b)
 {
-    declaration *d;
     umlclasslist tmplist = b->classlist;
-    FILE *licensefile = NULL;
 
     gb = b;
 
@@ -616,13 +684,10 @@ generate_code_ada (batch *b)
     if (body_file_ext == NULL)
         body_file_ext = BODY_EXT;
 
-    /* open license file */
-    if (b->license != NULL) {
-        licensefile = fopen (b->license, "r");
-        if (!licensefile) {
-            fprintf (stderr, "Can't open the license file.\n");
-            exit (1);
-        }
+    /* load the license file */
+    if (b->license != NULL && d2c_license_load (b->license) != 0) {
+        fprintf (stderr, "Can't open the license file.\n");
+        d2c_exit (1);
     }
 
     while (tmplist != NULL) {
@@ -635,78 +700,5 @@ generate_code_ada (batch *b)
     set_number_of_spaces_for_one_indentation (3);
 
     /* Generate a file for each outer declaration.  */
-    d = decls;
-    while (d != NULL) {
-        char *name, basename[BIG_BUFFER];
-        int synthesize_package = 0;
-        int need_body = 0;
-
-        if (d->decl_kind == dk_module) {
-            name = d->u.this_module->pkg->name;
-            strcpy (basename, name);
-            need_body = has_oo_class (d->u.this_module->contents);
-        } else {         /* dk_class */
-            name = d->u.this_class->key->name;
-            strcpy (basename, name);
-            if (is_oo_class (d->u.this_class->key)) {
-                need_body = 1;
-            } else {
-                strcat (basename, PACKAGE_EXT);
-                synthesize_package = 1;
-            }
-        }
-
-        spec = open_outfile (make_filename (basename, 0), b);
-        if (spec == NULL) {
-            d = d->next;
-            continue;
-        }
-
-        /* add license to the header */
-        if (b->license != NULL) {
-            int lc;
-            rewind (licensefile);
-            while ((lc = fgetc (licensefile)) != EOF)
-                print ("%c", (char) lc);
-        }
-
-        includes = NULL;
-        determine_includes (d, b);
-        if (use_corba)
-            print ("with CORBA.Value;\n\n");
-        if (includes) {
-            namelist incfile = includes;
-            while (incfile != NULL) {
-                if (!eq (incfile->name, name)) {
-                    print ("with %s;\n", incfile->name);
-                }
-                incfile = incfile->next;
-            }
-            print ("\n");
-        }
-
-        if (synthesize_package) {
-            emit ("package %s is\n\n", basename);
-            indentlevel++;
-        } else if (need_body) {
-            body = open_outfile (make_filename (basename, 1), b);
-        } else {
-            body = NULL;
-        }
-
-        gen_decl (d);
-
-        if (synthesize_package) {
-            indentlevel--;
-            emit ("end %s;\n\n", basename);
-        } else if (body != NULL) {
-            fclose (body);
-            body = NULL;
-        }
-
-        fclose (spec);
-
-        d = d->next;
-    }
+    d2c_generate_decls (b, generate_decl);
 }
-
@@ -147,9 +147,9 @@ int as3_generate_operation( FILE * outfile, umloperation *ope, int classtype )
         d2c_fprintf(outfile, ";\n");
     }
     else {
-        if ( ope->implementation != NULL ) {
+        if ( source_implementation(ope) != NULL ) {
             debug( DBG_GENCODE, "implementation found" );
-            d2c_fprintf(outfile, " {%s}", ope->implementation);
+            d2c_fprintf(outfile, " {%s}", source_implementation(ope));
         }
         else {
             d2c_fprintf(outfile, " {\n");
@@ -160,219 +160,200 @@ int as3_generate_operation( FILE * outfile, umloperation *ope, int classtype )
     return 0;
 }
 
-void generate_code_as3(batch *b)
+/* Generates the file of the class tmplist, a generation task.  */
+static void generate_class(batch *b, void *item)
 {
-    umlclasslist tmplist;
+    umlclasslist tmplist = item;
     umlassoclist associations;
     umlattrlist umla;
     umlpackagelist tmppcklist;
     umloplist umlo;
     char *tmpname;
-    char outfilename[BIG_BUFFER];
-    FILE * outfile, *licensefile = NULL;
+    char *outfilename;
+    FILE * outfile;
     umlclasslist used_classes;
     umlclass *class_;
     int classtype;
     sourcecode *source = NULL;
-    int tmpdirlgth, tmpfilelgth;
 
-    if (b->outdir == NULL)
-        b->outdir = ".";
+    class_ = tmplist->key;
+    tmpname = class_->name;
 
-    tmpdirlgth = strlen(b->outdir);
 
-    tmplist = b->classlist;
+    tmppcklist = make_package_list(tmplist->key->package);
 
-    /* open license file */
-    if ( b->license != NULL )
-    {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile)
-        {
-            fprintf(stderr, "Can't open the license file.\n");
-            exit(2);
-        }
+    if (tmppcklist) {
+        /* here we  calculate and create the directory if necessary */
+        char *outdir = create_package_dir( b, tmppcklist->key );
+        outfilename = d2c_file_path(outdir, tmplist->key->name, ".as");
+    } else {
+        outfilename = d2c_file_path(NULL, tmplist->key->name, ".as");
     }
 
-    while ( tmplist != NULL )
-    {
-        class_ = tmplist->key;
-        if ( is_present(b->classes, class_->name) ^ b->mask ) {
-            tmplist = tmplist->next;
-            continue;
-        }
-        tmpname = class_->name;
+    /* get implementation code from the existing file */
+    source_preserve( b, tmplist->key, outfilename, source );
 
-        /* This prevents buffer overflows */
-        tmpfilelgth = strlen(tmpname);
-        if (tmpfilelgth + tmpdirlgth > sizeof(outfilename) - 2)
+    if ( b->clobber )
+    {
+        outfile = d2c_outfile_open(outfilename, "w");
+        if ( outfile == NULL )
         {
-            fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-            exit(4);
+            fprintf(stderr, "Can't open file %s for writing\n", outfilename);
+            d2c_exit(3);
         }
 
-        tmppcklist = make_package_list(tmplist->key->package);
+        /* add license to the header */
+        d2c_license_write(outfile, b->license, D2C_COMMENT_BLOCK);
 
-        if (tmppcklist) {
-            /* here we  calculate and create the directory if necessary */
-            char *outdir = create_package_dir( b, tmppcklist->key );
-            sprintf(outfilename, "%s/%s.as", outdir, tmplist->key->name);
+        tmppcklist = make_package_list(class_->package);
+        if ( tmppcklist != NULL ){
+            d2c_fprintf(outfile, "package %s", tmppcklist->key->name);
+            d2c_open_brace(outfile, "");
+            d2c_shift_code();
+            tmppcklist = tmppcklist->next;
+            while ( tmppcklist != NULL )
+            {
+                d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
+                tmppcklist = tmppcklist->next;
+            }
+            /* d2c_fputs(";\n\n", outfile); */
         } else {
-            sprintf(outfilename, "%s.as", tmplist->key->name);
+            d2c_fprintf(outfile, "package ");
+            d2c_open_brace(outfile, "");
+            d2c_shift_code();
         }
 
-        /* get implementation code from the existing file */
-        source_preserve( b, tmplist->key, outfilename, source );
-
-        if ( b->clobber )
+        /* We generate the import clauses */
+        used_classes = list_classes(tmplist, b);
+        while (used_classes != NULL)
         {
-            outfile = fopen(outfilename, "w");
-            if ( outfile == NULL )
+            tmppcklist = make_package_list(used_classes->key->package);
+            if ( tmppcklist != NULL )
             {
-                fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-                exit(3);
-            }
-
-            /* add license to the header */
-            if (b->license != NULL)
-            {
-                int lc;
-                rewind(licensefile);
-                while ((lc = fgetc(licensefile)) != EOF)
-                    d2c_fputc( (char) lc, outfile);
-            }
-
-            tmppcklist = make_package_list(class_->package);
-            if ( tmppcklist != NULL ){
-                d2c_fprintf(outfile, "package %s", tmppcklist->key->name);
-                d2c_open_brace(outfile, "");
-                d2c_shift_code();
-                tmppcklist = tmppcklist->next;
-                while ( tmppcklist != NULL )
+                if (strcmp(tmppcklist->key->id, class_->package->id))
                 {
-                    d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
+                    /* This class' package and our current class' package are
+                       not the same */
+                    d2c_fprintf(outfile, "import %s", tmppcklist->key->name);
                     tmppcklist = tmppcklist->next;
-                }
-                /* d2c_fputs(";\n\n", outfile); */
-            } else {
-                d2c_fprintf(outfile, "package ");
-                d2c_open_brace(outfile, "");
-                d2c_shift_code();
-            }
-
-            /* We generate the import clauses */
-            used_classes = list_classes(tmplist, b);
-            while (used_classes != NULL)
-            {
-                tmppcklist = make_package_list(used_classes->key->package);
-                if ( tmppcklist != NULL )
-                {
-                    if (strcmp(tmppcklist->key->id, class_->package->id))
+                    while ( tmppcklist != NULL )
                     {
-                        /* This class' package and our current class' package are
-                           not the same */
-                        d2c_fprintf(outfile, "import %s", tmppcklist->key->name);
+                        d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
                         tmppcklist = tmppcklist->next;
-                        while ( tmppcklist != NULL )
-                        {
-                            d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
-                            tmppcklist = tmppcklist->next;
-                        }
-                        d2c_fprintf(outfile, ".%s;\n", used_classes->key->name);
                     }
+                    d2c_fprintf(outfile, ".%s;\n", used_classes->key->name);
                 }
-                else
-                {
-                    /* No info for this class' package, we include it directly */
-                    d2c_fprintf(outfile, "import %s;\n", used_classes->key->name);
-                }
-                used_classes = used_classes->next;
             }
+            else
+            {
+                /* No info for this class' package, we include it directly */
+                d2c_fprintf(outfile, "import %s;\n", used_classes->key->name);
+            }
+            used_classes = used_classes->next;
+        }
 
-            d2c_fprintf(outfile, "\npublic ");
+        d2c_fprintf(outfile, "\npublic ");
 
-            tmpname = strtolower(class_->stereotype);
-            if (eq(tmpname, "interface")) {
-                classtype = CLASSTYPE_INTERFACE;
+        tmpname = strtolower(class_->stereotype);
+        if (eq(tmpname, "interface")) {
+            classtype = CLASSTYPE_INTERFACE;
+        } else {
+            if (class_->isabstract) {
+                classtype = CLASSTYPE_ABSTRACT;
+                fprintf( stderr, "Actionscript cannot have abstract classes!\n" );
             } else {
-                if (class_->isabstract) {
-                    classtype = CLASSTYPE_ABSTRACT;
-                    fprintf( stderr, "Actionscript cannot have abstract classes!\n" );
-                } else {
-                    classtype = CLASSTYPE_CLASS;
-                }
+                classtype = CLASSTYPE_CLASS;
             }
-            free(tmpname);
+        }
+        free(tmpname);
 
-            switch (classtype)
-            {
-            case CLASSTYPE_INTERFACE:   d2c_fprintf(outfile, "interface "); break;
-            case CLASSTYPE_ABSTRACT:    d2c_fprintf(outfile, "class "); break;
-            case CLASSTYPE_CLASS:       d2c_fprintf(outfile, "class "); break;
-            }
+        switch (classtype)
+        {
+        case CLASSTYPE_INTERFACE:   d2c_fprintf(outfile, "interface "); break;
+        case CLASSTYPE_ABSTRACT:    d2c_fprintf(outfile, "class "); break;
+        case CLASSTYPE_CLASS:       d2c_fprintf(outfile, "class "); break;
+        }
 
-            d2c_fprintf(outfile, "%s", class_->name);
+        d2c_fprintf(outfile, "%s", class_->name);
 
-            /* if (as3_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS) == 0) */
-            /* { */
-            /*     d2c_fprintf(outfile, "\n"); */
-            /* } */
-            as3_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS);
-            as3_manage_parents(outfile, tmplist->parents, JAVA_IMPLEMENTS);
+        /* if (as3_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS) == 0) */
+        /* { */
+        /*     d2c_fprintf(outfile, "\n"); */
+        /* } */
+        as3_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS);
+        as3_manage_parents(outfile, tmplist->parents, JAVA_IMPLEMENTS);
 
-            /* At this point we need to make a decision:
-               If you want to implement flexibility to add "extends", then
-               the brace must be on the next line. */
-            d2c_open_brace(outfile, "");
+        /* At this point we need to make a decision:
+           If you want to implement flexibility to add "extends", then
+           the brace must be on the next line. */
+        d2c_open_brace(outfile, "");
 
-            d2c_shift_code();
-            umla = class_->attributes;
+        d2c_shift_code();
+        umla = class_->attributes;
 
-            if (umla != NULL)
-                d2c_fprintf(outfile, "/** Attributes */\n");
+        if (umla != NULL)
+            d2c_fprintf(outfile, "/** Attributes */\n");
 
-            while (umla != NULL)
-            {
-                as3_generate_attribute(outfile, &umla->key);
-                umla = umla->next;
-            }
+        while (umla != NULL)
+        {
+            as3_generate_attribute(outfile, &umla->key);
+            umla = umla->next;
+        }
 
-            associations = tmplist->associations;
-            if (associations != NULL)
-                d2c_fprintf(outfile, "/** Associations */\n");
+        associations = tmplist->associations;
+        if (associations != NULL)
+            d2c_fprintf(outfile, "/** Associations */\n");
 
-            while ( associations != NULL )
-            {
-                if (as3_vector_multiplicity(associations->multiplicity) == 2) {
-                    d2c_fprintf(outfile, "private %s:Vector.<%s>;\n",
-                                associations->name, associations->key->name);
-                } else {
-                  d2c_fprintf(outfile, "private %s:%s;\n",
-                              associations->name, associations->key->name);
-                }
-                associations = associations->next;
+        while ( associations != NULL )
+        {
+            if (as3_vector_multiplicity(associations->multiplicity) == 2) {
+                d2c_fprintf(outfile, "private %s:Vector.<%s>;\n",
+                            associations->name, associations->key->name);
+            } else {
+              d2c_fprintf(outfile, "private %s:%s;\n",
+                          associations->name, associations->key->name);
             }
+            associations = associations->next;
+        }
 
-            /* Operations */
-            umlo = class_->operations;
-            while (umlo != NULL)
-            {
-                as3_generate_operation( outfile, &umlo->key, classtype );
-                umlo = umlo->next;
-            }
+        /* Operations */
+        umlo = class_->operations;
+        while (umlo != NULL)
+        {
+            as3_generate_operation( outfile, &umlo->key, classtype );
+            umlo = umlo->next;
+        }
 
-            /* Class declaration. */
-            d2c_unshift_code();
-            d2c_close_brace(outfile, "\n");
+        /* Class declaration. */
+        d2c_unshift_code();
+        d2c_close_brace(outfile, "\n");
 
-            /* Package declaration. */
-            d2c_unshift_code();
-            d2c_close_brace(outfile, "\n");
+        /* Package declaration. */
+        d2c_unshift_code();
+        d2c_close_brace(outfile, "\n");
 
-            fclose(outfile);
-        }
-        tmplist = tmplist->next;
+        d2c_outfile_close(outfile);
     }
+    free(outfilename);
+}
+
+void generate_code_as3(batch *b)
+{
+    if (b->outdir == NULL)
+        b->outdir = ".";
+
+    create_package_dirs(b);
+
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 )
+    {
+        fprintf(stderr, "Can't open the license file.\n");
+        d2c_exit(2);
+    }
+
+    source_prescan(b, ".as");
+    d2c_generate_classes(b, generate_class);
+    source_prescan_free(b);
 }
 
 
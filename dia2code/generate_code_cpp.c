@@ -27,7 +27,7 @@
 #define SPEC_EXT "h"
 #define BODY_EXT "cpp"
 
-static batch *gb;   /* The current batch being processed.  */
+static D2C_TASK_LOCAL batch *gb;   /* The current batch being processed.  */
 
 /* Utilities.  */
 
@@ -111,7 +111,7 @@ has_oo_class (declaration *d)
 static char *
 cppname (char *name)
 {
-    static char buf[SMALL_BUFFER];
+    static D2C_TASK_LOCAL char buf[SMALL_BUFFER];
     if (use_corba) {
         if (eq (name, "boolean") ||
             eq (name, "char") ||
@@ -144,7 +144,7 @@ cppname (char *name)
 static char *
 fqname (umlclassnode *node, int use_ref_type)
 {
-    static char buf[BIG_BUFFER];
+    static D2C_TASK_LOCAL char buf[BIG_BUFFER];
 
     buf[0] = '\0';
     if (node == NULL)
@@ -348,7 +348,6 @@ gen_class (umlclassnode *node)
             print ("");
             if (umlo->key.attr.isabstract || is_valuetype) {
                 emit ("virtual ");
-                umlo->key.attr.value[0] = '0';
             }
             if (umlo->key.attr.isstatic) {
                 if (is_valuetype)
@@ -381,12 +380,10 @@ gen_class (umlclassnode *node)
             if (umlo->key.attr.isconstant) {
                 emit (" const");
             }
-            if (umlo->key.attr.value[0]) {
-                // virtual
-                if ((umlo->key.attr.isabstract || is_valuetype) &&
-                    umlo->key.attr.name[0] != '~')
-                    emit (" = %s", umlo->key.attr.value);
-            }
+            // pure virtual
+            if ((umlo->key.attr.isabstract || is_valuetype) &&
+                umlo->key.attr.name[0] != '~')
+                emit (" = 0");
             emit (";\n");
             umlo = umlo->next;
         }
@@ -460,7 +457,7 @@ gen_decl (declaration *d)
     } else if (is_const_stereo (stype)) {
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute not set at %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (umla->key.name) > 0)
             fprintf (stderr, "Warning: ignoring attribute name at %s\n", name);
@@ -509,7 +506,7 @@ gen_decl (declaration *d)
         umlattrnode *sw = umla;
         if (sw == NULL) {
             fprintf (stderr, "Error: attributes not set at union %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         fprintf (stderr, "%s: CORBAUnion not yet fully implemented\n", name);
         print ("class %s {  // CORBAUnion\n", name);
@@ -540,7 +537,7 @@ gen_decl (declaration *d)
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute (impl type) not set "
                              "at typedef %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (umla->key.name) > 0)  {
             fprintf (stderr, "Warning: typedef %s: ignoring name field "
@@ -554,12 +551,60 @@ gen_decl (declaration *d)
 }
 
 
+/* Generates the file of the outer declaration d, a generation task.  */
+static void
+generate_decl (batch *b, void *item)
+{
+    declaration *d = item;
+    char *name, *tmpname;
+    char filename[BIG_BUFFER];
+
+    gb = b;
+    if (d->decl_kind == dk_module) {
+        name = d->u.this_module->pkg->name;
+    } else {         /* dk_class */
+        name = d->u.this_class->key->name;
+    }
+    sprintf (filename, "%s.%s", name, file_ext);
+
+    spec = open_outfile (filename, b);
+    if (spec == NULL) {
+        return;
+    }
+
+    tmpname = strtoupper(name);
+    print("#ifndef %s__H\n", tmpname);
+    print("#define %s__H\n\n", tmpname);
+
+    /* add license to the header */
+    d2c_license_write (spec, b->license, D2C_COMMENT_BLOCK);
+
+    includes = NULL;
+    determine_includes (d, b);
+    if (use_corba)
+        print ("#include <p_orb.h>\n\n");
+    if (includes) {
+        namelist incfile = includes;
+        while (incfile != NULL) {
+            if (!eq (incfile->name, name)) {
+                print ("#include \"%s.%s\"\n", incfile->name, file_ext);
+            }
+            incfile = incfile->next;
+        }
+        print ("\n");
+    }
+
+    gen_decl (d);
+
+    indentlevel = 0;  /* just for safety (should be 0 already) */
+    print("#endif\n");
+    d2c_outfile_close (spec);
+}
+
 void
 generate_code_cpp (batch *b)
 {
-    declaration *d;
     umlclasslist tmplist = b->classlist;
-    FILE *licensefile = NULL;
 
     gb = b;
 
@@ -570,13 +615,10 @@ generate_code_cpp (batch *b)
         body_file_ext = "cpp";
      */
 
-    /* open license file */
-    if (b->license != NULL) {
-        licensefile = fopen (b->license, "r");
-        if (!licensefile) {
-            fprintf (stderr, "Can't open the license file.\n");
-            exit (1);
-        }
+    /* load the license file */
+    if (b->license != NULL && d2c_license_load (b->license) != 0) {
+        fprintf (stderr, "Can't open the license file.\n");
+        d2c_exit (1);
     }
 
     while (tmplist != NULL) {
@@ -587,58 +629,6 @@ generate_code_cpp (batch *b)
     }
 
     /* Generate a file for each outer declaration.  */
-    d = decls;
-    while (d != NULL) {
-        char *name, *tmpname;
-        char filename[BIG_BUFFER];
-
-        if (d->decl_kind == dk_module) {
-            name = d->u.this_module->pkg->name;
-        } else {         /* dk_class */
-            name = d->u.this_class->key->name;
-        }
-        sprintf (filename, "%s.%s", name, file_ext);
-
-        spec = open_outfile (filename, b);
-        if (spec == NULL) {
-            d = d->next;
-            continue;
-        }
-
-        tmpname = strtoupper(name);
-        print("#ifndef %s__H\n", tmpname);
-        print("#define %s__H\n\n", tmpname);
-
-        /* add license to the header */
-        if (b->license != NULL) {
-            int lc;
-            rewind (licensefile);
-            while ((lc = fgetc (licensefile)) != EOF)
-                print ("%c", (char) lc);
-        }
-
-        includes = NULL;
-        determine_includes (d, b);
-        if (use_corba)
-            print ("#include <p_orb.h>\n\n");
-        if (includes) {
-            namelist incfile = includes;
-            while (incfile != NULL) {
-                if (!eq (incfile->name, name)) {
-                    print ("#include \"%s.%s\"\n", incfile->name, file_ext);
-                }
-                incfile = incfile->next;
-            }
-            print ("\n");
-        }
-
-        gen_decl (d);
-
-        indentlevel = 0;  /* just for safety (should be 0 already) */
-        print("#endif\n");
-        fclose (spec);
-
-        d = d->next;
-    }
+    d2c_generate_decls (b, generate_decl);
 }
 
@@ -177,7 +177,7 @@ gen_decl (declaration *d)
     } else if (is_const_stereo (stype)) {
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute not set at const %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (umla->key.name) > 0)
             fprintf (stderr, "Warning: ignoring attribute name at const %s\n", name);
@@ -218,7 +218,7 @@ gen_decl (declaration *d)
         umlattrnode *sw = umla;
         if (sw == NULL) {
             fprintf (stderr, "Error: attributes not set at union %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (strlen (sw->key.name) > 0 && !eq (sw->key.name, "switch")) {
             emit ("%s// #switchname %s %s\n\n", name, sw->key.name);
@@ -247,7 +247,7 @@ gen_decl (declaration *d)
         if (umla == NULL) {
             fprintf (stderr, "Error: first attribute (impl type) not set "
                              "at typedef %s\n", name);
-            exit (1);
+            d2c_exit (1);
         }
         if (umla->key.name != NULL && strlen (umla->key.name) > 0)  {
             fprintf (stderr, "Warning: typedef %s: ignoring name field "
@@ -324,24 +324,69 @@ put_hfence (char *name)
     free (tmpname);
 }
 
+/* Generates the file of the outer declaration d, a generation task.  */
+static void
+generate_decl (batch *b, void *item)
+{
+    declaration *d = item;
+    char *name;
+    char filename[BIG_BUFFER];
+
+    if (d->decl_kind == dk_module) {
+        name = d->u.this_module->pkg->name;
+    } else {         /* dk_class */
+        name = d->u.this_class->key->name;
+    }
+
+    sprintf (filename, "%s.%s", name, file_ext);
+    /**
+     * The filename is no longer lowercased.
+     *  Selectively do this as soon as we have a
+     *  command line option for it.
+    */
+
+    spec = open_outfile (filename, b);
+    if (spec == NULL) {
+        return;
+    }
+
+    /* add license to the header */
+    d2c_license_write (spec, b->license, D2C_COMMENT_BLOCK);
+
+    put_hfence (name);
+
+    includes = NULL;
+    determine_includes (d, b);
+    if (includes) {
+        namelist incfile = includes;
+        while (incfile != NULL) {
+            if (!eq (incfile->name, name)) {
+                emit ("#include \"%s.%s\"\n", incfile->name, file_ext);
+            }
+            incfile = incfile->next;
+        }
+        emit ("\n");
+    }
+
+    gen_decl (d);
+
+    emit ("#endif\n");   /* from hfence */
+    d2c_outfile_close (spec);
+}
+
 void
 generate_code_idl (batch *b)
 {
-    declaration *d;
     umlclasslist tmplist = b->classlist;
 
-    FILE *licensefile = NULL;
 
     if (file_ext == NULL)
         file_ext = "idl";
 
-    /* open license file */
-    if ( b->license != NULL ) {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile) {
-            fprintf (stderr, "Can't open the license file.\n");
-            exit(2);
-        }
+    /* load the license file */
+    if (b->license != NULL && d2c_license_load (b->license) != 0) {
+        fprintf (stderr, "Can't open the license file.\n");
+        d2c_exit(2);
     }
 
     while (tmplist != NULL) {
@@ -355,60 +400,5 @@ generate_code_idl (batch *b)
     /* Generate a file for each outer declaration.
        Rose does it more elegantly. They use components for the files,
        and realizations for deciding which decl goes into which file.  */
-    d = decls;
-    while (d != NULL) {
-        char *name;
-        char filename[BIG_BUFFER];
-
-        if (d->decl_kind == dk_module) {
-            name = d->u.this_module->pkg->name;
-        } else {         /* dk_class */
-            name = d->u.this_class->key->name;
-        }
-
-        sprintf (filename, "%s.%s", name, file_ext);
-        /**
-         * The filename is no longer lowercased.
-         *  Selectively do this as soon as we have a
-         *  command line option for it.
-        */
-
-        spec = open_outfile (filename, b);
-        if (spec == NULL) {
-            d = d->next;
-            continue;
-        }
-
-        /* add license to the header */
-        if (b->license != NULL) {
-            int lc;
-            rewind (licensefile);
-            while ((lc = fgetc (licensefile)) != EOF)
-                emit ("%c", (char) lc);
-        }
-
-        put_hfence (name);
-
-        includes = NULL;
-        determine_includes (d, b);
-        if (includes) {
-            namelist incfile = includes;
-            while (incfile != NULL) {
-                if (!eq (incfile->name, name)) {
-                    emit ("#include \"%s.%s\"\n", incfile->name, file_ext);
-                }
-                incfile = incfile->next;
-            }
-            emit ("\n");
-        }
-
-        gen_decl (d);
-
-        emit ("#endif\n");   /* from hfence */
-        fclose (spec);
-
-        d = d->next;
-    }
+    d2c_generate_decls (b, generate_decl);
 }
-
-/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
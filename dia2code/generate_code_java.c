@@ -118,7 +118,6 @@ int java_generate_operation( FILE * outfile, umloperation *ope, int classtype, c
     /* method declaration */
     if ( ope->attr.isabstract ){
         d2c_fprintf(outfile, "abstract ");
-        ope->attr.value[0] = '0';
     }
     d2c_fprintf(outfile, "%s ", java_visibility_to_string(ope->attr.visibility));
     if ( ope->attr.isstatic )
@@ -141,9 +140,9 @@ int java_generate_operation( FILE * outfile, umloperation *ope, int classtype, c
         d2c_fprintf(outfile, ";\n");
     } 
     else {
-        if ( ope->implementation != NULL ) {
+        if ( source_implementation(ope) != NULL ) {
             debug( DBG_GENCODE, "implementation found" );
-            d2c_fprintf(outfile, "{%s}", ope->implementation);
+            d2c_fprintf(outfile, "{%s}", source_implementation(ope));
         }
         else {
             d2c_fprintf(outfile, "{");
@@ -155,204 +154,185 @@ int java_generate_operation( FILE * outfile, umloperation *ope, int classtype, c
 }
 
 
-void generate_code_java(batch *b)
+/* Generates the file of the class tmplist, a generation task.  */
+static void generate_class(batch *b, void *item)
 {
-    umlclasslist tmplist;
+    umlclasslist tmplist = item;
     umlassoclist associations;
     umlattrlist umla;
     umlpackagelist tmppcklist;
     umloplist umlo;
     char *tmpname;
-    char outfilename[BIG_BUFFER];
-    FILE * outfile, *licensefile = NULL;
+    char *outfilename;
+    FILE * outfile;
     umlclasslist used_classes;
     umlclass *class;
     int classtype;
     sourcecode *source = NULL;
-    int tmpdirlgth, tmpfilelgth;
 
-    if (b->outdir == NULL)
-        b->outdir = ".";
+    class = tmplist->key;
+    tmpname = class->name;
 
-    tmpdirlgth = strlen(b->outdir);
+    
+    tmppcklist = make_package_list(tmplist->key->package);
 
-    tmplist = b->classlist;
-
-    /* open license file */
-    if ( b->license != NULL )
-    {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile)
-        {
-            fprintf(stderr, "Can't open the license file.\n");
-            exit(2);
-        }
+    if (tmppcklist) {
+        /* here we  calculate and create the directory if necessary */
+        char *outdir = create_package_dir( b, tmppcklist->key );
+        outfilename = d2c_file_path(outdir, tmplist->key->name, ".java");
+    } else {
+        outfilename = d2c_file_path(NULL, tmplist->key->name, ".java");
     }
 
-    while ( tmplist != NULL )
+    /* get implementation code from the existing file */
+    source_preserve( b, tmplist->key, outfilename, source );
+    
+    if ( b->clobber )
     {
-        class = tmplist->key;
-        if ( is_present(b->classes,class->name) ^ b->mask ) {
-            tmplist = tmplist->next;
-            continue;
-        }
-        tmpname = class->name;
-
-        /* This prevents buffer overflows */
-        tmpfilelgth = strlen(tmpname);
-        if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2)
+        outfile = d2c_outfile_open(outfilename, "w");
+        if ( outfile == NULL )
         {
-            fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-            exit(4);
-        }
-        
-        tmppcklist = make_package_list(tmplist->key->package);
-
-        if (tmppcklist) {
-            /* here we  calculate and create the directory if necessary */
-            char *outdir = create_package_dir( b, tmppcklist->key );
-            sprintf(outfilename, "%s/%s.java", outdir, tmplist->key->name);
-        } else {
-            sprintf(outfilename, "%s.java", tmplist->key->name);
+            fprintf(stderr, "Can't open file %s for writing\n", outfilename);
+            d2c_exit(3);
         }
 
-        /* get implementation code from the existing file */
-        source_preserve( b, tmplist->key, outfilename, source );
-        
-        if ( b->clobber )
-        {
-            outfile = fopen(outfilename, "w");
-            if ( outfile == NULL )
-            {
-                fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-                exit(3);
-            }
+        /* add license to the header */
+        d2c_license_write(outfile, b->license, D2C_COMMENT_BLOCK);
 
-            /* add license to the header */
-            if (b->license != NULL)
+        
+        tmppcklist = make_package_list(class->package);
+        if ( tmppcklist != NULL ){
+            d2c_fprintf(outfile,"package %s",tmppcklist->key->name);
+            tmppcklist=tmppcklist->next;
+            while ( tmppcklist != NULL )
             {
-                int lc;
-                rewind(licensefile);
-                while ((lc = fgetc(licensefile)) != EOF)
-                    d2c_fputc(lc, outfile);
-            }
-
-            
-            tmppcklist = make_package_list(class->package);
-            if ( tmppcklist != NULL ){
-                d2c_fprintf(outfile,"package %s",tmppcklist->key->name);
+                d2c_fprintf(outfile,".%s",tmppcklist->key->name);
                 tmppcklist=tmppcklist->next;
-                while ( tmppcklist != NULL )
-                {
-                    d2c_fprintf(outfile,".%s",tmppcklist->key->name);
-                    tmppcklist=tmppcklist->next;
-                }
-                d2c_fputs(";\n\n", outfile);
             }
+            d2c_fputs(";\n\n", outfile);
+        }
 
-            /* We generate the import clauses */
-            used_classes = list_classes(tmplist, b);
-            while (used_classes != NULL)
+        /* We generate the import clauses */
+        used_classes = list_classes(tmplist, b);
+        while (used_classes != NULL)
+        {
+            tmppcklist = make_package_list(used_classes->key->package);
+            if ( tmppcklist != NULL )
             {
-                tmppcklist = make_package_list(used_classes->key->package);
-                if ( tmppcklist != NULL )
+                if ( strcmp(tmppcklist->key->id,class->package->id))
                 {
-                    if ( strcmp(tmppcklist->key->id,class->package->id))
+                    /* This class' package and our current class' package are
+                       not the same */
+                    d2c_fprintf(outfile,"import %s",tmppcklist->key->name);
+                    tmppcklist=tmppcklist->next;
+                    while ( tmppcklist != NULL )
                     {
-                        /* This class' package and our current class' package are
-                           not the same */
-                        d2c_fprintf(outfile,"import %s",tmppcklist->key->name);
+                        d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
                         tmppcklist=tmppcklist->next;
-                        while ( tmppcklist != NULL )
-                        {
-                            d2c_fprintf(outfile, ".%s", tmppcklist->key->name);
-                            tmppcklist=tmppcklist->next;
-                        }
-                        d2c_fprintf(outfile,".%s;\n",used_classes->key->name);
                     }
+                    d2c_fprintf(outfile,".%s;\n",used_classes->key->name);
                 }
-                else
-                {
-                    /* No info for this class' package, we include it directly */
-                    if (index(used_classes->key->name, '.') != NULL)
-                        d2c_fprintf(outfile, "import %s;\n", used_classes->key->name);
-                    else
-                        d2c_fprintf(outfile, "// not generating import for unqualified name %s\n",
-                                    used_classes->key->name);
-                }
-                used_classes = used_classes->next;
             }
-
-            d2c_fprintf(outfile, "\npublic ");
-
-            tmpname = strtolower(class->stereotype);
-            if (eq("interface", tmpname))
-                classtype = CLASSTYPE_INTERFACE;
             else
             {
-                if (class->isabstract)
-                    classtype = CLASSTYPE_ABSTRACT;
+                /* No info for this class' package, we include it directly */
+                if (index(used_classes->key->name, '.') != NULL)
+                    d2c_fprintf(outfile, "import %s;\n", used_classes->key->name);
                 else
-                    classtype = CLASSTYPE_CLASS;
+                    d2c_fprintf(outfile, "// not generating import for unqualified name %s\n",
+                                used_classes->key->name);
             }
-            free(tmpname);
+            used_classes = used_classes->next;
+        }
 
-            switch(classtype)
-            {
-            case CLASSTYPE_INTERFACE:   d2c_fprintf(outfile, "interface "); break;
-            case CLASSTYPE_ABSTRACT:    d2c_fprintf(outfile, "abstract class "); break;
-            case CLASSTYPE_CLASS:       d2c_fprintf(outfile, "class "); break;
-            }
+        d2c_fprintf(outfile, "\npublic ");
 
-            d2c_fprintf(outfile, "%s", class->name);
+        tmpname = strtolower(class->stereotype);
+        if (eq("interface", tmpname))
+            classtype = CLASSTYPE_INTERFACE;
+        else
+        {
+            if (class->isabstract)
+                classtype = CLASSTYPE_ABSTRACT;
+            else
+                classtype = CLASSTYPE_CLASS;
+        }
+        free(tmpname);
 
-            if (java_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS) == 0)
-            {
-                d2c_fprintf(outfile, "\n");
-            }
-            java_manage_parents(outfile, tmplist->parents, JAVA_IMPLEMENTS);
+        switch(classtype)
+        {
+        case CLASSTYPE_INTERFACE:   d2c_fprintf(outfile, "interface "); break;
+        case CLASSTYPE_ABSTRACT:    d2c_fprintf(outfile, "abstract class "); break;
+        case CLASSTYPE_CLASS:       d2c_fprintf(outfile, "class "); break;
+        }
 
-            /* At this point we need to make a decision:
-               If you want to implement flexibility to add "extends", then
-               the brace must be on the next line. */
-            d2c_open_brace(outfile, "");
+        d2c_fprintf(outfile, "%s", class->name);
 
-            d2c_shift_code();
-            umla = class->attributes;
+        if (java_manage_parents(outfile, tmplist->parents, JAVA_EXTENDS) == 0)
+        {
+            d2c_fprintf(outfile, "\n");
+        }
+        java_manage_parents(outfile, tmplist->parents, JAVA_IMPLEMENTS);
 
-            if( umla != NULL)
-                d2c_fprintf(outfile, "/** Attributes */\n");
+        /* At this point we need to make a decision:
+           If you want to implement flexibility to add "extends", then
+           the brace must be on the next line. */
+        d2c_open_brace(outfile, "");
 
-            while ( umla != NULL)
-            {
-                java_generate_attribute(outfile, &umla->key);
-                umla = umla->next;
-            }
+        d2c_shift_code();
+        umla = class->attributes;
 
-            associations = tmplist->associations;
-            if (associations != NULL)
-                d2c_fprintf(outfile, "/** Associations */\n");
+        if( umla != NULL)
+            d2c_fprintf(outfile, "/** Attributes */\n");
 
-            while ( associations != NULL )
-            {
-                d2c_fprintf(outfile, "private %s %s;\n", associations->key->name, associations->name);
-                associations = associations->next;
-            }
+        while ( umla != NULL)
+        {
+            java_generate_attribute(outfile, &umla->key);
+            umla = umla->next;
+        }
 
-            /* Operations */
-            umlo = class->operations;
-            while ( umlo != NULL)
-            {
-                java_generate_operation( outfile, &umlo->key, classtype, class->name);
-                umlo = umlo->next;
-            }
+        associations = tmplist->associations;
+        if (associations != NULL)
+            d2c_fprintf(outfile, "/** Associations */\n");
 
-            d2c_unshift_code();
-            d2c_close_brace(outfile, "\n");
+        while ( associations != NULL )
+        {
+            d2c_fprintf(outfile, "private %s %s;\n", associations->key->name, associations->name);
+            associations = associations->next;
+        }
 
-            fclose(outfile);
+        /* Operations */
+        umlo = class->operations;
+        while ( umlo != NULL)
+        {
+            java_generate_operation( outfile, &umlo->key, classtype, class->name);
+            umlo = umlo->next;
         }
-        tmplist = tmplist->next;
+
+        d2c_unshift_code();
+        d2c_close_brace(outfile, "\n");
+
+        d2c_outfile_close(outfile);
+    }
+    free(outfilename);
+}
+
+void generate_code_java(batch *b)
+{
+    if (b->outdir == NULL)
+        b->outdir = ".";
+
+    create_package_dirs(b);
+
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 )
+    {
+        fprintf(stderr, "Can't open the license file.\n");
+        d2c_exit(2);
     }
+
+    source_prescan(b, ".java");
+    d2c_generate_classes(b, generate_class);
+    source_prescan_free(b);
 }
 
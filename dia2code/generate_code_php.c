@@ -42,247 +42,224 @@ char *php_visibility(int visibility)
     }
 }
 
-void generate_code_php(batch *b) 
+/* Generates the file of the class tmplist, a generation task.  */
+static void generate_class(batch *b, void *item)
 {
-    umlclasslist tmplist, parents;
+    umlclasslist tmplist = item, parents;
     umlassoclist associations;
     umlattrlist umla, tmpa;
     umlpackagelist tmppcklist;
     umloplist umlo;
     char *tmpname, *outdir;
-    char outfilename[BIG_BUFFER];
-    FILE * outfile, *licensefile = NULL;
+    char *outfilename;
+    FILE * outfile;
     umlclasslist used_classes;
-    sourceblocknode *sbklist = NULL;
-    sourceblock *srcblock;
     sourcecode *source = NULL;
-    
-    int tmpdirlgth, tmpfilelgth;
 
-    if (b->outdir == NULL) {
-        b->outdir = ".";
-    }
-    tmpdirlgth = strlen(b->outdir);
+    tmpname = tmplist->key->name;
+    debug( 4, "----------generating class %s",  tmpname );
 
-    tmplist = b->classlist;
+    tmppcklist = make_package_list(tmplist->key->package);
 
-    /* open license file */
-    if ( b->license != NULL ) {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile) {
-            debug( 1, "warning: Can't open the license file.\n");
-        }
+    if (tmppcklist) {
+        /* here we calculate and create the directory if necessary */
+        outdir = create_package_dir( b, tmppcklist->key );
+        /* create the destination filename */
+        outfilename = d2c_file_path(outdir, tmplist->key->name, ".php");
+    } else {
+        /* create the destination filename */
+        outfilename = d2c_file_path(NULL, tmplist->key->name, ".php");
     }
-    
-    
-    
-    while ( tmplist != NULL ) {
-        char *sourcebuffer = NULL;
-        sbklist = NULL;
-        
-        if ( ! ( is_present(b->classes, tmplist->key->name) ^ b->mask ) ) {
-
-            tmpname = tmplist->key->name;
-            debug( 4, "----------generating class %s",  tmpname );
-            /* This prevents buffer overflows */
-            tmpfilelgth = strlen(tmpname);
-            if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2) {
-                fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-                exit(4);
-            }
-
-            tmppcklist = make_package_list(tmplist->key->package);
 
-            if (tmppcklist) {
-                /* here we calculate and create the directory if necessary */
-                create_package_dir( b, tmppcklist->key );
-                /* create the destination filename */
-                sprintf(outfilename, "%s/%s.php", outdir, tmplist->key->name);
-            } else {
-                /* create the destination filename */
-                sprintf(outfilename, "%s.php", tmplist->key->name);
-            }
+    /* get implementation code from the existing file
+       This does not work yet - source_preserve() 4th arg (source)
+       should be double-pointer (char**) because the updated source
+       pointer must be visible at the caller.  */
+    source_preserve( b, tmplist->key, outfilename, source );
+    
+    if ( b->clobber ) {
 
-            /* get implementation code from the existing file
-               This does not work yet - source_preserve() 4th arg (source)
-               should be double-pointer (char**) because the updated source
-               pointer must be visible at the caller.  */
-            source_preserve( b, tmplist->key, outfilename, source );
-            
-            if ( b->clobber ) {
+        outfile = d2c_outfile_open(outfilename, "w");
+        if ( outfile == NULL ) {
+            fprintf(stderr, "Can't open file %s for writing\n", outfilename);
+            d2c_exit(3);
+        }
 
-                outfile = fopen(outfilename, "w");
-                if ( outfile == NULL ) {
-                    fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-                    exit(3);
-                }
+        fprintf(outfile,"<?php\n" );
 
-                fprintf(outfile,"<?php\n" );
+        /* header */
+        /* add license to the header */
+        d2c_license_write(outfile, b->license, D2C_COMMENT_BLOCK);
 
-                /* header */
-                /* add license to the header */
-                if (b->license != NULL) {
-                    int lc;
-                    rewind(licensefile);
-                    while ((lc = fgetc(licensefile)) != EOF) {
-                        fprintf(outfile,"%c", (char) lc);
-                    }
+        /* We generate the include clauses */
+        used_classes = list_classes(tmplist, b);
+        while (used_classes != NULL) {
+            tmppcklist = make_package_list(used_classes->key->package);
+            if ( tmppcklist != NULL ){
+                if ( strcmp(tmppcklist->key->id,tmplist->key->package->id)){
+                    /* This class' package and our current class' package are
+                       not the same */
+                    outdir = create_package_dir( b, tmppcklist->key );
+                    fprintf(outfile, "require_once '%s/%s.php';\n", outdir, used_classes->key->name );
                 }
-
-                /* We generate the include clauses */
-                used_classes = list_classes(tmplist, b);
-                while (used_classes != NULL) {
-                    tmppcklist = make_package_list(used_classes->key->package);
-                    if ( tmppcklist != NULL ){
-                        if ( strcmp(tmppcklist->key->id,tmplist->key->package->id)){
-                            /* This class' package and our current class' package are
-                               not the same */
-                            outdir = create_package_dir( b, tmppcklist->key );
-                            fprintf(outfile, "require_once '%s/%s.php';\n", tmppcklist->key->directory, used_classes->key->name );
-                        }
-                    } else {
-                        /* XXX - If the used class is different from the
-                                 actual class, we include it. I don't know
-                                 if this is ok. */
-                        if ( strcmp(used_classes->key->name, tmplist->key->name) ) {
-                            fprintf(outfile, "require_once '%s.php';\n", used_classes->key->name );
-                        }
-                    }
-                    used_classes = used_classes->next;
+            } else {
+                /* XXX - If the used class is different from the
+                         actual class, we include it. I don't know
+                         if this is ok. */
+                if ( strcmp(used_classes->key->name, tmplist->key->name) ) {
+                    fprintf(outfile, "require_once '%s.php';\n", used_classes->key->name );
                 }
-                fprintf(outfile, "\n");
+            }
+            used_classes = used_classes->next;
+        }
+        fprintf(outfile, "\n");
 
-                fprintf(outfile,"/**\n" );
-                fprintf(outfile," * %s\n", tmplist->key->comment );
-                fprintf(outfile," *\n" );
-                fprintf(outfile," * @author    XXX\n" );
-                fprintf(outfile," * @version   XXX\n" );
-                fprintf(outfile," * @copyright XXX\n" );
+        fprintf(outfile,"/**\n" );
+        fprintf(outfile," * %s\n", tmplist->key->comment );
+        fprintf(outfile," *\n" );
+        fprintf(outfile," * @author    XXX\n" );
+        fprintf(outfile," * @version   XXX\n" );
+        fprintf(outfile," * @copyright XXX\n" );
 
-                tmppcklist = make_package_list(tmplist->key->package);
-                if ( tmppcklist != NULL ){
-                    int packcounter = 0;
-                    fprintf(outfile," * @package   %s",tmppcklist->key->name);
-                    tmppcklist=tmppcklist->next;
-                    while ( tmppcklist != NULL ){
-                        if( packcounter == 1 ) {
-                           fprintf(outfile,"\n" );
-                           fprintf(outfile," * @subpackage %s",tmppcklist->key->name);
-                        } else {
-                           fprintf(outfile,".%s",tmppcklist->key->name);
-                        }
-                        tmppcklist=tmppcklist->next;
-                        packcounter++;
-                    }
-                    fprintf(outfile,"\n");
+        tmppcklist = make_package_list(tmplist->key->package);
+        if ( tmppcklist != NULL ){
+            int packcounter = 0;
+            fprintf(outfile," * @package   %s",tmppcklist->key->name);
+            tmppcklist=tmppcklist->next;
+            while ( tmppcklist != NULL ){
+                if( packcounter == 1 ) {
+                   fprintf(outfile,"\n" );
+                   fprintf(outfile," * @subpackage %s",tmppcklist->key->name);
+                } else {
+                   fprintf(outfile,".%s",tmppcklist->key->name);
                 }
+                tmppcklist=tmppcklist->next;
+                packcounter++;
+            }
+            fprintf(outfile,"\n");
+        }
 
-                if (tmplist->key->isabstract) {
-                    fprintf(outfile," * @abstract\n" );
-                }
+        if (tmplist->key->isabstract) {
+            fprintf(outfile," * @abstract\n" );
+        }
 
-                fprintf(outfile," */\n" );
+        fprintf(outfile," */\n" );
 
-                fprintf(outfile, "class %s", tmplist->key->name);
+        fprintf(outfile, "class %s", tmplist->key->name);
 
-                parents = tmplist->parents;
-                if (parents != NULL) {
-                    while ( parents != NULL ) {
-                        tmpname = strtolower(parents->key->stereotype);
-                        fprintf(outfile, " extends ");
-                        free(tmpname);
-                        fprintf(outfile, "%s", parents->key->name);
-                        parents = parents->next;
-                    }
-                }
-                fprintf(outfile, " {\n");
+        parents = tmplist->parents;
+        if (parents != NULL) {
+            while ( parents != NULL ) {
+                tmpname = strtolower(parents->key->stereotype);
+                fprintf(outfile, " extends ");
+                free(tmpname);
+                fprintf(outfile, "%s", parents->key->name);
+                parents = parents->next;
+            }
+        }
+        fprintf(outfile, " {\n");
 
-                umla = tmplist->key->attributes;
-                while ( umla != NULL) {
-                    fprintf(outfile, "%s/**\n", TABS);
-                    fprintf(outfile, "%s * XXX\n", TABS );
-                    fprintf(outfile, "%s *\n", TABS );
-                    fprintf(outfile, "%s * @var    %s $%s\n",
-                            TABS, umla->key.type, umla->key.name);
-                    fprintf(outfile, "%s * @access %s", TABS, php_visibility(umla->key.visibility));
-                    fprintf(outfile,"\n" );
-                    if (umla->key.isstatic) {
-                        fprintf(outfile, "%s * @static ", TABS);
-                    }
-                    fprintf(outfile, "%s */\n", TABS);
+        umla = tmplist->key->attributes;
+        while ( umla != NULL) {
+            fprintf(outfile, "%s/**\n", TABS);
+            fprintf(outfile, "%s * XXX\n", TABS );
+            fprintf(outfile, "%s *\n", TABS );
+            fprintf(outfile, "%s * @var    %s $%s\n",
+                    TABS, umla->key.type, umla->key.name);
+            fprintf(outfile, "%s * @access %s", TABS, php_visibility(umla->key.visibility));
+            fprintf(outfile,"\n" );
+            if (umla->key.isstatic) {
+                fprintf(outfile, "%s * @static ", TABS);
+            }
+            fprintf(outfile, "%s */\n", TABS);
 
-                    fprintf(outfile, "%svar $%s%s",TABS, 
-                            (umla->key.visibility != '0') ? "_" : "",
-                            umla->key.name);
-                    if ( umla->key.value[0] != 0 ) {
-                        fprintf(outfile, " = %s", umla->key.value);
-                    }
-                    fprintf(outfile, ";\n\n");
-                    umla = umla->next;
-                }
+            fprintf(outfile, "%svar $%s%s",TABS, 
+                    (umla->key.visibility != '0') ? "_" : "",
+                    umla->key.name);
+            if ( umla->key.value[0] != 0 ) {
+                fprintf(outfile, " = %s", umla->key.value);
+            }
+            fprintf(outfile, ";\n\n");
+            umla = umla->next;
+        }
 
-                associations = tmplist->associations;
-                while ( associations != NULL ) {
-                    fprintf(outfile, "%s/**\n", TABS );
-                    fprintf(outfile, "%s * XXX\n", TABS );
-                    fprintf(outfile, "%s *\n", TABS );
-                    fprintf(outfile, "%s * @var    %s $%s\n",
-                            TABS, associations->key->name, associations->name);
-                    fprintf(outfile, "%s * @access private\n", TABS );
-                    fprintf(outfile, "%s * @accociation %s to %s\n",
-                            TABS, associations->key->name, associations->name);
-                    fprintf(outfile, "%s */\n", TABS );
-                    fprintf(outfile, "%s#var $%s;\n\n",
-                            TABS, associations->name);
-                    associations = associations->next;
-                }
+        associations = tmplist->associations;
+        while ( associations != NULL ) {
+            fprintf(outfile, "%s/**\n", TABS );
+            fprintf(outfile, "%s * XXX\n", TABS );
+            fprintf(outfile, "%s *\n", TABS );
+            fprintf(outfile, "%s * @var    %s $%s\n",
+                    TABS, associations->key->name, associations->name);
+            fprintf(outfile, "%s * @access private\n", TABS );
+            fprintf(outfile, "%s * @accociation %s to %s\n",
+                    TABS, associations->key->name, associations->name);
+            fprintf(outfile, "%s */\n", TABS );
+            fprintf(outfile, "%s#var $%s;\n\n",
+                    TABS, associations->name);
+            associations = associations->next;
+        }
 
-                umlo = tmplist->key->operations;
-                while ( umlo != NULL) {
-                    char *diaoid;
-                    /** comment_helper function that generate the javadoc comment block */
-                    generate_operation_comment( outfile, NULL, &umlo->key );
-                    /* fprintf(outfile,"%s * @access %s \n", TABS, php_visibility(umlo->key.attr.visibility)  );
-                    if ( umlo->key.attr.isabstract ) {
-                        fprintf(outfile,"%s * @abstract\n", TABS );
-                        umlo->key.attr.value[0] = '0';
-                    }
-                    if ( umlo->key.attr.isstatic ) {
-                        fprintf(outfile, "%s * @static ", TABS);
-                    }*/
-                    //fprintf(outfile,"%s */\n", TABS );
-                    fprintf(outfile, "%sfunction %s%s(", TABS,
-                            (umlo->key.attr.visibility != '0') ? "_" : "",
-                            umlo->key.attr.name );
-                    tmpa = umlo->key.parameters;
-                    while (tmpa != NULL) {
-                        fprintf(outfile, "$%s", tmpa->key.name);
-                        if ( tmpa->key.value[0] != 0 ){
-                            fprintf(outfile," = %s",tmpa->key.value);
-                        }
-                        tmpa = tmpa->next;
-                        if (tmpa != NULL) fprintf(outfile, ", ");
-                    }
-                    fprintf(outfile, ") ");
-                    
-                    if ( umlo->key.implementation != NULL ) {
-                        fprintf(outfile, "%s{%s}\n", TABS, umlo->key.implementation);
-                    } else if (!umlo->key.attr.isabstract) {
-                        fprintf(outfile, "%s{\n", TABS );
-                        fprintf(outfile,
-                                "%s%strigger_error('Not Implemented!', E_USER_WARNING);\n", TABS, TABS);
-                        fprintf(outfile, "%s}\n", TABS);
-                    } else {
-                        fprintf(outfile, "\n%s{\n%s}\n", TABS, TABS);
-                    }
-                    umlo = umlo->next;
+        umlo = tmplist->key->operations;
+        while ( umlo != NULL) {
+            char *diaoid;
+            /** comment_helper function that generate the javadoc comment block */
+            generate_operation_comment( outfile, NULL, &umlo->key );
+            /* fprintf(outfile,"%s * @access %s \n", TABS, php_visibility(umlo->key.attr.visibility)  );
+            if ( umlo->key.attr.isabstract ) {
+                fprintf(outfile,"%s * @abstract\n", TABS );
+                umlo->key.attr.value[0] = '0';
+            }
+            if ( umlo->key.attr.isstatic ) {
+                fprintf(outfile, "%s * @static ", TABS);
+            }*/
+            //fprintf(outfile,"%s */\n", TABS );
+            fprintf(outfile, "%sfunction %s%s(", TABS,
+                    (umlo->key.attr.visibility != '0') ? "_" : "",
+                    umlo->key.attr.name );
+            tmpa = umlo->key.parameters;
+            while (tmpa != NULL) {
+                fprintf(outfile, "$%s", tmpa->key.name);
+                if ( tmpa->key.value[0] != 0 ){
+                    fprintf(outfile," = %s",tmpa->key.value);
                 }
-                fprintf(outfile, "}\n\n");
-                fprintf(outfile,"?>\n" );
-                fclose(outfile);
+                tmpa = tmpa->next;
+                if (tmpa != NULL) fprintf(outfile, ", ");
             }
+            fprintf(outfile, ") ");
+            
+            if ( source_implementation(&umlo->key) != NULL ) {
+                fprintf(outfile, "%s{%s}\n", TABS, source_implementation(&umlo->key));
+            } else if (!umlo->key.attr.isabstract) {
+                fprintf(outfile, "%s{\n", TABS );
+                fprintf(outfile,
+                        "%s%strigger_error('Not Implemented!', E_USER_WARNING);\n", TABS, TABS);
+                fprintf(outfile, "%s}\n", TABS);
+            } else {
+                fprintf(outfile, "\n%s{\n%s}\n", TABS, TABS);
+            }
+            umlo = umlo->next;
         }
-        /* next class */
-        tmplist = tmplist->next;
+        fprintf(outfile, "}\n\n");
+        fprintf(outfile,"?>\n" );
+        d2c_outfile_close(outfile);
+    }
+    free(outfilename);
+}
+
+void generate_code_php(batch *b) 
+{
+    if (b->outdir == NULL) {
+        b->outdir = ".";
+    }
+
+    create_package_dirs(b);
+
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 ) {
+        debug( 1, "warning: Can't open the license file.\n");
     }
+
+    source_prescan(b, ".php");
+    d2c_generate_classes(b, generate_class);
+    source_prescan_free(b);
 }
@@ -117,7 +117,6 @@ void d2c_php_print_func_comments(FILE *outfile, umloplist umlo)
     
     if (umlo->key.attr.isabstract) {
         fprintf(outfile, "%s * @abstract\n", TABS );
-        umlo->key.attr.value[0] = '0';
     }
 
     if (umlo->key.attr.isstatic) {
@@ -253,13 +252,9 @@ void d2c_php_print_operations(FILE *outfile, umlclasslist tmplist)
 }
 
 
-int d2c_php_print_license(FILE *outfile, FILE *licensefile)
+int d2c_php_print_license(FILE *outfile, char *license)
 {
-    int lc;
-    rewind(licensefile);
-    while ((lc = fgetc(licensefile)) != EOF) {
-        fprintf(outfile, "%c", (char) lc);
-    }
+    d2c_license_write(outfile, license, D2C_COMMENT_BLOCK);
     return 0;
 }
 
@@ -383,77 +378,75 @@ FILE *d2c_php_getoutfile(umlclasslist tmplist, batch *b, FILE *outfile, int maxl
     sprintf(outfilename, "%s/%s.php", b->outdir, tmplist->key->name);
     FILE *dummy = fopen(outfilename, "r");
     if (b->clobber || !dummy) {
-        outfile = fopen(outfilename, "w");
+        outfile = d2c_outfile_open(outfilename, "w");
     }
     fclose(dummy);
     return outfile;
 }
 
 /*
- * main function called to begin output
+ * generates the file of one class, a generation task
  * */
-void generate_code_php_five(batch *b) 
+static void generate_class(batch *b, void *item)
 {
-    umlclasslist tmplist; 
+    umlclasslist tmplist = item;
     char *tmpname;
     char outfilename[BIG_BUFFER];
-    FILE * outfile, *dummyfile, *licensefile = NULL;
+    FILE * outfile, *dummyfile;
     int tmpdirlgth, tmpfilelgth;
 
-    if (b->outdir == NULL) {
-        b->outdir = ".";
-    }
     tmpdirlgth = strlen(b->outdir);
+    tmpname = tmplist->key->name;
+    /* This prevents buffer overflows */
+    tmpfilelgth = strlen(tmpname);
+    if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2) {
+        fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
+        d2c_exit(4);
+    }
+    sprintf(outfilename, "%s/%s.php", b->outdir, tmplist->key->name);
+    dummyfile = fopen(outfilename, "r");
+    if ( b->clobber || ! dummyfile ) {
 
-    tmplist = b->classlist;
+        outfile = d2c_outfile_open(outfilename, "w");
+        if ( outfile == NULL ) {
+            fprintf(stderr, "Can't open file %s for writing\n", outfilename);
+            d2c_exit(3);
+        }
 
-    /* open license file */
-    if ( b->license != NULL ) {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile) {
-            fprintf(stderr, "Can't open the license file.\n");
-            exit(2); 
+        fprintf(outfile, "<?php\n" );
+        /* header */
+        if(b->license != NULL) {
+            /* add license to the header */
+            d2c_php_print_license(outfile, b->license);
         }
+        d2c_php_print_includes(outfile, tmplist, b);
+        d2c_php_print_class_desc(outfile, tmplist);
+        d2c_php_print_class_decl(outfile, tmplist);
+        d2c_php_print_attributes(outfile, tmplist);
+        d2c_php_print_associations(outfile, tmplist);
+        d2c_php_print_operations(outfile, tmplist);
+        /* end class declaration */
+        fprintf(outfile, "}\n\n");
+        fprintf(outfile, "?>\n" );
+        d2c_outfile_close(outfile);
     }
-    /* for each class */
-    while ( tmplist != NULL ) {
-        if ( ! ( is_present(b->classes, tmplist->key->name) ^ b->mask ) ) {
-            tmpname = tmplist->key->name;
-            /* This prevents buffer overflows */
-            tmpfilelgth = strlen(tmpname);
-            if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2) {
-                fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-                exit(4);
-            }
-            sprintf(outfilename, "%s/%s.php", b->outdir, tmplist->key->name);
-            dummyfile = fopen(outfilename, "r");
-            if ( b->clobber || ! dummyfile ) {
-
-                outfile = fopen(outfilename, "w");
-                if ( outfile == NULL ) {
-                    fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-                    exit(3);
-                }
+}
 
-                fprintf(outfile, "<?php\n" );
-                /* header */
-                if(b->license != NULL) {
-                    /* add license to the header */
-                    d2c_php_print_license(outfile, licensefile);
-                }
-                d2c_php_print_includes(outfile, tmplist, b);
-                d2c_php_print_class_desc(outfile, tmplist);
-                d2c_php_print_class_decl(outfile, tmplist);
-                d2c_php_print_attributes(outfile, tmplist);
-                d2c_php_print_associations(outfile, tmplist);
-                d2c_php_print_operations(outfile, tmplist);
-                /* end class declaration */
-                fprintf(outfile, "}\n\n");
-                fprintf(outfile, "?>\n" );
-                fclose(outfile);
-            }
-        }
-        tmplist = tmplist->next;
+/*
+ * main function called to begin output
+ * */
+void generate_code_php_five(batch *b) 
+{
+    if (b->outdir == NULL) {
+        b->outdir = ".";
     }
+
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 ) {
+        fprintf(stderr, "Can't open the license file.\n");
+        d2c_exit(2);
+    }
+    /* for each class */
+    d2c_generate_classes(b, generate_class);
 }
 
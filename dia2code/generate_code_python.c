@@ -25,203 +25,187 @@
 
 #include "dia2code.h"
 
-void generate_code_python(batch *b) {
-    umlclasslist tmplist, parents;
+/* Generates the file of the class tmplist, a generation task.  */
+static void generate_class(batch *b, void *item) {
+    umlclasslist tmplist = item, parents;
     umlattrlist umla, tmpa;
     umloplist umlo;
     char outfilename[BIG_BUFFER];
-    FILE *licensefile = NULL;
     namelist used_classes, tmpnamelist;
     int intro_was_printed;
     int interface, abstract;
+    char *tmpname = tmplist->key->name;
 
-    tmplist = b->classlist;
-
-    /* open license file */
-    if ( b->license != NULL ) {
-        licensefile = fopen(b->license, "r");
-        if(!licensefile) {
-            fprintf(stderr, "Can't open the license file.\n");
-            exit(2);
-        }
+    sprintf(outfilename, "%s.py", tmplist->key->name);
+    spec = open_outfile (outfilename, b);
+    if (spec == NULL) {
+        return;
     }
 
-    while ( tmplist != NULL ) {
-
-        if ( ! ( is_present(b->classes, tmplist->key->name) ^ b->mask ) ) {
-
-            char *tmpname = tmplist->key->name;
-
-            sprintf(outfilename, "%s.py", tmplist->key->name);
-            spec = open_outfile (outfilename, b);
-            if (spec == NULL) {
-                tmplist = tmplist->next;
-                continue;
-            }
-
-            /* add license to the header */
-            if (b->license != NULL) {
-                int lc;
-                rewind(licensefile);
-                while ((lc = fgetc(licensefile)) != EOF) {
-                    print("%c", (char) lc);
-                }
-            }
+    /* add license to the header */
+    d2c_license_write(spec, b->license, D2C_COMMENT_HASH);
 
-            print("# File: %s\n\n", outfilename);
-            used_classes = find_classes(tmplist, b);
-            tmpnamelist = used_classes;
-            while (tmpnamelist != NULL) {
-                print("from %s import %s\n",
-                        tmpnamelist->name, tmpnamelist->name);
-                tmpnamelist = tmpnamelist->next;
+    print("# File: %s\n\n", outfilename);
+    used_classes = find_classes(tmplist, b);
+    tmpnamelist = used_classes;
+    while (tmpnamelist != NULL) {
+        print("from %s import %s\n",
+                tmpnamelist->name, tmpnamelist->name);
+        tmpnamelist = tmpnamelist->next;
+    }
+    if (used_classes != NULL) {
+        print("\n");
+    }
+    tmpname = strtolower(tmplist->key->stereotype);
+    interface = eq("interface", tmpname);
+    abstract = tmplist->key->isabstract;
+    free(tmpname);
+
+    print("class %s", tmplist->key->name);
+
+    parents = tmplist->parents;
+    if (parents != NULL) {
+        print("(");
+        while ( parents != NULL ) {
+            print("%s", parents->key->name);
+            parents = parents->next;
+            if (parents != NULL) print(", ");
+        }
+        print(")");
+    }
+    print(":");
+    if (abstract) {
+        print("    # Abstract class");
+    } else if (interface) {
+        print("    # Interface");
+    }
+    print("\n");
+    if (tmplist->key->comment && *(tmplist->key->comment))
+        print("    \"\"\"%s\"\"\"\n", tmplist->key->comment); /* include comments, wolf */
+    intro_was_printed = 0;
+    umla = tmplist->key->attributes;
+
+    /* class scope */
+    while (umla != NULL) {
+        if (umla->key.isstatic) {
+            if (!intro_was_printed) {
+                print("\n# Attributes: Class\n\n");
+                intro_was_printed = 1;
             }
-            if (used_classes != NULL) {
-                print("\n");
+            switch (umla->key.visibility) {
+            case '0':
+                print("    ");
+                break;
+            case '1':
+                print("    __");
+                break;
+            case '2':
+                print("    _");
+                break;
             }
-            tmpname = strtolower(tmplist->key->stereotype);
-            interface = eq("interface", tmpname);
-            abstract = tmplist->key->isabstract;
-            free(tmpname);
-
-            print("class %s", tmplist->key->name);
-
-            parents = tmplist->parents;
-            if (parents != NULL) {
-                print("(");
-                while ( parents != NULL ) {
-                    print("%s", parents->key->name);
-                    parents = parents->next;
-                    if (parents != NULL) print(", ");
-                }
-                print(")");
+            print("%s", umla->key.name);
+            if ( umla->key.value[0] != 0 ) {
+                print(" = %s", umla->key.value);
+            } else {
+                print(" = None");
             }
-            print(":");
-            if (abstract) {
-                print("    # Abstract class");
-            } else if (interface) {
-                print("    # Interface");
+            if (umla->key.type[0] != 0) {
+                print("  # %s", umla->key.type);
             }
             print("\n");
-            if (tmplist->key->comment && *(tmplist->key->comment))
-                print("    \"\"\"%s\"\"\"\n", tmplist->key->comment); /* include comments, wolf */
-            intro_was_printed = 0;
-            umla = tmplist->key->attributes;
-
-            /* class scope */
-            while (umla != NULL) {
-                if (umla->key.isstatic) {
-                    if (!intro_was_printed) {
-                        print("\n# Attributes: Class\n\n");
-                        intro_was_printed = 1;
-                    }
-                    switch (umla->key.visibility) {
-                    case '0':
-                        print("    ");
-                        break;
-                    case '1':
-                        print("    __");
-                        break;
-                    case '2':
-                        print("    _");
-                        break;
-                    }
-                    print("%s", umla->key.name);
-                    if ( umla->key.value[0] != 0 ) {
-                        print(" = %s", umla->key.value);
-                    } else {
-                        print(" = None");
-                    }
-                    if (umla->key.type[0] != 0) {
-                        print("  # %s", umla->key.type);
-                    }
-                    print("\n");
-                }
-                umla = umla->next;
+        }
+        umla = umla->next;
+    }
+    /* instance attributes */
+    intro_was_printed = 0;
+    umla = tmplist->key->attributes;
+    while ( umla != NULL) {
+        if (!umla->key.isstatic) {
+            if (!intro_was_printed) {
+                print("\n# Attributes: Instance\n\n");
+                print("    def __init__(self):\n");
+                intro_was_printed = 1;
             }
-            /* instance attributes */
-            intro_was_printed = 0;
-            umla = tmplist->key->attributes;
-            while ( umla != NULL) {
-                if (!umla->key.isstatic) {
-                    if (!intro_was_printed) {
-                        print("\n# Attributes: Instance\n\n");
-                        print("    def __init__(self):\n");
-                        intro_was_printed = 1;
-                    }
-                    switch (umla->key.visibility) {
-                    case '0':
-                        print("        self.");
-                        break;
-                    case '1':
-                        print("        self.__");
-                        break;
-                    case '2':
-                        print("        self._");
-                        break;
-                    }
-                    print("%s", umla->key.name);
-                    if ( umla->key.value[0] != 0 ) {
-                        print(" = %s", umla->key.value);
-                    } else {
-                        print(" = None");
-                    }
-                    if (umla->key.type[0] != 0) {
-                        print("  # %s", umla->key.type);
-                    }
-                    print("\n");
-                }
-                umla = umla->next;
+            switch (umla->key.visibility) {
+            case '0':
+                print("        self.");
+                break;
+            case '1':
+                print("        self.__");
+                break;
+            case '2':
+                print("        self._");
+                break;
             }
-
-            umlo = tmplist->key->operations;
-            print("\n# Operations\n\n");
-            while (umlo != NULL) {
-
-                switch (umlo->key.attr.visibility) {
-                case '0':
-                    print("    def %s(self", umlo->key.attr.name);
-                    break;
-                case '1':
-                    print("    def __%s(self", umlo->key.attr.name);
-                    break;
-                case '2':
-                    print("    def _%s(self", umlo->key.attr.name);
-                    break;
-                }
-
-                tmpa = umlo->key.parameters;
-                while (tmpa != NULL) {
-                    print(", %s", tmpa->key.name);
-                    if ( tmpa->key.value[0] != 0 ) {
-                        print(" = %s", tmpa->key.value);
-                    }
-                    tmpa = tmpa->next;
-                }
-                print("):\n");
-                tmpa = umlo->key.parameters;
-                if (tmpa)
-                    print("        \n");
-                while (tmpa != NULL) {
-                    print("        %s: %s\n", tmpa->key.name, tmpa->key.type);
-                    tmpa = tmpa->next;
-                }
-                if (abstract || interface) {
-                    print("        raise NotImplementedError()\n    \n");
-                } else {
-                    print("        return");
-                    if (umlo->key.attr.type[0]) 
-                        print("    # %s", umlo->key.attr.type);
-                    print("\n    \n");
-                }
-                umlo = umlo->next;
+            print("%s", umla->key.name);
+            if ( umla->key.value[0] != 0 ) {
+                print(" = %s", umla->key.value);
+            } else {
+                print(" = None");
+            }
+            if (umla->key.type[0] != 0) {
+                print("  # %s", umla->key.type);
             }
             print("\n");
+        }
+        umla = umla->next;
+    }
 
-            fclose(spec);
+    umlo = tmplist->key->operations;
+    print("\n# Operations\n\n");
+    while (umlo != NULL) {
+
+        switch (umlo->key.attr.visibility) {
+        case '0':
+            print("    def %s(self", umlo->key.attr.name);
+            break;
+        case '1':
+            print("    def __%s(self", umlo->key.attr.name);
+            break;
+        case '2':
+            print("    def _%s(self", umlo->key.attr.name);
+            break;
+        }
+
+        tmpa = umlo->key.parameters;
+        while (tmpa != NULL) {
+            print(", %s", tmpa->key.name);
+            if ( tmpa->key.value[0] != 0 ) {
+                print(" = %s", tmpa->key.value);
+            }
+            tmpa = tmpa->next;
+        }
+        print("):\n");
+        tmpa = umlo->key.parameters;
+        if (tmpa)
+            print("        \n");
+        while (tmpa != NULL) {
+            print("        %s: %s\n", tmpa->key.name, tmpa->key.type);
+            tmpa = tmpa->next;
         }
-        tmplist = tmplist->next;
+        if (abstract || interface) {
+            print("        raise NotImplementedError()\n    \n");
+        } else {
+            print("        return");
+            if (umlo->key.attr.type[0]) 
+                print("    # %s", umlo->key.attr.type);
+            print("\n    \n");
+        }
+        umlo = umlo->next;
     }
+    print("\n");
+
+    d2c_outfile_close(spec);
+}
+
+void generate_code_python(batch *b) {
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 ) {
+        fprintf(stderr, "Can't open the license file.\n");
+        d2c_exit(2);
+    }
+
+    d2c_generate_classes(b, generate_class);
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -26,7 +26,7 @@ void generate_code_shp(batch *b) {
     umlattrlist umla;
     char *tmpname;
     char outfilename[BIG_BUFFER];
-    FILE * outfileshp, *dummyfile;
+    FILE * outfileshp = NULL, *dummyfile;
 
     int tmpdirlgth, tmpfilelgth;
 
@@ -36,6 +36,15 @@ void generate_code_shp(batch *b) {
 
     tmpdirlgth = strlen(b->outdir);
 
+    sprintf(outfilename, "%s/createshapefiles.bat", b->outdir);
+    dummyfile = fopen(outfilename, "r");
+    if ( dummyfile ) {
+        fclose(dummyfile);
+        if ( ! b->clobber ) {
+            return;
+        }
+    }
+
     tmplist = b->classlist;
 
     while ( tmplist != NULL ) {
@@ -48,107 +57,100 @@ void generate_code_shp(batch *b) {
             tmpfilelgth = strlen(tmpname);
             if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2) {
                 fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-                exit(4);
+                d2c_exit(4);
             }
 
-            sprintf(outfilename, "%s/createshapefiles.bat", b->outdir);
-            dummyfile = fopen(outfilename, "r");
-            if ( b->clobber || ! dummyfile ) {
-
-                outfileshp = fopen(outfilename, "a");
+            /* the batch file is opened once, for the first selected class */
+            if ( outfileshp == NULL ) {
+                outfileshp = d2c_outfile_open(outfilename, "a");
                 if ( outfileshp == NULL ) {
                     fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-                    exit(3);
+                    d2c_exit(3);
                 }
+            }
 
-                /* This prevents buffer overflows */
-                tmpfilelgth = strlen(tmpname);
-                if (tmpfilelgth + tmpdirlgth > sizeof(*outfilename) - 2) {
-                    fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-                    exit(4);
-                }
+            free(tmpname);
+
+            if(tmplist->key->isabstract == 0) {
 
-                free(tmpname);
-
-                if(tmplist->key->isabstract == 0) {
-
-                    /* create attribute table */
-                    umla = tmplist->key->attributes;
-                    parentlist = tmplist;
-                    fprintf(outfileshp, "dbfcreate %s", tmplist->key->name);
-
-                    while ( umla != NULL) {
-                        if((strcmp(umla->key.name,"Shape") != 0)&&
-                           (umla->key.visibility != 1)) {
-                            if(strcmp(umla->key.type,"String") == 0) {
-                                fprintf(outfileshp, " -s %s 255",
-                                        umla->key.name);
-                            }
-                            else if((strcmp(umla->key.type,
-                                           "CodedValue") == 0)||
-                                strcmp(umla->key.type, "Integer") ==0 ) {
-                                fprintf(outfileshp, " -n %s 16 0",
-                                         umla->key.name);
-                            }
-                            else if(strcmp(umla->key.type, "Float") == 0) {
-                                fprintf(outfileshp, " -n %s 16 3",
-                                        umla->key.name);
-                            }
+                /* create attribute table */
+                umla = tmplist->key->attributes;
+                parentlist = tmplist;
+                fprintf(outfileshp, "dbfcreate %s", tmplist->key->name);
+
+                while ( umla != NULL) {
+                    if((strcmp(umla->key.name,"Shape") != 0)&&
+                       (umla->key.visibility != 1)) {
+                        if(strcmp(umla->key.type,"String") == 0) {
+                            fprintf(outfileshp, " -s %s 255",
+                                    umla->key.name);
                         }
-                        umla = umla->next;
-
-                        if((umla == NULL)&&(parentlist != NULL)) {
-                            parentlist = parentlist->parents;
-                            if(parentlist != NULL) {
-                                umla = parentlist->key->attributes;
-                                parentlist2 = b->classlist;
-                                while((strcmp(parentlist->key->name,
-                                              parentlist2->key->name) != 0)&&
-                                      (parentlist2 != NULL))
-                                    parentlist2 = parentlist2->next;
-                                parentlist = parentlist2;
-                            }
+                        else if((strcmp(umla->key.type,
+                                       "CodedValue") == 0)||
+                            strcmp(umla->key.type, "Integer") ==0 ) {
+                            fprintf(outfileshp, " -n %s 16 0",
+                                     umla->key.name);
                         }
-
-                    }
-                    fprintf(outfileshp, "\n");
-
-                    /* create shp file */
-                    umla = tmplist->key->attributes;
-                       parentlist = tmplist;
-                    while ( umla != NULL) {
-                        if(strcmp(umla->key.name,"Shape") == 0) {
-                            if(strcmp(strtolower(umla->key.type),
-                                      "polyline") == 0) {
-                                strcpy(umla->key.type, "arc");
-                            }
-                            fprintf(outfileshp, "shpcreate %s %s\n\n",
-                                    tmplist->key->name,
-                                    strtolower(umla->key.type));
-                            break;
+                        else if(strcmp(umla->key.type, "Float") == 0) {
+                            fprintf(outfileshp, " -n %s 16 3",
+                                    umla->key.name);
                         }
-                        umla = umla->next;
-
-                        if((umla == NULL)&&(parentlist != NULL)) {
-                            parentlist = parentlist->parents;
-                            if(parentlist != NULL) {
-                                umla = parentlist->key->attributes;
-                                parentlist2 = b->classlist;
-                                while((strcmp(parentlist->key->name,
-                                              parentlist2->key->name) != 0)&&
-                                      (parentlist2 != NULL))
-                                    parentlist2 = parentlist2->next;
-                                parentlist = parentlist2;
-                            }
+                    }
+                    umla = umla->next;
+
+                    if((umla == NULL)&&(parentlist != NULL)) {
+                        parentlist = parentlist->parents;
+                        if(parentlist != NULL) {
+                            umla = parentlist->key->attributes;
+                            parentlist2 = b->classlist;
+                            while((strcmp(parentlist->key->name,
+                                          parentlist2->key->name) != 0)&&
+                                  (parentlist2 != NULL))
+                                parentlist2 = parentlist2->next;
+                            parentlist = parentlist2;
                         }
+                    }
 
+                }
+                fprintf(outfileshp, "\n");
+
+                /* create shp file */
+                umla = tmplist->key->attributes;
+                   parentlist = tmplist;
+                while ( umla != NULL) {
+                    if(strcmp(umla->key.name,"Shape") == 0) {
+                        /* polylines are arcs; the model is shared with
+                           the other targets, so it is left as it is */
+                        char *shape = strtolower(umla->key.type);
+                        fprintf(outfileshp, "shpcreate %s %s\n\n",
+                                tmplist->key->name,
+                                eq(shape, "polyline") ? "arc" : shape);
+                        free(shape);
+                        break;
                     }
+                    umla = umla->next;
+
+                    if((umla == NULL)&&(parentlist != NULL)) {
+                        parentlist = parentlist->parents;
+                        if(parentlist != NULL) {
+                            umla = parentlist->key->attributes;
+                            parentlist2 = b->classlist;
+                            while((strcmp(parentlist->key->name,
+                                          parentlist2->key->name) != 0)&&
+                                  (parentlist2 != NULL))
+                                parentlist2 = parentlist2->next;
+                            parentlist = parentlist2;
+                        }
+                    }
+
                 }
-                fclose(outfileshp);
             }
         }
         tmplist = tmplist->next;
     }
+    if ( outfileshp != NULL ) {
+        d2c_outfile_close(outfileshp);
+    }
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -20,11 +20,61 @@
 #include "parse_diagram.h"
 #include "code_generators.h"
 
+/*
+ * The columns of each table are its attributes and the inherited ones.
+ * They are gathered in a copy of the attribute lists, by class: the
+ * model is shared with the other targets of the run.
+ */
+struct sqltable {
+    umlclass *key;
+    umlattrlist attributes;
+};
+typedef struct sqltable sqltable;
+
+static D2C_TASK_LOCAL sqltable *tables = NULL;
+static D2C_TASK_LOCAL int ntables = 0;
+
+static int by_class(const void *a, const void *b)
+{
+    const umlclass *x = ((const sqltable *) a)->key;
+    const umlclass *y = ((const sqltable *) b)->key;
+
+    return x < y ? -1 : x > y;
+}
+
+static void copy_tables(umlclasslist classlist)
+{
+    umlclasslist tmplist;
+
+    ntables = 0;
+    for (tmplist = classlist; tmplist != NULL; tmplist = tmplist->next) {
+        ntables++;
+    }
+    tables = my_malloc((ntables + 1) * sizeof(sqltable));
+    ntables = 0;
+    for (tmplist = classlist; tmplist != NULL; tmplist = tmplist->next) {
+        tables[ntables].key = tmplist->key;
+        tables[ntables].attributes = copy_attributes(tmplist->key->attributes);
+        ntables++;
+    }
+    qsort(tables, ntables, sizeof(sqltable), by_class);
+}
+
+/* returns the columns of the table of class */
+static umlattrlist columns(umlclass *class)
+{
+    sqltable key, *found;
+
+    key.key = class;
+    found = bsearch(&key, tables, ntables, sizeof(sqltable), by_class);
+    return found != NULL ? found->attributes : class->attributes;
+}
+
 void inherit_attributes(umlclasslist parents, umlattrlist umla) {
     umlattrlist pumla;
 
     while (parents != NULL) {
-        pumla = parents->key->attributes;
+        pumla = columns(parents->key);
         insert_attribute(copy_attributes(pumla), umla);
         parents = parents->next;
     }
@@ -50,22 +100,32 @@ void generate_code_sql(batch *b) {
 
     if (tablelist == NULL) {
         fprintf(stderr, "Sorry, no class found in your file.\n");
-        exit(4);
+        d2c_exit(4);
+    }
+    copy_tables(tablelist);
+
+    /* load the license file */
+    if ( b->license != NULL && d2c_license_load(b->license) != 0 ) {
+        fprintf(stderr, "Can't open the license file.\n");
+        d2c_exit(2);
     }
 
     sprintf(outfilename, "%s/DEFINITION.SQL", b->outdir);
     dummyfile = fopen(outfilename, "r");
     if ( b->clobber || ! dummyfile ) {
-        outfilesql = fopen(outfilename, "w"); /* Moved this one to be able to OVERWRITE old file, changed from "a" to "w"... */
+        outfilesql = d2c_outfile_open(outfilename, "w"); /* Moved this one to be able to OVERWRITE old file, changed from "a" to "w"... */
         if ( outfilesql == NULL ) {
             fprintf(stderr, "Can't open file %s for writing\n", outfilename);
-            exit(3);
+            d2c_exit(3);
         }
 
+        /* add license to the header */
+        d2c_license_write(outfilesql, b->license, D2C_COMMENT_DASHES);
+
         /* This prevents buffer overflows */
         if (tmpdirlgth > sizeof(*outfilename) - 2) {
             fprintf(stderr, "Sorry, name of file too long ...\nTry a smaller dir name\n");
-            exit(4);
+            d2c_exit(4);
         }
     }
 
@@ -84,7 +144,7 @@ void generate_code_sql(batch *b) {
 
             /* Attributes (columns) */
             fprintf(outfilesql, "-- Attributes --\n");
-            umla = tablelist->key->attributes;
+            umla = columns(tablelist->key);
             inherit_attributes (tablelist->parents, umla);
             while ( umla != NULL) {
                 fprintf(outfilesql, "  %s %s", umla->key.name, umla->key.type);
@@ -95,7 +155,7 @@ void generate_code_sql(batch *b) {
             }
 
             /* IsStatic attribute (Primary Key) */
-            umla = tablelist->key->attributes;
+            umla = columns(tablelist->key);
             while ( umla != NULL) {
                 if( umla->key.isstatic ) {
                     if( !seenFirst ) {
@@ -137,15 +197,15 @@ void generate_code_sql(batch *b) {
               AI: use "surrogate key" trailing _id convention of most popular ORMs
               http://en.wikipedia.org/wiki/Surrogate_key
             */
-            char tail[4];
             const char *fk_col =  assoc->name;
-            strncpy(tail, fk_col + strlen(fk_col) - 3, 3);
+            size_t namelen = strlen(fk_col);
+            const char *tail = namelen >= 3 ? fk_col + namelen - 3 : fk_col;
             if (!strcmp("_id", tail)) {
                 fk_col = "id";
             } else {
-                printf("warning: association name %s does not end in _id but rather %s,\n",
+                fprintf(stderr, "warning: association name %s does not end in _id but rather %s,\n",
                        assoc->name, tail);
-                printf("make sure FK cols have the same name on both tables\n");
+                fprintf(stderr, "make sure FK cols have the same name on both tables\n");
                 fk_col = assoc->name;
             }
             // assumes the default A to B direction (ignores direction setting in drawing)
@@ -161,7 +221,7 @@ void generate_code_sql(batch *b) {
             if(is_present(b->sqlopts, "fkidx")){
                 /* AI: many-to-many connectors have fk that are also pk... */
                 int pk = 0;
-                umla = assoc->key->attributes;
+                umla = columns(assoc->key);
                 while ( umla != NULL) {
                     if( umla->key.isstatic && !strcmp(umla->key.name,assoc->name)) {
                         pk = 1;
@@ -184,7 +244,9 @@ void generate_code_sql(batch *b) {
         tablelist = tablelist->next;
     }
     fprintf(stderr, "Finished!\n");
-    fclose(outfilesql);
+    d2c_outfile_close(outfilesql);
+    free(tables);
+    tables = NULL;
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
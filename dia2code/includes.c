@@ -1,6 +1,6 @@
 #include "includes.h"
 
-namelist includes = NULL;
+D2C_TASK_LOCAL namelist includes = NULL;
 
 int have_include (char *name)
 {
@@ -20,12 +20,12 @@ void add_include (char *name)
     if (have_include (name))
         return;
     if (inc == NULL) {
-        includes = NEW (namenode);
+        includes = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
         inc = includes;
     } else {
         while (inc->next)
             inc = inc->next;
-        inc->next = NEW (namenode);
+        inc->next = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
         inc = inc->next;
     }
     inc->name = name;
@@ -42,12 +42,12 @@ void push_include (umlclassnode *node)
     }
 }
 
-void determine_includes (declaration *d, batch *b)
+static void add_includes (declaration *d, batch *b)
 {
     if (d->decl_kind == dk_module) {
         declaration *inner = d->u.this_module->contents;
         while (inner != NULL) {
-            determine_includes (inner, b);
+            add_includes (inner, b);
             inner = inner->next;
         }
     } else {
@@ -59,3 +59,13 @@ void determine_includes (declaration *d, batch *b)
     }
 }
 
+void determine_includes (declaration *d, batch *b)
+{
+    d2c_clock clock;
+
+    d2c_stats_start (&clock);
+    add_includes (d, b);
+    d2c_stats_stop_at (D2C_PHASE_DECLS, &clock,
+                       d->decl_kind == dk_module ? d->u.this_module->pkg->name
+                                                 : d->u.this_class->key->name, NULL);
+}
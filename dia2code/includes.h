@@ -7,7 +7,7 @@
 #include "dia2code.h"
 #include "decls.h"
 
-extern namelist includes;
+extern D2C_TASK_LOCAL namelist includes;
 
 extern int have_include (char *name);
 extern void add_include (char *name);
@@ -0,0 +1,123 @@
+/***************************************************************************
+                          libdia2code.h  -  The dia2code library
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * libdia2code generates the code of a diagram in the calling process:
+ *
+ *     d2c_context *ctx = d2c_context_new();
+ *     d2c_sink *sink = d2c_sink_memory();
+ *
+ *     d2c_context_set(ctx, "file.outdir", "src");
+ *     if (d2c_parse_file(ctx, "model.dia") == D2C_OK
+ *             && d2c_generate(ctx, "java", sink) == D2C_OK) {
+ *         ... d2c_sink_memory_files(sink) ...
+ *     }
+ *     d2c_sink_free(sink);
+ *     d2c_context_free(ctx);
+ *
+ * The functions return an error code instead of exiting, the message
+ * going to stderr.  A context holds the options and the parsed diagram;
+ * different contexts can be used by different threads at the same time.
+ */
+
+#ifndef LIBDIA2CODE_H
+#define LIBDIA2CODE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Error codes, also the exit codes of dia2code */
+#define D2C_OK              0
+#define D2C_ERR_MEMORY      1   /* out of memory, or a thread can't start */
+#define D2C_ERR_INPUT       2   /* unreadable diagram or license file */
+#define D2C_ERR_OUTPUT      3   /* a generated file can't be written */
+#define D2C_ERR_GENERATE    4   /* no class found, or a file name too long */
+#define D2C_ERR_TARGET      5   /* unknown generator */
+#define D2C_ERR_OPTION      6   /* unknown option or invalid value */
+#define D2C_ERR_NO_DIAGRAM  7   /* no diagram parsed in the context */
+
+/**
+ * Output sinks receive the generated files.  The default one writes them
+ * below the output directory; the others get each file as a whole from
+ * d2c_outfile_close().  write() returns 0, 1 if the file was left
+ * unchanged, or -1 on error; mkdir, finish and destroy may be NULL.
+*/
+struct d2c_sink {
+    int (*write) (struct d2c_sink *sink, const char *filename, const char *buf, size_t len);
+    int (*mkdir) (struct d2c_sink *sink, const char *dirname, mode_t mode);
+    int (*finish) (struct d2c_sink *sink);
+    void (*destroy) (struct d2c_sink *sink);
+    void *data;
+};
+typedef struct d2c_sink d2c_sink;
+
+/* A file kept by the in-memory sink; buf is also '\0' terminated */
+struct d2c_memfile {
+    char *filename;
+    char *buf;
+    size_t len;
+    struct d2c_memfile *next;
+};
+typedef struct d2c_memfile d2c_memfile;
+
+d2c_sink * d2c_sink_memory ();
+d2c_memfile * d2c_sink_memory_files (d2c_sink *sink);
+d2c_sink * d2c_sink_tar (FILE *f);
+void d2c_sink_free (d2c_sink *sink);
+
+typedef struct d2c_context d2c_context;
+
+d2c_context * d2c_context_new ();
+void d2c_context_free (d2c_context *ctx);
+
+/**
+ * Sets an option of the context, with the names and values of the
+ * initialization file where there is one:
+ *
+ *     file.outdir            output directory, "." by default
+ *     file.license           license file (-l)
+ *     file.ext               file extension (-ext)
+ *     file.bodyext           body file extension (-bext)
+ *     indent.size            spaces per indentation level
+ *     indent.brace.newline   "yes" or "no"
+ *     generate.classes       comma-separated classes to generate (-cl)
+ *     generate.invert        "yes" to invert the selection (-v)
+ *     generate.clobber       "no" to keep the files that exist (-nc)
+ *     generate.buildtree     "yes" for a directory per package
+ *     sql.options            SQL options (-sqlx)
+ *
+ * Returns D2C_OK, or D2C_ERR_OPTION.  d2c_context_get() returns the
+ * value set, or NULL.
+*/
+int d2c_context_set (d2c_context *ctx, const char *name, const char *value);
+const char * d2c_context_get (d2c_context *ctx, const char *name);
+
+/**
+ * Parse a diagram into the context, replacing the previous one: from
+ * the file path, which may be compressed, or from the len bytes of an
+ * uncompressed diagram at buf.
+*/
+int d2c_parse_file (d2c_context *ctx, const char *path);
+int d2c_parse_buffer (d2c_context *ctx, const char *buf, size_t len);
+
+/**
+ * Generates the code of the diagram of the context with the generator
+ * named target, as for -t, into sink; a NULL sink writes the files
+ * below the output directory.  Nothing is written if it fails.
+*/
+int d2c_generate (d2c_context *ctx, const char *target, d2c_sink *sink);
+
+#endif
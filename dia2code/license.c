@@ -0,0 +1,257 @@
+/***************************************************************************
+                          license.c  -  License header of the generated files
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "dia2code.h"
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+ * The license file is read once, and rendered once per comment style;
+ * every generated file then gets its header with a single write.  The
+ * jobs of --batch may each use their own license, so every file loaded
+ * is kept, and shared by the threads.  The generators load it as they
+ * start, which reads it again if the file changed since: the requests
+ * of --serve, or the generations of a library context, then get the
+ * new text.  The older texts are kept too, another run may be writing
+ * them.
+ */
+struct license {
+    char *name;
+    dev_t dev;               /* what the file was when it was read */
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    char *rendered[D2C_COMMENT_STYLES];
+    size_t rendered_len[D2C_COMMENT_STYLES];
+    struct license *next;
+};
+
+static struct license *licenses = NULL;
+static pthread_mutex_t license_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* what starts a comment line in each style, see D2C_COMMENT_* */
+static const char *line_prefix[D2C_COMMENT_STYLES] = { " *", "//", "--", "#" };
+
+/* returns 1 if every non blank line of text starts with prefix */
+static int all_lines_start_with(const char *text, const char *prefix)
+{
+    const char *line = text;
+
+    while (*line != '\0') {
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        if (*line != '\n' && *line != '\r' && *line != '\0'
+                && strncmp(line, prefix, strlen(prefix)) != 0) {
+            return 0;
+        }
+        line = strchr(line, '\n');
+        if (line == NULL) {
+            break;
+        }
+        line++;
+    }
+    return 1;
+}
+
+/* returns 1 if the license is already written as a comment of style */
+static int is_comment(const char *text, int style)
+{
+    const char *start = text + strspn(text, " \t\r\n");
+
+    switch (style) {
+    case D2C_COMMENT_BLOCK:
+    case D2C_COMMENT_SLASHES:
+        return strncmp(start, "/*", 2) == 0 || strncmp(start, "//", 2) == 0;
+    default:
+        return all_lines_start_with(text, line_prefix[style]);
+    }
+}
+
+static void render(struct license *l, const char *text, size_t len, int style)
+{
+    FILE *f;
+    const char *p, *end = text + len;
+
+    if (len == 0 || is_comment(text, style)) {
+        l->rendered[style] = my_malloc(len + 1);
+        memcpy(l->rendered[style], text, len);
+        l->rendered_len[style] = len;
+        return;
+    }
+    f = open_memstream(&l->rendered[style], &l->rendered_len[style]);
+    if (f == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    if (style == D2C_COMMENT_BLOCK) {
+        fputs("/*\n", f);
+    }
+    for (p = text; p < end; p++) {
+        if (p == text || p[-1] == '\n') {
+            fputs(line_prefix[style], f);
+            if (*p != '\n' && *p != '\r') {
+                fputc(' ', f);
+            }
+        }
+        /* the text must not end the block comment */
+        if (style == D2C_COMMENT_BLOCK && p[0] == '*' && p + 1 < end && p[1] == '/') {
+            fputs("* ", f);
+            continue;
+        }
+        fputc(*p, f);
+    }
+    if (end[-1] != '\n') {
+        fputc('\n', f);
+    }
+    if (style == D2C_COMMENT_BLOCK) {
+        fputs(" */\n", f);
+    }
+    fclose(f);
+}
+
+/* returns 1 if l was read from the file st is the status of */
+static int same_file(const struct license *l, const struct stat *st)
+{
+    return l->dev == st->st_dev && l->ino == st->st_ino
+        && l->mtime.tv_sec == st->st_mtim.tv_sec
+        && l->mtime.tv_nsec == st->st_mtim.tv_nsec
+        && l->size == st->st_size;
+}
+
+/* finds the text of filename last loaded, or the one read from the
+   file of status st if st is not NULL */
+static struct license *find_license(const char *filename, const struct stat *st)
+{
+    struct license *l;
+
+    pthread_mutex_lock(&license_lock);
+    for (l = licenses; l != NULL; l = l->next) {
+        if (eq(l->name, filename) && (st == NULL || same_file(l, st))) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&license_lock);
+    return l;
+}
+
+/**
+ * Reads the license file and renders it for every comment style.
+ * Nothing is done if filename is already loaded and has not changed
+ * since, by its device, inode, modification time and size.  Returns 0,
+ * or -1 if the file can't be read.
+*/
+int d2c_license_load(const char *filename)
+{
+    char *text = NULL;
+    size_t len = 0, size = 0, n;
+    int style;
+    struct license *l;
+    struct stat st;
+    FILE *f;
+
+    if (stat(filename, &st) == 0 && find_license(filename, &st) != NULL) {
+        return 0;
+    }
+    f = fopen(filename, "rb");
+    if (f == NULL || fstat(fileno(f), &st) != 0) {
+        if (f != NULL) {
+            fclose(f);
+        }
+        return -1;
+    }
+    d2c_deps_input(filename);
+    do {
+        if (len == size) {
+            size = size == 0 ? LARGE_BUFFER : 2 * size;
+            text = realloc(text, size + 1);
+            if (text == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+        n = fread(text + len, 1, size - len, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    text[len] = '\0';
+
+    l = my_malloc(sizeof(struct license));
+    for (style = 0; style < D2C_COMMENT_STYLES; style++) {
+        render(l, text, len, style);
+    }
+    free(text);
+    l->name = strdup(filename);
+    l->dev = st.st_dev;
+    l->ino = st.st_ino;
+    l->mtime = st.st_mtim;
+    l->size = st.st_size;
+    /* another job may have loaded it meanwhile, the copies are the same;
+       the last one loaded comes first, for d2c_license_write() */
+    pthread_mutex_lock(&license_lock);
+    l->next = licenses;
+    licenses = l;
+    pthread_mutex_unlock(&license_lock);
+    return 0;
+}
+
+/**
+ * Writes the license last loaded by d2c_license_load() to f as a
+ * comment of the given style, without checking the file again.  A
+ * license that is already such a comment is copied as it is; any other
+ * text is turned into one.
+*/
+void d2c_license_write(FILE *f, const char *filename, int style)
+{
+    struct license *l;
+
+    if (filename == NULL) {
+        return;
+    }
+    l = find_license(filename, NULL);
+    if (l == NULL) {
+        if (d2c_license_load(filename) != 0) {
+            return;
+        }
+        l = find_license(filename, NULL);
+    }
+    fwrite(l->rendered[style], 1, l->rendered_len[style], f);
+}
+
+/**
+ * Drops the license file loaded by d2c_license_load(), so that it is
+ * read again when it changed.  No file may be generated meanwhile.
+*/
+void d2c_license_forget(const char *filename)
+{
+    struct license **p, *l;
+    int style;
+
+    pthread_mutex_lock(&license_lock);
+    for (p = &licenses; *p != NULL; ) {
+        l = *p;
+        if (eq(l->name, filename)) {
+            *p = l->next;
+            for (style = 0; style < D2C_COMMENT_STYLES; style++) {
+                free(l->rendered[style]);
+            }
+            free(l->name);
+            free(l);
+        } else {
+            p = &l->next;
+        }
+    }
+    pthread_mutex_unlock(&license_lock);
+}
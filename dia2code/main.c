@@ -18,6 +18,9 @@
 #include "dia2code.h"
 #include "code_generators.h"
 #include "parse_diagram.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
 
 int process_initialization_file(char *filename, int exit_if_not_found);
 
@@ -57,7 +60,7 @@ find_dia2code_module(const char *lang) {
         fprintf(stderr, "can't find the module: %s\n", dlerror());
         exit(2);
     }
-    printf("module name : %s\n", modulename);
+    fprintf(stderr, "module name : %s\n", modulename);
     generator = dlsym(handle, modulename);
 
     free(modulepath);
@@ -69,10 +72,686 @@ find_dia2code_module(const char *lang) {
 #endif /* DSO */
 
 char *outdir = NULL;   /* Output directory */
+char *tarfile = NULL;  /* Tar archive to write instead of files */
+char *batchfile = NULL;  /* Manifest of the jobs of --batch */
+char *serve_socket = NULL;   /* Socket of --serve */
+char *client_socket = NULL;  /* Socket of --client */
 
 int INDENT_CNT = 4; /* This should be a parameter in the command line */
 int bOpenBraceOnNewline = 1; /* This should also be a command-line parameter */
 
+/*
+ * Parses the comma-separated targets of "-t" in list, which is kept
+ * for their names.  Returns their number, 0 if one is unknown.
+ */
+static int parse_targets(char *list, d2c_target **targets)
+{
+    char *name, *save;
+    const d2c_generator *known;
+    void (*generator)(batch *);
+    int k, ntargets = 0;
+
+    /* at most one target per comma-separated name */
+    *targets = my_malloc((strlen(list) / 2 + 1) * sizeof(d2c_target));
+    memset(*targets, 0, (strlen(list) / 2 + 1) * sizeof(d2c_target));
+    for (name = strtok_r(list, ",", &save); name != NULL;
+         name = strtok_r(NULL, ",", &save)) {
+        known = d2c_find_generator(name);
+        generator = known != NULL ? known->generator : NULL;
+        if (generator == NULL) {
+#if DSO == 1 && defined(CODEGEN_USE_DSO)
+            generator = find_dia2code_module(name);
+            if ( ! generator ) {
+                fprintf(stderr, "can't find the generator: %s\n", dlerror());
+                return 0;
+            }
+#else
+            return 0;
+#endif
+        }
+        /* a target listed twice is generated once */
+        for (k = 0; k < ntargets && (*targets)[k].generator != generator; k++) {
+        }
+        if (k == ntargets) {
+            (*targets)[ntargets].name = name;
+            (*targets)[ntargets].generator = generator;
+            (*targets)[ntargets].buildtree = known != NULL && known->buildtree;
+            (*targets)[ntargets].pipeline = known != NULL && known->pipeline;
+            ntargets++;
+        }
+    }
+    return ntargets;
+}
+
+/* The manifest of --incremental, the cache of --output-cache, and the
+   fingerprints of the diagram */
+static d2c_manifest *generation_manifest = NULL;
+static d2c_cache *generation_cache = NULL;
+static d2c_fingerprints *generation_fingerprints = NULL;
+
+/* with --incremental, only the classes of b that changed since the
+   manifest was written are generated for target; with --output-cache,
+   those the cache has are taken from it */
+static void use_manifest(batch *b, const char *target)
+{
+    int count;
+
+    if (generation_cache != NULL) {
+        b->cache = d2c_cache_use(generation_cache, target,
+                                 d2c_options_hash(b, target),
+                                 generation_fingerprints, b->outdir);
+    }
+    if (generation_manifest == NULL) {
+        return;
+    }
+    b->manifest = d2c_manifest_use(generation_manifest, target,
+                                   d2c_options_hash(b, target),
+                                   generation_fingerprints);
+    b->changed = d2c_manifest_changed(b->manifest, b->classlist, &count);
+    b->incremental = 1;
+}
+
+/* Generates the targets from the diagram of b, as set up by the command line */
+static void generate(batch *b, d2c_target *targets, int ntargets)
+{
+    d2c_clock clock;
+    int i, previous;
+
+    /* the directories of a served model, or of the run before --watch
+       saw a change, may have been removed since */
+    start_package_dirs(b);
+    for (i = 0; i < ntargets; i++) {
+        if (targets[i].buildtree == 0 && b->buildtree == 1) {
+            if (ntargets == 1) {
+                fprintf( stderr,"warning: this generator does not support building tree yet. disabled \n" );
+            } else {
+                fprintf( stderr,"warning: %s does not support building tree yet. disabled for it\n",
+                         targets[i].name );
+            }
+        }
+    }
+
+    if (ntargets == 1) {
+        b->buildtree = b->buildtree && targets[0].buildtree;
+        use_manifest(b, targets[0].name);
+        previous = d2c_stats_generator_start(targets[0].name, &clock);
+        (*targets[0].generator)(b);
+        d2c_stats_generator_stop(previous, &clock);
+        return;
+    }
+    /* each target gets its own directory below the output directory */
+    for (i = 0; i < ntargets; i++) {
+        targets[i].b = *b;
+        targets[i].b.outdir = d2c_file_path(b->outdir, targets[i].name, "");
+        targets[i].b.buildtree = b->buildtree && targets[i].buildtree;
+        use_manifest(&targets[i].b, targets[i].name);
+        if (d2c_outfile_mkdir(targets[i].b.outdir, 0777) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Can't create directory %s\n", targets[i].b.outdir);
+            d2c_exit(3);
+        }
+    }
+    /* loaded here, the license is only read by the targets */
+    if (b->license != NULL) {
+        d2c_license_load(b->license);
+    }
+    d2c_generate_targets(targets, ntargets);
+}
+
+struct generation {
+    batch *b;
+    d2c_target *targets;
+    int ntargets;
+};
+
+static void call_generate(void *arg)
+{
+    struct generation *g = arg;
+
+    generate(g->b, g->targets, g->ntargets);
+}
+
+/*
+ * Parses diagram into b and generates the targets from it.  With
+ * --pipeline, and if all the targets support it, the classes are
+ * linked while they are generated; with --incremental or
+ * --output-cache, they are all linked first, to be fingerprinted.
+ */
+static void parse_and_generate(batch *b, char *diagram, d2c_target *targets, int ntargets)
+{
+    umlrelationlist relations;
+    struct generation g;
+    int i, status;
+
+    for (i = 0; i < ntargets && targets[i].pipeline; i++) {
+    }
+    b->pipeline = NULL;
+    if (generate_incremental || output_cache != NULL) {
+        b->classlist = parse_diagram(diagram);
+        generation_fingerprints = d2c_fingerprint_classes(b->classlist);
+        if (generate_incremental) {
+            generation_manifest = d2c_manifest_read(b->outdir);
+        }
+        if (output_cache != NULL) {
+            generation_cache = d2c_cache_open(output_cache);
+        }
+        generate(b, targets, ntargets);
+        return;
+    }
+    if (!generate_pipeline || i < ntargets) {
+        b->classlist = parse_diagram(diagram);
+        generate(b, targets, ntargets);
+        return;
+    }
+    b->classlist = parse_diagram_objects(diagram, &relations);
+    b->pipeline = d2c_pipeline_start(b->classlist, relations);
+    g.b = b;
+    g.targets = targets;
+    g.ntargets = ntargets;
+    /* the link stage is joined first, even if the generation failed */
+    status = d2c_catch(call_generate, &g);
+    d2c_pipeline_finish(b->pipeline);
+    b->pipeline = NULL;
+    if (status != 0) {
+        d2c_exit(status);
+    }
+}
+
+/* A line of the manifest of --batch, or a request of --serve */
+struct job {
+    const char *source;  /* the manifest, or the socket */
+    int line;
+    char *diagram;
+    char *target_names;
+    d2c_target *targets;
+    int ntargets;
+    batch b;
+    char *file_ext;
+    char *body_file_ext;
+    d2c_model *model;    /* with --serve, see d2c_model_get() */
+    int status;         /* exit status, 0 if the job succeeded */
+};
+typedef struct job job;
+
+/* what the jobs start from, see d2c_genstate_save() */
+static d2c_genstate job_state;
+
+/* returns the argument of the option of a manifest line */
+static char *job_argument(char **save, const char *manifest, int line)
+{
+    char *arg = strtok_r(NULL, " \t\r\n", save);
+
+    if (arg == NULL) {
+        fprintf(stderr, "%s:%d: missing option argument\n", manifest, line);
+        d2c_exit(2);
+    }
+    return arg;
+}
+
+/*
+ * Sets up the job j from the line s of the manifest of --batch: a
+ * diagram, its targets as given to -t, the output directory, and then
+ * the options -nc, -cl, -v, -l, -ext, -bext, --buildtree and -sqlx,
+ * which start from the values of the command line.  Returns 0 if the
+ * line is empty or starts with '#'.
+ */
+static int parse_job(job *j, char *s, const char *manifest, int line, const batch *defaults)
+{
+    char *token, *save;
+
+    j->source = manifest;
+    j->line = line;
+    j->diagram = NULL;
+    j->target_names = NULL;
+    j->targets = NULL;
+    j->ntargets = 0;
+    j->b = *defaults;
+    j->b.outdir = NULL;
+    j->file_ext = file_ext;
+    j->body_file_ext = body_file_ext;
+    j->model = NULL;
+    j->status = 0;
+
+    token = strtok_r(s, " \t\r\n", &save);
+    if (token == NULL || token[0] == '#') {
+        return 0;
+    }
+    j->diagram = strdup(token);
+
+    token = strtok_r(NULL, " \t\r\n", &save);
+    if (token == NULL || (j->target_names = strdup(token)) == NULL
+            || (j->ntargets = parse_targets(j->target_names, &j->targets)) == 0) {
+        fprintf(stderr, "%s:%d: missing or unknown target\n", manifest, line);
+        d2c_exit(2);
+    }
+    token = strtok_r(NULL, " \t\r\n", &save);
+    if (token == NULL) {
+        fprintf(stderr, "%s:%d: missing output directory\n", manifest, line);
+        d2c_exit(2);
+    }
+    j->b.outdir = strdup(token);
+
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if ( eq (token, "-nc") ) {
+            j->b.clobber = 0;
+        } else if ( eq (token, "-cl") ) {
+            j->b.classes = parse_class_names(job_argument(&save, manifest, line));
+            j->b.mask = 1 - j->b.mask;
+        } else if ( eq (token, "-v") ) {
+            j->b.mask = 1 - j->b.mask;
+        } else if ( eq (token, "-l") ) {
+            j->b.license = strdup(job_argument(&save, manifest, line));
+        } else if ( eq (token, "-ext") ) {
+            j->file_ext = strdup(job_argument(&save, manifest, line));
+        } else if ( eq (token, "-bext") ) {
+            j->body_file_ext = strdup(job_argument(&save, manifest, line));
+        } else if ( eq (token, "--buildtree") ) {
+            j->b.buildtree = 1;
+        } else if ( eq (token, "-sqlx") ) {
+            j->b.sqlopts = parse_sql_options(job_argument(&save, manifest, line));
+        } else {
+            fprintf(stderr, "%s:%d: unknown option %s\n", manifest, line, token);
+            d2c_exit(2);
+        }
+    }
+    return 1;
+}
+
+/* A line of the manifest of --batch, see read_line() */
+struct manifest_line {
+    job *j;
+    char *s;
+    const char *manifest;
+    int line;
+    const batch *defaults;
+    int jobs;           /* what parse_job() returned */
+};
+
+static void read_line(void *arg)
+{
+    struct manifest_line *l = arg;
+
+    l->jobs = parse_job(l->j, l->s, l->manifest, l->line, l->defaults);
+}
+
+/*
+ * Reads the manifest of --batch, one job per line as for parse_job().
+ * Returns the number of jobs.  A line that isn't a job is reported and
+ * skipped, the others are still run: *skipped counts such lines, and
+ * *status is set to the exit status of the first one, if it is still 0.
+ */
+static int read_manifest(const char *manifest, const batch *defaults, job **jobs,
+                         int *skipped, int *status)
+{
+    FILE *f;
+    char s[LARGE_BUFFER];
+    int line = 0, count = 0, size = 0, failed;
+    struct manifest_line l;
+
+    f = eq(manifest, "-") ? stdin : fopen(manifest, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open manifest %s\n", manifest);
+        d2c_exit(2);
+    }
+    *jobs = NULL;
+    while (fgets(s, sizeof(s), f) != NULL) {
+        line++;
+        if (count == size) {
+            size = size == 0 ? 16 : 2 * size;
+            *jobs = realloc(*jobs, size * sizeof(job));
+            if (*jobs == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+        l.j = &(*jobs)[count];
+        l.s = s;
+        l.manifest = manifest;
+        l.line = line;
+        l.defaults = defaults;
+        l.jobs = 0;
+        failed = d2c_catch(read_line, &l);
+        if (failed != 0) {
+            fprintf(stderr, "%s:%d: skipped\n", manifest, line);
+            free(l.j->diagram);
+            free(l.j->target_names);
+            free(l.j->targets);
+            free(l.j->b.outdir);
+            (*skipped)++;
+            if (*status == 0) {
+                *status = failed;
+            }
+            continue;
+        }
+        count += l.jobs;
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    return count;
+}
+
+static void generate_job(void *arg)
+{
+    job *j = arg;
+
+    /* libxml2 keeps this setting per thread */
+    xmlKeepBlanksDefault(0);
+    if (serve_socket == NULL) {
+        parse_and_generate(&j->b, j->diagram, j->targets, j->ntargets);
+        return;
+    }
+    /* the server parses a diagram again only once it changed */
+    j->model = d2c_model_get(j->diagram);
+    j->b.classlist = d2c_model_classes(j->model);
+    generate(&j->b, j->targets, j->ntargets);
+}
+
+/*
+ * Runs the job item, a task of --batch.  Its files are written once it
+ * is done, and only if it succeeded; a failed job does not stop the
+ * others.
+ */
+static void run_job(batch *unused, void *item)
+{
+    job *j = item;
+    void *files = NULL;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    d2c_genstate_restore(&job_state);
+    file_ext = j->file_ext;
+    body_file_ext = j->body_file_ext;
+    d2c_outfile_collect(&files);
+    j->status = d2c_catch(generate_job, j);
+    if (j->model != NULL) {
+        d2c_model_release(j->model);
+        j->model = NULL;
+    }
+    if (j->status != 0) {
+        d2c_outfile_discard();
+    } else {
+        d2c_outfile_collect(NULL);
+        j->status = d2c_catch(d2c_outfile_commit, files);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (j->status == 0) {
+        fprintf(stderr, "%s:%d: %s: ok (%.3fs)\n", j->source, j->line, j->diagram,
+                (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    } else {
+        fprintf(stderr, "%s:%d: %s: failed with exit code %d (%.3fs)\n",
+                j->source, j->line, j->diagram, j->status,
+                (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+}
+
+/*
+ * Runs the jobs of the manifest on generate_jobs threads, and returns
+ * the exit status of the first line skipped, else of the first job that
+ * failed, 0 if none did.
+ */
+static int run_manifest(const batch *defaults)
+{
+    job *jobs;
+    void **items;
+    int i, count, jobs_count, skipped = 0, failed = 0, status = 0;
+
+    count = read_manifest(batchfile, defaults, &jobs, &skipped, &status);
+    items = my_malloc((count + 1) * sizeof(void *));
+    for (i = 0; i < count; i++) {
+        items[i] = &jobs[i];
+    }
+    /* the jobs share the threads, each one generates its files alone */
+    jobs_count = generate_jobs;
+    generate_jobs = 1;
+    d2c_genstate_save(&job_state);
+    xmlInitParser();
+    d2c_run_jobs(run_job, items, count, jobs_count);
+
+    for (i = 0; i < count; i++) {
+        if (jobs[i].status != 0) {
+            failed++;
+            if (status == 0) {
+                status = jobs[i].status;
+            }
+        }
+    }
+    /* the lines skipped count as failed jobs */
+    fprintf(stderr, "%s: %d jobs, %d failed\n", batchfile, count + skipped, failed + skipped);
+    free(items);
+    return status;
+}
+
+/* what the requests of --serve start from, as the jobs of --batch */
+static batch serve_defaults;
+static int serve_requests = 0;
+
+struct request {
+    job *j;
+    char *line;
+};
+
+static void read_request(void *arg)
+{
+    struct request *r = arg;
+
+    parse_job(r->j, r->line, serve_socket,
+              __atomic_add_fetch(&serve_requests, 1, __ATOMIC_RELAXED),
+              &serve_defaults);
+}
+
+/* frees what parse_job() and generate() allocated for the job */
+static void free_job(job *j)
+{
+    int i;
+
+    for (i = 0; j->ntargets > 1 && i < j->ntargets; i++) {
+        free(j->targets[i].b.outdir);
+    }
+    free(j->diagram);
+    free(j->target_names);
+    free(j->targets);
+    free(j->b.outdir);
+    if (j->b.classes != serve_defaults.classes) {
+        free_names(j->b.classes);
+    }
+    if (j->b.sqlopts != serve_defaults.sqlopts) {
+        free_names(j->b.sqlopts);
+    }
+    if (j->b.license != serve_defaults.license) {
+        free(j->b.license);
+    }
+    if (j->file_ext != job_state.file_ext) {
+        free(j->file_ext);
+    }
+    if (j->body_file_ext != job_state.body_file_ext) {
+        free(j->body_file_ext);
+    }
+}
+
+/*
+ * Runs a request of a client of --serve, a line of a manifest of
+ * --batch, and returns its exit status.
+ */
+static int serve_request(char *line)
+{
+    job j;
+    struct request r;
+    int status;
+
+    d2c_genstate_restore(&job_state);
+    memset(&j, 0, sizeof(j));
+    r.j = &j;
+    r.line = line;
+    status = d2c_catch(read_request, &r);
+    if (status == 0) {
+        run_job(NULL, &j);
+        status = j.status;
+    }
+    free_job(&j);
+    return status;
+}
+
+/* appends word to the request of --client */
+static void add_word(char *request, const char *word)
+{
+    if (strlen(request) + strlen(word) + 2 > LARGE_BUFFER || strpbrk(word, " \t\r\n") != NULL) {
+        fprintf(stderr, "Can't send %s to the server\n", word);
+        exit(2);
+    }
+    if (request[0] != '\0') {
+        strcat(request, " ");
+    }
+    strcat(request, word);
+}
+
+/* the server has its own current directory, the paths sent are absolute */
+static char *client_path(char *path)
+{
+    char cwd[BIG_BUFFER];
+
+    if (path[0] == '/') {
+        return path;
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "Can't get the current directory\n");
+        exit(2);
+    }
+    return d2c_file_path(cwd, path, "");
+}
+
+/* The diagram that --watch generates again as it changes */
+struct watch {
+    batch *b;
+    char *diagram;
+    char *ini;
+    d2c_target *targets;
+    int ntargets;
+    umlclasslist classlist;        /* as last generated */
+    d2c_fingerprints *fingerprints;  /* of classlist */
+};
+
+/* the bits of the files of --watch, see d2c_watch() */
+#define WATCH_DIAGRAM 1
+#define WATCH_LICENSE 2
+#define WATCH_INI 4
+
+static struct watch watched;
+
+static void parse_watched(void *arg)
+{
+    watched.b->classlist = parse_diagram(watched.diagram);
+}
+
+/*
+ * Generates the watched diagram again once the files of changed did.
+ * Only the classes that changed since the last generation, and those
+ * that use them, get their files generated again by the targets that
+ * write one file per class; the others are generated in full.
+ */
+static void watch_cycle(int changed, const struct timespec *saved)
+{
+    batch *b = watched.b;
+    d2c_fingerprints *fingerprints = NULL;
+    struct generation g;
+    struct timespec end;
+    void *files = NULL;
+    int i, status, count = 0;
+
+    if (changed & WATCH_INI) {
+        process_initialization_file(watched.ini, 0);
+        b->outdir = outdir;
+    }
+    if ((changed & WATCH_LICENSE) && b->license != NULL) {
+        d2c_license_forget(b->license);
+    }
+    b->classlist = watched.classlist;
+    status = 0;
+    if (b->classlist == NULL || (changed & WATCH_DIAGRAM)) {
+        status = d2c_catch(parse_watched, NULL);
+    }
+    if (status == 0) {
+        fingerprints = d2c_fingerprint_classes(b->classlist);
+        /* a new license or setting may change every file */
+        b->incremental = watched.fingerprints != NULL
+            && !(changed & (WATCH_LICENSE | WATCH_INI));
+        if (b->incremental) {
+            b->changed = d2c_changed_classes(b->classlist, fingerprints,
+                                             watched.fingerprints, &count);
+        }
+        g.b = b;
+        g.targets = watched.targets;
+        g.ntargets = watched.ntargets;
+        d2c_outfile_collect(&files);
+        status = d2c_catch(call_generate, &g);
+        if (status != 0) {
+            d2c_outfile_discard();
+        } else {
+            d2c_outfile_collect(NULL);
+            status = d2c_catch(d2c_outfile_commit, files);
+        }
+        for (i = 0; watched.ntargets > 1 && i < watched.ntargets; i++) {
+            free(watched.targets[i].b.outdir);
+        }
+        free_names(b->changed);
+        b->changed = NULL;
+    }
+
+    /* what was generated is kept to compare the next version with */
+    if (status == 0) {
+        if (watched.classlist != b->classlist) {
+            free_diagram(watched.classlist);
+        }
+        d2c_fingerprints_free(watched.fingerprints);
+        watched.classlist = b->classlist;
+        watched.fingerprints = fingerprints;
+    } else {
+        if (watched.classlist != b->classlist) {
+            free_diagram(b->classlist);
+        }
+        d2c_fingerprints_free(fingerprints);
+    }
+    b->classlist = watched.classlist;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (status != 0) {
+        fprintf(stderr, "%s: failed with exit code %d (%.3fs)\n", watched.diagram, status,
+                (end.tv_sec - saved->tv_sec) + (end.tv_nsec - saved->tv_nsec) / 1e9);
+    } else if (b->incremental) {
+        fprintf(stderr, "%s: %d changed classes generated (%.3fs)\n", watched.diagram,
+                count, (end.tv_sec - saved->tv_sec) + (end.tv_nsec - saved->tv_nsec) / 1e9);
+    } else {
+        fprintf(stderr, "%s: generated (%.3fs)\n", watched.diagram,
+                (end.tv_sec - saved->tv_sec) + (end.tv_nsec - saved->tv_nsec) / 1e9);
+    }
+}
+
+/*
+ * Generates the diagram, and then again each time it, the license of b
+ * or the initialization file ini is saved.  Only returns, with an exit
+ * status, if the files can't be watched.
+ */
+static int watch_diagram(batch *b, char *diagram, char *ini, d2c_target *targets, int ntargets)
+{
+    char *files[3];
+    struct timespec start;
+
+    watched.b = b;
+    watched.diagram = diagram;
+    watched.ini = ini;
+    watched.targets = targets;
+    watched.ntargets = ntargets;
+    /* the files that did not change keep their time */
+    output_ifchanged = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    watch_cycle(WATCH_DIAGRAM, &start);
+    files[0] = diagram;
+    files[1] = b->license;
+    files[2] = ini;
+    return d2c_watch(files, 3, watch_cycle);
+}
+
 int main(int argc, char **argv) {
     int i;
     char *license = NULL;  /* License file */
@@ -80,15 +759,16 @@ int main(int argc, char **argv) {
     char *infile = NULL;    /* The input file */
     namelist classestogenerate = NULL;
     namelist sqloptions = NULL;
-    int classmask = 0, parameter = 0, buildtree = 0;
-    /* put to 1 in the params loop if the generator accepts buildtree option */
-    int generator_buildtree = 0;
+    int classmask = 0, parameter = 0, buildtree = 0, watch = 0;
+    char *classnames = NULL, *sqlnames = NULL;  /* as given, for --client */
+    d2c_target *targets = NULL;  /* The generators selected with -t */
+    int ntargets = 0;
+    char *names;
     batch *thisbatch;
-    int iniParameterProcessed;
+    int iniParameterProcessed, status;
     char inifile[BIG_BUFFER];
-
-    void (*generator)(batch *);
-    void (*generators[NO_GENERATORS])(batch *);
+    d2c_clock run_clock;
+    char *ininame = NULL;  /* The initialization file read, for --watch */
 
     char * notice = "\
 dia2code version " VERSION ", Copyright (C) 2000-2001 Javier O'Hara\n\
@@ -96,19 +776,128 @@ Dia2Code comes with ABSOLUTELY NO WARRANTY\n\
 This is free software, and you are welcome to redistribute it\n\
 under certain conditions; read the COPYING file for details.\n";
 
-    char *help = "[-h|--help] [-d <dir>] [-nc] [-cl <classlist>]\n\
-       [-t (ada|c|cpp|csharp|idl|java|php|php5|python|ruby|shp|sql|as3)] [-v]\n\
+    char *help = "[-h|--help] [-d <dir>] [-nc] [--if-changed] [--atomic]\n\
+       [--fsync (none|dir|file)] [--async-write] [--io-uring] [--tar <file>]\n\
+       [--jobs <n>] [--pipeline] [--batch <manifest>] [--serve <socket>]\n\
+       [--cache-size <megabytes>] [--client <socket>] [--watch]\n\
+       [--incremental] [--output-cache <dir>] [--output-cache-size <megabytes>]\n\
+       [--output-cache-link] [--depfile <file>] [--manifest <file>]\n\
+       [--preserve-index] [--stats[=json]] [--mem-report] [--trace <file>]\n\
+       [-cl <classlist>]\n\
+       [-t (ada|c|cpp|csharp|idl|java|php|php5|python|ruby|shp|sql|as3)[,...]] [-v]\n\
        [-l <license file>] [-ini <initialization file>]<diagramfile>";
 
     char *bighelp = "\
     -h --help            Print this help and exit\n\
     -t <target>          Selects the output language. <target> can be\n\
                          one of: ada,c,cpp,idl,java,php,php5,python,ruby,shp,sql,as3 or csharp. \n\
-                         Default is C++\n\
+                         Default is C++.  Several comma-separated targets,\n\
+                         e.g. cpp,sql,idl, are generated at the same time\n\
+                         from a single parse, each in the subdirectory of\n\
+                         the output directory named after it\n\
     -d <dir>             Output generated files to <dir>, default is \".\" \n\
     --buildtree          Convert package names to a directory tree. off by default \n\
     -l <license>         License file to prepend to generated files.\n\
+                         Unless it already is a comment in the syntax of\n\
+                         the target, it is turned into one.\n\
     -nc                  Do not overwrite files that already exist\n\
+    --if-changed         Only rewrite files whose content changed, so that\n\
+                         unchanged files keep their modification time\n\
+    --atomic             Write each file to a temporary file in the target\n\
+                         directory and rename it over the final name\n\
+    --fsync <level>      Durability of atomic writes (implies --atomic):\n\
+                         \"none\" (default), \"dir\" to sync each output\n\
+                         directory once per run, or \"file\" to also sync\n\
+                         every file before it is renamed\n\
+    --async-write        Write the files from a background thread while\n\
+                         the next ones are generated\n\
+    --io-uring           Open, write and close the files in batches with\n\
+                         Linux io_uring, when the kernel supports it\n\
+    --tar <file>         Write the generated files to <file> as a single\n\
+                         tar archive instead of creating them; \"-\" writes\n\
+                         the archive to the standard output\n\
+    --jobs <n>           Generate the files with <n> threads; 0 uses one\n\
+                         per processor.  The output is the same as with\n\
+                         the default of 1\n\
+    --pipeline           Link the classes on a thread of their own while\n\
+                         the first ones are generated and written (with\n\
+                         --async-write, unless --io-uring is given).\n\
+                         Applies to java, csharp, python, php5, ruby and\n\
+                         as3; the other targets are generated once all\n\
+                         the classes are linked\n\
+    --batch <manifest>   Run the jobs listed in <manifest>, \"-\" for the\n\
+                         standard input, instead of a single diagram.\n\
+                         Each line holds a diagram, its targets as for -t,\n\
+                         the output directory and any of the options -nc,\n\
+                         -cl, -v, -l, -ext, -bext, --buildtree and -sqlx;\n\
+                         those of the command line apply to every job.\n\
+                         The jobs run on --jobs threads, one per\n\
+                         processor by default.  The exit code is that of\n\
+                         the first failed job\n\
+    --serve <socket>     Keep running, and generate the requests of the\n\
+                         clients that connect to the Unix <socket>: lines\n\
+                         in the format of the manifest of --batch, the\n\
+                         paths absolute.  The diagrams stay parsed in\n\
+                         memory and are only parsed again once they\n\
+                         change.  The options of the command line apply\n\
+                         to every request\n\
+    --cache-size <n>     With --serve, the megabytes of parsed diagrams\n\
+                         kept in memory, 256 by default; the least\n\
+                         recently used ones are dropped first\n\
+    --client <socket>    Send the diagram, -t, -d, -nc, -cl, -v, -l, -ext,\n\
+                         -bext, --buildtree and -sqlx to the server of\n\
+                         --serve at <socket> instead of generating the\n\
+                         code; the exit code is that of the request\n\
+    --watch              Keep running, and generate again each time the\n\
+                         diagram, the license or the initialization file\n\
+                         is saved.  Only the classes that changed, and\n\
+                         those that use them, get their files generated\n\
+                         again by the targets with one file per class;\n\
+                         unchanged files are not rewritten\n\
+    --incremental        Keep in <dir>/.dia2code-manifest the files that\n\
+                         each class was generated to, and only generate\n\
+                         again the classes that changed since, or use\n\
+                         classes that did, or whose files are missing,\n\
+                         by the targets with one file per class.  Any\n\
+                         change of the options, the initialization file\n\
+                         or the license generates everything again.\n\
+                         --pipeline is ignored\n\
+    --output-cache <dir> Keep the files that each class is generated to\n\
+                         in the cache directory <dir>, which any number\n\
+                         of runs may share, and take them from it when a\n\
+                         class, its options and its previous files are\n\
+                         the same, for the targets with one file per\n\
+                         class.  The hits and misses are reported, and\n\
+                         added up in <dir>/stats.  --pipeline is ignored\n\
+    --output-cache-size <n>  The megabytes that the cache may take, 1024\n\
+                         by default; the least recently used files are\n\
+                         removed first\n\
+    --output-cache-link  Hard link the files from the cache instead of\n\
+                         copying them, with --atomic.  Such files must\n\
+                         not be modified in place\n\
+    --depfile <file>     Write to <file> a make rule, which ninja also\n\
+                         reads, from the generated files to the files\n\
+                         read: the diagrams, the initialization file,\n\
+                         the licenses and the sources whose code is\n\
+                         preserved (unless they are generated too)\n\
+    --manifest <file>    Write to <file> the list of the generated files,\n\
+                         one per line, \"-\" for the standard output; as\n\
+                         JSON, with the files read, if <file> ends in\n\
+                         .json\n\
+    --preserve-index     Keep in <dir>/.dia2code-preserve where the code\n\
+                         of each operation lies in the existing files,\n\
+                         and don't scan again those unchanged since\n\
+    --stats[=json]       Print on the standard error the wall clock and\n\
+                         CPU time of each phase of the run, and what was\n\
+                         parsed and written; as JSON with --stats=json\n\
+    --mem-report         Print on the standard error how much memory was\n\
+                         allocated for the classes, their attributes and\n\
+                         operations, the packages, the declarations, the\n\
+                         name lists and the preserved sources\n\
+    --trace <file>       Write to <file> the time spent parsing each class,\n\
+                         generating each class or declaration, scanning\n\
+                         each existing file and writing each file, in the\n\
+                         trace event format of chrome://tracing\n\
     -cl <classlist>      Generate code only for the classes specified in\n\
                          the comma-separated <classlist>. \n\
                          E.g: Base,Derived.\n\
@@ -152,22 +941,7 @@ under certain conditions; read the COPYING file for details.\n";
 
     /* initialise stuff like global variables to their default values */
     dia2code_initializations();
-
-    generator = NULL;
-    generators[0] = generate_code_cpp;
-    generators[1] = generate_code_java;
-    generators[2] = generate_code_c;
-    generators[3] = generate_code_sql;
-    generators[4] = generate_code_ada;
-    generators[5] = generate_code_python;
-    generators[6] = generate_code_php;
-    generators[7] = generate_code_shp;
-    generators[8] = generate_code_idl;
-    generators[9] = generate_code_csharp;
-    generators[10] = generate_code_php_five;
-    generators[11] = generate_code_ruby;
-    generators[12] = generate_code_as3;
-
+    generate_jobs = -1;   /* unset, the default depends on --batch */
 
     if (argc < 2) {
         fprintf(stderr, "%s\nUsage: %s %s\n", notice, argv[0], help);
@@ -207,51 +981,68 @@ under certain conditions; read the COPYING file for details.\n";
                 exit(0);
             } else if ( eq (argv[i], "--buildtree") ) {
                 buildtree = 1;
+            } else if ( eq (argv[i], "--if-changed") ) {
+                output_ifchanged = 1;
+            } else if ( eq (argv[i], "--atomic") ) {
+                output_atomic = 1;
+            } else if ( eq (argv[i], "--fsync") ) {
+                parameter = 10;
+            } else if ( eq (argv[i], "--async-write") ) {
+                output_async = 1;
+            } else if ( eq (argv[i], "--io-uring") ) {
+                output_uring = 1;
+            } else if ( eq (argv[i], "--tar") ) {
+                parameter = 11;
+            } else if ( eq (argv[i], "--jobs") ) {
+                parameter = 12;
+            } else if ( eq (argv[i], "--batch") ) {
+                parameter = 13;
+            } else if ( eq (argv[i], "--pipeline") ) {
+                generate_pipeline = 1;
+            } else if ( eq (argv[i], "--serve") ) {
+                parameter = 14;
+            } else if ( eq (argv[i], "--client") ) {
+                parameter = 15;
+            } else if ( eq (argv[i], "--cache-size") ) {
+                parameter = 16;
+            } else if ( eq (argv[i], "--watch") ) {
+                watch = 1;
+            } else if ( eq (argv[i], "--incremental") ) {
+                generate_incremental = 1;
+            } else if ( eq (argv[i], "--output-cache") ) {
+                parameter = 17;
+            } else if ( eq (argv[i], "--output-cache-size") ) {
+                parameter = 18;
+            } else if ( eq (argv[i], "--depfile") ) {
+                parameter = 19;
+            } else if ( eq (argv[i], "--manifest") ) {
+                parameter = 20;
+            } else if ( eq (argv[i], "--trace") ) {
+                parameter = 21;
+            } else if ( eq (argv[i], "--output-cache-link") ) {
+                output_cache_link = 1;
+            } else if ( eq (argv[i], "--preserve-index") ) {
+                preserve_index = 1;
+            } else if ( eq (argv[i], "--stats") ) {
+                generate_stats = D2C_STATS_TEXT;
+            } else if ( eq (argv[i], "--stats=json") ) {
+                generate_stats = D2C_STATS_JSON;
+            } else if ( eq (argv[i], "--mem-report") ) {
+                mem_report = 1;
             } else {
                 infile = argv[i];
             }
             break;
-        case 1:   /* Which code generator */
+        case 1:   /* Which code generators */
             parameter = 0;
-            if ( eq (argv[i], "cpp") ) {
-                generator = generators[0];
-            } else if ( eq (argv[i], "java") ) {
-                generator = generators[1];
-                generator_buildtree = 1;
-            } else if ( eq (argv[i], "c") ) {
-                generator = generators[2];
-            } else if ( eq (argv[i], "sql") ) {
-                generator = generators[3];
-            } else if ( eq (argv[i], "ada") ) {
-                generator = generators[4];
-            } else if ( eq (argv[i], "python") ) {
-                generator = generators[5];
-            } else if ( eq (argv[i], "php") ) {
-                generator = generators[6];
-                generator_buildtree = 1;
-            } else if ( eq (argv[i], "shp") ) {
-                generator = generators[7];
-            } else if ( eq (argv[i], "idl") ) {
-                generator = generators[8];
-            } else if ( eq (argv[i], "csharp") ) {
-                generator = generators[9];
-            } else if ( eq(argv[i], "php5") ) {
-                generator = generators[10];
-            } else if ( eq(argv[i], "ruby") ) {
-                generator = generators[11];
-            } else if ( eq(argv[i], "as3") ) {
-                generator = generators[12];
-                generator_buildtree = 1;
-            } else {
-#if DSO == 1 && defined(CODEGEN_USE_DSO)
-                generator = find_dia2code_module(argv[i]);
-                if ( ! generator ) {
-                    fprintf(stderr, "can't find the generator: %s\n", dlerror());
-                    parameter = -1;   /* error */
-                }
-#else
-parameter = -1;   /* error */
-#endif
+            names = strdup(argv[i]);
+            if (names == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+            ntargets = parse_targets(names, &targets);
+            if (ntargets == 0) {
+                parameter = -1;   /* error */
             }
             break;
         case 2:   /* Which output directory */
@@ -259,6 +1050,7 @@ parameter = -1;   /* error */
             parameter = 0;
             break;
         case 3:   /* Which classes to consider */
+            classnames = argv[i];
             classestogenerate = parse_class_names(argv[i]);
             classmask = 1 - classmask;
             parameter = 0;
@@ -277,6 +1069,7 @@ parameter = -1;   /* error */
             break;
         case 7:   /* Use initialization file */
             process_initialization_file(argv[i], 1);
+            ininame = argv[i];
             iniParameterProcessed = 1;
             parameter = 0;
             break;
@@ -285,22 +1078,103 @@ parameter = -1;   /* error */
             parameter = 0;
             break;
         case 9:   /* SQLx options */
+            sqlnames = argv[i];
             sqloptions = parse_sql_options(argv[i]);
             parameter = 0;
             break;
+        case 10:  /* Durability of atomic writes */
+            if (d2c_outfile_set_fsync(argv[i]) == 0) {
+                output_atomic = 1;
+                parameter = 0;
+            } else {
+                parameter = -1;   /* error */
+            }
+            break;
+        case 11:  /* Tar archive of the generated files */
+            tarfile = strdup(argv[i]);
+            parameter = 0;
+            break;
+        case 12:  /* Number of generation threads */
+            if (isdigit((unsigned char) argv[i][0])) {
+                generate_jobs = atoi(argv[i]);
+                parameter = 0;
+            } else {
+                parameter = -1;   /* error */
+            }
+            break;
+        case 13:  /* Manifest of jobs */
+            batchfile = argv[i];
+            parameter = 0;
+            break;
+        case 14:  /* Socket of the server */
+            serve_socket = argv[i];
+            parameter = 0;
+            break;
+        case 15:  /* Socket of the server to send the request to */
+            client_socket = argv[i];
+            parameter = 0;
+            break;
+        case 16:  /* Memory of the models of the server */
+            if (isdigit((unsigned char) argv[i][0])) {
+                serve_cache_size = atol(argv[i]);
+                parameter = 0;
+            } else {
+                parameter = -1;   /* error */
+            }
+            break;
+        case 17:  /* Directory of the output cache */
+            output_cache = strdup(argv[i]);
+            parameter = 0;
+            break;
+        case 18:  /* Size of the output cache */
+            if (isdigit((unsigned char) argv[i][0])) {
+                output_cache_size = atol(argv[i]);
+                parameter = 0;
+            } else {
+                parameter = -1;   /* error */
+            }
+            break;
+        case 19:  /* Make rule of the files read and generated */
+            deps_file = argv[i];
+            parameter = 0;
+            break;
+        case 20:  /* List of the generated files */
+            deps_manifest = argv[i];
+            parameter = 0;
+            break;
+        case 21:  /* Trace events of the run */
+            trace_file = argv[i];
+            parameter = 0;
+            break;
 
         }
     }
     /* parameter != 0 means the command line was invalid */
 
-    if ( parameter != 0 || infile == NULL ) {
+    if ( parameter != 0 || (infile == NULL && batchfile == NULL && serve_socket == NULL) ) {
         printf("%s\nUsage: %s %s\n\n%s\n", notice, argv[0], help, bighelp);
         exit(2);
     }
+    if ((deps_file != NULL || deps_manifest != NULL)
+            && (serve_socket != NULL || client_socket != NULL || watch)) {
+        fprintf(stderr, "--depfile and --manifest can't be used with --serve, --client or --watch\n");
+        exit(2);
+    }
+    if ((generate_stats || mem_report || trace_file != NULL)
+            && (serve_socket != NULL || client_socket != NULL || watch)) {
+        fprintf(stderr, "--stats, --mem-report and --trace can't be used with --serve, --client or --watch\n");
+        exit(2);
+    }
+    d2c_trace_open();
+    d2c_stats_start(&run_clock);
 
     if (iniParameterProcessed == 0)
     {
-        if (!process_initialization_file("dia2code.ini", 0))
+        if (process_initialization_file("dia2code.ini", 0))
+        {
+            ininame = "dia2code.ini";
+        }
+        else
         {
 #ifdef WIN32
             if (getenv("HOME") == NULL)
@@ -311,23 +1185,131 @@ parameter = -1;   /* error */
 #else
             strcpy(inifile, "~/.dia2code/dia2code.ini");
 #endif
-            process_initialization_file(inifile, 0);           
+            if (process_initialization_file(inifile, 0))
+            {
+                ininame = inifile;
+            }
+        }
+    }
+
+    /* the initialization files may have set any of these */
+    if (generate_incremental && (batchfile != NULL || serve_socket != NULL
+                                 || client_socket != NULL || tarfile != NULL || watch)) {
+        fprintf(stderr, "--incremental can't be used with --batch, --serve, --client, --tar or --watch\n");
+        exit(2);
+    }
+    if (output_cache != NULL && (batchfile != NULL || serve_socket != NULL
+                                 || client_socket != NULL || watch)) {
+        fprintf(stderr, "--output-cache can't be used with --batch, --serve, --client or --watch\n");
+        exit(2);
+    }
+    if (preserve_index && (batchfile != NULL || serve_socket != NULL
+                           || client_socket != NULL || tarfile != NULL || watch)) {
+        fprintf(stderr, "--preserve-index can't be used with --batch, --serve, --client, --tar or --watch\n");
+        exit(2);
+    }
+    if (watch && (infile == NULL || batchfile != NULL || serve_socket != NULL
+                  || client_socket != NULL || tarfile != NULL)) {
+        fprintf(stderr, "--watch needs a diagram, and can't be used with --batch, --serve, --client or --tar\n");
+        exit(2);
+    }
+
+    if (ntargets == 0) {
+        targets = NEW (d2c_target);
+        targets[0].name = d2c_generators[DEFAULT_TARGET].name;
+        targets[0].generator = d2c_generators[DEFAULT_TARGET].generator;
+        targets[0].buildtree = d2c_generators[DEFAULT_TARGET].buildtree;
+        targets[0].pipeline = d2c_generators[DEFAULT_TARGET].pipeline;
+        ntargets = 1;
+    }
+
+    if (client_socket != NULL) {
+        char request[LARGE_BUFFER] = "";
+
+        names = my_malloc(LARGE_BUFFER);
+        names[0] = '\0';
+
+        if (infile == NULL) {
+            printf("%s\nUsage: %s %s\n\n%s\n", notice, argv[0], help, bighelp);
+            exit(2);
+        }
+        add_word(request, client_path(infile));
+        for (i = 0; i < ntargets; i++) {
+            if (i > 0) {
+                strcat(names, ",");
+            }
+            strncat(names, targets[i].name, LARGE_BUFFER - strlen(names) - 2);
         }
+        add_word(request, names);
+        add_word(request, client_path(outdir != NULL ? outdir : "."));
+        if (!clobber) {
+            add_word(request, "-nc");
+        }
+        if (classnames != NULL) {
+            add_word(request, "-cl");
+            add_word(request, classnames);
+        }
+        if (classmask != (classnames != NULL)) {
+            add_word(request, "-v");
+        }
+        if (license != NULL) {
+            add_word(request, "-l");
+            add_word(request, client_path(license));
+        }
+        if (file_ext != NULL) {
+            add_word(request, "-ext");
+            add_word(request, file_ext);
+        }
+        if (body_file_ext != NULL) {
+            add_word(request, "-bext");
+            add_word(request, body_file_ext);
+        }
+        if (buildtree) {
+            add_word(request, "--buildtree");
+        }
+        if (sqlnames != NULL) {
+            add_word(request, "-sqlx");
+            add_word(request, sqlnames);
+        }
+        return d2c_client(client_socket, request);
+    }
+
+    if (generate_jobs < 0) {
+        generate_jobs = batchfile != NULL ? 0 : 1;
+    }
+    if (generate_jobs == 0) {
+        generate_jobs = d2c_default_jobs();
     }
 
-    if (generator_buildtree == 0 && buildtree == 1) {
-        buildtree = 0;
-        fprintf( stderr,"warning: this generator does not support building tree yet. disabled \n" );
+    /* the write stage of the pipeline */
+    if (generate_pipeline && !output_uring) {
+        output_async = 1;
+    }
+
+    if (output_uring && d2c_uring_init() != 0) {
+        fprintf( stderr,"warning: io_uring is not available, using POSIX I/O\n" );
+        output_uring = 0;
+    }
+
+    if (tarfile != NULL) {
+        FILE *f = eq(tarfile, "-") ? stdout : fopen(tarfile, "wb");
+        if (f == NULL) {
+            fprintf(stderr, "Can't open file %s for writing\n", tarfile);
+            exit(3);
+        }
+        output_sink = d2c_sink_tar(f);
     }
 
     thisbatch = (batch*)my_malloc(sizeof(batch));
 
+    /* read before --depfile was known */
+    if (ininame != NULL) {
+        d2c_deps_input(ininame);
+    }
+
     LIBXML_TEST_VERSION;
     xmlKeepBlanksDefault(0);
 
-    /* We build the class list from the dia file here */
-    thisbatch->classlist = parse_diagram(infile);
-
     thisbatch->outdir = outdir;
     thisbatch->license = license;
     thisbatch->clobber = clobber;
@@ -335,15 +1317,49 @@ parameter = -1;   /* error */
     thisbatch->sqlopts = sqloptions;
     thisbatch->mask = classmask;
     thisbatch->buildtree = buildtree;
+    thisbatch->pipeline = NULL;
+    thisbatch->incremental = 0;
+    thisbatch->changed = NULL;
+    thisbatch->manifest = NULL;
+    thisbatch->cache = NULL;
+    thisbatch->sources = NULL;
 
-    /* Code generation */
-    if ( !generator ) {
-        generator = generators[DEFAULT_TARGET];
+    status = 0;
+    if (serve_socket != NULL) {
+        serve_defaults = *thisbatch;
+        d2c_genstate_save(&job_state);
+        status = d2c_serve(serve_socket, serve_request);
+    } else if (batchfile != NULL) {
+        status = run_manifest(thisbatch);
+    } else if (watch) {
+        status = watch_diagram(thisbatch, infile, ininame, targets, ntargets);
+    } else {
+        /* We build the class list from the dia file here, and generate
+           the code from it */
+        d2c_preserve_index_open(thisbatch->outdir);
+        parse_and_generate(thisbatch, infile, targets, ntargets);
+    }
+    d2c_outfile_finish();
+    /* only reached once the generation succeeded */
+    d2c_preserve_index_close();
+    if (generation_manifest != NULL) {
+        d2c_manifest_write(generation_manifest);
+    }
+    if (generation_cache != NULL) {
+        d2c_cache_close(generation_cache);
+    }
+    d2c_fingerprints_free(generation_fingerprints);
+    if (status == 0 && (deps_file != NULL || deps_manifest != NULL)) {
+        status = d2c_deps_write(tarfile != NULL && !eq(tarfile, "-") ? tarfile : NULL);
     }
-    (*generator)(thisbatch);
 
+    if (d2c_trace_write() != 0 && status == 0) {
+        status = 3;
+    }
+    d2c_stats_report(&run_clock);
+    d2c_mem_report();
     param_list_destroy();
-    return 0;
+    return status;
 }
 
 typedef struct ini_parse_command
@@ -360,12 +1376,49 @@ typedef struct ini_parse_command
 #define PARSE_TYPE_YESNO 4
 #define PARSE_TYPE_TRUEFALSE 5
 
+void parse_fsync(char *name, char *value)
+{
+    if (d2c_outfile_set_fsync(value) == 0)
+        output_atomic = 1;
+    else
+        fprintf(stderr, "Invalid value for %s(%s)\n", name, value);
+}
+
+/* the indentation settings are per thread, see d2c_genstate */
+void parse_indent_size(char *name, char *value)
+{
+    indent_count = atoi(value);
+}
+
+void parse_brace_newline(char *name, char *value)
+{
+    switch(tolower(value[0]))
+    {
+    case 'y': indent_open_brace_on_newline = 1; break;
+    case 'n': indent_open_brace_on_newline = 0; break;
+    default:
+        fprintf(stderr, "Invalid yes/no value for %s(%s)\n", name, value);
+    }
+}
+
 ini_parse_command ini_parse_commands[] =
 {
     {"file.outdir", PARSE_TYPE_STRDUP, &outdir},
-    {"indent.brace.newline", PARSE_TYPE_YESNO, &indent_open_brace_on_newline},
-    {"indent.size", PARSE_TYPE_INT, &indent_count},
+    {"indent.brace.newline", PARSE_TYPE_FUNCTION, parse_brace_newline},
+    {"indent.size", PARSE_TYPE_FUNCTION, parse_indent_size},
     {"generate.backup", PARSE_TYPE_YESNO, &generate_backup},
+    {"file.ifchanged", PARSE_TYPE_YESNO, &output_ifchanged},
+    {"file.atomic", PARSE_TYPE_YESNO, &output_atomic},
+    {"file.fsync", PARSE_TYPE_FUNCTION, parse_fsync},
+    {"file.tar", PARSE_TYPE_STRDUP, &tarfile},
+    {"file.asyncwrite", PARSE_TYPE_YESNO, &output_async},
+    {"file.iouring", PARSE_TYPE_YESNO, &output_uring},
+    {"generate.jobs", PARSE_TYPE_INT, &generate_jobs},
+    {"generate.pipeline", PARSE_TYPE_YESNO, &generate_pipeline},
+    {"generate.incremental", PARSE_TYPE_YESNO, &generate_incremental},
+    {"file.cache", PARSE_TYPE_STRDUP, &output_cache},
+    {"file.cachelink", PARSE_TYPE_YESNO, &output_cache_link},
+    {"file.preserveindex", PARSE_TYPE_YESNO, &preserve_index},
     {NULL, -1, NULL}
 };
 
@@ -0,0 +1,432 @@
+/***************************************************************************
+                          manifest.c  -  The generation manifest of --incremental
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --incremental, the output directory keeps a manifest of what the
+ * last run generated: for every file written by the task of a class,
+ * the target, the class, the hash of the options of the target and the
+ * fingerprint of the class (see fingerprint.c).  The next run skips
+ * the classes whose files are all listed with the same options and
+ * fingerprint, and still exist.
+ *
+ * Only the targets that write one file per class (see
+ * d2c_generate_classes()) record their files, the others are always
+ * generated in full.  The manifest is replaced once the run succeeded.
+ */
+
+#include "dia2code.h"
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MANIFEST_NAME ".dia2code-manifest"
+#define MANIFEST_HEADER "# dia2code generation manifest 1\n"
+
+int generate_incremental = 0;   /* Set by switch "--incremental" */
+
+/* A line of the manifest */
+struct entry {
+    char *target;
+    char *classname;
+    uint64_t options;
+    uint64_t fingerprint;
+    char *file;
+    int keep;                /* written to the next manifest */
+};
+
+struct d2c_manifest_target {
+    d2c_manifest *m;
+    char *name;
+    uint64_t options;
+    d2c_fingerprints *fingerprints;
+    namelist changed;        /* see d2c_manifest_changed() */
+    struct d2c_manifest_target *next;
+};
+
+/* A class generated by this run, and the files it wrote */
+struct recorded {
+    d2c_manifest_target *target;
+    char *classname;
+    namelist files;
+    struct recorded *next;
+};
+
+struct d2c_manifest {
+    char *path;
+    struct entry *entries;   /* as read, sorted by target and class */
+    int count;
+    d2c_manifest_target *targets;
+    struct recorded *recorded;
+    pthread_mutex_t lock;    /* protects recorded */
+};
+
+/* The class whose task the calling thread runs, see d2c_manifest_begin() */
+static D2C_TASK_LOCAL struct recorded *recording = NULL;
+
+static int by_class(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    int c = strcmp(x->target, y->target);
+
+    return c != 0 ? c : strcmp(x->classname, y->classname);
+}
+
+static int by_file(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    int c = by_class(a, b);
+
+    return c != 0 ? c : strcmp(x->file, y->file);
+}
+
+/* parses the line s into e, returns 0 if it is not an entry */
+static int parse_entry(struct entry *e, char *s)
+{
+    char *field[5], *save = NULL, *end;
+    int i;
+
+    s[strcspn(s, "\r\n")] = '\0';
+    for (i = 0; i < 4; i++) {
+        field[i] = strtok_r(i == 0 ? s : NULL, "\t", &save);
+        if (field[i] == NULL) {
+            return 0;
+        }
+    }
+    field[4] = strtok_r(NULL, "", &save);
+    if (field[4] == NULL) {
+        return 0;
+    }
+    e->options = strtoull(field[2], &end, 16);
+    if (*end != '\0') {
+        return 0;
+    }
+    e->fingerprint = strtoull(field[3], &end, 16);
+    if (*end != '\0') {
+        return 0;
+    }
+    e->target = my_strdup(field[0]);
+    e->classname = my_strdup(field[1]);
+    e->file = my_strdup(field[4]);
+    e->keep = 1;
+    return 1;
+}
+
+/**
+ * Reads the manifest of the output directory outdir, if there is one,
+ * and returns it for this run.
+*/
+d2c_manifest * d2c_manifest_read (const char *outdir)
+{
+    d2c_manifest *m = NEW (d2c_manifest);
+    char s[LARGE_BUFFER];
+    int size = 0;
+    FILE *f;
+
+    m->path = d2c_file_path(outdir != NULL ? outdir : ".", MANIFEST_NAME, "");
+    m->entries = NULL;
+    m->count = 0;
+    m->targets = NULL;
+    m->recorded = NULL;
+    pthread_mutex_init(&m->lock, NULL);
+
+    f = fopen(m->path, "r");
+    if (f == NULL) {
+        return m;
+    }
+    /* a manifest of another version is ignored */
+    if (fgets(s, sizeof(s), f) == NULL || !eq(s, MANIFEST_HEADER)) {
+        fclose(f);
+        return m;
+    }
+    while (fgets(s, sizeof(s), f) != NULL) {
+        if (m->count == size) {
+            size = size == 0 ? 64 : 2 * size;
+            m->entries = realloc(m->entries, size * sizeof(struct entry));
+            if (m->entries == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+        m->count += parse_entry(&m->entries[m->count], s);
+    }
+    fclose(f);
+    qsort(m->entries, m->count, sizeof(struct entry), by_class);
+    return m;
+}
+
+/* returns the first entry of the class of target, or NULL */
+static struct entry *find_entries(d2c_manifest *m, const char *target,
+                                  const char *classname, int *count)
+{
+    struct entry key, *e;
+    int lo = 0, hi = m->count, mid;
+
+    key.target = (char *) target;
+    key.classname = (char *) classname;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (by_class(&m->entries[mid], &key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (*count = 0; lo + *count < m->count
+             && by_class(&m->entries[lo + *count], &key) == 0; (*count)++) {
+    }
+    e = &m->entries[lo];
+    return *count > 0 ? e : NULL;
+}
+
+/**
+ * Returns what the classes of target record in m, generated with the
+ * options hash and having the fingerprints.  The entries of the target
+ * that are not used by this run are dropped.
+*/
+d2c_manifest_target * d2c_manifest_use (d2c_manifest *m, const char *target,
+                                        uint64_t options, d2c_fingerprints *fingerprints)
+{
+    d2c_manifest_target *t = NEW (d2c_manifest_target);
+    int i;
+
+    t->m = m;
+    t->name = my_strdup(target);
+    t->options = options;
+    t->fingerprints = fingerprints;
+    t->changed = NULL;
+    t->next = m->targets;
+    m->targets = t;
+    for (i = 0; i < m->count; i++) {
+        if (eq(m->entries[i].target, target)) {
+            m->entries[i].keep = 0;
+        }
+    }
+    return t;
+}
+
+/**
+ * Returns the names of the classes of classlist that the target must
+ * generate, in the order of the diagram, and sets *count to their
+ * number.  The files of the others are kept as they are.  The list is
+ * freed with the manifest.
+*/
+namelist d2c_manifest_changed (d2c_manifest_target *t, umlclasslist classlist, int *count)
+{
+    namelist result = NULL, *last = &result;
+    umlclasslist node;
+    struct entry *e;
+    struct stat st;
+    uint64_t fingerprint;
+    int i, n, same;
+
+    *count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        fingerprint = d2c_fingerprint(t->fingerprints, node->key->name);
+        e = find_entries(t->m, t->name, node->key->name, &n);
+        same = e != NULL;
+        for (i = 0; same && i < n; i++) {
+            same = e[i].options == t->options && e[i].fingerprint == fingerprint
+                && stat(e[i].file, &st) == 0;
+        }
+        if (same) {
+            for (i = 0; i < n; i++) {
+                e[i].keep = 1;
+                d2c_deps_output(e[i].file);
+            }
+            continue;
+        }
+        *last = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+        (*last)->name = my_strdup(node->key->name);
+        (*last)->next = NULL;
+        last = &(*last)->next;
+        (*count)++;
+    }
+    free_names(t->changed);
+    t->changed = result;
+    return result;
+}
+
+/**
+ * Records the files that the calling thread opens, until
+ * d2c_manifest_end(), as those of the class of target t.
+*/
+void d2c_manifest_begin (d2c_manifest_target *t, const char *classname)
+{
+    /* left by a task that failed */
+    if (recording != NULL) {
+        free_names(recording->files);
+        free(recording->classname);
+        free(recording);
+    }
+    recording = NEW (struct recorded);
+    recording->target = t;
+    recording->classname = my_strdup(classname);
+    recording->files = NULL;
+}
+
+/* called by d2c_outfile_open() for every file */
+void d2c_manifest_file (const char *filename)
+{
+    namelist file;
+
+    if (recording != NULL) {
+        file = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+        file->name = my_strdup(filename);
+        file->next = recording->files;
+        recording->files = file;
+    }
+}
+
+void d2c_manifest_end ()
+{
+    d2c_manifest *m = recording->target->m;
+
+    pthread_mutex_lock(&m->lock);
+    recording->next = m->recorded;
+    m->recorded = recording;
+    pthread_mutex_unlock(&m->lock);
+    recording = NULL;
+}
+
+static void write_entry(FILE *f, const struct entry *e)
+{
+    fprintf(f, "%s\t%s\t%016llx\t%016llx\t%s\n", e->target, e->classname,
+            (unsigned long long) e->options, (unsigned long long) e->fingerprint,
+            e->file);
+}
+
+/**
+ * Replaces the manifest with the files of this run and those kept from
+ * the previous one, and frees m.  Returns 0, or -1 if it can't be
+ * written.
+*/
+int d2c_manifest_write (d2c_manifest *m)
+{
+    struct entry *entries;
+    struct recorded *r, *next_r;
+    d2c_manifest_target *t, *next_t;
+    namelist file;
+    char *tmpname;
+    int i, count = 0, size = m->count, status = 0;
+    FILE *f;
+
+    for (r = m->recorded; r != NULL; r = r->next) {
+        for (file = r->files; file != NULL; file = file->next) {
+            size++;
+        }
+    }
+    entries = my_malloc((size + 1) * sizeof(struct entry));
+    for (i = 0; i < m->count; i++) {
+        if (m->entries[i].keep) {
+            entries[count++] = m->entries[i];
+        }
+    }
+    for (r = m->recorded; r != NULL; r = r->next) {
+        for (file = r->files; file != NULL; file = file->next) {
+            entries[count].target = r->target->name;
+            entries[count].classname = r->classname;
+            entries[count].options = r->target->options;
+            entries[count].fingerprint = d2c_fingerprint(r->target->fingerprints,
+                                                         r->classname);
+            entries[count].file = file->name;
+            count++;
+        }
+    }
+    /* the threads record the classes in any order */
+    qsort(entries, count, sizeof(struct entry), by_file);
+
+    tmpname = d2c_file_path(NULL, m->path, ".tmp");
+    f = fopen(tmpname, "w");
+    if (f != NULL) {
+        fputs(MANIFEST_HEADER, f);
+        for (i = 0; i < count; i++) {
+            write_entry(f, &entries[i]);
+        }
+        if (fclose(f) != 0 || rename(tmpname, m->path) != 0) {
+            status = -1;
+        }
+    } else {
+        status = -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Can't write the manifest %s: %s\n", m->path, strerror(errno));
+        unlink(tmpname);
+    }
+    free(tmpname);
+    free(entries);
+
+    for (r = m->recorded; r != NULL; r = next_r) {
+        next_r = r->next;
+        free_names(r->files);
+        free(r->classname);
+        free(r);
+    }
+    for (t = m->targets; t != NULL; t = next_t) {
+        next_t = t->next;
+        free_names(t->changed);
+        free(t->name);
+        free(t);
+    }
+    for (i = 0; i < m->count; i++) {
+        free(m->entries[i].target);
+        free(m->entries[i].classname);
+        free(m->entries[i].file);
+    }
+    free(m->entries);
+    pthread_mutex_destroy(&m->lock);
+    free(m->path);
+    free(m);
+    return status;
+}
+
+/**
+ * Returns the hash of what, besides the diagram, the files of target
+ * depend on: the file extensions, the indentation, -nc, --buildtree,
+ * -sqlx and the content of the license.  Those are all the settings,
+ * from the command line or the initialization file, that change the
+ * generated files.  The paths, the output directory and the license
+ * file name included, are left out, for --output-cache to share the
+ * files between directories, and so are the settings of how the files
+ * are written (--jobs, --atomic, the cache, ...).
+*/
+uint64_t d2c_options_hash (const batch *b, const char *target)
+{
+    uint64_t h = D2C_HASH_INIT;
+    char buf[LARGE_BUFFER];
+    namelist n;
+    size_t len;
+    FILE *f;
+
+    h = d2c_hash_string(h, VERSION);
+    h = d2c_hash_string(h, target);
+    h = d2c_hash_string(h, file_ext != NULL ? file_ext : "");
+    h = d2c_hash_string(h, body_file_ext != NULL ? body_file_ext : "");
+    snprintf(buf, sizeof(buf), "%d %d %d %d", indent_count,
+             indent_open_brace_on_newline, b->clobber, b->buildtree);
+    h = d2c_hash_string(h, buf);
+    for (n = b->sqlopts; n != NULL; n = n->next) {
+        h = d2c_hash_string(h, n->name);
+    }
+    if (b->license != NULL) {
+        f = fopen(b->license, "rb");
+        if (f != NULL) {
+            while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+                h = d2c_hash_bytes(h, buf, len);
+            }
+            fclose(f);
+        }
+    }
+    return h;
+}
@@ -0,0 +1,124 @@
+/***************************************************************************
+                          memreport.c  -  The allocation accounting of --mem-report
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --mem-report, every block that my_malloc_tagged() hands out is
+ * counted under its tag: the classes (with their nodes, associations
+ * and templates), the attribute and operation nodes, the packages, the
+ * declarations of the ada, cpp and idl generators, the name lists, the
+ * blocks of the preserved sources, and the rest, the scratch memory of
+ * my_malloc().  The sizes are those the allocator actually reserved
+ * (malloc_usable_size()), so that my_free_tagged() can take them back
+ * without being told.
+ *
+ * The blocks of a tag are live until they are given to my_free_tagged()
+ * with that tag, and the peak is the most that were live at a time.
+ * The scratch memory is released with a plain free(): only how much was
+ * allocated is known for it.  The report goes to the standard error
+ * once the files are written.
+ *
+ * Without --mem-report, my_malloc_tagged() and my_free_tagged() only
+ * test mem_report.
+ */
+
+#include "dia2code.h"
+#include <malloc.h>
+
+int mem_report = 0;   /* Set by switch "--mem-report" */
+
+struct tagstats {
+    long long count;    /* blocks allocated */
+    long long bytes;    /* bytes allocated */
+    long long live;
+    long long peak;
+};
+
+static const char *tag_names[D2C_MEM_TAGS] = {
+    "class", "attribute node", "operation node", "package", "declaration",
+    "namelist", "source block", "scratch"
+};
+
+static struct tagstats tags[D2C_MEM_TAGS];
+
+/* all the tags but scratch */
+static long long live_total = 0, peak_total = 0;
+
+static void raise_peak(long long *peak, long long live)
+{
+    long long old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (live > old
+           && !__atomic_compare_exchange_n(peak, &old, live, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * Counts ptr, just allocated, under tag.
+*/
+void d2c_mem_alloc (void *ptr, int tag)
+{
+    long long size = malloc_usable_size(ptr);
+
+    __atomic_fetch_add(&tags[tag].count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tags[tag].bytes, size, __ATOMIC_RELAXED);
+    if (tag == D2C_MEM_SCRATCH) {
+        return;
+    }
+    raise_peak(&tags[tag].peak,
+               __atomic_add_fetch(&tags[tag].live, size, __ATOMIC_RELAXED));
+    raise_peak(&peak_total, __atomic_add_fetch(&live_total, size, __ATOMIC_RELAXED));
+}
+
+/**
+ * Takes ptr, about to be freed, back from the live blocks of tag.
+*/
+void d2c_mem_free (void *ptr, int tag)
+{
+    long long size;
+
+    if (ptr == NULL || tag == D2C_MEM_SCRATCH) {
+        return;
+    }
+    size = malloc_usable_size(ptr);
+    __atomic_fetch_sub(&tags[tag].live, size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&live_total, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * Prints the report of --mem-report on the standard error, in kilobytes.
+*/
+void d2c_mem_report ()
+{
+    int i;
+
+    if (!mem_report) {
+        return;
+    }
+    fprintf(stderr, "%-16s %10s %12s %12s %12s\n",
+            "allocation", "blocks", "total KB", "live KB", "peak KB");
+    for (i = 0; i < D2C_MEM_TAGS; i++) {
+        if (i == D2C_MEM_SCRATCH) {
+            fprintf(stderr, "%-16s %10lld %12.1f %12s %12s\n", tag_names[i],
+                    tags[i].count, tags[i].bytes / 1024.0, "-", "-");
+        } else {
+            fprintf(stderr, "%-16s %10lld %12.1f %12.1f %12.1f\n", tag_names[i],
+                    tags[i].count, tags[i].bytes / 1024.0, tags[i].live / 1024.0,
+                    tags[i].peak / 1024.0);
+        }
+    }
+    fprintf(stderr, "%-16s %10s %12s %12.1f %12.1f\n", "model and lists", "", "",
+            live_total / 1024.0, peak_total / 1024.0);
+}
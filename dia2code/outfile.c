@@ -0,0 +1,1142 @@
+/***************************************************************************
+                          outfile.c  -  Output of the generated files
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "dia2code.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+int output_ifchanged = 0;    /* Set by switch "--if-changed" */
+int output_atomic = 0;       /* Set by switch "--atomic" */
+int output_fsync = D2C_FSYNC_NONE;   /* Set by switch "--fsync" */
+int output_async = 0;        /* Set by switch "--async-write" */
+int output_uring = 0;        /* Set by switch "--io-uring" */
+int generate_backup = 0;     /* Set by "generate.backup" */
+
+static int files_written = 0;
+static int files_unchanged = 0;
+static int last_errcode = 3;    /* for the errors found after the close */
+
+static int dir_write(d2c_sink *sink, const char *filename, const char *buf, size_t len);
+static int dir_mkdir(d2c_sink *sink, const char *dirname, mode_t mode);
+
+static d2c_sink directory_sink = { dir_write, dir_mkdir, NULL, NULL, NULL };
+
+d2c_sink *output_sink = &directory_sink;   /* Set by switch "--tar" */
+
+/* The sink of the calling thread, see d2c_outfile_use_sink() */
+static D2C_TASK_LOCAL d2c_sink *task_sink = NULL;
+
+#define current_sink() (task_sink != NULL ? task_sink : output_sink)
+
+/*
+ * A generated file that is not written in place: either its content is
+ * gathered in memory (buf, len) until it is closed, or it is written to
+ * the temporary file tmpname which is renamed over filename on close.
+ */
+struct outbuf {
+    FILE *f;
+    char *filename;
+    char *tmpname;
+    char *buf;
+    size_t len;
+    int errcode;            /* exit code if the file can't be written */
+    struct outbuf *next;
+};
+typedef struct outbuf outbuf;
+
+static D2C_TASK_LOCAL outbuf *outbufs = NULL;
+
+/* With d2c_outfile_collect(), where the closed files are kept */
+static D2C_TASK_LOCAL void **collected = NULL;
+
+/* Serializes the output of the threads that commit their own files */
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Directories that received a renamed file, synced once at the end */
+static namelist synced_dirs = NULL;
+
+/*
+ * returns 1 if filename holds exactly len bytes equal to buf.
+ * The size is checked first so that most changed files are never read.
+ */
+static int same_content(const char *filename, const char *buf, size_t len)
+{
+    struct stat info;
+    char chunk[LARGE_BUFFER];
+    size_t n, pos = 0;
+    FILE *f;
+
+    if (stat(filename, &info) != 0 || !S_ISREG(info.st_mode)
+            || (size_t) info.st_size != len) {
+        return 0;
+    }
+    f = fopen(filename, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (pos + n > len || memcmp(chunk, buf + pos, n) != 0) {
+            fclose(f);
+            return 0;
+        }
+        pos += n;
+    }
+    fclose(f);
+    return pos == len;
+}
+
+/* copies the current content of filename into f, for the "a" mode */
+static void preload(FILE *f, const char *filename)
+{
+    char chunk[LARGE_BUFFER];
+    size_t n;
+    FILE *old = fopen(filename, "rb");
+
+    if (old == NULL) {
+        return;
+    }
+    while ((n = fread(chunk, 1, sizeof(chunk), old)) > 0) {
+        fwrite(chunk, 1, n, f);
+    }
+    fclose(old);
+}
+
+/* returns the directory part of filename, to be freed by the caller */
+static char *dir_of(const char *filename)
+{
+    const char *slash = strrchr(filename, '/');
+
+    if (slash == NULL) {
+        return strdup(".");
+    }
+    if (slash == filename) {
+        return strdup("/");
+    }
+    return my_strndup(filename, slash - filename);
+}
+
+static void remember_dir(const char *filename)
+{
+    namelist dir;
+    char *name = dir_of(filename);
+
+    /* files of the same directory are usually generated one after another */
+    for (dir = synced_dirs; dir != NULL; dir = dir->next) {
+        if (eq(dir->name, name)) {
+            free(name);
+            return;
+        }
+    }
+    dir = NEW_TAGGED (namenode, D2C_MEM_NAMELIST);
+    dir->name = name;
+    dir->next = synced_dirs;
+    synced_dirs = dir;
+}
+
+static void sync_dirs()
+{
+    namelist dir = synced_dirs, next;
+
+    while (dir != NULL) {
+        int fd = open(dir->name, O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+        next = dir->next;
+        free(dir->name);
+        my_free_tagged(dir, D2C_MEM_NAMELIST);
+        dir = next;
+    }
+    synced_dirs = NULL;
+}
+
+/* removes the temporary files left behind when exiting on an error */
+static void remove_tmpfiles()
+{
+    outbuf *ob;
+
+    for (ob = outbufs; ob != NULL; ob = ob->next) {
+        if (ob->tmpname != NULL) {
+            unlink(ob->tmpname);
+        }
+    }
+}
+
+/*
+ * Creates a temporary file next to filename, so that it can later be
+ * renamed over it.  Returns NULL if the directory is not writable.
+ */
+static FILE *open_tmpfile(outbuf *ob)
+{
+    static int cleanup_registered = 0;
+    static mode_t mode;
+    char *dir = dir_of(ob->filename);
+    const char *base = strrchr(ob->filename, '/');
+    int fd;
+    FILE *f;
+
+    base = base == NULL ? ob->filename : base + 1;
+    ob->tmpname = my_malloc(strlen(dir) + strlen(base) + 10);
+    sprintf(ob->tmpname, "%s/.%s.XXXXXX", dir, base);
+    free(dir);
+
+    fd = mkstemp(ob->tmpname);
+    if (fd < 0) {
+        free(ob->tmpname);
+        ob->tmpname = NULL;
+        return NULL;
+    }
+    /* mkstemp() creates the file with mode 0600, fopen() would use 0666 */
+    if (!cleanup_registered) {
+        mode = umask(0);
+        umask(mode);
+        mode = 0666 & ~mode;
+    }
+    fchmod(fd, mode);
+    f = fdopen(fd, "wb");
+    if (f == NULL) {
+        close(fd);
+        unlink(ob->tmpname);
+        free(ob->tmpname);
+        ob->tmpname = NULL;
+        return NULL;
+    }
+    if (!cleanup_registered) {
+        atexit(remove_tmpfiles);
+        cleanup_registered = 1;
+    }
+    return f;
+}
+
+/*
+ * generate.backup for atomic writes: the old file is hard linked as
+ * <file>.bak instead of being renamed, so <file> never goes missing.
+ */
+static void backup_link(const char *filename)
+{
+    char *backup_filename = my_malloc(strlen(filename) + 5);
+
+    sprintf(backup_filename, "%s.bak", filename);
+    if (remove(backup_filename) && errno != ENOENT) {
+        fprintf(stderr, "Error %d while trying to delete file %s\n", errno, backup_filename);
+    } else if (link(filename, backup_filename) && errno != ENOENT) {
+        fprintf(stderr, "Error %d while trying to link %s to %s\n", errno, filename, backup_filename);
+    }
+    free(backup_filename);
+}
+
+/*
+ * flushes ob->f and renames the temporary file over ob->filename.
+ * Returns -1 (and removes the temporary file) if that fails.
+ */
+static int finish_tmpfile(outbuf *ob)
+{
+    int rc = 0;
+
+    if (fflush(ob->f) != 0
+            || (output_fsync == D2C_FSYNC_FILE && fsync(fileno(ob->f)) != 0)) {
+        fprintf(stderr, "Can't write file %s\n", ob->filename);
+        fclose(ob->f);
+        rc = -1;
+    } else {
+        fclose(ob->f);
+        if (generate_backup) {
+            backup_link(ob->filename);
+        }
+        if (rename(ob->tmpname, ob->filename) != 0) {
+            fprintf(stderr, "Error %d while trying to rename %s to %s\n",
+                    errno, ob->tmpname, ob->filename);
+            rc = -1;
+        } else if (output_fsync != D2C_FSYNC_NONE) {
+            remember_dir(ob->filename);
+        }
+    }
+    if (rc != 0) {
+        unlink(ob->tmpname);
+    }
+    free(ob->tmpname);
+    ob->tmpname = NULL;
+    return rc;
+}
+
+/*
+ * write() of the directory sink, for files that were produced in memory.
+ * Returns 1 if the file already had this content and was left alone.
+ */
+static int dir_write(d2c_sink *sink, const char *filename, const char *buf, size_t len)
+{
+    outbuf ob;
+    FILE *f;
+
+    if (output_ifchanged && same_content(filename, buf, len)) {
+        debug(DBG_GENCODE, "%s unchanged", filename);
+        return 1;
+    }
+    if (output_uring && !output_atomic && d2c_uring_init() == 0) {
+        if (generate_backup) {
+            d2c_backup((char *) filename);
+        }
+        return d2c_uring_write(filename, buf, len);
+    }
+    ob.filename = (char *) filename;
+    if (output_atomic) {
+        ob.f = open_tmpfile(&ob);
+        f = ob.f;
+    } else {
+        if (generate_backup) {
+            d2c_backup(ob.filename);
+        }
+        f = fopen(filename, "wb");
+    }
+    if (f == NULL) {
+        fprintf(stderr, "Can't open file %s for writing\n", filename);
+        return -1;
+    }
+    if (fwrite(buf, 1, len, f) != len) {
+        fprintf(stderr, "Can't write file %s\n", filename);
+        fclose(f);
+        if (output_atomic) {
+            unlink(ob.tmpname);
+            free(ob.tmpname);
+        }
+        return -1;
+    }
+    if (output_atomic) {
+        return finish_tmpfile(&ob);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Can't write file %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int dir_mkdir(d2c_sink *sink, const char *dirname, mode_t mode)
+{
+    return mkdir(dirname, mode);
+}
+
+/*
+ * Background writer, for --async-write.  The generators hand their
+ * complete files to a bounded ring of WRITE_QUEUE_SIZE jobs, and a
+ * single writer thread passes them to the output sink.  The ring needs
+ * no lock: it has one producer and one consumer, each owning its index,
+ * and the two semaphores order their accesses.  A full ring blocks the
+ * generator, so at most WRITE_QUEUE_SIZE files wait in memory.
+ */
+#define WRITE_QUEUE_SIZE 64
+
+#define WRITE_FILE  0
+#define WRITE_FLUSH 1   /* posts write_flushed once the jobs before are done */
+#define WRITE_STOP  2
+
+struct writejob {
+    int kind;
+    char *filename;
+    char *buf;
+    size_t len;
+    int errcode;
+};
+typedef struct writejob writejob;
+
+static writejob write_queue[WRITE_QUEUE_SIZE];
+static unsigned int write_head = 0;   /* next job to queue, producer only */
+static unsigned int write_tail = 0;   /* next job to write, writer only */
+static sem_t write_free, write_used, write_flushed;
+static pthread_t writer;
+static int writer_running = 0;
+static int writer_error = 0;          /* exit code of the first failure */
+
+/* counts a file of len bytes for --stats */
+static void count_written(size_t len)
+{
+    d2c_count(D2C_COUNT_FILES, 1);
+    d2c_count(D2C_COUNT_BYTES, (long long) len);
+}
+
+static void *writer_main(void *arg)
+{
+    writejob job;
+    d2c_clock clock;
+    int rc;
+
+    for (;;) {
+        while (sem_wait(&write_used) != 0) {
+            /* EINTR */
+        }
+        job = write_queue[write_tail % WRITE_QUEUE_SIZE];
+        write_tail++;
+        sem_post(&write_free);
+
+        if (job.kind == WRITE_STOP) {
+            return NULL;
+        } else if (job.kind == WRITE_FLUSH) {
+            sem_post(&write_flushed);
+            continue;
+        }
+        /* after a failure the remaining files are dropped */
+        if (__atomic_load_n(&writer_error, __ATOMIC_ACQUIRE) == 0) {
+            d2c_stats_start(&clock);
+            rc = output_sink->write(output_sink, job.filename, job.buf, job.len);
+            d2c_stats_stop_at(D2C_PHASE_IO, &clock, NULL, job.filename);
+            if (rc < 0) {
+                __atomic_store_n(&writer_error, job.errcode, __ATOMIC_RELEASE);
+            } else if (rc > 0) {
+                files_unchanged++;
+            } else {
+                files_written++;
+                count_written(job.len);
+            }
+        }
+        free(job.filename);
+        free(job.buf);
+    }
+}
+
+/* exits with the code of a failed write, as the synchronous path would */
+static void check_writer()
+{
+    int errcode = __atomic_load_n(&writer_error, __ATOMIC_ACQUIRE);
+
+    if (errcode != 0) {
+        d2c_exit(errcode);
+    }
+}
+
+static void queue_job(int kind, char *filename, char *buf, size_t len, int errcode)
+{
+    writejob *job;
+
+    if (!writer_running) {
+        if (sem_init(&write_free, 0, WRITE_QUEUE_SIZE) != 0
+                || sem_init(&write_used, 0, 0) != 0
+                || sem_init(&write_flushed, 0, 0) != 0
+                || pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+            fprintf(stderr, "Can't start the writer thread\n");
+            d2c_exit(1);
+        }
+        writer_running = 1;
+    }
+    check_writer();
+    while (sem_wait(&write_free) != 0) {
+        /* EINTR */
+    }
+    job = &write_queue[write_head % WRITE_QUEUE_SIZE];
+    job->kind = kind;
+    job->filename = filename;
+    job->buf = buf;
+    job->len = len;
+    job->errcode = errcode;
+    write_head++;
+    sem_post(&write_used);
+}
+
+/* waits until the queued files are written */
+static void flush_writer()
+{
+    if (!writer_running) {
+        return;
+    }
+    queue_job(WRITE_FLUSH, NULL, NULL, 0, 0);
+    while (sem_wait(&write_flushed) != 0) {
+        /* EINTR */
+    }
+    check_writer();
+}
+
+static void stop_writer()
+{
+    if (!writer_running) {
+        return;
+    }
+    queue_job(WRITE_STOP, NULL, NULL, 0, 0);
+    pthread_join(writer, NULL);
+    writer_running = 0;
+    check_writer();
+}
+
+static FILE *outfile_open(char *filename, char *mode, int errcode)
+{
+    int on_disk = current_sink() == &directory_sink;
+    int cached;
+    outbuf *ob;
+
+    d2c_manifest_file(filename);
+    d2c_deps_output(filename);
+    /* the cache needs the content in memory */
+    cached = d2c_cache_file(filename);
+    if (on_disk && !output_ifchanged && !output_atomic && !output_async
+            && !output_uring && collected == NULL && !cached) {
+        FILE *f;
+        d2c_clock clock;
+        d2c_stats_start(&clock);
+        if (generate_backup && mode[0] == 'w') {
+            d2c_backup(filename);
+        }
+        f = fopen(filename, mode);
+        if (f != NULL) {
+            files_written++;
+            d2c_count(D2C_COUNT_FILES, 1);
+        }
+        d2c_stats_stop_at(D2C_PHASE_IO, &clock, NULL, filename);
+        return f;
+    }
+
+    ob = NEW (outbuf);
+    ob->filename = strdup(filename);
+    ob->tmpname = NULL;
+    ob->errcode = errcode;
+    if (ob->filename == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    if (on_disk && output_atomic && !output_ifchanged && !output_async
+            && collected == NULL && !cached) {
+        ob->f = open_tmpfile(ob);
+        if (ob->f == NULL) {
+            free(ob->filename);
+            free(ob);
+            return NULL;
+        }
+    } else {
+        ob->f = open_memstream(&ob->buf, &ob->len);
+        if (ob->f == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            d2c_exit(1);
+        }
+    }
+    if (on_disk && mode[0] == 'a') {
+        /* the file may still be waiting for the writer thread, unless
+           this thread collects: the main thread alone queues files */
+        if (collected == NULL) {
+            flush_writer();
+        }
+        preload(ob->f, filename);
+    }
+    ob->next = outbufs;
+    outbufs = ob;
+    return ob->f;
+}
+
+/**
+ * Opens a generated file.  mode is "w" or "a", as for fopen().
+ * Returns NULL if the file can't be opened; the caller reports it.
+*/
+FILE * d2c_outfile_open (char *filename, char *mode)
+{
+    return outfile_open(filename, mode, 3);
+}
+
+/**
+ * Makes filename a hard link to source, a file of --output-cache, with
+ * --output-cache-link.  Only the directory sink in --atomic mode, which
+ * never writes a file in place, links the files.  Returns -1 if the file
+ * is to be written instead.
+*/
+int d2c_outfile_link (const char *source, char *filename)
+{
+    struct stat a, b;
+    outbuf ob;
+
+    if (current_sink() != &directory_sink || !output_atomic || output_async
+            || output_uring || collected != NULL) {
+        return -1;
+    }
+    d2c_manifest_file(filename);
+    d2c_deps_output(filename);
+    if (output_ifchanged && stat(source, &a) == 0 && stat(filename, &b) == 0
+            && a.st_dev == b.st_dev && a.st_ino == b.st_ino) {
+        files_unchanged++;
+        return 0;
+    }
+    ob.filename = filename;
+    ob.f = open_tmpfile(&ob);
+    if (ob.f == NULL) {
+        return -1;
+    }
+    fclose(ob.f);
+    /* the name stays ours: only this process removes its temporary files */
+    unlink(ob.tmpname);
+    if (link(source, ob.tmpname) != 0) {
+        free(ob.tmpname);
+        return -1;
+    }
+    if (generate_backup) {
+        backup_link(filename);
+    }
+    if (rename(ob.tmpname, filename) != 0) {
+        fprintf(stderr, "Error %d while trying to rename %s to %s\n",
+                errno, ob.tmpname, filename);
+        unlink(ob.tmpname);
+        free(ob.tmpname);
+        return -1;
+    }
+    if (output_fsync != D2C_FSYNC_NONE) {
+        remember_dir(filename);
+    }
+    free(ob.tmpname);
+    files_written++;
+    d2c_count(D2C_COUNT_FILES, 1);
+    return 0;
+}
+
+/*
+ * Hands a file produced in memory to the writer thread with
+ * --async-write, or else to the output sink.  Exits with ob->errcode if
+ * it can't be written.
+ */
+static void deliver(outbuf *ob)
+{
+    d2c_clock clock;
+    int rc;
+
+    last_errcode = ob->errcode;
+    if (output_async && task_sink == NULL) {
+        /* the writer thread takes over filename and buf */
+        queue_job(WRITE_FILE, ob->filename, ob->buf, ob->len, ob->errcode);
+        free(ob);
+        return;
+    }
+    d2c_stats_start(&clock);
+    rc = current_sink()->write(current_sink(), ob->filename, ob->buf, ob->len);
+    d2c_stats_stop_at(D2C_PHASE_IO, &clock, NULL, ob->filename);
+    free(ob->buf);
+    if (rc < 0) {
+        d2c_exit(ob->errcode);
+    } else if (rc > 0) {
+        files_unchanged++;
+    } else {
+        files_written++;
+        count_written(ob->len);
+    }
+    free(ob->filename);
+    free(ob);
+}
+
+/**
+ * Closes a file returned by d2c_outfile_open() or open_outfile().
+ * This is where a file produced in memory is handed to the output sink
+ * (in --if-changed mode, only written if its content differs), or to
+ * the writer thread with --async-write; in --atomic mode this is where
+ * the temporary file replaces the old one.  While collecting, the file
+ * is only added to the list of the thread.
+*/
+void d2c_outfile_close (FILE *f)
+{
+    outbuf *ob = outbufs, *prev = NULL, **last;
+    d2c_clock clock;
+    long len = 0;
+    int rc;
+
+    while (ob != NULL && ob->f != f) {
+        prev = ob;
+        ob = ob->next;
+    }
+    if (ob == NULL) {
+        /* a file written in place, see outfile_open() */
+        d2c_stats_start(&clock);
+        if (generate_stats) {
+            len = ftell(f);
+        }
+        fclose(f);
+        d2c_count(D2C_COUNT_BYTES, len);
+        d2c_stats_stop(D2C_PHASE_IO, &clock);
+        return;
+    }
+    if (prev == NULL) {
+        outbufs = ob->next;
+    } else {
+        prev->next = ob->next;
+    }
+    if (ob->tmpname == NULL) {
+        /* closing the memory stream makes buf and len final */
+        fclose(f);
+        d2c_cache_content(ob->filename, ob->buf, ob->len);
+        if (collected != NULL) {
+            /* files are kept in the order they are closed */
+            last = (outbuf **) collected;
+            while (*last != NULL) {
+                last = &(*last)->next;
+            }
+            ob->next = NULL;
+            *last = ob;
+        } else {
+            deliver(ob);
+        }
+        return;
+    }
+    last_errcode = ob->errcode;
+    d2c_stats_start(&clock);
+    if (generate_stats) {
+        len = ftell(ob->f);
+    }
+    rc = finish_tmpfile(ob);
+    d2c_stats_stop_at(D2C_PHASE_IO, &clock, NULL, ob->filename);
+    if (rc < 0) {
+        d2c_exit(ob->errcode);
+    }
+    files_written++;
+    count_written(len);
+    free(ob->filename);
+    free(ob);
+}
+
+/**
+ * Makes the calling thread produce its files in memory and keep them in
+ * the list *files once closed, instead of writing them.  Called with
+ * NULL, it stops doing so.
+*/
+void d2c_outfile_collect (void **files)
+{
+    collected = files;
+}
+
+/**
+ * Writes the files collected in files, in the order they were closed,
+ * and frees the list.  A thread that collects files itself, such as a
+ * target generated next to others, adds them to its own list instead.
+*/
+static void deliver_all(void *files)
+{
+    outbuf *ob = files, *next;
+
+    while (ob != NULL) {
+        next = ob->next;
+        deliver(ob);
+        ob = next;
+    }
+}
+
+void d2c_outfile_commit (void *files)
+{
+    outbuf *ob = files, **last;
+    int code;
+
+    if (collected != NULL) {
+        last = (outbuf **) collected;
+        while (*last != NULL) {
+            last = &(*last)->next;
+        }
+        *last = ob;
+        return;
+    }
+    /* the jobs of --batch commit their files from their own threads */
+    pthread_mutex_lock(&commit_lock);
+    code = d2c_catch(deliver_all, files);
+    pthread_mutex_unlock(&commit_lock);
+    if (code != 0) {
+        d2c_exit(code);
+    }
+}
+
+/**
+ * Drops the files that the calling thread has open or has collected,
+ * after a failure caught with d2c_catch(), and stops collecting.
+*/
+void d2c_outfile_discard ()
+{
+    outbuf *ob, *next;
+
+    for (ob = outbufs; ob != NULL; ob = next) {
+        next = ob->next;
+        fclose(ob->f);
+        if (ob->tmpname != NULL) {
+            unlink(ob->tmpname);
+            free(ob->tmpname);
+        } else {
+            free(ob->buf);
+        }
+        free(ob->filename);
+        free(ob);
+    }
+    outbufs = NULL;
+    if (collected != NULL) {
+        for (ob = *collected; ob != NULL; ob = next) {
+            next = ob->next;
+            free(ob->buf);
+            free(ob->filename);
+            free(ob);
+        }
+        *collected = NULL;
+        collected = NULL;
+    }
+}
+
+/**
+ * Makes the calling thread write its files to sink rather than to
+ * output_sink, as the library does for d2c_generate(); NULL restores
+ * output_sink.  The tasks it runs inherit it, see d2c_genstate_save().
+*/
+void d2c_outfile_use_sink (d2c_sink *sink)
+{
+    task_sink = sink;
+}
+
+d2c_sink * d2c_outfile_sink ()
+{
+    return task_sink;
+}
+
+/**
+ * Parses the argument of "--fsync" and "file.fsync".
+ * Returns 0 on success, -1 for an unknown durability level.
+*/
+int d2c_outfile_set_fsync (char *level)
+{
+    if (eq(level, "none")) {
+        output_fsync = D2C_FSYNC_NONE;
+    } else if (eq(level, "dir")) {
+        output_fsync = D2C_FSYNC_DIR;
+    } else if (eq(level, "file")) {
+        output_fsync = D2C_FSYNC_FILE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Creates a directory of the generated tree, through the output sink.
+ * Sinks without directories (tar, memory) just ignore it.
+*/
+int d2c_outfile_mkdir (char *dirname, mode_t mode)
+{
+    d2c_sink *sink = current_sink();
+
+    if (sink->mkdir == NULL) {
+        return 0;
+    }
+    return sink->mkdir(sink, dirname, mode);
+}
+
+/**
+ * Called once all generated files are closed: waits for the writer
+ * thread, syncs the directories that received new files (a single fsync
+ * per directory), completes the output sink and reports how many files
+ * were written.
+*/
+void d2c_outfile_finish ()
+{
+    stop_writer();
+    if (d2c_uring_flush() != 0) {
+        d2c_exit(last_errcode);
+    }
+    sync_dirs();
+    if (output_sink->finish != NULL && output_sink->finish(output_sink) != 0) {
+        d2c_exit(3);
+    }
+    if (output_ifchanged) {
+        fprintf(stderr, "%d files written, %d unchanged\n",
+                files_written, files_unchanged);
+    }
+}
+
+/* In-memory sink: keeps every generated file in a list, in order */
+
+struct memsink {
+    d2c_memfile *files;
+    d2c_memfile *last;
+};
+typedef struct memsink memsink;
+
+static int mem_write(d2c_sink *sink, const char *filename, const char *buf, size_t len)
+{
+    memsink *m = sink->data;
+    d2c_memfile *file;
+
+    /* a file generated twice keeps its place and gets the new content */
+    for (file = m->files; file != NULL; file = file->next) {
+        if (eq(file->filename, filename)) {
+            break;
+        }
+    }
+    if (file == NULL) {
+        file = NEW (d2c_memfile);
+        file->filename = strdup(filename);
+        file->next = NULL;
+        if (m->last == NULL) {
+            m->files = file;
+        } else {
+            m->last->next = file;
+        }
+        m->last = file;
+    } else {
+        free(file->buf);
+    }
+    /* one more byte so that the content can be used as a string */
+    file->buf = my_malloc(len + 1);
+    memcpy(file->buf, buf, len);
+    file->buf[len] = '\0';
+    file->len = len;
+    return 0;
+}
+
+static void mem_destroy(d2c_sink *sink)
+{
+    memsink *m = sink->data;
+    d2c_memfile *file, *next;
+
+    for (file = m->files; file != NULL; file = next) {
+        next = file->next;
+        free(file->filename);
+        free(file->buf);
+        free(file);
+    }
+    free(m);
+}
+
+/**
+ * Returns a sink that keeps the generated files in memory, for tests
+ * and programs embedding the generators.  The files are listed by
+ * d2c_sink_memory_files().
+*/
+d2c_sink * d2c_sink_memory ()
+{
+    d2c_sink *sink = NEW (d2c_sink);
+    memsink *m = NEW (memsink);
+
+    m->files = NULL;
+    m->last = NULL;
+    sink->write = mem_write;
+    sink->mkdir = NULL;
+    sink->finish = NULL;
+    sink->destroy = mem_destroy;
+    sink->data = m;
+    return sink;
+}
+
+d2c_memfile * d2c_sink_memory_files (d2c_sink *sink)
+{
+    return ((memsink *) sink->data)->files;
+}
+
+/* Tar sink: a single ustar archive, with pax headers for long names */
+
+#define TAR_BLOCK 512
+
+struct tarsink {
+    FILE *f;
+    unsigned long mtime;
+};
+typedef struct tarsink tarsink;
+
+/* writes the zeros that complete a block of len bytes */
+static int tar_pad(FILE *f, size_t len)
+{
+    static const char zeros[TAR_BLOCK];
+    size_t rest = len % TAR_BLOCK;
+
+    if (rest == 0) {
+        return 0;
+    }
+    return fwrite(zeros, 1, TAR_BLOCK - rest, f) == TAR_BLOCK - rest ? 0 : -1;
+}
+
+/*
+ * Returns where name has to be split between the prefix and name fields
+ * of a ustar header: 0 if it fits in the name field, the length of the
+ * prefix otherwise, or -1 if it is too long and needs a pax header.
+ */
+static int tar_split(const char *name)
+{
+    size_t len = strlen(name);
+    const char *slash;
+
+    if (len <= 100) {
+        return 0;
+    }
+    /* the first '/' that leaves at most 100 chars to the name field */
+    for (slash = strchr(name, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        if (len - (slash - name) - 1 <= 100) {
+            break;
+        }
+    }
+    if (slash == NULL || slash == name || slash - name > 155) {
+        return -1;
+    }
+    return slash - name;
+}
+
+static int tar_header(tarsink *t, const char *name, size_t size, char type)
+{
+    unsigned char header[TAR_BLOCK];
+    unsigned int sum = 0;
+    size_t len = strlen(name);
+    int i, split = tar_split(name);
+
+    memset(header, 0, sizeof(header));
+    if (split > 0) {
+        memcpy(header + 345, name, split);
+        memcpy(header, name + split + 1, len - split - 1);
+    } else if (split == 0) {
+        memcpy(header, name, len);
+    } else {
+        /* the real name is in the preceding pax header */
+        memcpy(header, name + len - 100, 100);
+    }
+    sprintf((char *) header + 100, "%07o", 0644);
+    sprintf((char *) header + 108, "%07o", 0);
+    sprintf((char *) header + 116, "%07o", 0);
+    sprintf((char *) header + 124, "%011lo", (unsigned long) size);
+    sprintf((char *) header + 136, "%011lo", t->mtime);
+    memset(header + 148, ' ', 8);
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    for (i = 0; i < TAR_BLOCK; i++) {
+        sum += header[i];
+    }
+    sprintf((char *) header + 148, "%06o", sum);
+    header[155] = ' ';
+    return fwrite(header, 1, TAR_BLOCK, t->f) == TAR_BLOCK ? 0 : -1;
+}
+
+/* length of the pax record "<len> path=<name>\n", <len> counting itself */
+static size_t pax_record_len(size_t base)
+{
+    size_t len = base + 1, n, digits;
+
+    for (;;) {
+        for (n = len, digits = 1; n >= 10; n /= 10) {
+            digits++;
+        }
+        if (base + digits == len) {
+            return len;
+        }
+        len = base + digits;
+    }
+}
+
+static int tar_write(d2c_sink *sink, const char *filename, const char *buf, size_t len)
+{
+    tarsink *t = sink->data;
+    int rc = 0;
+
+    /* member names are relative: "./a/b.h" and "/a/b.h" become "a/b.h" */
+    while (filename[0] == '/' || (filename[0] == '.' && filename[1] == '/')) {
+        filename += filename[0] == '/' ? 1 : 2;
+    }
+    if (tar_split(filename) < 0) {
+        size_t reclen = pax_record_len(strlen(filename) + 7);
+        char *record = my_malloc(reclen + 1);
+
+        sprintf(record, "%lu path=%s\n", (unsigned long) reclen, filename);
+        rc = tar_header(t, "././@PaxHeader", reclen, 'x');
+        if (rc == 0 && (fwrite(record, 1, reclen, t->f) != reclen
+                        || tar_pad(t->f, reclen) != 0)) {
+            rc = -1;
+        }
+        free(record);
+    }
+    if (rc == 0) {
+        rc = tar_header(t, filename, len, '0');
+    }
+    if (rc != 0 || fwrite(buf, 1, len, t->f) != len || tar_pad(t->f, len) != 0) {
+        fprintf(stderr, "Can't write %s to the tar archive\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int tar_finish(d2c_sink *sink)
+{
+    static const char zeros[2 * TAR_BLOCK];
+    tarsink *t = sink->data;
+    int rc = 0;
+
+    if (fwrite(zeros, 1, sizeof(zeros), t->f) != sizeof(zeros)
+            || fflush(t->f) != 0) {
+        rc = -1;
+    }
+    if (t->f != stdout && fclose(t->f) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Can't write the tar archive\n");
+    }
+    return rc;
+}
+
+/**
+ * Returns a sink that streams the generated files to f as one
+ * uncompressed tar archive; f is closed at the end unless it is stdout.
+ * The members get the time of the run, or $SOURCE_DATE_EPOCH if set.
+*/
+d2c_sink * d2c_sink_tar (FILE *f)
+{
+    d2c_sink *sink = NEW (d2c_sink);
+    tarsink *t = NEW (tarsink);
+    char *epoch = getenv("SOURCE_DATE_EPOCH");
+
+    t->f = f;
+    t->mtime = epoch != NULL ? strtoul(epoch, NULL, 10) : (unsigned long) time(NULL);
+    sink->write = tar_write;
+    sink->mkdir = NULL;
+    sink->finish = tar_finish;
+    sink->destroy = NULL;
+    sink->data = t;
+    return sink;
+}
+
+/**
+ * Frees a sink returned by d2c_sink_memory() or d2c_sink_tar(), and the
+ * files it keeps.  The tar archive must have been completed by finish().
+*/
+void d2c_sink_free (d2c_sink *sink)
+{
+    if (sink->destroy != NULL) {
+        sink->destroy(sink);
+    } else {
+        free(sink->data);
+    }
+    free(sink);
+}
+
+FILE * open_outfile (char *filename, batch *b)
+{
+    static D2C_TASK_LOCAL char outfilename[BIG_BUFFER];
+    /* b is shared by the generation tasks, so it is left alone */
+    const char *outdir = b->outdir != NULL ? b->outdir : ".";
+    FILE *o;
+    int tmpdirlgth, tmpfilelgth;
+
+    tmpdirlgth = strlen (outdir);
+    tmpfilelgth = strlen (filename);
+
+    /* This prevents buffer overflows */
+    if (tmpfilelgth + tmpdirlgth > sizeof(outfilename) - 2) {
+        fprintf (stderr, "Sorry, name of file too long ...\n"
+                    "Try a smaller dir name\n");
+        d2c_exit (1);
+    }
+
+    sprintf (outfilename, "%s/%s", outdir, filename);
+    o = fopen (outfilename, "r");
+    if (o != NULL && !b->clobber) {
+        fclose (o);
+        return NULL;
+    }
+    o = outfile_open (outfilename, "w", 1);
+    if (o == NULL) {
+        fprintf (stderr, "Can't open file %s for writing\n", outfilename);
+        d2c_exit (1);
+    }
+    return o;
+}
@@ -23,23 +23,11 @@
 
 static char *sscanfmt()
 {
-    static char buf[16];
+    static D2C_TASK_LOCAL char buf[16];
     sprintf (buf, "#%%%d[^#]#", SMALL_BUFFER - 1);
     return buf;
 }
 
-umlclasslist find(umlclasslist list, char *id ) {
-    if ( id != NULL ) {
-        while ( list != NULL ) {
-            if ( eq(id, list->key->id) ) {
-                return list;
-            }
-            list = list->next;
-        }
-    }
-    return NULL;
-}
-
 /* the buffer must have room for SMALL_BUFFER characters */
 void parse_dia_string(xmlNodePtr stringnode, char *buffer) {
     xmlChar *content;
@@ -75,26 +63,28 @@ int parse_boolean(xmlNodePtr booleannode) {
 }
 
 
+/* The lists of a class are published with a release store, as other
+   classes' generation tasks may copy them, see append() and --pipeline.  */
 void addparent(umlclasslist base, umlclasslist derived) {
     umlclasslist tmp;
-    tmp = NEW (umlclassnode);
+    tmp = NEW_TAGGED (umlclassnode, D2C_MEM_CLASS);
     tmp->key = base->key;
     tmp->next = derived->parents;
-    derived->parents = tmp;
+    __atomic_store_n(&derived->parents, tmp, __ATOMIC_RELEASE);
 }
 
 void adddependency(umlclasslist dependent, umlclasslist dependee) {
     umlclasslist tmp;
-    tmp = NEW (umlclassnode);
+    tmp = NEW_TAGGED (umlclassnode, D2C_MEM_CLASS);
     tmp->key = dependent->key;
     tmp->next = dependee->dependencies;
-    dependee->dependencies = tmp;
+    __atomic_store_n(&dependee->dependencies, tmp, __ATOMIC_RELEASE);
 }
 
 void addaggregate(char *name, char composite, umlclasslist base,
                   umlclasslist associate, char *multiplicity) {
     umlassoclist tmp;
-    tmp = NEW (umlassocnode);
+    tmp = NEW_TAGGED (umlassocnode, D2C_MEM_CLASS);
     if (name != NULL && strlen (name) > 2)
         sscanf(name, sscanfmt(), tmp->name);
     if (multiplicity != NULL)
@@ -104,35 +94,40 @@ void addaggregate(char *name, char composite, umlclasslist base,
     tmp->key = base->key;
     tmp->composite = composite;
     tmp->next = associate->associations;
-    associate->associations = tmp;
+    __atomic_store_n(&associate->associations, tmp, __ATOMIC_RELEASE);
 }
 
-void inherit_realize ( umlclasslist classlist, char * base, char * derived ) {
-    umlclasslist umlbase, umlderived;
-    umlbase = find(classlist, base);
-    umlderived = find(classlist, derived);
-    if ( umlbase != NULL && umlderived != NULL ) {
-        addparent(umlbase, umlderived);
-    }
-}
+/* the relationships keep their texts, the document being freed */
+static char *copy_text(const char *s)
+{
+    char *copy;
 
-void associate ( umlclasslist classlist, char * name, char composite,
-                 char * base, char * aggregate, char *multiplicity) {
-    umlclasslist umlbase, umlaggregate;
-    umlbase = find(classlist, base);
-    umlaggregate = find(classlist, aggregate);
-    if ( umlbase != NULL && umlaggregate != NULL) {
-        addaggregate(name, composite, umlbase, umlaggregate, multiplicity);
+    if (s == NULL) {
+        return NULL;
     }
+    copy = my_malloc(strlen(s) + 1);
+    strcpy(copy, s);
+    return copy;
 }
 
-void make_depend ( umlclasslist classlist, char * dependent, char * dependee) {
-    umlclasslist umldependent, umldependee;
-    umldependent = find(classlist, dependent);
-    umldependee = find(classlist, dependee);
-    if ( umldependent != NULL && umldependee != NULL) {
-        adddependency(umldependent, umldependee);
-    }
+/* appends a relationship of kind from the class from to the class to */
+static umlrelation *add_relation(umlrelationlist **tail, int kind,
+                                 xmlChar *from, xmlChar *to)
+{
+    umlrelation *r = NEW (umlrelation);
+
+    r->kind = kind;
+    r->from = from;
+    r->to = to;
+    r->name = NULL;
+    r->composite = 0;
+    r->multiplicity = NULL;
+    r->source = r->target = NULL;
+    r->next = NULL;
+    d2c_count(D2C_COUNT_EDGES, 1);
+    **tail = r;
+    *tail = &r->next;
+    return r;
 }
 
 /**
@@ -231,7 +226,7 @@ void parse_attribute(xmlNodePtr node, umlattribute *tmp) {
 umlattrlist parse_attributes(xmlNodePtr node) {
     umlattrlist list = NULL, an;
     while ( node != NULL ) {
-        an = NEW (umlattrnode);
+        an = NEW_TAGGED (umlattrnode, D2C_MEM_ATTRIBUTE);
         an->next = NULL;
         parse_attribute(node->xmlChildrenNode, &(an->key));
         list = insert_attribute(an, list);
@@ -256,7 +251,7 @@ void parse_operation(xmlNodePtr node, umloperation *tmp) {
 umloplist parse_operations(xmlNodePtr node) {
     umloplist list = NULL, on;
     while ( node != NULL ) {
-        on = NEW (umlopnode);
+        on = NEW_TAGGED (umlopnode, D2C_MEM_OPERATION);
         on->next = NULL;
         on->key.implementation = NULL;
         parse_operation(node->xmlChildrenNode, &(on->key));
@@ -276,7 +271,7 @@ umltemplatelist parse_templates(xmlNodePtr node) {
     while ( node != NULL) {
         if ( node->xmlChildrenNode->xmlChildrenNode->xmlChildrenNode != NULL &&
                 node->xmlChildrenNode->next->xmlChildrenNode->xmlChildrenNode != NULL ) {
-            tn = NEW (umltemplatenode);
+            tn = NEW_TAGGED (umltemplatenode, D2C_MEM_CLASS);
             tn->next = NULL;
             parse_template(node->xmlChildrenNode, &(tn->key));
             list = insert_template(tn, list);
@@ -299,8 +294,8 @@ void make_javabean_methods(umlclass *myself) {
     while (attrlist != NULL) {
         if ( ! attrlist->key.isabstract) {
             /* The SET method */
-            operation = NEW (umlopnode);
-            parameter = NEW (umlattrnode);
+            operation = NEW_TAGGED (umlopnode, D2C_MEM_OPERATION);
+            parameter = NEW_TAGGED (umlattrnode, D2C_MEM_ATTRIBUTE);
 
             sprintf(parameter->key.name, "value");
             strncpy(parameter->key.type, attrlist->key.type, SMALL_BUFFER);
@@ -312,7 +307,7 @@ void make_javabean_methods(umlclass *myself) {
             parameter->next = NULL;
             operation->key.parameters = parameter;
 
-            operation->key.implementation = (char*) my_malloc (BIG_BUFFER);
+            operation->key.implementation = (char*) my_malloc_tagged (BIG_BUFFER, D2C_MEM_OPERATION);
             sprintf(operation->key.implementation, "    ");
             strcat(operation->key.implementation, attrlist->key.name);
             strcat(operation->key.implementation, " = value;");
@@ -332,7 +327,7 @@ void make_javabean_methods(umlclass *myself) {
             myself->operations = insert_operation(operation, myself->operations);
 
             /* The GET or IS method */
-            operation = NEW (umlopnode);
+            operation = NEW_TAGGED (umlopnode, D2C_MEM_OPERATION);
             operation->key.parameters = NULL;
             tmpname = strtoupperfirst(attrlist->key.name);
             if ( eq(attrlist->key.type, "boolean") ) {
@@ -343,7 +338,7 @@ void make_javabean_methods(umlclass *myself) {
             strncat(operation->key.attr.name, tmpname, SMALL_BUFFER - 1);
             free(tmpname);
 
-            operation->key.implementation = (char*) my_malloc (BIG_BUFFER);
+            operation->key.implementation = (char*) my_malloc_tagged (BIG_BUFFER, D2C_MEM_OPERATION);
             sprintf(operation->key.implementation, "    return ");
             strcat(operation->key.implementation, attrlist->key.name);
             strcat(operation->key.implementation, ";");
@@ -364,24 +359,27 @@ void make_javabean_methods(umlclass *myself) {
 
 void parse_geom_position(xmlNodePtr attribute, geometry * geom ) {
     xmlChar *val;
-    char * token;
+    char * token, *save;
     val = xmlGetProp(attribute, "val");
-    token = strtok(val,",");
+    token = strtok_r(val,",",&save);
     sscanf ( token, "%f", &(geom->pos_x) );
-    token = strtok(NULL,",");
+    token = strtok_r(NULL,",",&save);
     sscanf ( token, "%f", &(geom->pos_y) );
+    free(val);
 }
 
 void parse_geom_width(xmlNodePtr attribute, geometry * geom ) {
     xmlChar *val;
     val = xmlGetProp(attribute, "val");
     sscanf ( val, "%f", &(geom->width) );
+    free(val);
 }
 
 void parse_geom_height(xmlNodePtr attribute, geometry * geom ) {
     xmlChar *val;
     val = xmlGetProp(attribute, "val");
     sscanf ( val, "%f", &(geom->height) );
+    free(val);
 }
 
 
@@ -402,8 +400,8 @@ umlpackagelist parse_package(xmlNodePtr package) {
     xmlChar *attrname;
     //debug( 4, "parse_package %s", package->name );
 
-    listmyself = NEW (umlpackagenode);
-    myself = NEW (umlpackage);
+    listmyself = NEW_TAGGED (umlpackagenode, D2C_MEM_PACKAGE);
+    myself = NEW_TAGGED (umlpackage, D2C_MEM_PACKAGE);
 
     myself->parent = NULL;
 
@@ -425,6 +423,7 @@ umlpackagelist parse_package(xmlNodePtr package) {
             } else if ( eq ( "elem_height", attrname ) ) {
                 parse_geom_height(attribute->xmlChildrenNode, &myself->geom );
             }
+            free(attrname);
         }
         attribute = attribute->next;
     }
@@ -437,8 +436,8 @@ umlclasslist parse_class(xmlNodePtr class) {
     umlclasslist listmyself;
     umlclass *myself;
 
-    listmyself = NEW (umlclassnode);
-    myself = NEW (umlclass);
+    listmyself = NEW_TAGGED (umlclassnode, D2C_MEM_CLASS);
+    myself = NEW_TAGGED (umlclass, D2C_MEM_CLASS);
     myself->package = NULL;
     myself->isabstract = 0;
 
@@ -498,17 +497,13 @@ umlclasslist parse_class(xmlNodePtr class) {
 
 /**
   Simple, non-compromising, implementation declaration.
-  This function creates a plain vanilla interface (an
-  umlclasslist) and associates it to the implementator.
-  The implementator's code should contain the interface
-  name, but the interface itself will not be inserted
-  into the classlist, so no code can be generated for it.
+  The interface is made when the relationship is linked, see
+  link_relation().
 */
-void lolipop_implementation(umlclasslist classlist, xmlNodePtr object) {
+static void lolipop_implementation(umlrelationlist **tail, xmlNodePtr object) {
     xmlNodePtr attribute;
     xmlChar *id = NULL, *name = "";
     xmlChar *attrname;
-    umlclasslist interface, implementator;
 
     attribute = object->xmlChildrenNode;
     while ( attribute != NULL ) {
@@ -526,22 +521,57 @@ void lolipop_implementation(umlclasslist classlist, xmlNodePtr object) {
         }
         attribute = attribute->next;
     }
-    implementator = find(classlist, id);
-    free(id);
-    if (implementator != NULL && name != NULL && strlen(name) > 2) {
-        interface = NEW (umlclassnode);
-        interface->key = NEW (umlclass);
-        interface->parents = NULL;
-        interface->next = NULL;
-        sprintf(interface->key->id, "00");
-        sscanf(name, sscanfmt(), interface->key->name);
-        sprintf(interface->key->stereotype, "Interface");
-        interface->key->isabstract = 1;
-        interface->key->attributes = NULL;
-        interface->key->operations = NULL;
-        addparent(interface, implementator);
-        /* we MUST NOT free interface at this point */
+    add_relation(tail, RELATION_LOLIPOP, NULL, id)->name = copy_text(name);
+}
+
+static int by_address(const void *a, const void *b)
+{
+    const void *x = *(const void * const *) a;
+    const void *y = *(const void * const *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Sets *packages to the packages of the classes and their parents,
+   sorted by address, and returns how many there are.  */
+static int used_packages(umlclasslist classlist, umlpackage ***packages)
+{
+    umlclasslist node;
+    umlpackage *pkg;
+    int i, n, count = 0;
+
+    for (node = classlist; node != NULL; node = node->next) {
+        for (pkg = node->key->package; pkg != NULL; pkg = pkg->parent) {
+            count++;
+        }
+    }
+    *packages = my_malloc((count + 1) * sizeof(umlpackage *));
+    count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        for (pkg = node->key->package; pkg != NULL; pkg = pkg->parent) {
+            (*packages)[count++] = pkg;
+        }
+    }
+    qsort(*packages, count, sizeof(umlpackage *), by_address);
+    for (i = n = 0; i < count; i++) {
+        if (n == 0 || (*packages)[n - 1] != (*packages)[i]) {
+            (*packages)[n++] = (*packages)[i];
+        }
+    }
+    return n;
+}
+
+static void free_package(umlpackage *pkg)
+{
+    umlpackagedir *dir, *next;
+
+    for (dir = pkg->directories; dir != NULL; dir = next) {
+        next = dir->next;
+        free(dir->root);
+        free(dir->directory);
+        my_free_tagged(dir, D2C_MEM_PACKAGE);
     }
+    my_free_tagged(pkg, D2C_MEM_PACKAGE);
 }
 
 void recursive_search(xmlNodePtr node, xmlNodePtr * object) {
@@ -594,32 +624,63 @@ xmlNodePtr getNextObject(xmlNodePtr from) {
     return NULL;
 }
 
-umlclasslist parse_diagram(char *diafile) {
-    xmlDocPtr ptr;
+/* counts the members of class, for --stats */
+static void count_members(umlclass *class) {
+    umlattrlist attr;
+    umloplist op;
+    int n = 0;
+
+    for (attr = class->attributes; attr != NULL; attr = attr->next) {
+        n++;
+    }
+    d2c_count(D2C_COUNT_ATTRIBUTES, n);
+    n = 0;
+    for (op = class->operations; op != NULL; op = op->next) {
+        n++;
+    }
+    d2c_count(D2C_COUNT_OPERATIONS, n);
+}
+
+/*
+ * Reads the classes and the packages of the diagram, and puts each class
+ * in its package.  The relationships between the classes are returned
+ * in *relations, in the order they must be linked, see link_relation().
+ * The document is freed.  Each pass is timed with clock, see stats.c.
+ */
+static umlclasslist parse_objects(xmlDocPtr ptr, umlrelationlist *relations,
+                                  d2c_clock *clock) {
     xmlChar *end1 = NULL;
     xmlChar *end2 = NULL;
 
     xmlNodePtr object = NULL;
     umlclasslist classlist = NULL, endlist = NULL;
     umlpackagelist packagelist = NULL, dummypcklist, endpcklist = NULL;
+    umlrelationlist *tail = relations;
+    umlpackage **used;
+    int nused;
 
-    ptr = xmlParseFile(diafile);
-
-    if (ptr == NULL) {
-        fprintf(stderr, "That file does not exist or is not a Dia diagram\n");
-        exit(2);
-    }
+    *relations = NULL;
 
     /* we search for the first "object" node */
     recursive_search( ptr->xmlRootNode->xmlChildrenNode->next, &object );
 
     while (object != NULL) {
         xmlChar *objtype = xmlGetProp(object, "type");
+        d2c_count(D2C_COUNT_OBJECTS, 1);
         /* Here we have a Dia object */
         if ( eq("UML - Class", objtype) || eq("Database - Table", objtype)) {
             /* Here we have a class definition */
-            umlclasslist tmplist = parse_class(object);
+            d2c_clock span;
+            umlclasslist tmplist;
+
+            d2c_trace_start(&span);
+            tmplist = parse_class(object);
             if (tmplist != NULL) {
+                d2c_trace_end(&span, "parse class", "class", tmplist->key->name, NULL);
+                d2c_count(D2C_COUNT_CLASSES, 1);
+                if (generate_stats) {
+                    count_members(tmplist->key);
+                }
                 /* We get the ID of the object here*/
                 xmlChar *objid = xmlGetProp(object, "id");
                 sscanf(objid, "%79s", tmplist->key->id);
@@ -653,6 +714,7 @@ umlclasslist parse_diagram(char *diafile) {
         free(objtype);
         object = getNextObject(object);
     }
+    d2c_stats_stop(D2C_PHASE_CLASSES, clock);
 
     /* Second pass - Implementations and associations */
 
@@ -768,17 +830,21 @@ umlclasslist parse_diagram(char *diafile) {
 
             if (end1 != NULL && end2 != NULL) {
                 char *thisname = name;
+                umlrelation *r;
                 if (direction == 1) {
                     if (thisname == NULL || !*thisname || eq("##", thisname))
                         thisname = name_a;
-                    associate(classlist, thisname, composite, end1, end2, multiplicity_a);
+                    r = add_relation(&tail, RELATION_ASSOCIATION, end1, end2);
+                    r->multiplicity = copy_text(multiplicity_a);
                 } else {
                     if (thisname == NULL || !*thisname || eq("##", thisname))
                         thisname = name_b;
-                    associate(classlist, thisname, composite, end2, end1, multiplicity_b);
+                    r = add_relation(&tail, RELATION_ASSOCIATION, end2, end1);
+                    r->multiplicity = copy_text(multiplicity_b);
                 }
-                free(end1);
-                free(end2);
+                r->name = copy_text(thisname);
+                r->composite = composite;
+                end1 = end2 = NULL;
             }
 
         } else if ( eq("UML - Dependency", objtype) ) {
@@ -787,9 +853,8 @@ umlclasslist parse_diagram(char *diafile) {
                 if ( eq("connections", attribute->name) ) {
                     end1 = xmlGetProp(attribute->xmlChildrenNode->next, "to");
                     end2 = xmlGetProp(attribute->xmlChildrenNode, "to");
-                    make_depend(classlist, end1, end2);
-                    free(end1);
-                    free(end2);
+                    add_relation(&tail, RELATION_DEPENDENCY, end1, end2);
+                    end1 = end2 = NULL;
                 }
                 attribute = attribute->next;
             }
@@ -799,19 +864,18 @@ umlclasslist parse_diagram(char *diafile) {
                 if ( eq("connections", attribute->name) ) {
                     end1 = xmlGetProp(attribute->xmlChildrenNode, "to");
                     end2 = xmlGetProp(attribute->xmlChildrenNode->next, "to");
-                    inherit_realize(classlist, end1, end2);
-                    free(end2);
-                    free(end1);
+                    add_relation(&tail, RELATION_PARENT, end1, end2);
+                    end1 = end2 = NULL;
                 }
                 attribute = attribute->next;
             }
         } else if ( eq("UML - Implements", objtype) ) {
-            lolipop_implementation(classlist, object);
+            lolipop_implementation(&tail, object);
         }
         free(objtype);
         object = getNextObject(object);
     }
-
+    d2c_stats_stop(D2C_PHASE_RELATIONS, clock);
 
     /* Generalizations: we must put this AFTER all the interface
        implementations. generate_code_java relies on this. */
@@ -824,9 +888,8 @@ umlclasslist parse_diagram(char *diafile) {
                 if ( eq("connections", attribute->name) ) {
                     end1 = xmlGetProp(attribute->xmlChildrenNode, "to");
                     end2 = xmlGetProp(attribute->xmlChildrenNode->next, "to");
-                    inherit_realize(classlist, end1, end2);
-                    free(end2);
-                    free(end1);
+                    add_relation(&tail, RELATION_PARENT, end1, end2);
+                    end1 = end2 = NULL;
                 }
                 attribute = attribute->next;
             }
@@ -834,6 +897,7 @@ umlclasslist parse_diagram(char *diafile) {
         free(objtype);
         object = getNextObject(object);
     }
+    d2c_stats_stop(D2C_PHASE_GENERALIZATIONS, clock);
 
     /* Packages: we should scan the packagelist and then the classlist.
        Scanning the packagelist we'll build all relationships between
@@ -880,5 +944,340 @@ umlclasslist parse_diagram(char *diafile) {
         dummypcklist = dummypcklist->next;
     }
 
+    /* the packages that hold no class are not needed any more */
+    nused = used_packages(classlist, &used);
+    while (packagelist != NULL) {
+        dummypcklist = packagelist->next;
+        if (bsearch(&packagelist->key, used, nused, sizeof(umlpackage *),
+                    by_address) == NULL) {
+            free_package(packagelist->key);
+        }
+        my_free_tagged(packagelist, D2C_MEM_PACKAGE);
+        packagelist = dummypcklist;
+    }
+    free(used);
+    d2c_stats_stop(D2C_PHASE_PACKAGES, clock);
+    xmlFreeDoc(ptr);
+    d2c_stats_stop(D2C_PHASE_XML, clock);
+
+    return classlist;
+}
+
+umlclasslist parse_diagram_objects(char *diafile, umlrelationlist *relations) {
+    xmlDocPtr ptr;
+    d2c_clock clock;
+
+    d2c_stats_start(&clock);
+    ptr = xmlParseFile(diafile);
+    d2c_stats_stop(D2C_PHASE_XML, &clock);
+    d2c_deps_input(diafile);
+    if (ptr == NULL) {
+        fprintf(stderr, "That file does not exist or is not a Dia diagram\n");
+        d2c_exit(2);
+    }
+    return parse_objects(ptr, relations, &clock);
+}
+
+/* An entry of the index of the classes by id, see resolve_relations() */
+struct classindex {
+    umlclasslist node;
+    int pos;
+};
+
+static unsigned int hash_id(const char *id)
+{
+    unsigned int h = 2166136261u;
+
+    while (*id != '\0') {
+        h = (h ^ (unsigned char) *id++) * 16777619u;
+    }
+    return h;
+}
+
+static struct classindex *lookup_id(struct classindex *index, unsigned int mask,
+                                    const char *id)
+{
+    unsigned int i = hash_id(id) & mask;
+
+    while (index[i].node != NULL && !eq(index[i].node->key->id, id)) {
+        i = (i + 1) & mask;
+    }
+    return &index[i];
+}
+
+/*
+ * Finds the classes of each relationship, by id, as the first class of
+ * classlist with that id.  target_pos is set to the position of the
+ * target in classlist.  Returns the number of classes.
+ */
+int resolve_relations(umlclasslist classlist, umlrelationlist relations)
+{
+    struct classindex *index, *entry;
+    unsigned int size = 16;
+    umlclasslist node;
+    int count = 0;
+
+    for (node = classlist; node != NULL; node = node->next) {
+        count++;
+    }
+    while (size < 2 * (unsigned int) count) {
+        size *= 2;
+    }
+    index = my_malloc(size * sizeof(struct classindex));
+    memset(index, 0, size * sizeof(struct classindex));
+    count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        entry = lookup_id(index, size - 1, node->key->id);
+        if (entry->node == NULL) {
+            entry->node = node;
+            entry->pos = count;
+        }
+        count++;
+    }
+
+    for (; relations != NULL; relations = relations->next) {
+        if (relations->from != NULL) {
+            relations->source = lookup_id(index, size - 1, relations->from)->node;
+        }
+        if (relations->to != NULL) {
+            entry = lookup_id(index, size - 1, relations->to);
+            relations->target = entry->node;
+            relations->target_pos = entry->pos;
+        }
+    }
+    free(index);
+    return count;
+}
+
+/**
+  Adds the relationship r, once resolved, to the lists of its target.
+  For a lolipop, a plain vanilla interface (an umlclasslist) is made
+  and associated to the implementator.  The implementator's code should
+  contain the interface name, but the interface itself is not inserted
+  into the classlist, so no code can be generated for it.
+*/
+void link_relation(umlrelation *r)
+{
+    umlclasslist interface;
+
+    if (r->target == NULL || (r->kind != RELATION_LOLIPOP && r->source == NULL)) {
+        return;
+    }
+    switch (r->kind) {
+    case RELATION_ASSOCIATION:
+        addaggregate(r->name, r->composite, r->source, r->target, r->multiplicity);
+        break;
+    case RELATION_DEPENDENCY:
+        adddependency(r->source, r->target);
+        break;
+    case RELATION_PARENT:
+        addparent(r->source, r->target);
+        break;
+    case RELATION_LOLIPOP:
+        if (r->name != NULL && strlen(r->name) > 2) {
+            interface = NEW_TAGGED (umlclassnode, D2C_MEM_CLASS);
+            interface->key = NEW_TAGGED (umlclass, D2C_MEM_CLASS);
+            interface->parents = NULL;
+            interface->next = NULL;
+            sprintf(interface->key->id, "00");
+            sscanf(r->name, sscanfmt(), interface->key->name);
+            sprintf(interface->key->stereotype, "Interface");
+            interface->key->isabstract = 1;
+            interface->key->attributes = NULL;
+            interface->key->operations = NULL;
+            addparent(interface, r->target);
+            /* its class now belongs to the parents of the target */
+            my_free_tagged(interface, D2C_MEM_CLASS);
+        }
+        break;
+    }
+}
+
+void free_relations(umlrelationlist relations)
+{
+    umlrelationlist next;
+
+    for (; relations != NULL; relations = next) {
+        next = relations->next;
+        free(relations->from);
+        free(relations->to);
+        free(relations->name);
+        free(relations->multiplicity);
+        free(relations);
+    }
+}
+
+static umlclasslist link_diagram(umlclasslist classlist, umlrelationlist relations) {
+    umlrelationlist r;
+    d2c_clock clock;
+
+    d2c_stats_start(&clock);
+    resolve_relations(classlist, relations);
+    for (r = relations; r != NULL; r = r->next) {
+        link_relation(r);
+    }
+    free_relations(relations);
+    d2c_stats_stop(D2C_PHASE_LINK, &clock);
     return classlist;
 }
+
+umlclasslist parse_diagram(char *diafile) {
+    umlclasslist classlist;
+    umlrelationlist relations;
+
+    classlist = parse_diagram_objects(diafile, &relations);
+    return link_diagram(classlist, relations);
+}
+
+/**
+ * Parses the uncompressed diagram of len bytes at buf, as parse_diagram()
+ * does for a file.
+*/
+umlclasslist parse_diagram_buffer(const char *buf, int len) {
+    umlclasslist classlist;
+    umlrelationlist relations;
+    xmlDocPtr ptr;
+    d2c_clock clock;
+
+    d2c_stats_start(&clock);
+    ptr = xmlParseMemory(buf, len);
+    d2c_stats_stop(D2C_PHASE_XML, &clock);
+    if (ptr == NULL) {
+        fprintf(stderr, "That is not a Dia diagram\n");
+        d2c_exit(2);
+    }
+    classlist = parse_objects(ptr, &relations, &clock);
+    return link_diagram(classlist, relations);
+}
+
+static void free_attributes(umlattrlist list)
+{
+    umlattrlist next;
+
+    for (; list != NULL; list = next) {
+        next = list->next;
+        my_free_tagged(list, D2C_MEM_ATTRIBUTE);
+    }
+}
+
+static void free_class(umlclass *class)
+{
+    umloplist op, nextop;
+    umltemplatelist tmpl, nexttmpl;
+
+    free_attributes(class->attributes);
+    for (op = class->operations; op != NULL; op = nextop) {
+        nextop = op->next;
+        free_attributes(op->key.parameters);
+        my_free_tagged(op->key.implementation, D2C_MEM_OPERATION);
+        my_free_tagged(op, D2C_MEM_OPERATION);
+    }
+    for (tmpl = class->templates; tmpl != NULL; tmpl = nexttmpl) {
+        nexttmpl = tmpl->next;
+        my_free_tagged(tmpl, D2C_MEM_CLASS);
+    }
+    my_free_tagged(class, D2C_MEM_CLASS);
+}
+
+static void free_classnodes(umlclasslist list)
+{
+    umlclasslist next;
+
+    for (; list != NULL; list = next) {
+        next = list->next;
+        my_free_tagged(list, D2C_MEM_CLASS);
+    }
+}
+
+/**
+ * Frees the classes of classlist, as returned by parse_diagram(), with
+ * their packages and relationships.
+*/
+void free_diagram(umlclasslist classlist)
+{
+    umlclasslist node, next, parent;
+    umlassoclist assoc, nextassoc;
+    umlclass **classes;
+    umlpackage **packages;
+    int i, count = 0;
+
+    for (node = classlist; node != NULL; node = node->next) {
+        count++;
+    }
+    classes = my_malloc((count + 1) * sizeof(umlclass *));
+    count = 0;
+    for (node = classlist; node != NULL; node = node->next) {
+        classes[count++] = node->key;
+    }
+    qsort(classes, count, sizeof(umlclass *), by_address);
+
+    for (node = classlist; node != NULL; node = node->next) {
+        /* the parents that are not in the list are interfaces, see
+           link_relation() */
+        for (parent = node->parents; parent != NULL; parent = parent->next) {
+            if (bsearch(&parent->key, classes, count, sizeof(umlclass *),
+                        by_address) == NULL) {
+                free_class(parent->key);
+            }
+        }
+        free_classnodes(node->parents);
+        free_classnodes(node->dependencies);
+        for (assoc = node->associations; assoc != NULL; assoc = nextassoc) {
+            nextassoc = assoc->next;
+            my_free_tagged(assoc, D2C_MEM_CLASS);
+        }
+    }
+    free(classes);
+
+    count = used_packages(classlist, &packages);
+    for (i = 0; i < count; i++) {
+        free_package(packages[i]);
+    }
+    free(packages);
+
+    for (node = classlist; node != NULL; node = next) {
+        next = node->next;
+        free_class(node->key);
+        my_free_tagged(node, D2C_MEM_CLASS);
+    }
+}
+
+/**
+ * Returns about how many bytes the classes of classlist take in memory,
+ * for the cache of --serve.
+*/
+size_t diagram_size(umlclasslist classlist)
+{
+    umlclasslist node, other;
+    umlattrlist attr;
+    umloplist op;
+    umltemplatelist tmpl;
+    umlassoclist assoc;
+    size_t size = 0;
+
+    for (node = classlist; node != NULL; node = node->next) {
+        size += sizeof(umlclassnode) + sizeof(umlclass);
+        for (attr = node->key->attributes; attr != NULL; attr = attr->next) {
+            size += sizeof(umlattrnode);
+        }
+        for (op = node->key->operations; op != NULL; op = op->next) {
+            size += sizeof(umlopnode);
+            for (attr = op->key.parameters; attr != NULL; attr = attr->next) {
+                size += sizeof(umlattrnode);
+            }
+        }
+        for (tmpl = node->key->templates; tmpl != NULL; tmpl = tmpl->next) {
+            size += sizeof(umltemplatenode);
+        }
+        for (other = node->parents; other != NULL; other = other->next) {
+            size += sizeof(umlclassnode);
+        }
+        for (other = node->dependencies; other != NULL; other = other->next) {
+            size += sizeof(umlclassnode);
+        }
+        for (assoc = node->associations; assoc != NULL; assoc = assoc->next) {
+            size += sizeof(umlassocnode);
+        }
+    }
+    return size;
+}
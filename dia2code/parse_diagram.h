@@ -18,4 +18,32 @@
 #include "dia2code.h"
 
 umlclasslist parse_diagram(char *diafile);
+umlclasslist parse_diagram_buffer(const char *buf, int len);
+void free_diagram(umlclasslist classlist);
+size_t diagram_size(umlclasslist classlist);
+
+/* A relationship of the diagram, that adds the class "from" to the lists
+   of the class "to" when it is linked.  */
+struct umlrelation {
+    int kind;
+    xmlChar *from, *to;       /* The ids of the classes */
+    char *name;               /* Of the association, or of the interface */
+    char composite;
+    char *multiplicity;
+    umlclasslist source, target;   /* Set by resolve_relations() */
+    int target_pos;                /* Position of the target in the list */
+    struct umlrelation *next;
+};
+typedef struct umlrelation umlrelation;
+typedef umlrelation *umlrelationlist;
+
+#define RELATION_ASSOCIATION 0
+#define RELATION_DEPENDENCY  1
+#define RELATION_PARENT      2  /* Realization or generalization */
+#define RELATION_LOLIPOP     3  /* "UML - Implements" */
+
+umlclasslist parse_diagram_objects(char *diafile, umlrelationlist *relations);
+int resolve_relations(umlclasslist classlist, umlrelationlist relations);
+void link_relation(umlrelation *r);
+void free_relations(umlrelationlist relations);
 umlattrlist insert_attribute(umlattrlist n, umlattrlist l);
@@ -0,0 +1,149 @@
+/***************************************************************************
+                          pipeline.c  -  Linking the classes while they are generated
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --pipeline, a diagram goes through four stages: parse, link,
+ * generate and write.  The parse stage reads all the classes and
+ * packages, as the relationships of a class can be anywhere in the
+ * diagram.  The link stage then runs on its own thread: it links the
+ * classes one after the other, in the order of the class list, each
+ * with the relationships that change its lists.  A generation task
+ * only waits for its own class, see d2c_generate_classes(), and the
+ * tasks are handed out in order, within a window of files not yet
+ * written (see d2c_run_tasks()).  The files then go to the writer
+ * thread of --async-write through its bounded queue.
+ *
+ * Only the generators whose files depend on the lists of their own
+ * class are pipelined; the others are generated once all the classes
+ * are linked.
+ */
+
+#include "dia2code.h"
+#include "parse_diagram.h"
+#include <pthread.h>
+
+int generate_pipeline = 0;   /* Set by switch "--pipeline" */
+
+struct d2c_pipeline {
+    umlclasslist classlist;
+    umlrelationlist relations;
+    int linked;              /* classes of the list linked so far */
+    pthread_mutex_t lock;
+    pthread_cond_t progress;
+    pthread_t linker;
+};
+
+static void publish(d2c_pipeline *p, int linked)
+{
+    pthread_mutex_lock(&p->lock);
+    p->linked = linked;
+    pthread_cond_broadcast(&p->progress);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* the link stage */
+static void *link_main(void *arg)
+{
+    d2c_pipeline *p = arg;
+    umlrelationlist r, *sorted;
+    int *start, count, pos, i;
+    d2c_clock clock;
+
+    d2c_stats_start(&clock);
+    count = resolve_relations(p->classlist, p->relations);
+
+    /* the relationships of each class, in the order they are linked */
+    start = my_malloc((count + 2) * sizeof(int));
+    memset(start, 0, (count + 2) * sizeof(int));
+    for (r = p->relations; r != NULL; r = r->next) {
+        if (r->target != NULL) {
+            start[r->target_pos + 2]++;
+        }
+    }
+    for (pos = 0; pos < count; pos++) {
+        start[pos + 2] += start[pos + 1];
+    }
+    sorted = my_malloc((start[count + 1] + 1) * sizeof(umlrelationlist));
+    for (r = p->relations; r != NULL; r = r->next) {
+        if (r->target != NULL) {
+            sorted[start[r->target_pos + 1]++] = r;
+        }
+    }
+
+    /* start[pos] is now the first relationship of the class at pos */
+    for (pos = 0; pos < count; pos++) {
+        for (i = start[pos]; i < start[pos + 1]; i++) {
+            link_relation(sorted[i]);
+        }
+        publish(p, pos + 1);
+    }
+    free(sorted);
+    free(start);
+    d2c_stats_stop(D2C_PHASE_LINK, &clock);
+    return NULL;
+}
+
+static void free_pipeline(d2c_pipeline *p)
+{
+    pthread_cond_destroy(&p->progress);
+    pthread_mutex_destroy(&p->lock);
+    free_relations(p->relations);
+    free(p);
+}
+
+/**
+ * Starts linking the classes of classlist with relations, as returned
+ * by parse_diagram_objects().  Returns NULL if the link stage can't be
+ * started, in which case the classes are linked before returning.
+*/
+d2c_pipeline *d2c_pipeline_start (umlclasslist classlist, struct umlrelation *relations)
+{
+    d2c_pipeline *p = my_malloc(sizeof(d2c_pipeline));
+
+    p->classlist = classlist;
+    p->relations = relations;
+    p->linked = 0;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->progress, NULL);
+    if (pthread_create(&p->linker, NULL, link_main, p) != 0) {
+        link_main(p);
+        free_pipeline(p);
+        return NULL;
+    }
+    return p;
+}
+
+/**
+ * Waits until the class at position pos of the class list is linked.
+*/
+void d2c_pipeline_wait (d2c_pipeline *p, int pos)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->linked <= pos) {
+        pthread_cond_wait(&p->progress, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * Waits until all the classes are linked, and frees p.
+*/
+void d2c_pipeline_finish (d2c_pipeline *p)
+{
+    if (p != NULL) {
+        pthread_join(p->linker, NULL);
+        free_pipeline(p);
+    }
+}
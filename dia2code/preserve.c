@@ -0,0 +1,469 @@
+/***************************************************************************
+                          preserve.c  -  The preservation index of --preserve-index
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --preserve-index, the output directory keeps an index of the
+ * blocks of code that source_preserve() finds in the existing files:
+ * for each file, its size, modification and change times, device and
+ * inode, and the offset and length of the block of every @diaoid.  A
+ * file whose stat data is the same as in the index is not scanned
+ * again, only the blocks of the operations of its class are read.
+ *
+ * A file is indexed when it is scanned, and its entry kept as long as
+ * its stat data doesn't change, so the files that the runs leave as
+ * they are (with --if-changed, or those of the classes not generated)
+ * are only scanned once.  As git does with its index, an entry whose
+ * file was modified just before it was scanned may change again without
+ * its stat data changing: the hash of its content is kept with it, and
+ * checked before the entry is used.  The index is replaced once the run
+ * succeeded.
+ */
+
+#include "dia2code.h"
+#include "source_parser.h"
+#include <errno.h>
+#include <pthread.h>
+
+#define INDEX_NAME ".dia2code-preserve"
+#define INDEX_HEADER "# dia2code preservation index 1\n"
+#define RACY_SECONDS 2
+#define RACY_MILLISECONDS 100
+
+int preserve_index = 0;   /* Set by switch "--preserve-index" */
+
+enum { ENTRY_READ, ENTRY_SCANNED };
+
+struct block {
+    off_t offset;
+    size_t len;
+    char *oid;
+};
+
+struct d2c_preserve_entry {
+    char *filename;
+    struct stat info;        /* only the fields of same_file() are set */
+    uint64_t hash;           /* of the content if racy, else 0 */
+    struct timespec seen;    /* when the content was known to match info */
+    int kind;
+    int verified;            /* the hash was checked by this run */
+    struct block *blocks;    /* sorted by oid */
+    int count;
+    struct d2c_preserve_entry *next;
+};
+
+static char *index_path = NULL;
+static d2c_preserve_entry *entries = NULL;   /* as read, sorted by filename */
+static int entry_count = 0;
+static d2c_preserve_entry *recorded = NULL;  /* by this run */
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *copy(const char *s, size_t len)
+{
+    char *c = my_malloc(len + 1);
+
+    memcpy(c, s, len);
+    c[len] = '\0';
+    return c;
+}
+
+static int by_filename(const void *a, const void *b)
+{
+    return strcmp(((const d2c_preserve_entry *) a)->filename,
+                  ((const d2c_preserve_entry *) b)->filename);
+}
+
+static int by_oid(const void *a, const void *b)
+{
+    return strcmp(((const struct block *) a)->oid, ((const struct block *) b)->oid);
+}
+
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_size == b->st_size
+        && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+        && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec
+        && a->st_ctim.tv_sec == b->st_ctim.tv_sec
+        && a->st_ctim.tv_nsec == b->st_ctim.tv_nsec
+        && a->st_dev == b->st_dev
+        && a->st_ino == b->st_ino;
+}
+
+/* the file may have been modified again in the tick of its last
+   modification, after it was seen, without its stat data changing: on
+   the file systems whose times have no nanoseconds, the tick is long */
+static int is_racy(const struct stat *info, const struct timespec *seen)
+{
+    long long modified = info->st_mtim.tv_sec * 1000000000LL + info->st_mtim.tv_nsec;
+    long long margin = info->st_mtim.tv_nsec == 0 ? RACY_SECONDS * 1000000000LL
+                                                  : RACY_MILLISECONDS * 1000000LL;
+
+    return modified + margin > seen->tv_sec * 1000000000LL + seen->tv_nsec;
+}
+
+/* FNV-1a on 8 bytes at a time, whose high bits are folded back in: fast
+   enough for files of megabytes */
+static uint64_t content_hash(uint64_t h, const char *buf, size_t len)
+{
+    uint64_t w;
+
+    for (; len >= 8; buf += 8, len -= 8) {
+        memcpy(&w, buf, 8);
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    return d2c_hash_bytes(h, buf, len);
+}
+
+/* returns the hash of the content of filename, 0 if it can't be read */
+static uint64_t file_hash(const char *filename)
+{
+    char buf[16 * LARGE_BUFFER];
+    uint64_t h = D2C_HASH_INIT;
+    size_t n;
+    FILE *f = fopen(filename, "rb");
+
+    if (f == NULL) {
+        return 0;
+    }
+    /* fread() only returns less than asked at the end of the file */
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        h = content_hash(h, buf, n);
+    }
+    if (ferror(f)) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    return h != 0 ? h : 1;
+}
+
+static void free_entry(d2c_preserve_entry *e)
+{
+    int i;
+
+    for (i = 0; i < e->count; i++) {
+        free(e->blocks[i].oid);
+    }
+    free(e->blocks);
+    free(e->filename);
+}
+
+/* parses a "F" line into e, returns 0 if it is not one */
+static int parse_file(d2c_preserve_entry *e, char *s)
+{
+    unsigned long long size, dev, ino, hash;
+    long long msec, csec;
+    long mnsec, cnsec;
+    int n = 0;
+
+    if (sscanf(s, "F\t%llu\t%lld.%ld\t%lld.%ld\t%llu\t%llu\t%llx\t%n", &size, &msec,
+               &mnsec, &csec, &cnsec, &dev, &ino, &hash, &n) != 8 || n == 0) {
+        return 0;
+    }
+    memset(&e->info, 0, sizeof(e->info));
+    e->info.st_size = size;
+    e->info.st_mtim.tv_sec = msec;
+    e->info.st_mtim.tv_nsec = mnsec;
+    e->info.st_ctim.tv_sec = csec;
+    e->info.st_ctim.tv_nsec = cnsec;
+    e->info.st_dev = dev;
+    e->info.st_ino = ino;
+    e->hash = hash;
+    e->seen.tv_sec = e->seen.tv_nsec = 0;
+    e->kind = ENTRY_READ;
+    e->verified = 0;
+    e->filename = copy(s + n, strcspn(s + n, "\r\n"));
+    e->blocks = NULL;
+    e->count = 0;
+    return 1;
+}
+
+/* parses a "B" line into a new block of e, returns 0 if it is not one */
+static int parse_block(d2c_preserve_entry *e, char *s, int *size)
+{
+    unsigned long long offset, len;
+    int n = 0;
+
+    if (sscanf(s, "B\t%llu\t%llu\t%n", &offset, &len, &n) != 2 || n == 0) {
+        return 0;
+    }
+    if (e->count == *size) {
+        *size = *size == 0 ? 16 : 2 * *size;
+        e->blocks = realloc(e->blocks, *size * sizeof(struct block));
+        if (e->blocks == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            d2c_exit(1);
+        }
+    }
+    e->blocks[e->count].offset = offset;
+    e->blocks[e->count].len = len;
+    e->blocks[e->count].oid = copy(s + n, strcspn(s + n, "\r\n"));
+    e->count++;
+    return 1;
+}
+
+/**
+ * Reads the preservation index of outdir, with --preserve-index.  An
+ * index that is missing, or of another version, is taken as empty.
+*/
+void d2c_preserve_index_open (const char *outdir)
+{
+    char *s = NULL;
+    size_t n = 0;
+    int size = 0, blocks = 0;
+    d2c_preserve_entry *e = NULL;
+    FILE *f;
+
+    if (!preserve_index) {
+        return;
+    }
+    index_path = d2c_file_path(outdir != NULL ? outdir : ".", INDEX_NAME, "");
+    f = fopen(index_path, "r");
+    if (f == NULL) {
+        return;
+    }
+    if (getline(&s, &n, f) < 0 || !eq(s, INDEX_HEADER)) {
+        free(s);
+        fclose(f);
+        return;
+    }
+    while (getline(&s, &n, f) >= 0) {
+        if (s[0] == 'B') {
+            if (e != NULL && !parse_block(e, s, &blocks)) {
+                debug(DBG_SOURCE, "bad block in %s: %s", index_path, s);
+            }
+            continue;
+        }
+        if (entry_count == size) {
+            size = size == 0 ? 64 : 2 * size;
+            entries = realloc(entries, size * sizeof(d2c_preserve_entry));
+            if (entries == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                d2c_exit(1);
+            }
+        }
+        e = &entries[entry_count];
+        blocks = 0;
+        if (parse_file(e, s)) {
+            entry_count++;
+        } else {
+            e = NULL;
+        }
+    }
+    free(s);
+    fclose(f);
+    for (e = entries; e < entries + entry_count; e++) {
+        qsort(e->blocks, e->count, sizeof(struct block), by_oid);
+    }
+    qsort(entries, entry_count, sizeof(d2c_preserve_entry), by_filename);
+    debug(DBG_SOURCE, "d2c_preserve_index_open: %d files in %s", entry_count, index_path);
+}
+
+/**
+ * Returns the entry of the index for filename, if the file is the same
+ * as when it was indexed, or else NULL.
+*/
+const d2c_preserve_entry * d2c_preserve_index_find (const char *filename)
+{
+    d2c_preserve_entry key, *e;
+    struct stat info;
+    struct timespec now;
+
+    if (entry_count == 0) {
+        return NULL;
+    }
+    key.filename = (char *) filename;
+    e = bsearch(&key, entries, entry_count, sizeof(d2c_preserve_entry), by_filename);
+    if (e == NULL || stat(filename, &info) != 0 || !same_file(&e->info, &info)) {
+        return NULL;
+    }
+    if (e->hash != 0) {
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (file_hash(filename) != e->hash) {
+            debug(DBG_SOURCE, "%s changed since it was indexed", filename);
+            return NULL;
+        }
+        pthread_mutex_lock(&index_lock);
+        e->verified = 1;
+        e->seen = now;
+        pthread_mutex_unlock(&index_lock);
+    }
+    return e;
+}
+
+/**
+ * Finds the block of e whose oid is the len chars of oid.  Returns 0 if
+ * there is none, else sets its offset in the file and its length.
+*/
+int d2c_preserve_index_block (const d2c_preserve_entry *e, const char *oid, size_t len,
+                              off_t *offset, size_t *blocklen)
+{
+    struct block key, *found;
+
+    key.oid = copy(oid, len);
+    found = bsearch(&key, e->blocks, e->count, sizeof(struct block), by_oid);
+    free(key.oid);
+    if (found == NULL) {
+        return 0;
+    }
+    *offset = found->offset;
+    *blocklen = found->len;
+    return 1;
+}
+
+static void record(const char *filename, const sourcecode *code, uint64_t hash)
+{
+    d2c_preserve_entry *e = NEW (d2c_preserve_entry);
+    size_t i;
+    int k = 0;
+
+    e->filename = copy(filename, strlen(filename));
+    e->info = code->info;
+    e->hash = hash;
+    e->seen = code->seen;
+    e->kind = ENTRY_SCANNED;
+    e->verified = 1;
+    e->count = code->count;
+    e->blocks = my_malloc((code->count + 1) * sizeof(struct block));
+    for (i = 0; i < code->slots; i++) {
+        if (code->index[i].oid != NULL) {
+            e->blocks[k].offset = code->index[i].spos - code->buffer;
+            e->blocks[k].len = code->index[i].len;
+            e->blocks[k].oid = copy(code->index[i].oid, code->index[i].oidlen);
+            k++;
+        }
+    }
+    qsort(e->blocks, e->count, sizeof(struct block), by_oid);
+    pthread_mutex_lock(&index_lock);
+    e->next = recorded;
+    recorded = e;
+    pthread_mutex_unlock(&index_lock);
+}
+
+/**
+ * Adds to the index the blocks of code, the existing file filename as
+ * source_preserve() scanned it.
+*/
+void d2c_preserve_index_add (const char *filename, const sourcecode *code)
+{
+    uint64_t hash = 0;
+
+    if (index_path == NULL) {
+        return;
+    }
+    if (is_racy(&code->info, &code->seen)) {
+        hash = content_hash(D2C_HASH_INIT, code->buffer, code->size);
+        hash = hash != 0 ? hash : 1;
+    }
+    record(filename, code, hash);
+}
+
+/* the entries of a file, the one scanned by this run first */
+static int by_priority(const void *a, const void *b)
+{
+    const d2c_preserve_entry *x = a, *y = b;
+    int c = by_filename(a, b);
+
+    return c != 0 ? c : y->kind - x->kind;
+}
+
+static void write_entry(FILE *f, const d2c_preserve_entry *e)
+{
+    int i;
+
+    fprintf(f, "F\t%llu\t%lld.%09ld\t%lld.%09ld\t%llu\t%llu\t%016llx\t%s\n",
+            (unsigned long long) e->info.st_size,
+            (long long) e->info.st_mtim.tv_sec, (long) e->info.st_mtim.tv_nsec,
+            (long long) e->info.st_ctim.tv_sec, (long) e->info.st_ctim.tv_nsec,
+            (unsigned long long) e->info.st_dev, (unsigned long long) e->info.st_ino,
+            (unsigned long long) e->hash, e->filename);
+    for (i = 0; i < e->count; i++) {
+        fprintf(f, "B\t%llu\t%llu\t%s\n", (unsigned long long) e->blocks[i].offset,
+                (unsigned long long) e->blocks[i].len, e->blocks[i].oid);
+    }
+}
+
+/**
+ * Writes the preservation index once the generation succeeded and the
+ * files are written, and forgets it.
+*/
+void d2c_preserve_index_close ()
+{
+    d2c_preserve_entry *all, *e, *next;
+    struct stat info;
+    char *tmpname;
+    int i, count = entry_count, kept = 0, status = 0;
+    FILE *f;
+
+    if (index_path == NULL) {
+        return;
+    }
+    for (e = recorded; e != NULL; e = e->next) {
+        count++;
+    }
+    all = my_malloc((count + 1) * sizeof(d2c_preserve_entry));
+    memcpy(all, entries, entry_count * sizeof(d2c_preserve_entry));
+    for (i = entry_count, e = recorded; e != NULL; e = next, i++) {
+        next = e->next;
+        all[i] = *e;
+        free(e);
+    }
+    qsort(all, count, sizeof(d2c_preserve_entry), by_priority);
+    for (i = 0; i < count; i++) {
+        e = &all[i];
+        if ((kept > 0 && eq(all[kept - 1].filename, e->filename))
+                || strpbrk(e->filename, "\t\n\r") != NULL || stat(e->filename, &info) != 0
+                || !same_file(&e->info, &info)) {
+            free_entry(e);
+            continue;
+        }
+        /* an entry read and not checked stays as it was */
+        if (e->verified && !is_racy(&e->info, &e->seen)) {
+            e->hash = 0;
+        }
+        all[kept++] = *e;
+    }
+
+    tmpname = d2c_file_path(NULL, index_path, ".tmp");
+    f = fopen(tmpname, "w");
+    if (f != NULL) {
+        fputs(INDEX_HEADER, f);
+        for (i = 0; i < kept; i++) {
+            write_entry(f, &all[i]);
+        }
+        if (ferror(f) | (fclose(f) != 0) || rename(tmpname, index_path) != 0) {
+            status = -1;
+        }
+    } else {
+        status = -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Can't write the preservation index %s: %s\n", index_path,
+                strerror(errno));
+        unlink(tmpname);
+    }
+    debug(DBG_SOURCE, "d2c_preserve_index_close: %d files", kept);
+    free(tmpname);
+    for (i = 0; i < kept; i++) {
+        free_entry(&all[i]);
+    }
+    free(all);
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    recorded = NULL;
+    free(index_path);
+    index_path = NULL;
+}
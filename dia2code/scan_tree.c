@@ -15,11 +15,10 @@
  *                                                                         *
  ***************************************************************************/
 #include "dia2code.h"
-#define NEW_KLASS(c) ((c*)malloc(sizeof(c)))
 
 /* Adds an item to a name list */
 namelist name_list_add(namelist l, const char *data) {
-    namenode *n = NEW_KLASS(namenode);
+    namenode *n = NEW_TAGGED(namenode, D2C_MEM_NAMELIST);
     n->name = strdup(data);
     n->next = l;
     return n;
@@ -106,6 +105,7 @@ namelist find_classes(umlclasslist current_class, batch *b) {
 }
 
 umlclasslist find_by_name(umlclasslist list, const char * name ) {
+    d2c_count(D2C_COUNT_FIND_BY_NAME, 1);
     if ( name != NULL && strlen(name) > 0 ) {
         while ( list != NULL ) {
             if ( ! strcmp(name, list->key->name) ) {
@@ -125,9 +125,10 @@ umlclasslist append ( umlclasslist list, umlclassnode * class ) {
 
     tmpnode = (umlclassnode*) my_malloc ( sizeof(umlclassnode) );
     tmpnode->key = class->key;
-    tmpnode->parents = class->parents;
-    tmpnode->associations = class->associations;
-    tmpnode->dependencies = class->dependencies;
+    /* class may still be being linked, see addparent() */
+    tmpnode->parents = __atomic_load_n(&class->parents, __ATOMIC_ACQUIRE);
+    tmpnode->associations = __atomic_load_n(&class->associations, __ATOMIC_ACQUIRE);
+    tmpnode->dependencies = __atomic_load_n(&class->dependencies, __ATOMIC_ACQUIRE);
     tmpnode->next = NULL;
 
     if ( tmplist != NULL ) {
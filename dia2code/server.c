@@ -0,0 +1,372 @@
+/***************************************************************************
+                          server.c  -  The resident server of --serve
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --serve, dia2code listens on a Unix socket and keeps the diagrams
+ * it parsed in memory.  A client sends one request per line, in the
+ * format of the lines of a --batch manifest, and gets back one line per
+ * request with its exit status; the messages go to the standard error
+ * of the server.  Every client connection has its own thread.
+ *
+ * The models are cached by path, and a model is reused as long as the
+ * modification time, size and inode of its file are those it was parsed
+ * from.  The generators only read a model, so the requests that use it
+ * share it; a model evicted or replaced while in use is freed by the
+ * last request that releases it.  Once the models take more than
+ * --cache-size megabytes, the least recently used ones are evicted.
+ */
+
+#include "dia2code.h"
+#include "parse_diagram.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+long serve_cache_size = 256;   /* Set by switch "--cache-size", in megabytes */
+
+struct d2c_model {
+    char *path;
+    struct stat st;          /* of the file when it was parsed */
+    umlclasslist classlist;
+    size_t size;             /* see diagram_size() */
+    int refs;                /* the cache holds one while it lists the model */
+    struct d2c_model *prev, *next;   /* the most recently used first */
+};
+
+static d2c_model *models = NULL, *oldest = NULL;
+static size_t cached_size = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the socket is removed when the server is stopped */
+static char socket_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+struct client {
+    int fd;
+    d2c_request_fn handler;
+};
+
+static int same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino
+        && a->st_size == b->st_size
+        && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+        && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/* the list of the models is changed with cache_lock held */
+static void unlink_model(d2c_model *m)
+{
+    if (m->prev != NULL) {
+        m->prev->next = m->next;
+    } else {
+        models = m->next;
+    }
+    if (m->next != NULL) {
+        m->next->prev = m->prev;
+    } else {
+        oldest = m->prev;
+    }
+    m->prev = m->next = NULL;
+    cached_size -= m->size;
+}
+
+static void link_first(d2c_model *m)
+{
+    m->prev = NULL;
+    m->next = models;
+    if (models != NULL) {
+        models->prev = m;
+    } else {
+        oldest = m;
+    }
+    models = m;
+    cached_size += m->size;
+}
+
+/* removes m from the cache; returns m if it is no longer used, for the
+   caller to free once cache_lock is released */
+static d2c_model *uncache(d2c_model *m)
+{
+    unlink_model(m);
+    return --m->refs == 0 ? m : NULL;
+}
+
+static void free_model(d2c_model *m)
+{
+    if (m != NULL) {
+        free_diagram(m->classlist);
+        free(m->path);
+        free(m);
+    }
+}
+
+/**
+ * Returns the model of the diagram file, parsed unless the cache holds
+ * it already; d2c_model_release() is called once it is no longer used.
+ * Exits as parse_diagram() does.
+*/
+d2c_model * d2c_model_get (char *diagram)
+{
+    d2c_model *m, *unused = NULL, *evicted;
+    umlclasslist classlist;
+    struct stat st;
+    int cached;
+
+    /* a file that can't be found fails to parse, uncached */
+    cached = stat(diagram, &st) == 0;
+    pthread_mutex_lock(&cache_lock);
+    for (m = models; cached && m != NULL && !eq(m->path, diagram); m = m->next) {
+    }
+    if (cached && m != NULL) {
+        if (same_file(&m->st, &st)) {
+            unlink_model(m);
+            link_first(m);
+            m->refs++;
+            pthread_mutex_unlock(&cache_lock);
+            return m;
+        }
+        unused = uncache(m);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    free_model(unused);
+
+    classlist = parse_diagram(diagram);
+    m = NEW (d2c_model);
+    m->path = strdup(diagram);
+    if (m->path == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    m->st = st;
+    m->classlist = classlist;
+    m->size = sizeof(d2c_model) + diagram_size(m->classlist);
+    m->refs = 1;
+    m->prev = m->next = NULL;
+    if (!cached) {
+        return m;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    /* another client may have parsed it meanwhile */
+    for (evicted = models; evicted != NULL && !eq(evicted->path, diagram);
+         evicted = evicted->next) {
+    }
+    unused = evicted != NULL ? uncache(evicted) : NULL;
+    m->refs++;
+    link_first(m);
+    while (cached_size > (size_t) serve_cache_size * 1024 * 1024 && oldest != m) {
+        evicted = uncache(oldest);
+        if (evicted != NULL) {
+            evicted->next = unused;
+            unused = evicted;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    while (unused != NULL) {
+        evicted = unused->next;
+        free_model(unused);
+        unused = evicted;
+    }
+    return m;
+}
+
+umlclasslist d2c_model_classes (d2c_model *model)
+{
+    return model->classlist;
+}
+
+void d2c_model_release (d2c_model *model)
+{
+    int refs;
+
+    pthread_mutex_lock(&cache_lock);
+    refs = --model->refs;
+    pthread_mutex_unlock(&cache_lock);
+    if (refs == 0) {
+        free_model(model);
+    }
+}
+
+/* Answers the requests of a client until it disconnects */
+static void *serve_client(void *arg)
+{
+    struct client *c = arg;
+    FILE *in;
+    char s[LARGE_BUFFER], reply[32], *p;
+    int len;
+
+    /* libxml2 keeps this setting per thread */
+    xmlKeepBlanksDefault(0);
+    in = fdopen(c->fd, "r");
+    if (in == NULL) {
+        close(c->fd);
+        free(c);
+        return NULL;
+    }
+    while (fgets(s, sizeof(s), in) != NULL) {
+        for (p = s; isspace((unsigned char) *p); p++) {
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        len = snprintf(reply, sizeof(reply), "%d\n", c->handler(s));
+        if (write(c->fd, reply, len) != len) {
+            break;
+        }
+    }
+    fclose(in);
+    free(c);
+    return NULL;
+}
+
+static void stop_server(int sig)
+{
+    unlink(socket_path);
+    _exit(0);
+}
+
+/* fills addr for the socket at path, returns -1 if the path is too long */
+static int socket_address(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "The socket path %s is too long\n", path);
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * Listens on the Unix socket at path and runs handler(request) for each
+ * request line of the clients, on one thread per client.  Only returns,
+ * with an exit status, if the socket can't be set up.
+*/
+int d2c_serve (const char *path, d2c_request_fn handler)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct stat st;
+    struct client *c;
+    pthread_t thread;
+    int fd, s;
+
+    if (socket_address(&addr, path) != 0) {
+        return 2;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Can't create a socket: %s\n", strerror(errno));
+        return 1;
+    }
+    /* the socket of a server that is gone is replaced */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s >= 0 && connect(s, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "A server is already listening on %s\n", path);
+            close(s);
+            close(fd);
+            return 2;
+        }
+        if (s >= 0) {
+            close(s);
+        }
+        unlink(path);
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Can't listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 3;
+    }
+    strcpy(socket_path, path);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+    sa.sa_handler = stop_server;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    xmlInitParser();
+    fprintf(stderr, "Listening on %s\n", path);
+
+    for (;;) {
+        s = accept(fd, NULL, NULL);
+        if (s < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "Can't accept a client: %s\n", strerror(errno));
+            }
+            continue;
+        }
+        c = NEW (struct client);
+        c->fd = s;
+        c->handler = handler;
+        if (pthread_create(&thread, NULL, serve_client, c) != 0) {
+            fprintf(stderr, "Can't start a client thread\n");
+            close(s);
+            free(c);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/**
+ * Sends the request line to the server listening on the Unix socket at
+ * path, and returns the exit status it answers.
+*/
+int d2c_client (const char *path, const char *request)
+{
+    struct sockaddr_un addr;
+    char reply[32];
+    size_t len = strlen(request);
+    ssize_t n;
+    int fd, got = 0;
+
+    if (socket_address(&addr, path) != 0) {
+        return 2;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Can't connect to the server on %s: %s\n", path,
+                strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 2;
+    }
+    if (write(fd, request, len) != (ssize_t) len || write(fd, "\n", 1) != 1) {
+        fprintf(stderr, "Can't send the request to %s\n", path);
+        close(fd);
+        return 2;
+    }
+    shutdown(fd, SHUT_WR);
+    while (got < (int) sizeof(reply) - 1
+           && (n = read(fd, reply + got, sizeof(reply) - 1 - got)) > 0) {
+        got += n;
+    }
+    close(fd);
+    reply[got] = '\0';
+    if (!isdigit((unsigned char) reply[0])) {
+        fprintf(stderr, "The server on %s did not answer\n", path);
+        return 2;
+    }
+    return atoi(reply);
+}
@@ -10,263 +10,652 @@
 #include "dia2code.h"
 #include "source_parser.h"
 
-/*  block with heterogen or unknown content */
-#define SP_AT_MISC  1
-/* block containing an atribute definition */
-#define SP_AT_IMPL   2
-/* block containing a method implementation */
-#define SP_OP_IMPL   3
+static const char oidtag[] = "@diaoid";
 
 /*
- * test a file existence and extract the source and the blocks
- * source is allocated and initialised with the source code buffer and the blocks markers
+ * the implementations found by source_preserve() for the class being
+ * generated: they are kept out of the model, which the targets share,
+ * in a table of preserved_size slots addressed by the operation
  */
-void source_preserve( batch *b, umlclass *class, const char *filename, sourcecode *source )
+struct preserved {
+    umloperation *op;    /* NULL if the slot is free */
+    char *implementation;
+};
+static D2C_TASK_LOCAL struct preserved *preserved = NULL;
+static D2C_TASK_LOCAL size_t preserved_size = 0;
+
+/*
+ * like find_diaoid(), on the len chars of buf, which need not end with
+ * a '\0', and without a copy: returns the oid following the first
+ * @diaoid tag, whose length is set in *oidlen, or NULL if there is none
+ */
+static const char *oid_find( const char *buf, size_t len, size_t *oidlen )
 {
-    char *diaoid = NULL;
-    umloplist umlo;
-    sourceblock *srcblock = NULL;
-    debug( 4, "preserve_source(filename=%s)", filename);
-    source = (sourcecode*) my_malloc( sizeof(sourcecode));
-    source->buffer = NULL;
-    source->blocks = NULL;
-    
-    //open the file in read only 
-    FILE * rofile = fopen(filename, "r");
-    if( ! rofile ) {
-        debug( DBG_SOURCE, "no existing file %s for class %s", filename, class->name );
-        return;
+    const char *end = buf + len;
+    const char *cp, *ep;
+
+    if( len < sizeof(oidtag) ) {
+        return NULL;
     }
-    /* from here, the file exists, we transfer the content in a buffer and parse the source */
-    source->buffer = source_loadfromfile( filename );
-    if( source->buffer == NULL ) {
-        debug( 4, "warning: NULL sourcebuffer from file" );
-    } else {
-        source->blocks  = source_parse( source->buffer );
-        /* copy source blocks found to method->implementation */
-        umlo = class->operations;
-        while( umlo != NULL ) {
-            /* is there a diaoid hidden in the operation comment ? */
-            if( (diaoid=find_diaoid(umlo->key.attr.comment,NULL)) != NULL) {
-                debug( DBG_SOURCE,"diaoid:%s found in comment for method %s", diaoid, umlo->key.attr.name );
-                /* now try to find the implementation block in the sourcebuffer */
-                srcblock = sourceblock_find( source->blocks, diaoid );
-                // srcblock->spos poitns the implementation of lengtjh srcblock->len
-                if( srcblock != NULL ) {
-                    umlo->key.implementation = (char*) my_strndup( srcblock->spos, srcblock->len );
-                }
-            } else {
-                debug( DBG_SOURCE, "diaoid %s not found in source", diaoid );
-            }
-            umlo = umlo->next;
-        } // while
+    cp = memmem( buf, len, oidtag, sizeof(oidtag) - 1 );
+    if( cp == NULL || (size_t) (end - cp) < sizeof(oidtag) ) {
+        return NULL;
     }
-    fclose(rofile);
+    cp += sizeof(oidtag);
+    for( ep = cp; ep < end && strchr( " \t\n\r", *ep ) == NULL; ep++ ) {
+    }
+    *oidlen = ep - cp;
+    return cp;
 }
 
 /*
- * constructor for a new sourceblock structure address
- * @return an initialized sourceblock address
+ * The end of a block is found by a small lexer, which skips the
+ * comments and the string and character literals, so that their braces
+ * aren't counted.  Java, ActionScript and the C family share its rules;
+ * PHP adds the comments starting with '#' and the literals spanning
+ * lines, which elsewhere end at the end of the line so that a stray
+ * quote can't hide the rest of the file.  Between the chars that matter
+ * to it, it moves 8 bytes at a time, and memchr() and memmem() find the
+ * end of comments and literals.
  */
-sourceblock *sourceblock_new( char *spos, size_t len, char *oid, int type )
+#define SP_ONES   0x0101010101010101ULL
+#define SP_HIGHS  0x8080808080808080ULL
+/* nonzero if one of the 8 bytes of w is c */
+#define SP_HAS_BYTE(w, c) \
+    ((((w) ^ (SP_ONES * (c))) - SP_ONES) & ~((w) ^ (SP_ONES * (c))) & SP_HIGHS)
+
+static int is_special( int c, int php )
+{
+    return c == '{' || c == '}' || c == '/' || c == '"' || c == '\'' || (php && c == '#');
+}
+
+/* the first char of [cp, end) that matters to block_end(), or end */
+static const char *next_special( const char *cp, const char *end, int php )
 {
-    debug( DBG_GENCODE, "sourceblock_new( spos=%p, len=%ld, oid=%s, type=%d )", spos,len,oid,type );
-    // TODO : safety checks
-    sourceblock *blk;
-    blk = (sourceblock*) malloc( sizeof(sourceblock));
-    blk->spos = spos;
-    blk->len = len;
-    blk->type = type;
-    blk->oid = (char*) my_strndup( oid, 30 );
-    return blk;
+    uint64_t w;
+
+    while( end - cp >= 8 ) {
+        memcpy( &w, cp, 8 );
+        if( SP_HAS_BYTE( w, '{' ) | SP_HAS_BYTE( w, '}' ) | SP_HAS_BYTE( w, '/' )
+            | SP_HAS_BYTE( w, '"' ) | SP_HAS_BYTE( w, '\'' )
+            | (php ? SP_HAS_BYTE( w, '#' ) : 0) ) {
+            break;
+        }
+        cp += 8;
+    }
+    while( cp < end && ! is_special( (unsigned char) *cp, php ) ) {
+        cp ++;
+    }
+    return cp;
+}
+
+/* the last char of the line of cp, its '\n' */
+static const char *line_end( const char *cp, const char *end )
+{
+    const char *ep = memchr( cp, '\n', end - cp );
+
+    return ep != NULL ? ep : end - 1;
+}
+
+/* the last char of the block comment that starts at cp */
+static const char *comment_end( const char *cp, const char *end )
+{
+    const char *ep = memmem( cp + 2, end - cp - 2, "*/", 2 );
+
+    return ep != NULL ? ep + 1 : end - 1;
+}
+
+/* the last char of the literal whose opening quote is at cp */
+static const char *literal_end( const char *cp, const char *end, int php )
+{
+    const char *ep;
+    char quote = *cp;
+
+    /* a Java text block */
+    if( quote == '"' && end - cp >= 3 && cp[1] == '"' && cp[2] == '"' ) {
+        ep = memmem( cp + 3, end - cp - 3, "\"\"\"", 3 );
+        return ep != NULL ? ep + 2 : end - 1;
+    }
+    for( ep = cp + 1; ep < end; ep++ ) {
+        if( *ep == '\\' && ep + 1 < end ) {
+            ep ++;
+        } else if( *ep == quote || (*ep == '\n' && ! php) ) {
+            return ep;
+        }
+    }
+    return end - 1;
 }
 
 /*
-* add a sourceblock at the head of the chained list
-* @param the node is added at end of the list
-*@return the newly allocated node
- */ 
-sourceblocknode *sourceblocklist_add( sourceblocknode *list, const sourceblock *blk )
+ * the span of the '}' matching the '{' at buf, nested blocks included
+ * @return the length of the block, braces included, or 0 if not found
+ */
+static size_t block_end( const char *buf, const char *end, int php )
 {
-    debug( DBG_GENCODE, "sourceblocklist_add( list=%p, blk=%p )", list,blk );
-    sourceblocknode *new =  (sourceblocknode*) malloc( sizeof(sourceblocknode));
-    new->blk = (sourceblock*) blk;
-    /* if the list is null, no need to link  */
-    if( list == NULL ) {
-        new->next = NULL;
-    } else {
-        new->next = list;
+    const char *cp;
+    int depth = 0;
+
+    for( cp = buf; (cp = next_special( cp, end, php )) < end; cp++ ) {
+        switch( *cp ) {
+        case '{':
+            depth ++;
+            break;
+        case '}':
+            if( --depth == 0 ) {
+                return cp - buf + 1;
+            }
+            break;
+        case '/':
+            if( cp + 1 < end && cp[1] == '/' ) {
+                cp = line_end( cp, end );
+            } else if( cp + 1 < end && cp[1] == '*' ) {
+                cp = comment_end( cp, end );
+            }
+            break;
+        case '#':
+            cp = line_end( cp, end );
+            break;
+        default:
+            cp = literal_end( cp, end, php );
+            break;
+        }
     }
-    return new;
+    return 0;
 }
 
-sourceblock *sourceblock_find( sourceblocknode *list, const char *oid )
+static size_t oid_slot( const sourcecode *source, const char *oid, size_t len )
 {
-    sourceblock *blk = NULL;
-    sourceblocknode *pt=list;
-    if( list == NULL ) {
-        debug( DBG_GENCODE, "list should not be null in sourceblock_find" );
-        return NULL;
+    return d2c_hash_bytes( D2C_HASH_INIT, oid, len ) & (source->slots - 1);
+}
+
+/*
+ * adds blk to the index of source, in place of an earlier block of the
+ * same oid: as before the index, the last one of the file wins
+ */
+static void sourceblock_add( sourcecode *source, const sourceblock *blk )
+{
+    size_t i, n;
+    sourceblock *old = source->index;
+
+    if( 2 * (source->count + 1) > source->slots ) {
+        n = source->slots;
+        source->slots = n == 0 ? 64 : 2 * n;
+        source->index = my_malloc_tagged( source->slots * sizeof(sourceblock), D2C_MEM_SOURCE );
+        for( i = 0; i < source->slots; i++ ) {
+            source->index[i].oid = NULL;
+        }
+        source->count = 0;
+        for( i = 0; i < n; i++ ) {
+            if( old[i].oid != NULL ) {
+                sourceblock_add( source, &old[i] );
+            }
+        }
+        my_free_tagged( old, D2C_MEM_SOURCE );
     }
-    if( oid == NULL ) {
-        debug(  DBG_GENCODE,"oid should not be null in sourceblock_find\n" );
+    for( i = oid_slot( source, blk->oid, blk->oidlen );
+         source->index[i].oid != NULL; i = (i + 1) & (source->slots - 1) ) {
+        if( source->index[i].oidlen == blk->oidlen
+            && memcmp( source->index[i].oid, blk->oid, blk->oidlen ) == 0 ) {
+            source->index[i] = *blk;
+            return;
+        }
+    }
+    source->index[i] = *blk;
+    source->count ++;
+}
+
+/*
+ * @return the block of source whose oid is the len chars of oid, or NULL
+ */
+static const sourceblock *sourceblock_find( const sourcecode *source, const char *oid, size_t len )
+{
+    size_t i;
+
+    if( source->slots == 0 ) {
         return NULL;
     }
-    while( pt != NULL ) {
-        
-        if( (pt->blk->oid != NULL) && (strcmp( pt->blk->oid, oid ) == 0) ) {
-            return pt->blk;
+    for( i = oid_slot( source, oid, len );
+         source->index[i].oid != NULL; i = (i + 1) & (source->slots - 1) ) {
+        if( source->index[i].oidlen == len && memcmp( source->index[i].oid, oid, len ) == 0 ) {
+            return &source->index[i];
         }
-        pt = pt->next;
     }
     return NULL;
 }
 
-sourceblocknode *source_parse( const char *sourcebuffer )
+/*
+ * indexes, in a single pass over the file, the blocks of source: each
+ * @diaoid tag followed by the end of a comment then by a '{' gives the
+ * code between that brace and the matching one
+ */
+static void source_parse( sourcecode *source )
 {
-    char *tokens[] = { "*/", "{",'\0' }; // we mut find this successfully these tags to isolate the funtion/method source
-    sourceblocknode *list=NULL;
-    sourceblock *srcbk;
-    char *currentoid=NULL;
-    char **newpos= (char**) malloc( sizeof(char*) );
-    sourceblock tokenblocks[3];
-    char  *pos = (char*) sourcebuffer; /* moving pointer */
-    
-    debug( DBG_GENCODE, "source_parse( sourcebuffer=%p )\n", sourcebuffer );
-    
-    while( (currentoid = find_diaoid( pos, newpos)) != NULL ) 
-    {
-        debug( 7, "source_parse : oid=%s  buf/newpos : %p/%p \n", currentoid, sourcebuffer, *newpos);
-        int numfound = find_more_str( *newpos, tokens, tokenblocks );
-        debug( 7, "found %d items from 2\n", numfound );
-        /* +1 for the ending bracket that is oitherwise not included */
-        if( numfound != 2 ) {
+    const char *end = source->buffer + source->size;
+    const char *pos = source->buffer; /* moving pointer */
+    const char *cp;
+    sourceblock blk;
+    size_t len;
+
+    debug( DBG_GENCODE, "source_parse( size=%ld )", (long) source->size );
+    while( (blk.oid = oid_find( pos, end - pos, &blk.oidlen )) != NULL ) {
+        pos = blk.oid;
+        cp = memmem( pos, end - pos, "*/", 2 );
+        if( cp != NULL ) {
+            cp = memchr( cp, '{', end - cp );
+        }
+        if( cp == NULL ) {
             debug( 7, "not all 2 tokens found" );
+        } else if( (len = block_end( cp, end, source->php )) == 0 ) {
+            debug( 7, "METHOD SOURCE NOT FOUND" );
+        } else {
+            /* without the { and } */
+            blk.spos = cp + 1;
+            blk.len = len - 2;
+            debug( 7, "source_parse: oid=%.*s spos=%p len=%ld", (int) blk.oidlen, blk.oid,
+                   blk.spos, (long) blk.len );
+            sourceblock_add( source, &blk );
         }
-       else {
-            /*  find matching brace from char spos*/
-            srcbk = find_matching_char( tokenblocks[1].spos, currentoid , '{', '}', 5000 );
-            if( srcbk != NULL ) {
-                debug( DBG_GENCODE, "srcbk spos=%p len=%ld \n",  srcbk->spos, srcbk->len );
-                /* this to remove the { and } from the block */
-                srcbk->spos ++; srcbk->len -= 2;
-                char *source = (char*) my_strndup( srcbk->spos, srcbk->len ); /* only used for debug message */
-                debug( 7, "METHOD SOURCE-----------------------------------------\n%s\n------------------------------------\n", source );
-                free(source);
-                list = sourceblocklist_add( list, srcbk );                
-            } else {
-                debug(7, "METHOD SOURCE NOT FOUND\n" );
-            }
+    }
+}
+
+/*
+ * maps the file in source->buffer, or reads it if it can't be mapped
+ * @return 0, or -1 if there is no such file
+ */
+static int source_open( sourcecode *source, const char *filename )
+{
+    ssize_t n;
+    size_t done = 0;
+    const char *cp;
+    int fd;
+
+    source->buffer = NULL;
+    source->size = 0;
+    source->mapped = 0;
+    source->index = NULL;
+    source->slots = 0;
+    source->count = 0;
+    source->php = (cp = strrchr( filename, '.' )) != NULL && strncmp( cp, ".php", 4 ) == 0;
+    clock_gettime( CLOCK_REALTIME, &source->seen );
+    fd = open( filename, O_RDONLY );
+    if( fd < 0 ) {
+        return -1;
+    }
+    if( fstat( fd, &source->info ) != 0 || source->info.st_size == 0 ) {
+        close( fd );
+        return 0;
+    }
+    source->size = source->info.st_size;
+    source->buffer = mmap( NULL, source->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( source->buffer != MAP_FAILED ) {
+        source->mapped = 1;
+    } else {
+        source->buffer = my_malloc_tagged( source->size, D2C_MEM_SOURCE );
+        while( done < source->size
+               && (n = read( fd, (char *) source->buffer + done, source->size - done )) > 0 ) {
+            done += n;
         }
-        pos = *newpos;
+        source->size = done;
     }
-    return list;
+    close( fd );
+    return 0;
 }
 
+static void source_close( sourcecode *source )
+{
+    if( source->mapped ) {
+        munmap( (void *) source->buffer, source->size );
+    } else {
+        my_free_tagged( (void *) source->buffer, D2C_MEM_SOURCE );
+    }
+    my_free_tagged( source->index, D2C_MEM_SOURCE );
+}
+
+/*
+ * With --jobs, the existing files of the classes of a target are mapped
+ * and indexed by source_prescan() before the classes are generated, all
+ * of them at once on the worker threads, rather than each one by the
+ * task of its class just before it is written: source_preserve() then
+ * finds them in b->sources, by name, and reads nothing.
+ */
+struct prescanned {
+    char *filename;
+    int exists;
+    const d2c_preserve_entry *indexed;  /* if code was not read, see preserve.c */
+    sourcecode code;
+};
+
+struct source_prescan {
+    int count;
+    struct prescanned *files;   /* sorted by filename */
+};
 
+static int by_filename( const void *a, const void *b )
+{
+    return strcmp( ((const struct prescanned *) a)->filename,
+                   ((const struct prescanned *) b)->filename );
+}
+
+/* maps and indexes the file of p */
+static void prescan( struct prescanned *p )
+{
+    p->indexed = d2c_preserve_index_find( p->filename );
+    if( p->indexed != NULL ) {
+        p->exists = 0;
+        return;
+    }
+    p->exists = source_open( &p->code, p->filename ) == 0;
+    if( p->exists ) {
+        source_parse( &p->code );
+        d2c_preserve_index_add( p->filename, &p->code );
+    }
+}
+
+/* prescan() of item, a job */
+static void prescan_file( batch *b, void *item )
+{
+    struct prescanned *p = item;
+    d2c_clock span;
+
+    d2c_trace_start( &span );
+    prescan( p );
+    d2c_trace_end( &span, "preservation scan", "preserve", NULL, p->filename );
+}
 
 /*
- * transfer a file content into a char buffer
- * in case of failure, return NULL
- * @param the filename
- * @return the allocated buffer as a char * 
- *
+ * indexes, with generate_jobs threads, the existing files of the classes
+ * of b that are to be generated, named as the java, as3 and php
+ * generators name them, with ext; with a single job or --pipeline, whose
+ * classes are still being linked, each file is read by its own task
  */
-char *source_loadfromfile(const char *filename )
+void source_prescan( batch *b, const char *ext )
 {
-    struct stat info;
-    int fi; // file descriptor
-    size_t sz;
-    char *buf = NULL;
-    
-    if( stat( filename, &info ) ) {
-        return NULL;
+    struct source_prescan *scan;
+    umlclasslist node;
+    umlpackage *pkg;
+    void **items;
+    int i, count = 0;
+
+    source_prescan_free( b );
+    if( generate_jobs <= 1 || b->pipeline != NULL ) {
+        return;
+    }
+    for( node = b->classlist; node != NULL; node = node->next ) {
+        count++;
+    }
+    scan = NEW (struct source_prescan);
+    scan->files = my_malloc( (count + 1) * sizeof(struct prescanned) );
+    scan->count = 0;
+    for( node = b->classlist; node != NULL; node = node->next ) {
+        /* the classes of d2c_generate_classes() */
+        if( (is_present( b->classes, node->key->name ) ^ b->mask)
+            || (b->incremental && ! is_present( b->changed, node->key->name )) ) {
+            continue;
+        }
+        /* the outermost package, see make_package_list() */
+        for( pkg = node->key->package; pkg != NULL && pkg->parent != NULL; pkg = pkg->parent ) {
+        }
+        scan->files[scan->count++].filename =
+            d2c_file_path( pkg != NULL ? create_package_dir( b, pkg ) : NULL, node->key->name, ext );
+    }
+    /* two classes of the same name share their file */
+    qsort( scan->files, scan->count, sizeof(struct prescanned), by_filename );
+    for( i = count = 0; i < scan->count; i++ ) {
+        if( count > 0 && eq( scan->files[count - 1].filename, scan->files[i].filename ) ) {
+            free( scan->files[i].filename );
+        } else {
+            scan->files[count++] = scan->files[i];
+        }
+    }
+    scan->count = count;
+    items = my_malloc( (count + 1) * sizeof(void *) );
+    for( i = 0; i < count; i++ ) {
+        items[i] = &scan->files[i];
+    }
+    debug( DBG_SOURCE, "source_prescan: %d files", count );
+    b->sources = scan;
+    d2c_run_jobs( prescan_file, items, count, generate_jobs );
+    free( items );
+}
+
+/*
+ * unmaps the files of source_prescan(), once the classes are generated
+ */
+void source_prescan_free( batch *b )
+{
+    struct source_prescan *scan = b->sources;
+    int i;
+
+    if( scan == NULL ) {
+        return;
+    }
+    for( i = 0; i < scan->count; i++ ) {
+        if( scan->files[i].exists ) {
+            source_close( &scan->files[i].code );
+        }
+        free( scan->files[i].filename );
     }
+    free( scan->files );
+    free( scan );
+    b->sources = NULL;
+}
+
+/* forgets the implementations kept for the previous class */
+static void preserved_free( void )
+{
+    size_t i;
 
-    sz = info.st_size;
-    fi = open(filename, O_RDONLY, 0777);
-    if( ! fi  ) {
-       return NULL;
+    for( i = 0; i < preserved_size; i++ ) {
+        if( preserved[i].op != NULL ) {
+            my_free_tagged( preserved[i].implementation, D2C_MEM_SOURCE );
+        }
     }
-    buf = my_malloc(sizeof(char)*sz + 2 );
-    read( fi, buf, sz );
-    close(fi);
-    buf[sz]= '\0';
-    return buf;
+    my_free_tagged( preserved, D2C_MEM_SOURCE );
+    preserved = NULL;
+    preserved_size = 0;
 }
 
+/* makes room for the implementations of the operations of class */
+static void preserved_start( umlclass *class )
+{
+    umloplist umlo;
+    size_t count = 0;
 
+    for( umlo = class->operations; umlo != NULL; umlo = umlo->next ) {
+        count++;
+    }
+    /* at most half full */
+    for( preserved_size = 16; preserved_size < 2 * count; preserved_size *= 2 ) {
+    }
+    preserved = my_malloc_tagged( preserved_size * sizeof(struct preserved), D2C_MEM_SOURCE );
+    memset( preserved, 0, preserved_size * sizeof(struct preserved) );
+}
 
+/* the slot of op in the table, or the free one where it goes */
+static struct preserved *preserved_slot( const umloperation *op )
+{
+    size_t i = (size_t) (((uint64_t) (uintptr_t) op * 0x9E3779B97F4A7C15ULL) >> 32);
+
+    for( i &= preserved_size - 1; preserved[i].op != NULL && preserved[i].op != op;
+         i = (i + 1) & (preserved_size - 1) ) {
+    }
+    return &preserved[i];
+}
 
-int find_more_str( char *buf, char *tofind[], sourceblock pblocks[] )
+/* copies the block of len bytes at spos, up to a '\0', as a source block */
+static char *block_copy( const char *spos, size_t len )
 {
-    char *tok = NULL;
-    int i=0;
-    char *ep, *np = buf;
-    
-    while( tofind[i] != NULL ) {
-        tok = tofind[i];
-        ep = strstr( np, tok );
-        if( ep == NULL ) {
-            return i;
+    char *implementation;
+
+    len = strnlen( spos, len );
+    implementation = my_malloc_tagged( len + 1, D2C_MEM_SOURCE );
+    memcpy( implementation, spos, len );
+    implementation[len] = '\0';
+    return implementation;
+}
+
+static void preserved_add( umloperation *op, char *implementation )
+{
+    struct preserved *p = preserved_slot( op );
+
+    p->op = op;
+    p->implementation = implementation;
+}
+
+/*
+ * @return the oid hidden in the comment of op, whose length is set in
+ * *oidlen, or NULL if there is none
+ */
+static const char *operation_oid( umloperation *op, size_t *oidlen )
+{
+    const char *diaoid = oid_find( op->attr.comment, strlen( op->attr.comment ), oidlen );
+
+    if( diaoid != NULL ) {
+        debug( DBG_SOURCE,"diaoid:%.*s found in comment for method %s", (int) *oidlen, diaoid,
+               op->attr.name );
+    }
+    return diaoid;
+}
+
+/* keeps the implementations of the operations of class that code has */
+static void preserve_blocks( umlclass *class, const sourcecode *code )
+{
+    const char *diaoid;
+    size_t oidlen;
+    umloplist umlo;
+    const sourceblock *srcblock;
+
+    if( code->count > 0 ) {
+        preserved_start( class );
+    }
+    for( umlo = class->operations; umlo != NULL && code->count > 0; umlo = umlo->next ) {
+        if( (diaoid = operation_oid( &umlo->key, &oidlen )) == NULL ) {
+            continue;
         }
-        else {
-            pblocks[i].spos = ep;
-            if( i > 0 ) {
-                pblocks[i-1].len = ep-np;
-            }
-            // printf( "--->found %s<--------\n", (char*)my_strndup(ep,40));
-            np=ep;
+        /* now try to find the implementation block in the sourcebuffer */
+        srcblock = sourceblock_find( code, diaoid, oidlen );
+        if( srcblock != NULL ) {
+            preserved_add( &umlo->key, block_copy( srcblock->spos, srcblock->len ) );
+        } else {
+            debug( DBG_SOURCE, "diaoid %.*s not found in source", (int) oidlen, diaoid );
         }
-        i++;
     }
-    return i; // number of stuff found
 }
 
-/**
- * given an opening char openc, find the matching closing char closec in a text buffer
- * support nested blocks 
- * @param the text buffer
- * @param opening char
- * @param closing char
- * @param  a limiter where parsing should stop anyway
- * @return a sourceblock . if none found, result.len = 0
- * @example find_matching_char( cppsource, '{', '}', 40000 );
- * TODO : ignore some section such as comment blocks, strings
- * @return the found position as a char pointer, NULL if not found
+/*
+ * keeps the implementations of the operations of class, read from
+ * filename at the offsets that the preservation index has for them
+ * @return 0, or -1 if the file can't be read, and none is kept
  */
-sourceblock *find_matching_char( const char *buf, char *oid, char openc, char closec, int maxcars )
+static int preserve_indexed( umlclass *class, const char *filename, const d2c_preserve_entry *e )
 {
-    char *cp, *startpos;
-    int len=0, depth = 0;
-    sourceblock *srcbk=NULL; // the block returned
-    cp = (char*) buf;
-    debug( DBG_GENCODE, "find_matching_char. openc=%c closec=%c oid=%s maxcars=%d", openc, closec, oid, maxcars );
-    while( cp != NULL ) {
-        
-        if( *cp == openc ) {
-            debug( 7, "openc found" );
-            if( depth == 0 ) {
-                startpos=cp;
-            }
-            depth ++;
-        }else if( *cp == closec ) {
-            debug( 7, "closec found " );
-            depth --;
-            /* we found the closing char */
-            if( depth == 0 ) {
-                size_t bklen = cp - buf +1;
-                srcbk = sourceblock_new( startpos, bklen, oid,  SP_OP_IMPL );
-                debug( 7, "sourceblock returned: spos=%p len=%ld oid=%s", srcbk->spos, srcbk->len, srcbk->oid );
-                break;
-            }
+    const char *diaoid;
+    size_t oidlen, len, done;
+    off_t offset;
+    umloplist umlo;
+    char *implementation;
+    ssize_t n;
+    int fd;
+
+    debug( DBG_SOURCE, "%s found in the preservation index", filename );
+    fd = open( filename, O_RDONLY );
+    if( fd < 0 ) {
+        return -1;
+    }
+    preserved_start( class );
+    for( umlo = class->operations; umlo != NULL; umlo = umlo->next ) {
+        if( (diaoid = operation_oid( &umlo->key, &oidlen )) == NULL ) {
+            continue;
         }
-        if( len > maxcars ) {
-            break;
+        if( ! d2c_preserve_index_block( e, diaoid, oidlen, &offset, &len ) ) {
+            debug( DBG_SOURCE, "diaoid %.*s not found in source", (int) oidlen, diaoid );
+            continue;
         }
-        len ++;
-        cp ++;
+        implementation = my_malloc_tagged( len + 1, D2C_MEM_SOURCE );
+        for( done = 0; done < len
+             && (n = pread( fd, implementation + done, len - done, offset + done )) > 0; ) {
+            done += n;
+        }
+        if( done < len ) {
+            my_free_tagged( implementation, D2C_MEM_SOURCE );
+            preserved_free();
+            close( fd );
+            return -1;
+        }
+        implementation[len] = '\0';
+        preserved_add( &umlo->key, implementation );
+    }
+    close( fd );
+    return 0;
+}
+
+/*
+ * test a file existence and extract the implementations of the
+ * operations of class from it: the file is mapped and its blocks
+ * indexed by oid, unless source_prescan() did it already, and only
+ * those of the operations are copied.  With --preserve-index, a file
+ * that is unchanged since it was indexed is not mapped, those blocks
+ * are read from it
+ */
+static void preserve_file( batch *b, umlclass *class, const char *filename )
+{
+    struct prescanned key, *found = NULL;
+    const d2c_preserve_entry *indexed;
+    sourcecode own, *code = &own;
+    debug( 4, "preserve_source(filename=%s)", filename);
+    /* forget those of the previous class */
+    preserved_free();
+    if( b->sources != NULL ) {
+        key.filename = (char *) filename;
+        found = bsearch( &key, b->sources->files, b->sources->count,
+                         sizeof(struct prescanned), by_filename );
+    }
+    indexed = found != NULL ? found->indexed : d2c_preserve_index_find( filename );
+    if( indexed != NULL ) {
+        if( preserve_indexed( class, filename, indexed ) == 0 ) {
+            d2c_deps_input(filename);
+            return;
+        }
+        /* scanned after all */
+        found = NULL;
+    }
+    if( found != NULL ? ! found->exists : source_open( &own, filename ) != 0 ) {
+        debug( DBG_SOURCE, "no existing file %s for class %s", filename, class->name );
+        return;
+    }
+    d2c_deps_input(filename);
+    if( found != NULL ) {
+        code = &found->code;
+    } else {
+        source_parse( &own );
+        d2c_preserve_index_add( filename, &own );
     }
-    return srcbk;
+    /* copy source blocks found to method->implementation */
+    preserve_blocks( class, code );
+    if( code == &own ) {
+        source_close( &own );
+    }
+}
+
+void source_preserve( batch *b, umlclass *class, const char *filename, sourcecode *source )
+{
+    d2c_clock span;
+
+    d2c_trace_start( &span );
+    preserve_file( b, class, filename );
+    d2c_trace_end( &span, "preserve", "preserve", class->name, filename );
 }
 
+/*
+ * @return the implementation of op found by source_preserve() in the
+ * existing file of the class, or else the one of the diagram
+ */
+char *source_implementation( umloperation *op )
+{
+    struct preserved *p;
+
+    if( preserved_size > 0 && (p = preserved_slot( op ))->op != NULL ) {
+        return p->implementation;
+    }
+    return op->implementation;
+}
@@ -5,57 +5,61 @@
 #include <sys/types.h> 
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
 
 /*
- defines a section of source code between starting and ending positions
- as for now, two additional informations are attached to each block : an unique oid and a type 
+ defines a section of source code, the implementation of the operation
+ whose oid is given: both point into the file, which is not copied
 */
 struct sourceblock {
-    char * spos; /* starting position - file buffer offset */
+    const char *spos; /* starting position - file buffer offset */
     size_t len; /* length in char */
-    int type;
-    char *oid;
+    const char *oid; /* not terminated, NULL for a free slot of the index */
+    size_t oidlen;
 };
 
 typedef struct sourceblock sourceblock;
 
-/* 
- to link block togethers 
-*/
-struct _sourceblocknode {
-    sourceblock *blk;
-    struct _sourceblocknode *next;
-};
-
-typedef struct _sourceblocknode sourceblocknode;
-
 /*  
   macro structure used for code preservation feature 
-  buffer contains the complete source of the file
-  blocks is a list of identified blocks (methods implementations for now) in this source
+  buffer contains the complete source of the file, mapped if it can be
+  index is a hash table of the blocks (methods implementations for now)
+  of this source, by oid, with slots entries of which count are used
+  php tells that the file follows the rules of PHP for its comments and
+  literals, rather than those of Java and C
+  info and seen are the stat data of the file and when it was read, for
+  the preservation index
 */
 struct _sourcecode
 {
-    sourceblocknode *blocks;
-    char *buffer;
+    const char *buffer;
+    size_t size;
+    int mapped;
+    int php;
+    sourceblock *index;
+    size_t slots;
+    size_t count;
+    struct stat info;
+    struct timespec seen;
 };
 typedef struct _sourcecode sourcecode;
 
 
 void source_preserve( batch *b, umlclass *class, const char *filename, sourcecode *source );
 
-//sourceblock *block_find( sourceblocknode list, const char *oid );
-sourceblock *sourceblock_find( sourceblocknode *list, const char *oid );
-
-sourceblocknode *source_parse( const char *sourcebuffer );
-
-sourceblock *sourceblock_new( char *spos, size_t len, char *oid, int type );
+char *source_implementation( umloperation *op );
 
-char *source_loadfromfile(const char *filename );
+void source_prescan( batch *b, const char *ext );
+void source_prescan_free( batch *b );
 
-int find_more_str( char *buf, char *tofind[], sourceblock pblocks[] );
+/* The preservation index of --preserve-index, see preserve.c */
+typedef struct d2c_preserve_entry d2c_preserve_entry;
 
-sourceblock *find_matching_char( const char *buf, char *oid, char openc, char closec, int maxcars );
+const d2c_preserve_entry *d2c_preserve_index_find( const char *filename );
+int d2c_preserve_index_block( const d2c_preserve_entry *e, const char *oid, size_t len,
+                              off_t *offset, size_t *blocklen );
+void d2c_preserve_index_add( const char *filename, const sourcecode *code );
 
 
 #endif
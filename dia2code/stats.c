@@ -0,0 +1,308 @@
+/***************************************************************************
+                          stats.c  -  The phase timings and counters of --stats
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --stats, dia2code measures the wall clock and CPU time of each
+ * phase of the run, and counts what it parsed and wrote.  The report is
+ * printed on the standard error once the files are written: a table,
+ * or with --stats=json a JSON object that always has the same keys in
+ * the same order.
+ *
+ * Some phases run on several threads at a time (the includes of the
+ * declarations and the file output with --jobs, the link stage of
+ * --pipeline): the times of a phase are those of its threads added up,
+ * so its wall time may exceed that of the run.  The CPU time is that of
+ * the thread (CLOCK_THREAD_CPUTIME_ID).  A generator is timed on the
+ * thread that runs it, which includes the declarations and the file
+ * output it does, and the CPU time of the tasks it hands to the workers
+ * of --jobs is added to its own, see d2c_stats_task().
+ *
+ * With --trace, the same hooks also record each phase and each run of
+ * a generator as a span, see trace.c.  Without --stats or --trace, they
+ * return at once.
+ */
+
+#include "dia2code.h"
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_GENERATORS 32
+
+int generate_stats = D2C_STATS_NONE;   /* Set by switch "--stats" */
+
+struct times {
+    long long wall;     /* nanoseconds */
+    long long cpu;
+};
+
+static const char *phase_names[D2C_PHASES] = {
+    "xml_load", "class_pass", "relationship_pass", "generalization_pass",
+    "package_resolution", "link", "declarations", "file_io"
+};
+
+static const char *phase_titles[D2C_PHASES] = {
+    "XML load", "class pass", "relationship pass", "generalization pass",
+    "package resolution", "link", "declarations and includes", "file I/O"
+};
+
+static const char *counter_names[D2C_COUNTERS] = {
+    "objects", "classes", "attributes", "operations", "edges",
+    "find_by_name", "files_written", "bytes_written"
+};
+
+static struct times phases[D2C_PHASES];
+
+/* the generators, by name, in the order they first ran */
+static struct {
+    char *name;
+    struct times t;
+} generators[MAX_GENERATORS];
+static int generator_count = 0;
+
+static long long counters[D2C_COUNTERS];
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The generator that the calling thread works for, -1 if none */
+static D2C_TASK_LOCAL int current_generator = -1;
+
+/* whether the hooks have anything to do */
+static int timing(void)
+{
+    return generate_stats != D2C_STATS_NONE || trace_file != NULL;
+}
+
+static long long elapsed(const struct timespec *from, const struct timespec *to)
+{
+    return (long long) (to->tv_sec - from->tv_sec) * 1000000000LL
+           + (to->tv_nsec - from->tv_nsec);
+}
+
+/* returns the times since start, and sets start to now */
+static struct times lap(d2c_clock *start)
+{
+    struct timespec wall, cpu;
+    struct times t;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    t.wall = elapsed(&start->wall, &wall);
+    t.cpu = elapsed(&start->cpu, &cpu);
+    start->wall = wall;
+    start->cpu = cpu;
+    return t;
+}
+
+/**
+ * Starts timing a phase on the calling thread.
+*/
+void d2c_stats_start (d2c_clock *start)
+{
+    if (!timing()) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start->wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start->cpu);
+}
+
+/**
+ * Adds the time since start to phase, and restarts start, so that the
+ * next phase of the same thread can follow with the same clock.
+*/
+void d2c_stats_stop (int phase, d2c_clock *start)
+{
+    d2c_stats_stop_at(phase, start, NULL, NULL);
+}
+
+/**
+ * d2c_stats_stop() of a phase about the class classname or the file
+ * path, either of which may be NULL, for the span of --trace.
+*/
+void d2c_stats_stop_at (int phase, d2c_clock *start, const char *classname,
+                        const char *path)
+{
+    d2c_clock from = *start;
+    struct times t;
+
+    if (!timing()) {
+        return;
+    }
+    t = lap(start);
+    d2c_trace_end(&from, phase_titles[phase], "phase", classname, path);
+    pthread_mutex_lock(&stats_lock);
+    phases[phase].wall += t.wall;
+    phases[phase].cpu += t.cpu;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * Adds n to counter.
+*/
+void d2c_stats_add (int counter, long long n)
+{
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Starts timing the generator name on the calling thread.  Returns the
+ * generator that the thread worked for, to be given back to
+ * d2c_stats_generator_stop().
+*/
+int d2c_stats_generator_start (const char *name, d2c_clock *start)
+{
+    int i, previous = current_generator;
+
+    if (!timing()) {
+        return previous;
+    }
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < generator_count && !eq(generators[i].name, name); i++) {
+    }
+    /* the names of the targets of --batch don't outlive their job */
+    if (i == generator_count && generator_count < MAX_GENERATORS
+            && (generators[i].name = strdup(name)) != NULL) {
+        generator_count++;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    current_generator = i < generator_count ? i : -1;
+    d2c_stats_start(start);
+    return previous;
+}
+
+void d2c_stats_generator_stop (int previous, d2c_clock *start)
+{
+    d2c_clock from = *start;
+    struct times t;
+
+    if (!timing()) {
+        return;
+    }
+    t = lap(start);
+    d2c_trace_end(&from, current_generator >= 0 ? generators[current_generator].name
+                                                : "generator", "generator", NULL, NULL);
+    if (current_generator >= 0) {
+        pthread_mutex_lock(&stats_lock);
+        generators[current_generator].t.wall += t.wall;
+        generators[current_generator].t.cpu += t.cpu;
+        pthread_mutex_unlock(&stats_lock);
+    }
+    current_generator = previous;
+}
+
+/**
+ * Called by a worker of --jobs once it ran a task, started at start:
+ * the CPU time of the task goes to the generator that handed it out.
+*/
+void d2c_stats_task (d2c_clock *start)
+{
+    struct times t;
+
+    if (!timing() || current_generator < 0) {
+        return;
+    }
+    t = lap(start);
+    pthread_mutex_lock(&stats_lock);
+    generators[current_generator].t.cpu += t.cpu;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * The generator of the calling thread, which the tasks inherit through
+ * d2c_genstate.
+*/
+int d2c_stats_generator ()
+{
+    return current_generator;
+}
+
+void d2c_stats_use_generator (int generator)
+{
+    current_generator = generator;
+}
+
+static int by_generator_name(const void *a, const void *b)
+{
+    return strcmp(generators[*(const int *) a].name, generators[*(const int *) b].name);
+}
+
+static double ms(long long ns)
+{
+    return ns / 1e6;
+}
+
+static void put_times_json(FILE *f, const char *name, const struct times *t, int last)
+{
+    fprintf(f, "    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}%s\n",
+            name, ms(t->wall), ms(t->cpu), last ? "" : ",");
+}
+
+/**
+ * Prints the report of --stats on the standard error.  The run started
+ * at start, on the calling thread; its CPU time is that of the process.
+*/
+void d2c_stats_report (d2c_clock *start)
+{
+    struct timespec zero = { 0, 0 }, now;
+    struct times total;
+    int order[MAX_GENERATORS];
+    char title[64];
+    int i;
+
+    if (generate_stats == D2C_STATS_NONE) {
+        return;
+    }
+    total = lap(start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    total.cpu = elapsed(&zero, &now);
+    for (i = 0; i < generator_count; i++) {
+        order[i] = i;
+    }
+    qsort(order, generator_count, sizeof(int), by_generator_name);
+
+    if (generate_stats == D2C_STATS_JSON) {
+        fprintf(stderr, "{\n  \"phases\": {\n");
+        for (i = 0; i < D2C_PHASES; i++) {
+            put_times_json(stderr, phase_names[i], &phases[i], i == D2C_PHASES - 1);
+        }
+        fprintf(stderr, "  },\n  \"generators\": {%s", generator_count > 0 ? "\n" : "");
+        for (i = 0; i < generator_count; i++) {
+            put_times_json(stderr, generators[order[i]].name, &generators[order[i]].t,
+                           i == generator_count - 1);
+        }
+        fprintf(stderr, "%s},\n  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f},\n",
+                generator_count > 0 ? "  " : "", ms(total.wall), ms(total.cpu));
+        fprintf(stderr, "  \"counters\": {\n");
+        for (i = 0; i < D2C_COUNTERS; i++) {
+            fprintf(stderr, "    \"%s\": %lld%s\n", counter_names[i], counters[i],
+                    i == D2C_COUNTERS - 1 ? "" : ",");
+        }
+        fprintf(stderr, "  }\n}\n");
+        return;
+    }
+    fprintf(stderr, "%-28s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    for (i = 0; i < D2C_PHASES; i++) {
+        fprintf(stderr, "%-28s %12.3f %12.3f\n", phase_titles[i],
+                ms(phases[i].wall), ms(phases[i].cpu));
+    }
+    for (i = 0; i < generator_count; i++) {
+        snprintf(title, sizeof(title), "generation (%s)", generators[order[i]].name);
+        fprintf(stderr, "%-28s %12.3f %12.3f\n", title,
+                ms(generators[order[i]].t.wall), ms(generators[order[i]].t.cpu));
+    }
+    fprintf(stderr, "%-28s %12.3f %12.3f\n", "total", ms(total.wall), ms(total.cpu));
+    for (i = 0; i < D2C_COUNTERS; i++) {
+        fprintf(stderr, "%-28s %12lld\n", counter_names[i], counters[i]);
+    }
+}
@@ -0,0 +1,472 @@
+/***************************************************************************
+                          tasks.c  -  Parallel generation tasks
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Generation tasks for --jobs.  The workers produce their files in
+ * memory (see d2c_outfile_collect()); the main thread writes the files
+ * of task 0, then those of task 1, and so on as the tasks complete.
+ * Output errors are thus found, and exit, in the main thread and in the
+ * same order as in a serial run.  The workers take the tasks in order
+ * from a shared cursor, at most a window of tasks ahead of the files
+ * written, so that the files waiting in memory stay bounded whatever
+ * the number of tasks.
+ *
+ * The jobs of --batch, which write their own files, are not ordered:
+ * every worker thread owns a deque of job numbers, initially a
+ * contiguous share of them.  It takes its own jobs from the front, in
+ * order, and once it runs out it steals from the back of the other
+ * deques, where the work that is needed last waits.  Jobs never create
+ * jobs, so a worker that finds all the deques empty is done.
+ *
+ * The targets of "-t cpp,sql,idl" are tasks too, each running on its
+ * own thread against the shared model; the tasks of a target then add
+ * their files to those of the target.  The jobs of --batch are tasks
+ * that write their own files as they complete (see d2c_run_jobs()).
+ *
+ * A task that fails, calling d2c_exit(), stops the others from
+ * starting; the files of the tasks before it are written, and then the
+ * thread that ran the tasks fails with the same exit status.
+ */
+
+#include "dia2code.h"
+#include "includes.h"
+#include <pthread.h>
+#include <unistd.h>
+
+int generate_jobs = 1;   /* Set by switch "--jobs" */
+
+/* the ordered tasks are handed out at most this many per worker ahead
+   of the files written */
+#define TASK_WINDOW 16
+
+struct taskqueue {
+    pthread_mutex_t lock;
+    int front;           /* next task of the owner */
+    int back;            /* one past the last task left */
+};
+typedef struct taskqueue taskqueue;
+
+struct taskrun {
+    batch *b;
+    d2c_task_fn fn;
+    d2c_genstate state;  /* set up by the generator, for the workers */
+    void **items;
+    void **files;        /* the files of each task, see d2c_outfile_collect() */
+    int ordered;         /* the tasks' files are written in task order */
+    char *done;
+    int *status;         /* exit status of each task, see d2c_catch() */
+    int stop;            /* the first failed task, count if none */
+    int window;          /* see TASK_WINDOW, 0 to use the queues */
+    int next;            /* next task to hand out, with a window */
+    int committed;       /* tasks whose files are written */
+    int count;
+    int workers;
+    taskqueue *queues;
+    pthread_mutex_t lock;        /* protects done */
+    pthread_cond_t finished;
+};
+typedef struct taskrun taskrun;
+
+struct worker {
+    taskrun *run;
+    int self;
+    pthread_t thread;
+};
+typedef struct worker worker;
+
+/* the state left by the previous task must not leak into the next one */
+static void run_task(batch *b, d2c_task_fn fn, void *item)
+{
+    d2c_reset_output_state();
+    includes = NULL;
+    fn(b, item);
+}
+
+struct taskcall {
+    batch *b;
+    d2c_task_fn fn;
+    void *item;
+};
+
+static void call_task(void *arg)
+{
+    struct taskcall *call = arg;
+
+    run_task(call->b, call->fn, call->item);
+}
+
+/* returns the next task for worker self, or -1 once all are taken */
+static int next_task(taskrun *run, int self)
+{
+    taskqueue *q = &run->queues[self];
+    int i, task = -1;
+
+    if (run->window > 0) {
+        pthread_mutex_lock(&run->lock);
+        while (run->next < run->count && run->next - run->committed >= run->window
+               && run->next < run->stop) {
+            pthread_cond_wait(&run->finished, &run->lock);
+        }
+        if (run->next < run->count) {
+            task = run->next++;
+        }
+        pthread_mutex_unlock(&run->lock);
+        return task;
+    }
+    pthread_mutex_lock(&q->lock);
+    if (q->front < q->back) {
+        task = q->front++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    for (i = 1; task < 0 && i < run->workers; i++) {
+        q = &run->queues[(self + i) % run->workers];
+        pthread_mutex_lock(&q->lock);
+        if (q->front < q->back) {
+            task = --q->back;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+    return task;
+}
+
+static void *worker_main(void *arg)
+{
+    worker *w = arg;
+    taskrun *run = w->run;
+    struct taskcall call;
+    d2c_clock clock;
+    int task, code;
+
+    call.b = run->b;
+    call.fn = run->fn;
+    while ((task = next_task(run, w->self)) >= 0) {
+        /* as set up by the generator, not by the previous task */
+        d2c_genstate_restore(&run->state);
+        if (run->ordered) {
+            d2c_outfile_collect(&run->files[task]);
+        }
+        call.item = run->items[task];
+        code = 0;
+        /* the tasks after a failed one are not run, as in a serial run */
+        if (task < __atomic_load_n(&run->stop, __ATOMIC_ACQUIRE)) {
+            d2c_stats_start(&clock);
+            code = d2c_catch(call_task, &call);
+            d2c_stats_task(&clock);
+        }
+        if (code != 0) {
+            int stop = __atomic_load_n(&run->stop, __ATOMIC_ACQUIRE);
+
+            d2c_outfile_discard();
+            while (task < stop
+                   && !__atomic_compare_exchange_n(&run->stop, &stop, task, 0,
+                                                   __ATOMIC_ACQ_REL,
+                                                   __ATOMIC_ACQUIRE)) {
+            }
+        }
+        d2c_outfile_collect(NULL);
+
+        pthread_mutex_lock(&run->lock);
+        run->status[task] = code;
+        run->done[task] = 1;
+        pthread_cond_broadcast(&run->finished);
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+/* spreads the tasks over up to jobs threads */
+static void run_tasks(batch *b, d2c_task_fn fn, void **items, int count, int jobs,
+                      int ordered)
+{
+    taskrun run;
+    worker *workers;
+    int i, started, failed = 0;
+
+    if (jobs <= 1 || count <= 1) {
+        for (i = 0; i < count; i++) {
+            run_task(b, fn, items[i]);
+        }
+        return;
+    }
+
+    run.b = b;
+    run.fn = fn;
+    d2c_genstate_save(&run.state);
+    run.items = items;
+    run.ordered = ordered;
+    run.count = count;
+    run.stop = count;
+    run.next = 0;
+    run.committed = 0;
+    run.workers = jobs < count ? jobs : count;
+    run.window = ordered ? TASK_WINDOW * run.workers : 0;
+    run.files = my_malloc(count * sizeof(void *));
+    run.done = my_malloc(count);
+    run.status = my_malloc(count * sizeof(int));
+    run.queues = my_malloc(run.workers * sizeof(taskqueue));
+    memset(run.files, 0, count * sizeof(void *));
+    memset(run.done, 0, count);
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.finished, NULL);
+    for (i = 0; i < run.workers; i++) {
+        pthread_mutex_init(&run.queues[i].lock, NULL);
+        run.queues[i].front = (int) ((long) count * i / run.workers);
+        run.queues[i].back = (int) ((long) count * (i + 1) / run.workers);
+    }
+
+    workers = my_malloc(run.workers * sizeof(worker));
+    for (started = 0; started < run.workers; started++) {
+        workers[started].run = &run;
+        workers[started].self = started;
+        if (pthread_create(&workers[started].thread, NULL, worker_main,
+                           &workers[started]) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        fprintf(stderr, "Can't start the generation threads\n");
+        d2c_exit(1);
+    }
+    /* the deques of the jobs of the workers that did not start are stolen */
+
+    for (i = 0; i < count && failed == 0; i++) {
+        pthread_mutex_lock(&run.lock);
+        while (!run.done[i]) {
+            pthread_cond_wait(&run.finished, &run.lock);
+        }
+        failed = run.status[i];
+        pthread_mutex_unlock(&run.lock);
+        if (failed == 0 && run.ordered) {
+            failed = d2c_catch(d2c_outfile_commit, run.files[i]);
+        }
+        pthread_mutex_lock(&run.lock);
+        run.committed = i + 1;
+        /* the workers are joined first, even if a file could not be written */
+        if (failed != 0) {
+            __atomic_store_n(&run.stop, 0, __ATOMIC_RELEASE);
+        }
+        pthread_cond_broadcast(&run.finished);
+        pthread_mutex_unlock(&run.lock);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (i = 0; i < run.workers; i++) {
+        pthread_mutex_destroy(&run.queues[i].lock);
+    }
+    pthread_cond_destroy(&run.finished);
+    pthread_mutex_destroy(&run.lock);
+    free(workers);
+    free(run.queues);
+    free(run.status);
+    free(run.done);
+    free(run.files);
+    if (failed != 0) {
+        d2c_exit(failed);
+    }
+}
+
+/**
+ * Runs fn(b, items[i]) for every i below count, each call producing its
+ * own files.  The tasks are spread over generate_jobs threads, or run
+ * one after the other when there is a single job.
+*/
+void d2c_run_tasks (batch *b, d2c_task_fn fn, void **items, int count)
+{
+    run_tasks(b, fn, items, count, generate_jobs, 1);
+}
+
+/* A class of the class list, with --pipeline, --incremental,
+   --output-cache or --trace */
+struct class_task {
+    int pos;
+    umlclasslist node;
+    d2c_task_fn fn;
+};
+
+/* Generates the class item once it is linked, recording its files in
+   the manifest, unless the cache has them, a task */
+static void generate_class_task(batch *b, void *item)
+{
+    struct class_task *c = item;
+    d2c_clock span;
+
+    if (b->pipeline != NULL) {
+        d2c_pipeline_wait(b->pipeline, c->pos);
+    }
+    d2c_trace_start(&span);
+    if (b->manifest != NULL) {
+        d2c_manifest_begin(b->manifest, c->node->key->name);
+    }
+    if (b->cache == NULL) {
+        c->fn(b, c->node);
+    } else if (!d2c_cache_restore(b->cache, c->node->key->name)) {
+        d2c_cache_begin(b->cache, c->node->key->name);
+        c->fn(b, c->node);
+        d2c_cache_end();
+    }
+    if (b->manifest != NULL) {
+        d2c_manifest_end();
+    }
+    d2c_trace_end(&span, "generate class", "class", c->node->key->name, NULL);
+}
+
+/**
+ * Runs fn(b, node) as a task for each class of b selected by -cl and -v,
+ * in the order of the diagram, and only for those of b->changed if b is
+ * incremental.  With --pipeline, each task waits for its own class to
+ * be linked, and with a manifest, the files of each class are recorded;
+ * with a cache, they are taken from it when it has them.
+*/
+void d2c_generate_classes (batch *b, d2c_task_fn fn)
+{
+    umlclasslist tmplist;
+    struct class_task *tasks = NULL;
+    void **items;
+    int count = 0, pos = 0;
+
+    for (tmplist = b->classlist; tmplist != NULL; tmplist = tmplist->next) {
+        count++;
+    }
+    items = my_malloc((count + 1) * sizeof(void *));
+    if (b->pipeline != NULL || b->manifest != NULL || b->cache != NULL
+            || trace_file != NULL) {
+        tasks = my_malloc((count + 1) * sizeof(struct class_task));
+    }
+    count = 0;
+    for (tmplist = b->classlist; tmplist != NULL; tmplist = tmplist->next, pos++) {
+        if (is_present(b->classes, tmplist->key->name) ^ b->mask) {
+            continue;
+        }
+        if (b->incremental && !is_present(b->changed, tmplist->key->name)) {
+            continue;
+        }
+        if (tasks != NULL) {
+            tasks[count].pos = pos;
+            tasks[count].node = tmplist;
+            tasks[count].fn = fn;
+            items[count] = &tasks[count];
+        } else {
+            items[count] = tmplist;
+        }
+        count++;
+    }
+    d2c_run_tasks(b, tasks != NULL ? generate_class_task : fn, items, count);
+    free(tasks);
+    free(items);
+}
+
+/* A declaration of decls, with --trace */
+struct decl_task {
+    declaration *d;
+    d2c_task_fn fn;
+};
+
+/* Generates the declaration item, a task */
+static void generate_decl_task(batch *b, void *item)
+{
+    struct decl_task *t = item;
+    d2c_clock span;
+
+    d2c_trace_start(&span);
+    t->fn(b, t->d);
+    d2c_trace_end(&span, "generate declaration", "declaration",
+                  t->d->decl_kind == dk_module ? t->d->u.this_module->pkg->name
+                                               : t->d->u.this_class->key->name, NULL);
+}
+
+/**
+ * Runs fn(b, d) as a task for each declaration d of decls, in order.
+*/
+void d2c_generate_decls (batch *b, d2c_task_fn fn)
+{
+    struct decl_task *tasks = NULL;
+    declaration *d;
+    void **items;
+    int count = 0;
+
+    for (d = decls; d != NULL; d = d->next) {
+        count++;
+    }
+    items = my_malloc((count + 1) * sizeof(void *));
+    if (trace_file != NULL) {
+        tasks = my_malloc((count + 1) * sizeof(struct decl_task));
+    }
+    count = 0;
+    for (d = decls; d != NULL; d = d->next) {
+        if (tasks != NULL) {
+            tasks[count].d = d;
+            tasks[count].fn = fn;
+            items[count] = &tasks[count];
+        } else {
+            items[count] = d;
+        }
+        count++;
+    }
+    d2c_run_tasks(b, tasks != NULL ? generate_decl_task : fn, items, count);
+    free(tasks);
+    free(items);
+}
+
+/* Generates the target item, a task */
+static void generate_target(batch *b, void *item)
+{
+    d2c_target *target = item;
+    d2c_clock clock;
+    int previous;
+
+    previous = d2c_stats_generator_start(target->name, &clock);
+    (*target->generator)(&target->b);
+    d2c_stats_generator_stop(previous, &clock);
+}
+
+/**
+ * Generates the targets at the same time, one thread each.  Their files
+ * are written in the order of the targets, and within a target in the
+ * order of a serial run.
+*/
+void d2c_generate_targets (d2c_target *targets, int count)
+{
+    void **items;
+    int i;
+
+    items = my_malloc((count + 1) * sizeof(void *));
+    for (i = 0; i < count; i++) {
+        items[i] = &targets[i];
+    }
+    run_tasks(NULL, generate_target, items, count, count, 1);
+    free(items);
+}
+
+/**
+ * Runs fn(NULL, items[i]) for every i below count on up to jobs threads.
+ * Unlike d2c_run_tasks(), the jobs write their own files, as they
+ * complete, and are expected to catch their own failures.
+*/
+void d2c_run_jobs (d2c_task_fn fn, void **items, int count, int jobs)
+{
+    run_tasks(NULL, fn, items, count, jobs, 0);
+}
+
+/**
+ * Number of jobs for "--jobs 0": one per online processor.
+*/
+int d2c_default_jobs ()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int) n : 1;
+}
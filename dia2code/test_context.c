@@ -0,0 +1,116 @@
+/***************************************************************************
+                          test_context.c  -  Checks of the library interface
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Runs the generations of a context one after the other, as a program
+ * using libdia2code would: the package directories a generation knew
+ * must not be taken as existing by the next one, whether the first one
+ * wrote into a memory sink or the directories were removed since.
+ * Run by "make check".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "libdia2code.h"
+
+/* a class in the package "org" */
+static const char diagram[] =
+"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+"<dia:diagram xmlns:dia=\"http://www.lysator.liu.se/~alla/dia/\">\n"
+"<dia:diagramdata/>\n"
+"<dia:layer name=\"Background\" visible=\"true\">\n"
+"<dia:object type=\"UML - LargePackage\" version=\"0\" id=\"O0\">\n"
+"<dia:attribute name=\"obj_pos\"><dia:point val=\"0,0\"/></dia:attribute>\n"
+"<dia:attribute name=\"elem_width\"><dia:real val=\"100\"/></dia:attribute>\n"
+"<dia:attribute name=\"elem_height\"><dia:real val=\"100\"/></dia:attribute>\n"
+"<dia:attribute name=\"name\"><dia:string>#org#</dia:string></dia:attribute>\n"
+"</dia:object>\n"
+"<dia:object type=\"UML - Class\" version=\"0\" id=\"O1\">\n"
+"<dia:attribute name=\"obj_pos\"><dia:point val=\"10,10\"/></dia:attribute>\n"
+"<dia:attribute name=\"elem_width\"><dia:real val=\"5\"/></dia:attribute>\n"
+"<dia:attribute name=\"elem_height\"><dia:real val=\"5\"/></dia:attribute>\n"
+"<dia:attribute name=\"name\"><dia:string>#Klass#</dia:string></dia:attribute>\n"
+"<dia:attribute name=\"stereotype\"><dia:string>##</dia:string></dia:attribute>\n"
+"<dia:attribute name=\"comment\"><dia:string>##</dia:string></dia:attribute>\n"
+"<dia:attribute name=\"abstract\"><dia:boolean val=\"false\"/></dia:attribute>\n"
+"<dia:attribute name=\"attributes\"/>\n"
+"<dia:attribute name=\"operations\"/>\n"
+"<dia:attribute name=\"templates\"/>\n"
+"</dia:object>\n"
+"</dia:layer>\n"
+"</dia:diagram>\n";
+
+static int failures = 0;
+
+static void check(int ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static int exists(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0;
+}
+
+int main ()
+{
+    char outdir[] = "/tmp/test_context.XXXXXX";
+    char dir[64], file[64];
+    d2c_context *ctx;
+    d2c_sink *sink;
+
+    if (mkdtemp(outdir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/org", outdir);
+    snprintf(file, sizeof(file), "%s/org/Klass.java", outdir);
+
+    ctx = d2c_context_new();
+    sink = d2c_sink_memory();
+    check(d2c_context_set(ctx, "file.outdir", outdir) == D2C_OK, "file.outdir");
+    check(d2c_context_set(ctx, "generate.buildtree", "yes") == D2C_OK, "generate.buildtree");
+    check(d2c_parse_buffer(ctx, diagram, sizeof(diagram) - 1) == D2C_OK, "d2c_parse_buffer");
+
+    /* the memory sink creates no directory... */
+    check(d2c_generate(ctx, "java", sink) == D2C_OK, "java into a memory sink");
+    check(d2c_sink_memory_files(sink) != NULL, "files in the memory sink");
+    check(!exists(dir), "no directory for the memory sink");
+
+    /* ...so writing to the disk next has to */
+    check(d2c_generate(ctx, "java", NULL) == D2C_OK, "java to the disk after a memory sink");
+    check(exists(file), "file written after a memory sink");
+
+    /* and again once the output is removed */
+    unlink(file);
+    rmdir(dir);
+    check(d2c_generate(ctx, "java", NULL) == D2C_OK, "java to the disk after a removal");
+    check(exists(file), "file written after a removal");
+
+    d2c_sink_free(sink);
+    d2c_context_free(ctx);
+    unlink(file);
+    rmdir(dir);
+    rmdir(outdir);
+    return failures == 0 ? 0 : 1;
+}
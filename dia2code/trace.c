@@ -0,0 +1,190 @@
+/***************************************************************************
+                          trace.c  -  The trace events of --trace
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --trace <file>, dia2code records a span for each phase of the
+ * parse (the same as --stats, see stats.c), each class parsed, each
+ * class and declaration generated, each existing file scanned for its
+ * preserved code and each file written, with the thread that ran it and
+ * the class or the file it was about.  Once the files are written, the
+ * spans are saved in the trace event format of Chrome, which
+ * chrome://tracing and Perfetto open: complete ("X") events, in
+ * microseconds since the start of the run, and the names of the
+ * threads.
+ *
+ * The threads are numbered in the order they record their first span,
+ * the one that parsed the diagram being 1.  The spans are kept in
+ * memory until the end, under a lock.
+ */
+
+#include "dia2code.h"
+#include <pthread.h>
+#include <unistd.h>
+
+char *trace_file = NULL;   /* Set by switch "--trace" */
+
+struct event {
+    const char *name;
+    const char *category;
+    long long start;        /* nanoseconds since origin */
+    long long duration;
+    int thread;
+    char *classname;
+    char *path;
+};
+
+static struct event *events = NULL;
+static size_t event_count = 0, event_slots = 0;
+static int thread_count = 0;
+static struct timespec origin;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The number of the calling thread, 0 until it records a span */
+static D2C_TASK_LOCAL int thread_number = 0;
+
+static long long since(const struct timespec *from, const struct timespec *to)
+{
+    return (long long) (to->tv_sec - from->tv_sec) * 1000000000LL
+           + (to->tv_nsec - from->tv_nsec);
+}
+
+/**
+ * Starts the trace of --trace: the spans are timed from now on.
+*/
+void d2c_trace_open ()
+{
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+}
+
+/**
+ * Starts a span on the calling thread.
+*/
+void d2c_trace_start (d2c_clock *start)
+{
+    if (trace_file == NULL) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start->wall);
+}
+
+/**
+ * Records the span of the calling thread that started at start (only
+ * its wall clock time is used) and ends now.  name and category must
+ * outlive the run; classname and path, either of which may be NULL,
+ * are copied.
+*/
+void d2c_trace_end (const d2c_clock *start, const char *name, const char *category,
+                    const char *classname, const char *path)
+{
+    struct timespec now;
+    struct event *e;
+    char *classcopy, *pathcopy;
+
+    if (trace_file == NULL) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    classcopy = my_strdup(classname);
+    pathcopy = my_strdup(path);
+    pthread_mutex_lock(&trace_lock);
+    if (thread_number == 0) {
+        thread_number = ++thread_count;
+    }
+    if (event_count == event_slots) {
+        event_slots = event_slots == 0 ? 1024 : 2 * event_slots;
+        events = realloc(events, event_slots * sizeof(struct event));
+        if (events == NULL) {
+            pthread_mutex_unlock(&trace_lock);
+            fprintf(stderr, "Out of memory\n");
+            d2c_exit(1);
+        }
+    }
+    e = &events[event_count++];
+    e->name = name;
+    e->category = category;
+    e->start = since(&origin, &start->wall);
+    e->duration = since(&start->wall, &now);
+    e->thread = thread_number;
+    e->classname = classcopy;
+    e->path = pathcopy;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* microseconds, as the trace event format counts them */
+static double us(long long ns)
+{
+    return ns / 1e3;
+}
+
+/**
+ * Writes the spans recorded to the file of --trace, and frees them.
+ * Returns 0, or 3 if the file can't be written.
+*/
+int d2c_trace_write ()
+{
+    struct event *e;
+    FILE *f;
+    int pid = (int) getpid();
+    int i, status = 0;
+    size_t n;
+
+    if (trace_file == NULL) {
+        return 0;
+    }
+    f = fopen(trace_file, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open file %s for writing\n", trace_file);
+        status = 3;
+    } else {
+        fprintf(f, "{\"traceEvents\": [");
+        for (i = 1; i <= thread_count; i++) {
+            fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                    "\"tid\": %d, \"args\": {\"name\": ", i > 1 ? "," : "", pid, i);
+            if (i == 1) {
+                fprintf(f, "\"main\"}}");
+            } else {
+                fprintf(f, "\"thread %d\"}}", i);
+            }
+        }
+        for (n = 0; n < event_count; n++) {
+            e = &events[n];
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {",
+                    e->name, e->category, us(e->start), us(e->duration), pid, e->thread);
+            if (e->classname != NULL) {
+                fprintf(f, "\"class\": ");
+                d2c_put_json(f, e->classname);
+            }
+            if (e->path != NULL) {
+                fprintf(f, e->classname != NULL ? ", \"path\": " : "\"path\": ");
+                d2c_put_json(f, e->path);
+            }
+            fprintf(f, "}}");
+        }
+        fprintf(f, "\n],\n\"displayTimeUnit\": \"ms\"}\n");
+        if (ferror(f) | (fclose(f) != 0)) {
+            fprintf(stderr, "Can't write file %s\n", trace_file);
+            status = 3;
+        }
+    }
+    for (n = 0; n < event_count; n++) {
+        free(events[n].classname);
+        free(events[n].path);
+    }
+    free(events);
+    events = NULL;
+    event_count = event_slots = 0;
+    return status;
+}
@@ -0,0 +1,390 @@
+/***************************************************************************
+                          uring_writer.c  -  Batched file output with io_uring
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Output backend for --io-uring: the generated files are collected in
+ * batches of URING_BATCH, and each batch costs two io_uring_enter()
+ * calls instead of an open(), write() and close() per file.  The first
+ * submission opens all the files of the batch, the second one writes
+ * and closes them (each close is linked to its write).
+ *
+ * The ring is set up with the raw system calls, so no liburing is
+ * needed.  When the kernel headers lack io_uring, or the kernel refuses
+ * it at runtime or lacks one of the operations (IORING_OP_OPENAT came
+ * with 5.6), d2c_uring_init() fails and the files are written with
+ * plain POSIX calls.  Should an operation still complete with -EINVAL,
+ * the files of that batch are finished with POSIX calls and the ring is
+ * given up.
+ */
+
+#include "dia2code.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define URING_BATCH 64
+
+struct uring {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+struct uring_file {
+    char *filename;
+    char *buf;
+    size_t len;
+    int fd;
+    int written;        /* result of the write */
+    int closed;         /* result of the close */
+};
+
+static struct uring ring;
+static int ring_ready = 0;
+static int ring_failed = 0;
+static struct uring_file batch_files[URING_BATCH];
+static int batch_count = 0;
+
+/* whether the kernel of the ring fd supports the operations of a batch */
+static int supports_batches(int fd)
+{
+#ifdef IO_URING_OP_SUPPORTED
+    static const int needed[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE };
+    struct io_uring_probe *probe;
+    int i, ok;
+
+    probe = calloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return 0;
+    }
+    /* kernels without the probe don't have IORING_OP_OPENAT either */
+    ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (i = 0; ok && i < (int) (sizeof(needed) / sizeof(needed[0])); i++) {
+        ok = needed[i] <= probe->last_op
+             && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Sets up the ring, once.  Returns -1 if io_uring can't be used, in
+ * which case the caller writes the files itself.
+*/
+int d2c_uring_init ()
+{
+    struct io_uring_params p;
+    size_t sq_size, cq_size;
+    char *sq, *cq;
+
+    if (ring_ready || ring_failed) {
+        return ring_ready ? 0 : -1;
+    }
+    ring_failed = 1;
+    memset(&p, 0, sizeof(p));
+    /* a batch needs two entries per file: the write and the close */
+    ring.fd = syscall(__NR_io_uring_setup, 2 * URING_BATCH, &p);
+    if (ring.fd < 0) {
+        return -1;
+    }
+    if (!supports_batches(ring.fd)) {
+        close(ring.fd);
+        return -1;
+    }
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    }
+    sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(ring.fd);
+        return -1;
+    }
+    cq = sq;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring.fd, IORING_OFF_CQ_RING);
+    }
+    ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring.fd, IORING_OFF_SQES);
+    if (cq == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        close(ring.fd);
+        return -1;
+    }
+    ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *) (sq + p.sq_off.array);
+    ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    ring_ready = 1;
+    ring_failed = 0;
+    return 0;
+}
+
+static struct io_uring_sqe *next_sqe(unsigned *tail)
+{
+    unsigned index = *tail & *ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    (*tail)++;
+    return sqe;
+}
+
+/*
+ * Publishes the entries queued up to tail and waits for as many
+ * completions, passing each one to done().  The kernel stops taking
+ * entries at one that fails to start (an unknown operation, say), so
+ * the rest are submitted again while waiting.  Returns -1 if the kernel
+ * rejects the submission.
+ */
+static int submit_and_wait(unsigned tail, unsigned count,
+                           void (*done)(__u64 user_data, int res))
+{
+    unsigned head, submitted = 0, seen = 0;
+    struct io_uring_cqe *cqe;
+    int rc;
+
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+    while (seen < count) {
+        head = *ring.cq_head;
+        if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            do {
+                rc = syscall(__NR_io_uring_enter, ring.fd, count - submitted, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+            } while (rc < 0 && errno == EINTR);
+            if (rc < 0) {
+                return -1;
+            }
+            submitted += rc;
+            continue;
+        }
+        cqe = &ring.cqes[head & *ring.cq_mask];
+        done(cqe->user_data, cqe->res);
+        __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+        seen++;
+    }
+    return 0;
+}
+
+static void opened(__u64 user_data, int res)
+{
+    batch_files[user_data].fd = res;
+}
+
+static void written(__u64 user_data, int res)
+{
+    if (user_data & 1) {
+        batch_files[user_data >> 1].closed = res;
+    } else {
+        batch_files[user_data >> 1].written = res;
+    }
+}
+
+/* writes what a short, failed or unsupported write left, without io_uring */
+static int finish_file(struct uring_file *file)
+{
+    size_t done = file->written > 0 ? file->written : 0;
+    ssize_t n;
+
+    if (file->written < 0) {
+        return -1;
+    }
+    while (done < file->len) {
+        n = pwrite(file->fd, file->buf + done, file->len - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * Writes the files collected by d2c_uring_write().  Returns 0, or -1
+ * after reporting the files that could not be written.
+*/
+int d2c_uring_flush ()
+{
+    unsigned tail;
+    int i, n = 0, rc = 0, unsupported = 0;
+
+    if (batch_count == 0) {
+        return 0;
+    }
+
+    tail = *ring.sq_tail;
+    for (i = 0; i < batch_count; i++) {
+        struct io_uring_sqe *sqe = next_sqe(&tail);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (__u64) (unsigned long) batch_files[i].filename;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len = 0666;
+        sqe->user_data = i;
+    }
+    if (submit_and_wait(tail, batch_count, opened) != 0) {
+        fprintf(stderr, "io_uring submission failed\n");
+        return -1;
+    }
+
+    tail = *ring.sq_tail;
+    for (i = 0; i < batch_count; i++) {
+        struct io_uring_sqe *sqe;
+        struct uring_file *file = &batch_files[i];
+
+        file->written = file->closed = -ECANCELED;
+        if (file->fd < 0) {
+            continue;
+        }
+        sqe = next_sqe(&tail);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = file->fd;
+        sqe->addr = (__u64) (unsigned long) file->buf;
+        sqe->len = file->len;
+        sqe->off = 0;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = (__u64) i << 1;
+        sqe = next_sqe(&tail);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = file->fd;
+        sqe->user_data = ((__u64) i << 1) | 1;
+        n += 2;
+    }
+    if (n > 0 && submit_and_wait(tail, n, written) != 0) {
+        fprintf(stderr, "io_uring submission failed\n");
+        return -1;
+    }
+
+    for (i = 0; i < batch_count; i++) {
+        struct uring_file *file = &batch_files[i];
+
+        /* an operation the kernel doesn't know after all */
+        if (file->fd == -EINVAL) {
+            unsupported = 1;
+            file->fd = open(file->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            file->written = 0;
+        } else if (file->written == -EINVAL || file->closed == -EINVAL) {
+            /* a failed close cancels its write too */
+            unsupported = 1;
+            if (file->written < 0) {
+                file->written = 0;
+            }
+            file->closed = -ECANCELED;
+        }
+        if (file->fd < 0) {
+            fprintf(stderr, "Can't open file %s for writing\n", file->filename);
+            rc = -1;
+        } else if (file->closed == -ECANCELED) {
+            /* the write was short or failed, so its close was skipped, or
+               the kernel lacked one of them */
+            int failed = finish_file(file) != 0;
+            if (close(file->fd) != 0 || failed) {
+                fprintf(stderr, "Can't write file %s\n", file->filename);
+                rc = -1;
+            }
+        } else if (file->written != (int) file->len || file->closed < 0) {
+            fprintf(stderr, "Can't write file %s\n", file->filename);
+            rc = -1;
+        }
+        free(file->filename);
+        free(file->buf);
+    }
+    batch_count = 0;
+    if (unsupported) {
+        close(ring.fd);
+        ring_ready = 0;
+        ring_failed = 1;
+    }
+    return rc;
+}
+
+/**
+ * Adds a file to the current batch, which is written once full.  The
+ * buffer is copied.  Returns -1 if writing a batch failed.
+*/
+int d2c_uring_write (const char *filename, const char *buf, size_t len)
+{
+    struct uring_file *file;
+    int i;
+
+    /* the files of a batch are written in any order */
+    for (i = 0; i < batch_count; i++) {
+        if (eq(batch_files[i].filename, filename)) {
+            if (d2c_uring_flush() != 0) {
+                return -1;
+            }
+            break;
+        }
+    }
+    file = &batch_files[batch_count++];
+    file->filename = strdup(filename);
+    file->buf = my_malloc(len + 1);
+    memcpy(file->buf, buf, len);
+    file->len = len;
+    if (file->filename == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        d2c_exit(1);
+    }
+    if (batch_count == URING_BATCH) {
+        return d2c_uring_flush();
+    }
+    return 0;
+}
+
+#else /* HAVE_IO_URING */
+
+int d2c_uring_init ()
+{
+    return -1;
+}
+
+int d2c_uring_write (const char *filename, const char *buf, size_t len)
+{
+    return -1;
+}
+
+int d2c_uring_flush ()
+{
+    return 0;
+}
+
+#endif /* HAVE_IO_URING */
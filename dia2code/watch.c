@@ -0,0 +1,164 @@
+/***************************************************************************
+                          watch.c  -  Waiting for the files of --watch to change
+                             -------------------
+    begin                : Mon Oct 19 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * With --watch, dia2code keeps running after the first generation and
+ * generates again each time the diagram, the license or the
+ * initialization file is saved.  The directories of the files are
+ * watched with inotify rather than the files themselves, since editors
+ * often save by renaming a new file over the old one.  Saving a file
+ * may take several writes, and Dia saves all its open diagrams at once,
+ * so the events are collected until none came for WATCH_DEBOUNCE
+ * milliseconds, and the generation then runs once for all of them.
+ */
+
+#include "dia2code.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_DEBOUNCE 200
+
+#ifdef __linux__
+
+struct watched_file {
+    int wd;
+    const char *name;        /* in the directory of wd */
+};
+
+/*
+ * Reads the pending events of fd, and adds to *changed the bit of each
+ * of the count files they concern.  Returns -1 on error.
+ */
+static int read_events(int fd, struct watched_file *files, int count, int *changed)
+{
+    union {
+        struct inotify_event aligned;
+        char buf[LARGE_BUFFER];
+    } events;
+    struct inotify_event *event;
+    ssize_t len;
+    char *p;
+    int i;
+
+    len = read(fd, events.buf, sizeof(events.buf));
+    if (len < 0) {
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    }
+    for (p = events.buf; p < events.buf + len;
+         p += sizeof(struct inotify_event) + event->len) {
+        event = (struct inotify_event *) p;
+        if (event->mask & IN_Q_OVERFLOW) {
+            /* events were lost, any file may have changed */
+            *changed |= (1 << count) - 1;
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            if (event->wd == files[i].wd && event->len > 0
+                    && eq(event->name, files[i].name)) {
+                *changed |= 1 << i;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs cycle(changed, saved) each time some of the count files change,
+ * changed having bit i set if files[i] did, and saved being the time of
+ * the first change (CLOCK_MONOTONIC).  The NULL files are not watched.
+ * Only returns, with an exit status, if the files can't be watched.
+*/
+int d2c_watch (char **files, int count, d2c_watch_fn cycle)
+{
+    struct watched_file *watched;
+    struct pollfd pfd;
+    struct timespec saved;
+    char *dir, *slash;
+    int fd, i, changed;
+
+    fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Can't watch the files: %s\n", strerror(errno));
+        return 1;
+    }
+    watched = my_malloc(count * sizeof(struct watched_file));
+    for (i = 0; i < count; i++) {
+        watched[i].wd = -1;
+        if (files[i] == NULL) {
+            continue;
+        }
+        slash = strrchr(files[i], '/');
+        if (slash == NULL) {
+            dir = strdup(".");
+            watched[i].name = files[i];
+        } else {
+            dir = my_strndup(files[i], slash == files[i] ? 1 : slash - files[i]);
+            watched[i].name = slash + 1;
+        }
+        watched[i].wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watched[i].wd < 0) {
+            fprintf(stderr, "Can't watch directory %s: %s\n", dir, strerror(errno));
+            free(dir);
+            free(watched);
+            close(fd);
+            return 2;
+        }
+        free(dir);
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        changed = 0;
+        /* until one of the files changes */
+        while (changed == 0) {
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                break;
+            }
+            if (read_events(fd, watched, count, &changed) != 0) {
+                break;
+            }
+        }
+        if (changed == 0) {
+            fprintf(stderr, "Can't watch the files: %s\n", strerror(errno));
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &saved);
+        /* and until they are left alone */
+        while (poll(&pfd, 1, WATCH_DEBOUNCE) > 0
+               && read_events(fd, watched, count, &changed) == 0) {
+        }
+        (*cycle)(changed, &saved);
+    }
+    free(watched);
+    close(fd);
+    return 1;
+}
+
+#else
+
+int d2c_watch (char **files, int count, d2c_watch_fn cycle)
+{
+    fprintf(stderr, "--watch is only supported on Linux\n");
+    return 2;
+}
+
+#endif